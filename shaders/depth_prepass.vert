@@ -0,0 +1,43 @@
+#version 450
+
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_buffer_reference : require
+
+#include "input_structures.glsl"
+
+// Depth-only prepass. Reads just the quantized positions, the first 8 bytes of every packed vertex
+struct PackedPosition {
+	uint positionXY;
+	uint positionZ;
+};
+
+layout(buffer_reference, std430) readonly buffer PositionBuffer {
+	PackedPosition positions[];
+};
+
+layout(buffer_reference, std430) readonly buffer InstanceBuffer {
+	mat4 matrices[];
+};
+
+// Same block as mesh.vert, vertexBuffer points at the position stream here
+layout(push_constant) uniform constants {
+	mat4 render_matrix;
+	vec4 positionOffset;
+	vec4 positionScale;
+	PositionBuffer positionBuffer;
+	uvec2 colorBuffer;
+	InstanceBuffer instanceBuffer;
+} PushConstants;
+
+// Must match mesh.vert exactly for the equal depth test that follows
+invariant gl_Position;
+
+void main() {
+	PackedPosition v = PushConstants.positionBuffer.positions[gl_VertexIndex];
+
+	vec3 quantized = vec3(unpackUnorm2x16(v.positionXY), unpackUnorm2x16(v.positionZ).x);
+	vec4 position = vec4(PushConstants.positionOffset.xyz + quantized * PushConstants.positionScale.xyz, 1.0f);
+
+	mat4 model = PushConstants.positionScale.w > 0.0 ? PushConstants.instanceBuffer.matrices[gl_InstanceIndex] : PushConstants.render_matrix;
+	gl_Position = sceneData.viewProj * model * position;
+}
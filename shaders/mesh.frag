@@ -7,14 +7,44 @@
 layout (location = 0) in vec3 inNormal;
 layout (location = 1) in vec3 inColor;
 layout (location = 2) in vec2 inUV;
+layout (location = 3) in vec3 inWorldPosition;
 
 layout (location = 0) out vec4 outFragColor;
 
+// Color textures are sampled through sRGB formats and vertex and factor colors are linear as glTF defines them,
+// so lighting happens in linear space. The draw image holds display encoded values like the background and
+// ImGui write them, and is copied to the UNORM swapchain as is, so the shaded result is encoded here.
+// Shading in linear space makes the sun falloff softer than it was before the textures were linearized
+vec3 linearToSrgb(vec3 c) {
+	return mix(c * 12.92, 1.055 * pow(c, vec3(1.0 / 2.4)) - 0.055, greaterThan(c, vec3(0.0031308)));
+}
+
 void main() {
-	float lightValue = max(dot(inNormal, sceneData.sunlightDirection.xyz), 0.1f);
+	vec3 normal = normalize(inNormal);
+	float lightValue = max(dot(normal, sceneData.sunlightDirection.xyz), 0.1f);
 	
 	vec3 color = inColor * texture(colorTex, inUV).xyz;
-	vec3 ambient = color * sceneData.ambientColor.xyz;
+
+	// The loader stores every metallic-roughness texture with roughness in R and metallic in G
+	vec2 metalRough = texture(metalRoughTex, inUV).rg;
+	float roughness = clamp(materialData.metalRoughFactors.y * metalRough.r, 0.1, 1.0);
+	float metallic = clamp(materialData.metalRoughFactors.x * metalRough.g, 0.0, 1.0);
+
+	// Metals have no diffuse term and reflect in their base color, everything else reflects 4% white
+	vec3 diffuse = color * (1.0 - metallic);
+	vec3 specularColor = mix(vec3(0.04), color, metallic);
+
+	// Normalized Blinn-Phong with the exponent matching the roughness of a GGX lobe
+	vec3 lightDirection = normalize(sceneData.sunlightDirection.xyz);
+	vec3 cameraPosition = -transpose(mat3(sceneData.view)) * sceneData.view[3].xyz;
+	vec3 halfVector = normalize(lightDirection + normalize(cameraPosition - inWorldPosition));
+	float alpha = roughness * roughness;
+	float exponent = 2.0 / (alpha * alpha) - 2.0;
+	float highlight = pow(max(dot(normal, halfVector), 0.0), exponent) * (exponent + 8.0) / 8.0;
+	vec3 specular = specularColor * highlight * max(dot(normal, lightDirection), 0.0);
+
+	vec3 ambient = (diffuse + specularColor) * sceneData.ambientColor.xyz;
+	vec3 lit = (diffuse * lightValue + specular) * sceneData.sunlightColor.w + ambient;
 	
-	outFragColor = vec4(color * lightValue * sceneData.sunlightColor.w + ambient, 1.0f);
+	outFragColor = vec4(linearToSrgb(max(lit, vec3(0.0f))), 1.0f);
 }
\ No newline at end of file
@@ -8,34 +8,64 @@
 layout (location = 0) out vec3 outNormal;
 layout (location = 1) out vec3 outColor;
 layout (location = 2) out vec2 outUV;
+layout (location = 3) out vec3 outWorldPosition;
 
-struct Vertex {
-	vec3 position;
-	float uv_x;
-	vec3 normal;
-	float uv_y;
-	vec4 color;
+// 16 bytes, see PackedVertex in vk_types.h
+struct PackedVertex {
+	uint positionXY; // unorm 16 bit x and y, relative to the surface bounds
+	uint positionZ;  // unorm 16 bit z in the low half
+	uint normal;     // octahedral, snorm 2x16
+	uint uv;         // half 2x16
 };
 
 layout(buffer_reference, std430) readonly buffer VertexBuffer {
-	Vertex vertices[];
+	PackedVertex vertices[];
+};
+
+layout(buffer_reference, std430) readonly buffer ColorBuffer {
+	uint colors[];
+};
+
+layout(buffer_reference, std430) readonly buffer InstanceBuffer {
+	mat4 matrices[];
 };
 
 // Push constants block
 layout(push_constant) uniform constants {
 	mat4 render_matrix;
+	vec4 positionOffset; // w is 1 when the color stream is bound
+	vec4 positionScale;  // w is 1 for instanced draws, which read their matrix from instanceBuffer
 	VertexBuffer vertexBuffer;
+	ColorBuffer colorBuffer;
+	InstanceBuffer instanceBuffer;
 } PushConstants;
 
+// Must match depth_prepass.vert exactly for the equal depth test after the prepass
+invariant gl_Position;
+
+vec3 decode_octahedral(vec2 e) {
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.x += n.x >= 0.0 ? -t : t;
+	n.y += n.y >= 0.0 ? -t : t;
+	return normalize(n);
+}
+
 void main() {
-	Vertex v = PushConstants.vertexBuffer.vertices[gl_VertexIndex];
-	
-	vec4 position = vec4(v.position, 1.0f);
+	PackedVertex v = PushConstants.vertexBuffer.vertices[gl_VertexIndex];
+
+	vec3 quantized = vec3(unpackUnorm2x16(v.positionXY), unpackUnorm2x16(v.positionZ).x);
+	vec4 position = vec4(PushConstants.positionOffset.xyz + quantized * PushConstants.positionScale.xyz, 1.0f);
 	
-	gl_Position = sceneData.viewProj * PushConstants.render_matrix * position;
+	mat4 model = PushConstants.positionScale.w > 0.0 ? PushConstants.instanceBuffer.matrices[gl_InstanceIndex] : PushConstants.render_matrix;
+	vec4 worldPosition = model * position;
+	gl_Position = sceneData.viewProj * worldPosition;
+
+	vec3 normal = decode_octahedral(unpackSnorm2x16(v.normal));
+	vec4 color = PushConstants.positionOffset.w > 0.0 ? unpackUnorm4x8(PushConstants.colorBuffer.colors[gl_VertexIndex]) : vec4(1.0);
 	
-	outNormal = (PushConstants.render_matrix * vec4(v.normal, 0.f)).xyz;
-	outColor = v.color.xyz * materialData.colorFactors.xyz;
-	outUV.x = v.uv_x;
-	outUV.y = v.uv_y;
-}
\ No newline at end of file
+	outNormal = (model * vec4(normal, 0.f)).xyz;
+	outColor = color.xyz * materialData.colorFactors.xyz;
+	outUV = unpackHalf2x16(v.uv);
+	outWorldPosition = worldPosition.xyz;
+}
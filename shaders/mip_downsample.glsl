@@ -0,0 +1,156 @@
+// Body of the mip_downsample*.comp variants, which define MIP_FORMAT as the storage format of the image.
+
+// Single pass mip generation, after the FidelityFX single pass downsampler. Every workgroup box filters a
+// 64x64 tile of the base level down to one texel of level 6 in shared memory. The last workgroup to finish
+// then filters level 6 down to level 12 the same way, so up to 12 levels take one dispatch.
+// Sizes halve rounding down and the last texel of an odd side reads the remaining row or column twice,
+// every level is rounded to 8 bits before the next is built from it. sRGB images are written through UNORM
+// views and filtered in linear space. Matches the loader's CPU chain up to rounding.
+
+layout(local_size_x = 256) in;
+
+layout(MIP_FORMAT, set = 0, binding = 0) uniform readonly image2D baseLevel;
+// Level 6 is read back by the last workgroup, so it has its own coherent binding
+layout(MIP_FORMAT, set = 0, binding = 1) uniform coherent image2D level6;
+// Levels 1 to 12, element 5 is level 6 and never written through here
+layout(MIP_FORMAT, set = 0, binding = 2) uniform writeonly image2D levels[12];
+
+layout(std430, set = 0, binding = 3) buffer CounterBuffer {
+	uint finishedWorkgroups[];
+};
+
+layout(push_constant) uniform constants {
+	ivec2 baseSize;
+	uint levelCount; // Below the base level, at most 12
+	uint counterIndex;
+	uint srgb;
+} PushConstants;
+
+// One 32x32 level of the tile, packed like the image
+shared uint tile[32][32];
+shared uint isLastWorkgroup;
+
+ivec2 levelSize(int level) {
+	return max(PushConstants.baseSize >> level, ivec2(1));
+}
+
+// Indexed with constants only, dynamic indexing of storage image arrays is an optional feature
+void storeLevel(int level, ivec2 coord, vec4 value) {
+	if (level > int(PushConstants.levelCount) || any(greaterThanEqual(coord, levelSize(level)))) {
+		return;
+	}
+
+	switch (level) {
+	case 1: imageStore(levels[0], coord, value); break;
+	case 2: imageStore(levels[1], coord, value); break;
+	case 3: imageStore(levels[2], coord, value); break;
+	case 4: imageStore(levels[3], coord, value); break;
+	case 5: imageStore(levels[4], coord, value); break;
+	case 6: imageStore(level6, coord, value); break;
+	case 7: imageStore(levels[6], coord, value); break;
+	case 8: imageStore(levels[7], coord, value); break;
+	case 9: imageStore(levels[8], coord, value); break;
+	case 10: imageStore(levels[9], coord, value); break;
+	case 11: imageStore(levels[10], coord, value); break;
+	case 12: imageStore(levels[11], coord, value); break;
+	}
+}
+
+vec3 srgbToLinear(vec3 c) {
+	return mix(c / 12.92, pow((c + 0.055) / 1.055, vec3(2.4)), greaterThan(c, vec3(0.04045)));
+}
+
+vec3 linearToSrgb(vec3 c) {
+	return mix(c * 12.92, 1.055 * pow(c, vec3(1.0 / 2.4)) - 0.055, greaterThan(c, vec3(0.0031308)));
+}
+
+// Alpha is always linear
+vec4 average(vec4 a, vec4 b, vec4 c, vec4 d) {
+	if (PushConstants.srgb == 0) {
+		return (a + b + c + d) * 0.25;
+	}
+
+	vec3 color = (srgbToLinear(a.rgb) + srgbToLinear(b.rgb) + srgbToLinear(c.rgb) + srgbToLinear(d.rgb)) * 0.25;
+	return vec4(linearToSrgb(color), (a.a + b.a + c.a + d.a) * 0.25);
+}
+
+vec4 loadSource(int level, ivec2 coord) {
+	return (level == 0) ? imageLoad(baseLevel, coord) : imageLoad(level6, coord);
+}
+
+// Builds the six levels below srcLevel (0 or 6) for the 32x32 texels of the first one starting at origin
+void downsampleTile(int srcLevel, ivec2 origin) {
+	uint index = gl_LocalInvocationIndex;
+
+	// First level straight from the image, four texels per invocation
+	ivec2 srcSize = levelSize(srcLevel);
+	for (uint i = 0; i < 4; i++) {
+		ivec2 local = ivec2((index + i * 256) % 32, (index + i * 256) / 32);
+		ivec2 coord = origin + local;
+
+		ivec2 a = min(coord * 2, srcSize - 1);
+		ivec2 b = min(coord * 2 + 1, srcSize - 1);
+		vec4 value = average(loadSource(srcLevel, a), loadSource(srcLevel, ivec2(b.x, a.y)),
+			loadSource(srcLevel, ivec2(a.x, b.y)), loadSource(srcLevel, b));
+
+		tile[local.y][local.x] = packUnorm4x8(value);
+		storeLevel(srcLevel + 1, coord, unpackUnorm4x8(tile[local.y][local.x]));
+	}
+	barrier();
+
+	// The rest from shared memory, each level in the top left corner of the one before
+	for (int step = 1; step < 6; step++) {
+		int level = srcLevel + 1 + step;
+		int side = 32 >> step;
+		ivec2 local = ivec2(index % side, index / side);
+		ivec2 coord = (origin >> step) + local;
+
+		// Only texels inside the level are built. A tile past the end of a small level has none, and reading
+		// its clamped sources would index before the start of the tile
+		bool active = index < uint(side * side) && all(lessThan(coord, levelSize(level)));
+
+		uint packed = 0;
+		if (active) {
+			// The origin is a multiple of 32, so the sources start at srcOrigin and clamping to the last texel of
+			// an odd level only pulls them back towards it, always onto texels the previous step wrote
+			ivec2 srcOrigin = origin >> (step - 1);
+			ivec2 srcMax = levelSize(level - 1) - 1;
+			ivec2 a = min(coord * 2, srcMax) - srcOrigin;
+			ivec2 b = min(coord * 2 + 1, srcMax) - srcOrigin;
+			vec4 value = average(unpackUnorm4x8(tile[a.y][a.x]), unpackUnorm4x8(tile[a.y][b.x]),
+				unpackUnorm4x8(tile[b.y][a.x]), unpackUnorm4x8(tile[b.y][b.x]));
+			packed = packUnorm4x8(value);
+		}
+		barrier();
+
+		if (active) {
+			tile[local.y][local.x] = packed;
+			storeLevel(level, coord, unpackUnorm4x8(packed));
+		}
+		barrier();
+	}
+}
+
+void main() {
+	downsampleTile(0, ivec2(gl_WorkGroupID.xy) * 32);
+
+	if (PushConstants.levelCount <= 6) {
+		return;
+	}
+
+	// Level 6 was written by the first invocation, it counts the workgroup as done once that is visible
+	if (gl_LocalInvocationIndex == 0) {
+		memoryBarrierImage();
+		uint finished = atomicAdd(finishedWorkgroups[PushConstants.counterIndex], 1);
+		isLastWorkgroup = (finished == gl_NumWorkGroups.x * gl_NumWorkGroups.y - 1) ? 1u : 0u;
+	}
+	barrier();
+
+	if (isLastWorkgroup == 0) {
+		return;
+	}
+
+	// Level 6 is at most 64x64 as the base is at most 4096, one tile covers it
+	memoryBarrierImage();
+	downsampleTile(6, ivec2(0));
+}
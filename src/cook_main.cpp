@@ -0,0 +1,12 @@
+// vksr_cook: imports a glTF file once, offline, and writes it as a package loadPackage maps at runtime
+#include "vk_loader.h"
+
+int main(int argc, char* argv[])
+{
+    if (argc != 3) {
+        fmt::println("Usage: vksr_cook <input.gltf|input.glb> <output.vkpak>");
+        return 1;
+    }
+
+    return cookGltf(argv[1], argv[2]) ? 0 : 1;
+}
@@ -0,0 +1,93 @@
+#include "draw_sort.h"
+
+#include <algorithm>
+#include <array>
+
+uint32_t drawsort::quantize_depth(float distance) {
+	constexpr uint32_t DEPTH_MAX = (1u << 24) - 1;
+
+	float t = std::clamp(distance / MAX_DISTANCE, 0.f, 1.f);
+	return (uint32_t)(t * DEPTH_MAX);
+}
+
+uint64_t drawsort::opaque_key(uint32_t pipeline, uint32_t material, uint32_t geometry, float distance) {
+	return ((uint64_t)Pass::Opaque << 62)
+		| ((uint64_t)(pipeline & 0x3f) << 56)
+		| ((uint64_t)(material & 0xffff) << 40)
+		| ((uint64_t)(geometry & 0xffff) << 24)
+		| quantize_depth(distance);
+}
+
+uint64_t drawsort::transparent_key(uint32_t pipeline, uint32_t material, uint32_t geometry, float distance) {
+	constexpr uint32_t DEPTH_MAX = (1u << 24) - 1;
+
+	return ((uint64_t)Pass::Transparent << 62)
+		| ((uint64_t)(DEPTH_MAX - quantize_depth(distance)) << 38)
+		| ((uint64_t)(pipeline & 0x3f) << 32)
+		| ((uint64_t)(material & 0xffff) << 16)
+		| (geometry & 0xffff);
+}
+
+uint32_t drawsort::IdAllocator::acquire() {
+	if (freeIds.empty()) {
+		return next++;
+	}
+
+	uint32_t id = freeIds.back();
+	freeIds.pop_back();
+	return id;
+}
+
+void drawsort::IdAllocator::release(uint32_t id) {
+	freeIds.push_back(id);
+}
+
+void drawsort::sort(std::vector<DrawSortEntry>& entries, std::vector<DrawSortEntry>& scratch) {
+	const size_t count = entries.size();
+
+	bool sorted = true;
+	for (size_t i = 1; i < count && sorted; i++) {
+		sorted = entries[i - 1].key <= entries[i].key;
+	}
+	if (sorted) {
+		return;
+	}
+
+	// One histogram per digit, all built in a single pass
+	std::array<std::array<uint32_t, 256>, 8> histograms = {};
+	for (const DrawSortEntry& e : entries) {
+		for (int d = 0; d < 8; d++) {
+			histograms[d][(e.key >> (d * 8)) & 0xff]++;
+		}
+	}
+
+	scratch.resize(count);
+	std::vector<DrawSortEntry>* src = &entries;
+	std::vector<DrawSortEntry>* dst = &scratch;
+
+	for (int d = 0; d < 8; d++) {
+		std::array<uint32_t, 256>& histogram = histograms[d];
+
+		// Every key has the same digit, this pass would not move anything
+		if (histogram[((*src)[0].key >> (d * 8)) & 0xff] == count) {
+			continue;
+		}
+
+		uint32_t offset = 0;
+		for (uint32_t& bucket : histogram) {
+			uint32_t bucketCount = bucket;
+			bucket = offset;
+			offset += bucketCount;
+		}
+
+		for (const DrawSortEntry& e : *src) {
+			(*dst)[histogram[(e.key >> (d * 8)) & 0xff]++] = e;
+		}
+
+		std::swap(src, dst);
+	}
+
+	if (src != &entries) {
+		entries.swap(scratch);
+	}
+}
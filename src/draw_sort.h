@@ -0,0 +1,48 @@
+#pragma once
+// draw_sort.h
+
+// Packed 64-bit draw sort keys and the radix sort that orders them. No Vulkan dependency.
+//
+// Opaque key:      | pass 2 | pipeline 6 | material 16 | geometry 16 | depth 24 |
+// Transparent key: | pass 2 | inverted depth 24 | pipeline 6 | material 16 | geometry 16 |
+// Opaque draws group by state and go front-to-back inside a bucket. Transparent draws go strictly
+// back-to-front, state only breaks ties.
+
+#include <vector>
+#include <cstdint>
+
+struct DrawSortEntry {
+	uint64_t key;
+	uint32_t index; // Into the draw list the keys were built from
+};
+
+namespace drawsort {
+	enum class Pass : uint32_t {
+		Opaque = 0,
+		Transparent = 1
+	};
+
+	// Distances past this all land in the last depth bucket, matches the far plane
+	constexpr float MAX_DISTANCE = 10000.f;
+
+	uint32_t quantize_depth(float distance);
+
+	uint64_t opaque_key(uint32_t pipeline, uint32_t material, uint32_t geometry, float distance);
+	uint64_t transparent_key(uint32_t pipeline, uint32_t material, uint32_t geometry, float distance);
+
+	// Hands out the material and geometry ids the keys hold. Released ids are handed out again first, so the
+	// ids fit their 16 bits as long as fewer than 65536 are alive at once
+	struct IdAllocator {
+		uint32_t acquire();
+		void release(uint32_t id);
+
+	private:
+		uint32_t next{ 0 };
+		std::vector<uint32_t> freeIds;
+	};
+
+	// LSD radix sort over 8-bit digits. Digits that are equal for every key are skipped, and input that is
+	// already sorted (an unchanged scene reusing last frame's order) returns after one linear check.
+	// scratch is resized as needed and can be kept around between calls.
+	void sort(std::vector<DrawSortEntry>& entries, std::vector<DrawSortEntry>& scratch);
+}
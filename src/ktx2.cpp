@@ -0,0 +1,105 @@
+#include "ktx2.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+namespace {
+	constexpr uint8_t IDENTIFIER[12] = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A };
+
+	// Identifier, 9 header words and the index up to the level array
+	constexpr size_t LEVEL_INDEX_OFFSET = 80;
+	constexpr size_t LEVEL_INDEX_ENTRY_SIZE = 24;
+
+	template<typename T>
+	T read(std::span<const std::byte> bytes, size_t offset) {
+		T value;
+		memcpy(&value, bytes.data() + offset, sizeof(T));
+		return value;
+	}
+
+	template<typename T>
+	void write(std::span<std::byte> bytes, size_t offset, T value) {
+		memcpy(bytes.data() + offset, &value, sizeof(T));
+	}
+}
+
+namespace ktx2 {
+	bool is_ktx2(std::span<const std::byte> bytes) {
+		return bytes.size() >= sizeof(IDENTIFIER) && memcmp(bytes.data(), IDENTIFIER, sizeof(IDENTIFIER)) == 0;
+	}
+
+	bool read_header(std::span<const std::byte> bytes, Header& header) {
+		if (!is_ktx2(bytes) || bytes.size() < LEVEL_INDEX_OFFSET) {
+			return false;
+		}
+
+		header.vkFormat = read<uint32_t>(bytes, 12);
+		header.width = read<uint32_t>(bytes, 20);
+		header.height = read<uint32_t>(bytes, 24);
+		const uint32_t depth = read<uint32_t>(bytes, 28);
+		const uint32_t layerCount = read<uint32_t>(bytes, 32);
+		const uint32_t faceCount = read<uint32_t>(bytes, 36);
+		const uint32_t levelCount = read<uint32_t>(bytes, 40);
+		header.supercompression = read<uint32_t>(bytes, 44);
+
+		if (header.width == 0 || header.height == 0 || depth > 1 || layerCount > 1 || faceCount != 1) {
+			return false;
+		}
+
+		// A level count of 0 asks the loader to generate the mips, only the base level is stored then
+		const size_t storedLevels = levelCount == 0 ? 1 : levelCount;
+		const size_t maxLevels = 32 - std::countl_zero(std::max(header.width, header.height));
+		header.generateMips = levelCount == 0;
+		if (storedLevels > maxLevels || bytes.size() < LEVEL_INDEX_OFFSET + storedLevels * LEVEL_INDEX_ENTRY_SIZE) {
+			return false;
+		}
+
+		header.levels.resize(storedLevels);
+		for (size_t i = 0; i < storedLevels; i++) {
+			const size_t entry = LEVEL_INDEX_OFFSET + i * LEVEL_INDEX_ENTRY_SIZE;
+			const uint64_t offset = read<uint64_t>(bytes, entry);
+			const uint64_t size = read<uint64_t>(bytes, entry + 8);
+			if (offset > bytes.size() || size > bytes.size() - offset) {
+				return false;
+			}
+			header.levels[i] = Level{ (size_t)offset, (size_t)size };
+		}
+		return true;
+	}
+
+	std::vector<std::byte> create(uint32_t vkFormat, uint32_t width, uint32_t height, std::span<const size_t> levelSizes, Header& header) {
+		header.vkFormat = vkFormat;
+		header.width = width;
+		header.height = height;
+		header.supercompression = NONE;
+		header.levels.clear();
+		header.generateMips = false;
+
+		// Levels start 16 byte aligned, which covers the copy alignment of every block format
+		size_t size = (LEVEL_INDEX_OFFSET + levelSizes.size() * LEVEL_INDEX_ENTRY_SIZE + 15) & ~size_t(15);
+		for (size_t levelSize : levelSizes) {
+			header.levels.push_back(Level{ size, levelSize });
+			size += (levelSize + 15) & ~size_t(15);
+		}
+
+		std::vector<std::byte> file(size);
+		std::span<std::byte> bytes = file;
+
+		memcpy(file.data(), IDENTIFIER, sizeof(IDENTIFIER));
+		write<uint32_t>(bytes, 12, vkFormat);
+		write<uint32_t>(bytes, 16, 1); // typeSize
+		write<uint32_t>(bytes, 20, width);
+		write<uint32_t>(bytes, 24, height);
+		write<uint32_t>(bytes, 36, 1); // faceCount
+		write<uint32_t>(bytes, 40, (uint32_t)levelSizes.size());
+
+		for (size_t i = 0; i < header.levels.size(); i++) {
+			const size_t entry = LEVEL_INDEX_OFFSET + i * LEVEL_INDEX_ENTRY_SIZE;
+			write<uint64_t>(bytes, entry, header.levels[i].offset);
+			write<uint64_t>(bytes, entry + 8, header.levels[i].size);
+			write<uint64_t>(bytes, entry + 16, header.levels[i].size);
+		}
+		return file;
+	}
+}
@@ -0,0 +1,46 @@
+#pragma once
+// ktx2.h
+
+// Reader for KTX2 texture containers. Only parses the header and the level index and has no Vulkan
+// dependency, the format is the raw VkFormat value stored in the file.
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace ktx2 {
+	enum Supercompression : uint32_t {
+		NONE = 0,
+		BASIS_LZ = 1,
+		ZSTANDARD = 2,
+		ZLIB = 3,
+	};
+
+	struct Level {
+		size_t offset; // From the start of the file
+		size_t size;
+	};
+
+	struct Header {
+		uint32_t vkFormat{ 0 }; // 0 (undefined) for Basis Universal payloads
+		uint32_t width{ 0 };
+		uint32_t height{ 0 };
+		uint32_t supercompression{ NONE };
+		std::vector<Level> levels; // Largest first, always at least one
+		bool generateMips{ false }; // The file has a level count of 0, only the base level is stored
+	};
+
+	// Checks the 12 byte file identifier
+	bool is_ktx2(std::span<const std::byte> bytes);
+
+	// False when bytes is not a KTX2 file or not a plain 2D texture (array layers, cube faces and depth are
+	// rejected), when it has more levels than halving its size allows or when a level lies outside of bytes.
+	// The level sizes depend on the format and are left to the caller
+	bool read_header(std::span<const std::byte> bytes, Header& header);
+
+	// Lays out a 2D file with levels of the given sizes, largest first, and returns it with the level data
+	// zeroed for the caller to fill in at header.levels. No data format descriptor is written, so the files
+	// are for read_header and not for other KTX tools
+	std::vector<std::byte> create(uint32_t vkFormat, uint32_t width, uint32_t height, std::span<const size_t> levelSizes, Header& header);
+}
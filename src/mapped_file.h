@@ -0,0 +1,31 @@
+#pragma once
+// mapped_file.h
+
+// Read-only memory mapping of a whole file. No Vulkan dependency.
+// The pages come straight from the OS file cache, so reading them copies nothing into the process
+// and another process mapping the same file shares them.
+
+#include <cstddef>
+#include <filesystem>
+#include <span>
+
+class MappedFile {
+public:
+	MappedFile() = default;
+	~MappedFile();
+
+	MappedFile(MappedFile&& other) noexcept;
+	MappedFile& operator=(MappedFile&& other) noexcept;
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	// False when the file can not be opened or mapped. An empty file maps to no bytes
+	bool open(const std::filesystem::path& path);
+	void close();
+
+	std::span<const std::byte> bytes() const { return { _data, _size }; }
+
+private:
+	const std::byte* _data{ nullptr };
+	size_t _size{ 0 };
+};
@@ -0,0 +1,714 @@
+#include "mesh_utils.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <queue>
+#include <unordered_map>
+
+#include <glm/geometric.hpp>
+
+namespace {
+	//> position_welding
+	// Vertices split on normal or UV seams share a position. Simplification works on these welded positions
+	struct PositionKey {
+		uint32_t bits[3];
+
+		bool operator==(const PositionKey& other) const {
+			return bits[0] == other.bits[0] && bits[1] == other.bits[1] && bits[2] == other.bits[2];
+		}
+	};
+
+	struct PositionKeyHash {
+		size_t operator()(const PositionKey& key) const {
+			size_t h = key.bits[0];
+			h = h * 73856093u ^ key.bits[1];
+			h = h * 19349663u ^ key.bits[2];
+			return h;
+		}
+	};
+
+	PositionKey make_position_key(const glm::vec3& p) {
+		PositionKey key;
+		memcpy(key.bits, &p, sizeof(key.bits));
+		return key;
+	}
+	//< position_welding
+
+	//> quadric
+	// Symmetric 4x4 error quadric of a set of planes, stored as its upper triangle
+	struct Quadric {
+		double a[10] = {};
+
+		void add_plane(const glm::vec3& n, float d) {
+			a[0] += n.x * n.x; a[1] += n.x * n.y; a[2] += n.x * n.z; a[3] += n.x * d;
+			a[4] += n.y * n.y; a[5] += n.y * n.z; a[6] += n.y * d;
+			a[7] += n.z * n.z; a[8] += n.z * d;
+			a[9] += (double)d * d;
+		}
+
+		void add(const Quadric& other) {
+			for (int i = 0; i < 10; i++) {
+				a[i] += other.a[i];
+			}
+		}
+
+		// Sum of squared distances from p to the planes
+		double error(const glm::vec3& p) const {
+			double x = p.x, y = p.y, z = p.z;
+			return a[0] * x * x + 2 * a[1] * x * y + 2 * a[2] * x * z + 2 * a[3] * x
+				+ a[4] * y * y + 2 * a[5] * y * z + 2 * a[6] * y
+				+ a[7] * z * z + 2 * a[8] * z
+				+ a[9];
+		}
+	};
+	//< quadric
+
+	struct Collapse {
+		double cost;
+		uint32_t from;
+		uint32_t to;
+		uint32_t fromVersion;
+		uint32_t toVersion;
+
+		bool operator>(const Collapse& other) const { return cost > other.cost; }
+	};
+}
+
+//> simplify
+std::vector<uint32_t> meshutil::simplify(std::span<const uint32_t> indices, std::span<const glm::vec3> positions, size_t targetIndexCount, float maxError, float* resultError) {
+	constexpr uint32_t INVALID = ~0u;
+
+	const size_t triCount = indices.size() / 3;
+	std::vector<uint32_t> tris(indices.begin(), indices.begin() + triCount * 3);
+	std::vector<bool> triAlive(triCount, true);
+
+	// Weld vertices by position. Welded vertices that came from more than one original are seams
+	std::unordered_map<PositionKey, uint32_t, PositionKeyHash> positionMap;
+	std::vector<uint32_t> remap(positions.size(), INVALID);
+	std::vector<glm::vec3> weldedPos;
+	std::vector<uint32_t> weldedOriginal;
+	std::vector<uint32_t> originalCount;
+
+	for (uint32_t index : tris) {
+		if (remap[index] != INVALID) {
+			continue;
+		}
+
+		auto [it, inserted] = positionMap.try_emplace(make_position_key(positions[index]), (uint32_t)weldedPos.size());
+		if (inserted) {
+			weldedPos.push_back(positions[index]);
+			weldedOriginal.push_back(index);
+			originalCount.push_back(0);
+		}
+
+		remap[index] = it->second;
+		originalCount[it->second]++;
+	}
+
+	const size_t weldedCount = weldedPos.size();
+	std::vector<std::vector<uint32_t>> adjacency(weldedCount);
+	std::vector<Quadric> quadrics(weldedCount);
+	std::vector<bool> locked(weldedCount, false);
+	std::vector<bool> removed(weldedCount, false);
+	std::vector<uint32_t> version(weldedCount, 0);
+
+	size_t aliveCount = triCount;
+	std::unordered_map<uint64_t, uint32_t> edgeUse;
+
+	auto edge_key = [](uint32_t a, uint32_t b) {
+		return ((uint64_t)std::min(a, b) << 32) | std::max(a, b);
+	};
+
+	for (size_t t = 0; t < triCount; t++) {
+		uint32_t w0 = remap[tris[t * 3]];
+		uint32_t w1 = remap[tris[t * 3 + 1]];
+		uint32_t w2 = remap[tris[t * 3 + 2]];
+
+		if (w0 == w1 || w1 == w2 || w0 == w2) {
+			triAlive[t] = false;
+			aliveCount--;
+			continue;
+		}
+
+		adjacency[w0].push_back((uint32_t)t);
+		adjacency[w1].push_back((uint32_t)t);
+		adjacency[w2].push_back((uint32_t)t);
+
+		edgeUse[edge_key(w0, w1)]++;
+		edgeUse[edge_key(w1, w2)]++;
+		edgeUse[edge_key(w2, w0)]++;
+
+		glm::vec3 normal = glm::cross(weldedPos[w1] - weldedPos[w0], weldedPos[w2] - weldedPos[w0]);
+		float length = glm::length(normal);
+		if (length > 0.f) {
+			normal /= length;
+			float d = -glm::dot(normal, weldedPos[w0]);
+			quadrics[w0].add_plane(normal, d);
+			quadrics[w1].add_plane(normal, d);
+			quadrics[w2].add_plane(normal, d);
+		}
+	}
+
+	// Open borders and non-manifold edges stay where they are
+	for (auto& [key, count] : edgeUse) {
+		if (count != 2) {
+			locked[(uint32_t)(key >> 32)] = true;
+			locked[(uint32_t)(key & 0xffffffff)] = true;
+		}
+	}
+
+	std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> queue;
+
+	auto push_collapse = [&](uint32_t from, uint32_t to) {
+		if (locked[from] || originalCount[from] != 1) {
+			return;
+		}
+
+		Quadric q = quadrics[from];
+		q.add(quadrics[to]);
+		queue.push(Collapse{ std::max(q.error(weldedPos[to]), 0.0), from, to, version[from], version[to] });
+	};
+
+	for (size_t t = 0; t < triCount; t++) {
+		if (!triAlive[t]) {
+			continue;
+		}
+		for (int c = 0; c < 3; c++) {
+			uint32_t a = remap[tris[t * 3 + c]];
+			uint32_t b = remap[tris[t * 3 + (c + 1) % 3]];
+			push_collapse(a, b);
+			push_collapse(b, a);
+		}
+	}
+
+	const size_t targetTriCount = targetIndexCount / 3;
+	const double maxCost = (double)maxError * maxError;
+	double worstCost = 0.0;
+
+	while (aliveCount > targetTriCount && !queue.empty()) {
+		Collapse collapse = queue.top();
+		queue.pop();
+
+		if (collapse.cost > maxCost) {
+			break;
+		}
+
+		const uint32_t u = collapse.from;
+		const uint32_t v = collapse.to;
+
+		if (removed[u] || removed[v] || collapse.fromVersion != version[u] || collapse.toVersion != version[v]) {
+			continue;
+		}
+
+		// The original index of v used along the edge replaces u, it has to be the same on both sides
+		uint32_t targetOriginal = INVALID;
+		bool valid = true;
+
+		for (uint32_t t : adjacency[u]) {
+			if (!triAlive[t]) {
+				continue;
+			}
+			for (int c = 0; c < 3; c++) {
+				uint32_t original = tris[t * 3 + c];
+				if (remap[original] == v) {
+					if (targetOriginal == INVALID) {
+						targetOriginal = original;
+					}
+					else if (targetOriginal != original) {
+						valid = false;
+					}
+				}
+			}
+		}
+
+		if (!valid || targetOriginal == INVALID) {
+			continue;
+		}
+
+		// Reject collapses that flip or degenerate any of the remaining triangles
+		for (uint32_t t : adjacency[u]) {
+			if (!triAlive[t] || !valid) {
+				continue;
+			}
+
+			glm::vec3 p[3];
+			glm::vec3 moved[3];
+			bool hasV = false;
+			for (int c = 0; c < 3; c++) {
+				uint32_t w = remap[tris[t * 3 + c]];
+				hasV |= (w == v);
+				p[c] = weldedPos[w];
+				moved[c] = (w == u) ? weldedPos[v] : p[c];
+			}
+
+			if (hasV) {
+				continue;
+			}
+
+			glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+			glm::vec3 after = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+			if (glm::dot(before, after) <= 1e-6f * glm::dot(before, before)) {
+				valid = false;
+			}
+		}
+
+		if (!valid) {
+			continue;
+		}
+
+		// Collapse u into v
+		const uint32_t sourceOriginal = weldedOriginal[u];
+		for (uint32_t t : adjacency[u]) {
+			if (!triAlive[t]) {
+				continue;
+			}
+
+			bool hasV = remap[tris[t * 3]] == v || remap[tris[t * 3 + 1]] == v || remap[tris[t * 3 + 2]] == v;
+			if (hasV) {
+				triAlive[t] = false;
+				aliveCount--;
+				continue;
+			}
+
+			for (int c = 0; c < 3; c++) {
+				if (tris[t * 3 + c] == sourceOriginal) {
+					tris[t * 3 + c] = targetOriginal;
+				}
+			}
+			adjacency[v].push_back(t);
+		}
+
+		removed[u] = true;
+		adjacency[u].clear();
+		quadrics[v].add(quadrics[u]);
+		version[v]++;
+		worstCost = std::max(worstCost, collapse.cost);
+
+		// Drop dead triangles from v and requeue every edge touching it, their cost changed with v's quadric
+		std::erase_if(adjacency[v], [&](uint32_t t) { return !triAlive[t]; });
+
+		for (uint32_t t : adjacency[v]) {
+			for (int c = 0; c < 3; c++) {
+				uint32_t w = remap[tris[t * 3 + c]];
+				if (w != v) {
+					push_collapse(w, v);
+					push_collapse(v, w);
+				}
+			}
+		}
+	}
+
+	if (resultError) {
+		*resultError = (float)std::sqrt(worstCost);
+	}
+
+	std::vector<uint32_t> result;
+	result.reserve(aliveCount * 3);
+	for (size_t t = 0; t < triCount; t++) {
+		if (triAlive[t]) {
+			result.push_back(tris[t * 3]);
+			result.push_back(tris[t * 3 + 1]);
+			result.push_back(tris[t * 3 + 2]);
+		}
+	}
+
+	return result;
+}
+//< simplify
+
+//> optimize
+namespace {
+	constexpr int VERTEX_CACHE_SIZE = 32;
+
+	// Scores from Tom Forsyth's "Linear-Speed Vertex Cache Optimisation"
+	float vertex_score(int cachePosition, uint32_t remainingTriangles) {
+		if (remainingTriangles == 0) {
+			return -1.f;
+		}
+
+		float score = 0.f;
+		if (cachePosition >= 0) {
+			// The last triangle's vertices get a fixed score so it doesn't matter which one is reused
+			if (cachePosition < 3) {
+				score = 0.75f;
+			}
+			else {
+				float scaler = 1.f - (float)(cachePosition - 3) / (VERTEX_CACHE_SIZE - 3);
+				score = std::pow(scaler, 1.5f);
+			}
+		}
+
+		// Prefer vertices with few triangles left so they don't linger as lone stragglers
+		return score + 2.f / std::sqrt((float)remainingTriangles);
+	}
+}
+
+void meshutil::optimize_vertex_cache(std::span<uint32_t> indices, size_t vertexCount) {
+	const size_t triCount = indices.size() / 3;
+	if (triCount == 0) {
+		return;
+	}
+
+	// Vertex to triangle adjacency as offsets into one array
+	std::vector<uint32_t> remaining(vertexCount, 0);
+	for (size_t i = 0; i < triCount * 3; i++) {
+		remaining[indices[i]]++;
+	}
+
+	std::vector<uint32_t> offsets(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; v++) {
+		offsets[v + 1] = offsets[v] + remaining[v];
+	}
+
+	std::vector<uint32_t> adjacency(triCount * 3);
+	std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+	for (size_t t = 0; t < triCount; t++) {
+		for (int c = 0; c < 3; c++) {
+			adjacency[fill[indices[t * 3 + c]]++] = (uint32_t)t;
+		}
+	}
+
+	std::vector<int> cachePosition(vertexCount, -1);
+	std::vector<float> vertexScores(vertexCount);
+	for (size_t v = 0; v < vertexCount; v++) {
+		vertexScores[v] = vertex_score(-1, remaining[v]);
+	}
+
+	std::vector<float> triScores(triCount);
+	for (size_t t = 0; t < triCount; t++) {
+		triScores[t] = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+	}
+
+	std::vector<bool> emitted(triCount, false);
+	std::vector<uint32_t> result;
+	result.reserve(triCount * 3);
+
+	// Three extra slots for the vertices pushed out of the cache by the newest triangle
+	std::vector<uint32_t> cache;
+	std::vector<uint32_t> newCache;
+	cache.reserve(VERTEX_CACHE_SIZE + 3);
+	newCache.reserve(VERTEX_CACHE_SIZE + 3);
+
+	size_t scanCursor = 0;
+	uint32_t bestTri = 0;
+	float bestScore = triScores[0];
+	for (size_t t = 1; t < triCount; t++) {
+		if (triScores[t] > bestScore) {
+			bestScore = triScores[t];
+			bestTri = (uint32_t)t;
+		}
+	}
+
+	while (true) {
+		emitted[bestTri] = true;
+
+		uint32_t tri[3] = { indices[bestTri * 3], indices[bestTri * 3 + 1], indices[bestTri * 3 + 2] };
+		result.insert(result.end(), tri, tri + 3);
+
+		// Move the triangle's vertices to the front of the cache
+		newCache.assign(tri, tri + 3);
+		for (uint32_t v : cache) {
+			if (v != tri[0] && v != tri[1] && v != tri[2]) {
+				newCache.push_back(v);
+			}
+		}
+
+		for (int c = 0; c < 3; c++) {
+			uint32_t v = tri[c];
+			uint32_t* begin = &adjacency[offsets[v]];
+			uint32_t* end = begin + remaining[v];
+			*std::find(begin, end, bestTri) = *(end - 1);
+			remaining[v]--;
+		}
+
+		// Rescore everything in the cache and the vertices that just fell out of it
+		for (size_t i = 0; i < newCache.size(); i++) {
+			uint32_t v = newCache[i];
+			cachePosition[v] = i < VERTEX_CACHE_SIZE ? (int)i : -1;
+
+			float score = vertex_score(cachePosition[v], remaining[v]);
+			float delta = score - vertexScores[v];
+			vertexScores[v] = score;
+
+			for (uint32_t j = 0; j < remaining[v]; j++) {
+				triScores[adjacency[offsets[v] + j]] += delta;
+			}
+		}
+
+		if (newCache.size() > VERTEX_CACHE_SIZE) {
+			newCache.resize(VERTEX_CACHE_SIZE);
+		}
+		std::swap(cache, newCache);
+
+		// Next triangle is the best one touching the cache, falling back to a linear scan
+		bestScore = -1.f;
+		for (uint32_t v : cache) {
+			for (uint32_t j = 0; j < remaining[v]; j++) {
+				uint32_t t = adjacency[offsets[v] + j];
+				if (triScores[t] > bestScore) {
+					bestScore = triScores[t];
+					bestTri = t;
+				}
+			}
+		}
+
+		if (bestScore < 0.f) {
+			while (scanCursor < triCount && emitted[scanCursor]) {
+				scanCursor++;
+			}
+			if (scanCursor == triCount) {
+				break;
+			}
+			bestTri = (uint32_t)scanCursor;
+		}
+	}
+
+	std::copy(result.begin(), result.end(), indices.begin());
+}
+
+void meshutil::optimize_overdraw(std::span<uint32_t> indices, std::span<const glm::vec3> positions) {
+	constexpr int FIFO_SIZE = 16;
+	// Tiny clusters would scatter the cache order for little gain
+	constexpr size_t MIN_CLUSTER_TRIANGLES = 16;
+
+	const size_t triCount = indices.size() / 3;
+	if (triCount <= MIN_CLUSTER_TRIANGLES) {
+		return;
+	}
+
+	// A new cluster can start wherever a simulated FIFO cache misses most of a triangle
+	std::vector<size_t> clusterStarts;
+	std::vector<uint32_t> fifo(FIFO_SIZE, ~0u);
+	size_t fifoHead = 0;
+
+	for (size_t t = 0; t < triCount; t++) {
+		int misses = 0;
+		for (int c = 0; c < 3; c++) {
+			uint32_t v = indices[t * 3 + c];
+			if (std::find(fifo.begin(), fifo.end(), v) == fifo.end()) {
+				fifo[fifoHead] = v;
+				fifoHead = (fifoHead + 1) % FIFO_SIZE;
+				misses++;
+			}
+		}
+
+		if (t == 0 || (misses >= 2 && t - clusterStarts.back() >= MIN_CLUSTER_TRIANGLES)) {
+			clusterStarts.push_back(t);
+		}
+	}
+
+	if (clusterStarts.size() < 2) {
+		return;
+	}
+	clusterStarts.push_back(triCount);
+
+	// Area weighted centroid of the whole mesh
+	glm::vec3 meshCentroid{ 0.f };
+	float meshArea = 0.f;
+	for (size_t t = 0; t < triCount; t++) {
+		const glm::vec3& a = positions[indices[t * 3]];
+		const glm::vec3& b = positions[indices[t * 3 + 1]];
+		const glm::vec3& c = positions[indices[t * 3 + 2]];
+		float area = glm::length(glm::cross(b - a, c - a));
+		meshCentroid += (a + b + c) * (area / 3.f);
+		meshArea += area;
+	}
+	meshCentroid = meshArea > 0.f ? meshCentroid / meshArea : meshCentroid;
+
+	struct Cluster {
+		size_t begin;
+		size_t end;
+		float sortKey;
+	};
+
+	std::vector<Cluster> clusters;
+	for (size_t i = 0; i + 1 < clusterStarts.size(); i++) {
+		glm::vec3 centroid{ 0.f };
+		glm::vec3 normal{ 0.f };
+		float area = 0.f;
+
+		for (size_t t = clusterStarts[i]; t < clusterStarts[i + 1]; t++) {
+			const glm::vec3& a = positions[indices[t * 3]];
+			const glm::vec3& b = positions[indices[t * 3 + 1]];
+			const glm::vec3& c = positions[indices[t * 3 + 2]];
+			glm::vec3 n = glm::cross(b - a, c - a);
+			float triArea = glm::length(n);
+			centroid += (a + b + c) * (triArea / 3.f);
+			normal += n;
+			area += triArea;
+		}
+
+		float normalLength = glm::length(normal);
+		float key = 0.f;
+		if (area > 0.f && normalLength > 0.f) {
+			key = glm::dot(centroid / area - meshCentroid, normal / normalLength);
+		}
+
+		clusters.push_back(Cluster{ clusterStarts[i], clusterStarts[i + 1], key });
+	}
+
+	// Clusters facing away from the center are the most likely to occlude the rest
+	std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) { return a.sortKey > b.sortKey; });
+
+	std::vector<uint32_t> result;
+	result.reserve(triCount * 3);
+	for (const Cluster& cluster : clusters) {
+		result.insert(result.end(), indices.begin() + cluster.begin * 3, indices.begin() + cluster.end * 3);
+	}
+
+	std::copy(result.begin(), result.end(), indices.begin());
+}
+
+std::vector<uint32_t> meshutil::optimize_vertex_fetch(std::span<uint32_t> indices, size_t vertexCount) {
+	constexpr uint32_t INVALID = ~0u;
+
+	std::vector<uint32_t> remap(vertexCount, INVALID);
+	uint32_t next = 0;
+
+	for (uint32_t& index : indices) {
+		if (remap[index] == INVALID) {
+			remap[index] = next++;
+		}
+		index = remap[index];
+	}
+
+	for (uint32_t& r : remap) {
+		if (r == INVALID) {
+			r = next++;
+		}
+	}
+
+	return remap;
+}
+//< optimize
+
+//> meshlets
+namespace {
+	void compute_meshlet_bounds(meshutil::Meshlet& meshlet, std::span<const uint32_t> indices, std::span<const glm::vec3> positions) {
+		std::span<const uint32_t> triangles = indices.subspan(meshlet.firstIndex, meshlet.indexCount);
+
+		// Sphere around the box center, looser than a minimal sphere but cheap and never too small
+		glm::vec3 minpos = positions[triangles[0]];
+		glm::vec3 maxpos = minpos;
+		for (uint32_t index : triangles) {
+			minpos = glm::min(minpos, positions[index]);
+			maxpos = glm::max(maxpos, positions[index]);
+		}
+
+		meshlet.center = (minpos + maxpos) * 0.5f;
+		meshlet.radius = 0.f;
+		for (uint32_t index : triangles) {
+			meshlet.radius = std::max(meshlet.radius, glm::length(positions[index] - meshlet.center));
+		}
+
+		// Cone around the average triangle normal
+		std::vector<glm::vec3> normals;
+		normals.reserve(triangles.size() / 3);
+		glm::vec3 axis{ 0.f };
+		for (size_t i = 0; i + 2 < triangles.size(); i += 3) {
+			const glm::vec3& a = positions[triangles[i]];
+			glm::vec3 n = glm::cross(positions[triangles[i + 1]] - a, positions[triangles[i + 2]] - a);
+			float length = glm::length(n);
+			if (length > 0.f) {
+				normals.push_back(n / length);
+				axis += n / length;
+			}
+		}
+
+		meshlet.coneAxis = glm::vec3{ 0.f, 0.f, 1.f };
+		meshlet.coneCutoff = 1.f;
+
+		float axisLength = glm::length(axis);
+		if (normals.empty() || axisLength <= 0.f) {
+			return;
+		}
+		axis /= axisLength;
+
+		float minDot = 1.f;
+		for (const glm::vec3& n : normals) {
+			minDot = std::min(minDot, glm::dot(n, axis));
+		}
+
+		// Normals spreading over a hemisphere or more leave no view direction where everything is back facing
+		if (minDot <= 0.f) {
+			return;
+		}
+
+		// Sine of the spread angle: the meshlet is back facing when the view direction is within 90 degrees minus the spread of the axis
+		meshlet.coneAxis = axis;
+		meshlet.coneCutoff = std::sqrt(1.f - minDot * minDot);
+	}
+}
+
+std::vector<meshutil::Meshlet> meshutil::build_meshlets(std::span<const uint32_t> indices, std::span<const glm::vec3> positions, size_t maxVertices, size_t maxTriangles) {
+	std::vector<Meshlet> meshlets;
+
+	const size_t triCount = indices.size() / 3;
+	if (triCount == 0) {
+		return meshlets;
+	}
+
+	// Vertices used by the meshlet being built, tagged with its number to avoid clearing
+	std::vector<uint32_t> usedBy(positions.size(), ~0u);
+	size_t vertexCount = 0;
+
+	Meshlet current = {};
+
+	auto finish = [&]() {
+		compute_meshlet_bounds(current, indices, positions);
+		meshlets.push_back(current);
+	};
+
+	for (size_t t = 0; t < triCount; t++) {
+		const uint32_t tag = (uint32_t)meshlets.size();
+
+		size_t newVertices = 0;
+		for (int c = 0; c < 3; c++) {
+			uint32_t v = indices[t * 3 + c];
+			// Repeated vertices within the triangle are counted once
+			bool seen = usedBy[v] == tag;
+			for (int p = 0; p < c && !seen; p++) {
+				seen = indices[t * 3 + p] == v;
+			}
+			newVertices += seen ? 0 : 1;
+		}
+
+		if (current.indexCount > 0 && (vertexCount + newVertices > maxVertices || current.indexCount / 3 + 1 > maxTriangles)) {
+			finish();
+			current = {};
+			current.firstIndex = (uint32_t)(t * 3);
+			vertexCount = 0;
+			t--;
+			continue;
+		}
+
+		for (int c = 0; c < 3; c++) {
+			usedBy[indices[t * 3 + c]] = tag;
+		}
+		vertexCount += newVertices;
+		current.indexCount += 3;
+	}
+
+	finish();
+
+	return meshlets;
+}
+//< meshlets
+
+//> index_packing
+bool meshutil::rebase_indices(std::span<uint32_t> indices, uint32_t firstVertex) {
+	bool fitsUint16 = true;
+	for (uint32_t& index : indices) {
+		index -= firstVertex;
+		fitsUint16 &= index <= UINT16_MAX;
+	}
+	return fitsUint16;
+}
+
+void meshutil::narrow_indices(std::span<const uint32_t> indices, std::span<uint16_t> out) {
+	for (size_t i = 0; i < indices.size(); i++) {
+		out[i] = (uint16_t)indices[i];
+	}
+}
+//< index_packing
@@ -0,0 +1,60 @@
+#pragma once
+// mesh_utils.h
+
+// Import time mesh processing. Works on plain index and position arrays so it has no Vulkan dependency.
+
+#include <vector>
+#include <span>
+#include <cstdint>
+
+#include <glm/vec3.hpp>
+
+namespace meshutil {
+	//> simplify
+	// Quadric error edge collapse. Vertices are never moved, a collapse snaps one vertex onto a neighbour,
+	// so the result indexes the same vertex data. Borders and attribute seams are kept in place.
+	// Stops at targetIndexCount or once the next collapse would exceed maxError (in position units).
+	// resultError receives the largest error of the collapses that were done.
+	std::vector<uint32_t> simplify(std::span<const uint32_t> indices, std::span<const glm::vec3> positions, size_t targetIndexCount, float maxError, float* resultError = nullptr);
+	//< simplify
+
+	//> optimize
+	// Reorders triangles for the post-transform vertex cache (Forsyth's linear-speed algorithm).
+	// Indices have to be in [0, vertexCount).
+	void optimize_vertex_cache(std::span<uint32_t> indices, size_t vertexCount);
+
+	// Splits a cache optimized triangle list into clusters at cache misses and sorts the clusters so
+	// outward facing ones come first, which cuts overdraw while keeping most of the cache locality.
+	void optimize_overdraw(std::span<uint32_t> indices, std::span<const glm::vec3> positions);
+
+	// Renumbers vertices in the order the indices first use them and rewrites the indices to match.
+	// Returns the old to new vertex mapping, unused vertices are moved to the end.
+	std::vector<uint32_t> optimize_vertex_fetch(std::span<uint32_t> indices, size_t vertexCount);
+	//< optimize
+
+	//> meshlets
+	// A run of consecutive triangles with its culling data. Indices are not copied, the meshlet is
+	// a range of the input index list
+	struct Meshlet {
+		uint32_t firstIndex;
+		uint32_t indexCount;
+		glm::vec3 center;
+		float radius;
+		glm::vec3 coneAxis;
+		float coneCutoff; // 1 when the triangles face too many directions for cone culling
+	};
+
+	// Splits a triangle list in order into meshlets of at most maxVertices unique vertices and maxTriangles triangles.
+	// Works best on cache optimized indices, where consecutive triangles are close together.
+	std::vector<Meshlet> build_meshlets(std::span<const uint32_t> indices, std::span<const glm::vec3> positions, size_t maxVertices = 64, size_t maxTriangles = 124);
+	//< meshlets
+
+	//> index_packing
+	// Makes indices relative to firstVertex, so every surface counts its vertices from 0 and most fit in 16 bits.
+	// Returns whether they all do
+	bool rebase_indices(std::span<uint32_t> indices, uint32_t firstVertex);
+
+	// Copies indices to 16-bit values, every one has to fit
+	void narrow_indices(std::span<const uint32_t> indices, std::span<uint16_t> out);
+	//< index_packing
+}
@@ -0,0 +1,395 @@
+#include "meshopt_decode.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+	constexpr uint8_t VERTEX_HEADER = 0xA0;
+	constexpr uint8_t INDEX_HEADER = 0xE0;
+	constexpr uint8_t SEQUENCE_HEADER = 0xD0;
+
+	constexpr size_t BYTE_GROUP_SIZE = 16;
+	constexpr size_t BYTE_GROUP_DECODE_LIMIT = 24; // Largest group: 8 bytes of 4-bit values and 16 literals
+	constexpr size_t VERTEX_BLOCK_SIZE_BYTES = 8192;
+	constexpr size_t VERTEX_BLOCK_MAX_SIZE = 256;
+	constexpr size_t TAIL_MAX_SIZE = 32;
+
+	//> vertex_codec
+	// One group of 16 bytes. 0 bits is all zero, 2 and 4 bits are packed most significant first with the
+	// all ones value standing for a literal byte that follows the packed values, 8 bits is all literals
+	const uint8_t* decode_bytes_group(const uint8_t* data, uint8_t* out, int bitslog2) {
+		switch (bitslog2) {
+		case 0:
+			memset(out, 0, BYTE_GROUP_SIZE);
+			return data;
+		case 1:
+		case 2: {
+			const int bits = 1 << bitslog2;
+			const size_t perByte = 8 / bits;
+			const uint8_t sentinel = (uint8_t)((1 << bits) - 1);
+
+			const uint8_t* literals = data + BYTE_GROUP_SIZE / perByte;
+			for (size_t i = 0; i < BYTE_GROUP_SIZE; i++) {
+				uint8_t value = (data[i / perByte] >> (8 - bits * (i % perByte + 1))) & sentinel;
+				out[i] = value == sentinel ? *literals++ : value;
+			}
+			return literals;
+		}
+		default:
+			memcpy(out, data, BYTE_GROUP_SIZE);
+			return data + BYTE_GROUP_SIZE;
+		}
+	}
+
+	// size bytes in groups of 16, preceded by the 2-bit width of every group
+	const uint8_t* decode_bytes(const uint8_t* data, const uint8_t* dataEnd, uint8_t* out, size_t size) {
+		const size_t headerSize = (size / BYTE_GROUP_SIZE + 3) / 4;
+		if ((size_t)(dataEnd - data) < headerSize) {
+			return nullptr;
+		}
+
+		const uint8_t* header = data;
+		data += headerSize;
+
+		for (size_t i = 0; i < size; i += BYTE_GROUP_SIZE) {
+			// The stream always ends in the tail, so a group never reads past the end when this holds
+			if ((size_t)(dataEnd - data) < BYTE_GROUP_DECODE_LIMIT) {
+				return nullptr;
+			}
+
+			const size_t group = i / BYTE_GROUP_SIZE;
+			const int bitslog2 = (header[group / 4] >> ((group % 4) * 2)) & 3;
+			data = decode_bytes_group(data, out + i, bitslog2);
+		}
+		return data;
+	}
+
+	// Byte k of every vertex in the block is stored together, as zigzag deltas to byte k of the previous vertex
+	const uint8_t* decode_vertex_block(const uint8_t* data, const uint8_t* dataEnd, uint8_t* out, size_t count, size_t stride, uint8_t* lastVertex) {
+		uint8_t deltas[VERTEX_BLOCK_MAX_SIZE];
+		const size_t alignedCount = (count + BYTE_GROUP_SIZE - 1) & ~(BYTE_GROUP_SIZE - 1);
+
+		for (size_t k = 0; k < stride; k++) {
+			data = decode_bytes(data, dataEnd, deltas, alignedCount);
+			if (!data) {
+				return nullptr;
+			}
+
+			uint8_t previous = lastVertex[k];
+			for (size_t i = 0; i < count; i++) {
+				const uint8_t delta = deltas[i];
+				previous += (uint8_t)((delta >> 1) ^ (0 - (delta & 1)));
+				out[i * stride + k] = previous;
+			}
+			lastVertex[k] = previous;
+		}
+		return data;
+	}
+	//< vertex_codec
+
+	//> index_codec
+	uint32_t decode_vbyte(const uint8_t*& data) {
+		const uint8_t lead = *data++;
+		if (lead < 128) {
+			return lead;
+		}
+
+		uint32_t result = lead & 127;
+		uint32_t shift = 7;
+		for (int i = 0; i < 4; i++) {
+			const uint8_t group = *data++;
+			result |= (uint32_t)(group & 127) << shift;
+			shift += 7;
+			if (group < 128) {
+				break;
+			}
+		}
+		return result;
+	}
+
+	uint32_t decode_index(const uint8_t*& data, uint32_t last) {
+		const uint32_t v = decode_vbyte(data);
+		return last + ((v >> 1) ^ (0 - (v & 1)));
+	}
+
+	void write_index(void* destination, size_t i, size_t stride, uint32_t index) {
+		if (stride == 2) {
+			((uint16_t*)destination)[i] = (uint16_t)index;
+		}
+		else {
+			((uint32_t*)destination)[i] = index;
+		}
+	}
+
+	// The FIFOs have to be updated exactly like the encoder does or every later triangle decodes wrong
+	struct IndexFifos {
+		uint32_t edges[16][2];
+		uint32_t vertices[16];
+		size_t edgeOffset{ 0 };
+		size_t vertexOffset{ 0 };
+
+		IndexFifos() {
+			memset(edges, -1, sizeof(edges));
+			memset(vertices, -1, sizeof(vertices));
+		}
+
+		void push_edge(uint32_t a, uint32_t b) {
+			edges[edgeOffset][0] = a;
+			edges[edgeOffset][1] = b;
+			edgeOffset = (edgeOffset + 1) & 15;
+		}
+
+		void push_vertex(uint32_t v, bool advance = true) {
+			vertices[vertexOffset] = v;
+			vertexOffset = (vertexOffset + advance) & 15;
+		}
+	};
+	//< index_codec
+
+	template<typename T>
+	void decode_filter_oct(T* data, size_t count) {
+		const float maxValue = (float)((1 << (sizeof(T) * 8 - 1)) - 1);
+
+		for (size_t i = 0; i < count; i++) {
+			// z is stored as 1 - |x| - |y| at the same scale, folded over for the lower hemisphere
+			float x = (float)data[i * 4 + 0];
+			float y = (float)data[i * 4 + 1];
+			float z = (float)data[i * 4 + 2] - std::fabs(x) - std::fabs(y);
+
+			const float t = z >= 0.f ? 0.f : z;
+			x += x >= 0.f ? t : -t;
+			y += y >= 0.f ? t : -t;
+
+			// Only a malformed stream gets here without a direction, it stays a zero vector
+			const float length = std::sqrt(x * x + y * y + z * z);
+			if (length == 0.f) {
+				continue;
+			}
+
+			const float scale = maxValue / length;
+			data[i * 4 + 0] = (T)(int)(x * scale + (x >= 0.f ? 0.5f : -0.5f));
+			data[i * 4 + 1] = (T)(int)(y * scale + (y >= 0.f ? 0.5f : -0.5f));
+			data[i * 4 + 2] = (T)(int)(z * scale + (z >= 0.f ? 0.5f : -0.5f));
+		}
+	}
+}
+
+namespace meshopt {
+	//> codecs
+	bool decode_vertex_buffer(void* destination, size_t count, size_t stride, std::span<const std::byte> encoded) {
+		if (stride == 0 || stride > 256 || stride % 4 != 0 || encoded.size() < 1 + stride) {
+			return false;
+		}
+
+		const uint8_t* data = (const uint8_t*)encoded.data();
+		const uint8_t* dataEnd = data + encoded.size();
+
+		// Only version 0 is part of the extension
+		if (*data++ != VERTEX_HEADER) {
+			return false;
+		}
+
+		// The first vertex is the base of the deltas and sits at the very end
+		uint8_t lastVertex[256];
+		memcpy(lastVertex, dataEnd - stride, stride);
+
+		uint8_t* out = (uint8_t*)destination;
+		const size_t blockSize = std::min((VERTEX_BLOCK_SIZE_BYTES / stride) & ~(BYTE_GROUP_SIZE - 1), VERTEX_BLOCK_MAX_SIZE);
+		for (size_t offset = 0; offset < count; offset += blockSize) {
+			data = decode_vertex_block(data, dataEnd, out + offset * stride, std::min(blockSize, count - offset), stride, lastVertex);
+			if (!data) {
+				return false;
+			}
+		}
+
+		return (size_t)(dataEnd - data) == std::max(stride, TAIL_MAX_SIZE);
+	}
+
+	bool decode_index_buffer(void* destination, size_t count, size_t stride, std::span<const std::byte> encoded) {
+		// Header, a code byte per triangle and the 16 byte table of common auxiliary codes
+		if (count % 3 != 0 || (stride != 2 && stride != 4) || encoded.size() < 1 + count / 3 + 16) {
+			return false;
+		}
+
+		const uint8_t* buffer = (const uint8_t*)encoded.data();
+		if ((buffer[0] & 0xF0) != INDEX_HEADER || (buffer[0] & 0x0F) > 1) {
+			return false;
+		}
+
+		// Version 1 codes the free vertices 13 and 14 as a delta of -1 and 1 to the last one instead of FIFO slots
+		const int fecMax = (buffer[0] & 0x0F) >= 1 ? 13 : 15;
+
+		const uint8_t* code = buffer + 1;
+		const uint8_t* data = code + count / 3;
+		const uint8_t* dataSafeEnd = buffer + encoded.size() - 16;
+		const uint8_t* codeauxTable = dataSafeEnd;
+
+		IndexFifos fifos;
+		uint32_t next = 0;
+		uint32_t last = 0;
+
+		for (size_t i = 0; i < count; i += 3) {
+			// A triangle reads at most 16 bytes, the table behind dataSafeEnd covers the overrun
+			if (data > dataSafeEnd) {
+				return false;
+			}
+
+			const uint8_t codetri = *code++;
+			uint32_t a, b, c;
+
+			if (codetri < 0xF0) {
+				// Reuses an edge of a recent triangle, the third vertex is new, from the FIFO or coded
+				const size_t edge = (fifos.edgeOffset - 1 - (codetri >> 4)) & 15;
+				a = fifos.edges[edge][0];
+				b = fifos.edges[edge][1];
+
+				const int fec = codetri & 15;
+				if (fec < fecMax) {
+					c = fec == 0 ? next++ : fifos.vertices[(fifos.vertexOffset - 1 - fec) & 15];
+					fifos.push_vertex(c, fec == 0);
+				}
+				else {
+					c = last = fec != 15 ? last + (fec - (fec ^ 3)) : decode_index(data, last);
+					fifos.push_vertex(c);
+				}
+
+				fifos.push_edge(c, b);
+				fifos.push_edge(a, c);
+			}
+			else {
+				// A triangle without a shared edge. 0xFE and 0xFF have their auxiliary code inline
+				const bool inlineCode = codetri >= 0xFE;
+				const uint8_t codeaux = inlineCode ? *data++ : codeauxTable[codetri & 15];
+				const int fea = codetri == 0xFF ? 15 : 0;
+				const int feb = codeaux >> 4;
+				const int fec = codeaux & 15;
+
+				// An inline zero resets the counter of new vertices
+				if (inlineCode && codeaux == 0) {
+					next = 0;
+				}
+
+				a = fea == 0 ? next++ : 0;
+				b = feb == 0 ? next++ : fifos.vertices[(fifos.vertexOffset - feb) & 15];
+				c = fec == 0 ? next++ : fifos.vertices[(fifos.vertexOffset - fec) & 15];
+
+				if (fea == 15) {
+					last = a = decode_index(data, last);
+				}
+				if (feb == 15) {
+					last = b = decode_index(data, last);
+				}
+				if (fec == 15) {
+					last = c = decode_index(data, last);
+				}
+
+				fifos.push_vertex(a);
+				fifos.push_vertex(b, feb == 0 || feb == 15);
+				fifos.push_vertex(c, fec == 0 || fec == 15);
+
+				fifos.push_edge(b, a);
+				fifos.push_edge(c, b);
+				fifos.push_edge(a, c);
+			}
+
+			write_index(destination, i + 0, stride, a);
+			write_index(destination, i + 1, stride, b);
+			write_index(destination, i + 2, stride, c);
+		}
+
+		// Everything up to the table has to be used
+		return data == dataSafeEnd;
+	}
+
+	bool decode_index_sequence(void* destination, size_t count, size_t stride, std::span<const std::byte> encoded) {
+		// Header, at least a byte per index and a 4 byte tail
+		if ((stride != 2 && stride != 4) || encoded.size() < 1 + count + 4) {
+			return false;
+		}
+
+		const uint8_t* buffer = (const uint8_t*)encoded.data();
+		if ((buffer[0] & 0xF0) != SEQUENCE_HEADER || (buffer[0] & 0x0F) > 1) {
+			return false;
+		}
+
+		const uint8_t* data = buffer + 1;
+		const uint8_t* dataSafeEnd = buffer + encoded.size() - 4;
+
+		// Two baselines, the low bit of every code says which one the delta is against
+		uint32_t last[2] = { 0, 0 };
+
+		for (size_t i = 0; i < count; i++) {
+			// An index reads at most 5 bytes, the tail covers the overrun
+			if (data >= dataSafeEnd) {
+				return false;
+			}
+
+			uint32_t v = decode_vbyte(data);
+			const uint32_t baseline = v & 1;
+			v >>= 1;
+
+			const uint32_t index = last[baseline] + ((v >> 1) ^ (0 - (v & 1)));
+			last[baseline] = index;
+			write_index(destination, i, stride, index);
+		}
+
+		return data == dataSafeEnd;
+	}
+	//< codecs
+
+	//> filters
+	void decode_filter_oct(void* data, size_t count, size_t stride) {
+		if (stride == 4) {
+			::decode_filter_oct((int8_t*)data, count);
+		}
+		else {
+			::decode_filter_oct((int16_t*)data, count);
+		}
+	}
+
+	void decode_filter_quat(void* data, size_t count) {
+		int16_t* q = (int16_t*)data;
+		const float scale = 1.f / std::sqrt(2.f);
+
+		for (size_t i = 0; i < count; i++) {
+			// The fourth component holds the scale in its upper bits and the index of the dropped component in the lowest two
+			const int sf = q[i * 4 + 3] | 3;
+			const float ss = scale / (float)sf;
+
+			const float x = (float)q[i * 4 + 0] * ss;
+			const float y = (float)q[i * 4 + 1] * ss;
+			const float z = (float)q[i * 4 + 2] * ss;
+
+			// Clamped, rounding can push the sum slightly above 1
+			const float ww = 1.f - x * x - y * y - z * z;
+			const float w = std::sqrt(ww >= 0.f ? ww : 0.f);
+
+			const int qc = q[i * 4 + 3] & 3;
+			q[i * 4 + ((qc + 1) & 3)] = (int16_t)(int)(x * 32767.f + (x >= 0.f ? 0.5f : -0.5f));
+			q[i * 4 + ((qc + 2) & 3)] = (int16_t)(int)(y * 32767.f + (y >= 0.f ? 0.5f : -0.5f));
+			q[i * 4 + ((qc + 3) & 3)] = (int16_t)(int)(z * 32767.f + (z >= 0.f ? 0.5f : -0.5f));
+			q[i * 4 + ((qc + 0) & 3)] = (int16_t)(int)(w * 32767.f + 0.5f);
+		}
+	}
+
+	void decode_filter_exp(void* data, size_t count, size_t stride) {
+		uint32_t* words = (uint32_t*)data;
+		const size_t wordCount = count * (stride / 4);
+
+		for (size_t i = 0; i < wordCount; i++) {
+			const uint32_t v = words[i];
+			const int32_t mantissa = (int32_t)(v << 8) >> 8;
+			const int32_t exponent = (int32_t)v >> 24;
+
+			// ldexp(mantissa, exponent) by building 2^exponent directly
+			float power;
+			const uint32_t powerBits = (uint32_t)(exponent + 127) << 23;
+			memcpy(&power, &powerBits, sizeof(power));
+
+			const float result = power * (float)mantissa;
+			memcpy(&words[i], &result, sizeof(result));
+		}
+	}
+	//< filters
+}
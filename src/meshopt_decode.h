@@ -0,0 +1,36 @@
+#pragma once
+// meshopt_decode.h
+
+// Decoders for the buffer view streams of EXT_meshopt_compression, following the bitstream in the
+// extension spec. Works on plain byte arrays so it has no Vulkan dependency and runs on loader threads.
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+namespace meshopt {
+	//> codecs
+	// Every decoder writes count elements of stride bytes to destination and returns false when the
+	// stream is malformed or does not hold exactly that many elements. destination is undefined then.
+
+	// ATTRIBUTES mode, byte-wise delta coded vertex data. stride is a multiple of 4, at most 256
+	bool decode_vertex_buffer(void* destination, size_t count, size_t stride, std::span<const std::byte> encoded);
+
+	// TRIANGLES mode, a triangle list coded against an edge and vertex FIFO. count is a multiple of 3, stride 2 or 4
+	bool decode_index_buffer(void* destination, size_t count, size_t stride, std::span<const std::byte> encoded);
+
+	// INDICES mode, any index list as varint deltas. stride 2 or 4
+	bool decode_index_sequence(void* destination, size_t count, size_t stride, std::span<const std::byte> encoded);
+	//< codecs
+
+	//> filters
+	// Applied in place after decode_vertex_buffer, they turn the filtered integers back into the accessor data
+
+	// Octahedral normals and tangents as signed 8-bit (stride 4) or 16-bit (stride 8) components
+	void decode_filter_oct(void* data, size_t count, size_t stride);
+	// Rotations as the three smallest components in 16-bit, stride 8
+	void decode_filter_quat(void* data, size_t count);
+	// Floats as a 24-bit mantissa with a shared 8-bit exponent, every 4 bytes of every element
+	void decode_filter_exp(void* data, size_t count, size_t stride);
+	//< filters
+}
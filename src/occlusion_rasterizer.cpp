@@ -0,0 +1,261 @@
+#include "occlusion_rasterizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+namespace {
+	// Default to a handful of threads, the buffer is too small to scale much further
+	uint32_t default_thread_count(uint32_t threadCount) {
+		return threadCount != 0 ? threadCount : std::clamp(std::thread::hardware_concurrency(), 1u, 4u);
+	}
+}
+
+OcclusionRasterizer::OcclusionRasterizer(int width, int height, uint32_t threadCount)
+	: _threadCount(default_thread_count(threadCount))
+	, _workers(_threadCount - 1) {
+	// Round the resolution up to whole tiles
+	_tilesX = (std::max(width, 1) + TILE_SIZE - 1) / TILE_SIZE;
+	_tilesY = (std::max(height, 1) + TILE_SIZE - 1) / TILE_SIZE;
+	_width = _tilesX * TILE_SIZE;
+	_height = _tilesY * TILE_SIZE;
+
+	_depth.resize((size_t)_width * _height, 0.f);
+	_tileMinDepth.resize((size_t)_tilesX * _tilesY, 0.f);
+}
+
+void OcclusionRasterizer::begin_frame(const glm::mat4& viewProj) {
+	_viewProj = viewProj;
+	_triangles.clear();
+}
+
+void OcclusionRasterizer::add_occluder(const OccluderGeometry& geometry, const glm::mat4& transform) {
+	glm::mat4 matrix = _viewProj * transform;
+
+	for (size_t i = 0; i + 2 < geometry.indices.size(); i += 3) {
+		glm::vec4 a = matrix * glm::vec4(geometry.positions[geometry.indices[i]], 1.f);
+		glm::vec4 b = matrix * glm::vec4(geometry.positions[geometry.indices[i + 1]], 1.f);
+		glm::vec4 c = matrix * glm::vec4(geometry.positions[geometry.indices[i + 2]], 1.f);
+
+		clip_and_queue(a, b, c);
+	}
+}
+
+void OcclusionRasterizer::clip_and_queue(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c) {
+	// With the reversed depth range, everything in front of the near plane has z > w. Clip against w - z >= 0
+	const glm::vec4 input[3] = { a, b, c };
+	const float distance[3] = { a.w - a.z, b.w - b.z, c.w - c.z };
+
+	if (distance[0] >= 0.f && distance[1] >= 0.f && distance[2] >= 0.f) {
+		queue_triangle(a, b, c);
+		return;
+	}
+
+	// One clipping plane turns a triangle into at most a quad
+	glm::vec4 clipped[4];
+	int count = 0;
+
+	for (int i = 0; i < 3; i++) {
+		int next = (i + 1) % 3;
+
+		if (distance[i] >= 0.f) {
+			clipped[count++] = input[i];
+		}
+
+		if ((distance[i] >= 0.f) != (distance[next] >= 0.f)) {
+			float t = distance[i] / (distance[i] - distance[next]);
+			clipped[count++] = input[i] + (input[next] - input[i]) * t;
+		}
+	}
+
+	for (int i = 2; i < count; i++) {
+		queue_triangle(clipped[0], clipped[i - 1], clipped[i]);
+	}
+}
+
+void OcclusionRasterizer::queue_triangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c) {
+	// Triangles that are exactly on the near plane have w = 0 after clipping, nothing to draw
+	if (a.w <= 0.f || b.w <= 0.f || c.w <= 0.f) {
+		return;
+	}
+
+	ScreenTriangle tri;
+	const glm::vec4* verts[3] = { &a, &b, &c };
+
+	for (int i = 0; i < 3; i++) {
+		const glm::vec4& v = *verts[i];
+		// NDC to pixels, y points down like the Vulkan viewport
+		tri.v[i].x = (v.x / v.w * 0.5f + 0.5f) * _width;
+		tri.v[i].y = (v.y / v.w * 0.5f + 0.5f) * _height;
+		tri.z[i] = v.z / v.w;
+	}
+
+	_triangles.push_back(tri);
+}
+
+void OcclusionRasterizer::rasterize() {
+	uint32_t bandCount = std::min(_threadCount, (uint32_t)_tilesY);
+	int tileRowsPerBand = (_tilesY + bandCount - 1) / bandCount;
+
+	// Bands past the last tile row are empty
+	_workers.parallel_for(bandCount, [&](size_t band) {
+		int begin = (int)band * tileRowsPerBand;
+		int end = std::min(begin + tileRowsPerBand, _tilesY);
+		if (begin < end) {
+			rasterize_band(begin, end);
+		}
+		});
+}
+
+void OcclusionRasterizer::rasterize_band(int tileRowBegin, int tileRowEnd) {
+	const int yBegin = tileRowBegin * TILE_SIZE;
+	const int yEnd = tileRowEnd * TILE_SIZE;
+
+	std::fill(_depth.begin() + (size_t)yBegin * _width, _depth.begin() + (size_t)yEnd * _width, 0.f);
+
+	for (const ScreenTriangle& tri : _triangles) {
+		glm::vec2 v0 = tri.v[0];
+		glm::vec2 v1 = tri.v[1];
+		glm::vec2 v2 = tri.v[2];
+		float z0 = tri.z[0];
+		float z1 = tri.z[1];
+		float z2 = tri.z[2];
+
+		float area = (v1.x - v0.x) * (v2.y - v0.y) - (v1.y - v0.y) * (v2.x - v0.x);
+		if (std::abs(area) < 1e-8f) {
+			continue;
+		}
+
+		// Occluders are treated as double sided, flip clockwise triangles
+		if (area < 0.f) {
+			std::swap(v1, v2);
+			std::swap(z1, z2);
+			area = -area;
+		}
+
+		// Clamp in float first, clipped triangles can have huge coordinates
+		float minXf = std::clamp(std::min({ v0.x, v1.x, v2.x }), 0.f, (float)_width);
+		float maxXf = std::clamp(std::max({ v0.x, v1.x, v2.x }), 0.f, (float)_width);
+		float minYf = std::clamp(std::min({ v0.y, v1.y, v2.y }), (float)yBegin, (float)yEnd);
+		float maxYf = std::clamp(std::max({ v0.y, v1.y, v2.y }), (float)yBegin, (float)yEnd);
+
+		int minX = (int)std::floor(minXf);
+		int maxX = std::min((int)std::ceil(maxXf), _width - 1);
+		int minY = (int)std::floor(minYf);
+		int maxY = std::min((int)std::ceil(maxYf), yEnd - 1);
+
+		if (minX > maxX || minY > maxY) {
+			continue;
+		}
+
+		// Edge functions and depth as planes a * x + b * y + c, so the inner loop is a plain multiply-add per lane
+		auto edge_plane = [](const glm::vec2& a, const glm::vec2& b) {
+			float ea = -(b.y - a.y);
+			float eb = b.x - a.x;
+			return glm::vec3{ ea, eb, -(ea * a.x + eb * a.y) };
+		};
+
+		glm::vec3 e0 = edge_plane(v1, v2);
+		glm::vec3 e1 = edge_plane(v2, v0);
+		glm::vec3 e2 = edge_plane(v0, v1);
+
+		float invArea = 1.f / area;
+		glm::vec3 zPlane = (e0 * z0 + e1 * z1 + e2 * z2) * invArea;
+
+		for (int y = minY; y <= maxY; y++) {
+			float py = y + 0.5f;
+			float r0 = e0.y * py + e0.z;
+			float r1 = e1.y * py + e1.z;
+			float r2 = e2.y * py + e2.z;
+			float rz = zPlane.y * py + zPlane.z;
+
+			float* row = &_depth[(size_t)y * _width];
+
+			// Branchless so the compiler can vectorize the row
+			for (int x = minX; x <= maxX; x++) {
+				float px = x + 0.5f;
+				float w0 = e0.x * px + r0;
+				float w1 = e1.x * px + r1;
+				float w2 = e2.x * px + r2;
+				float z = zPlane.x * px + rz;
+
+				bool inside = (w0 >= 0.f) & (w1 >= 0.f) & (w2 >= 0.f);
+				float nearest = std::max(row[x], z);
+				row[x] = inside ? nearest : row[x];
+			}
+		}
+	}
+
+	// Farthest depth per tile for the hierarchical test
+	for (int ty = tileRowBegin; ty < tileRowEnd; ty++) {
+		for (int tx = 0; tx < _tilesX; tx++) {
+			float farthest = 1.f;
+			for (int y = ty * TILE_SIZE; y < (ty + 1) * TILE_SIZE; y++) {
+				const float* row = &_depth[(size_t)y * _width + tx * TILE_SIZE];
+				for (int x = 0; x < TILE_SIZE; x++) {
+					farthest = std::min(farthest, row[x]);
+				}
+			}
+			_tileMinDepth[(size_t)ty * _tilesX + tx] = farthest;
+		}
+	}
+}
+
+bool OcclusionRasterizer::is_visible(const glm::vec3& origin, const glm::vec3& extents, const glm::mat4& transform) const {
+	glm::mat4 matrix = _viewProj * transform;
+
+	glm::vec3 ndcMin = { 1.5f, 1.5f, 1.5f };
+	glm::vec3 ndcMax = { -1.5f, -1.5f, -1.5f };
+
+	for (int c = 0; c < 8; c++) {
+		glm::vec3 corner = { (c & 1) ? 1.f : -1.f, (c & 2) ? 1.f : -1.f, (c & 4) ? 1.f : -1.f };
+		glm::vec4 v = matrix * glm::vec4(origin + corner * extents, 1.f);
+
+		// Boxes reaching past the near plane can't be hidden
+		if (v.w <= 0.f || v.z > v.w) {
+			return true;
+		}
+
+		glm::vec3 ndc = glm::vec3{ v.x, v.y, v.z } / v.w;
+		ndcMin = glm::min(ndcMin, ndc);
+		ndcMax = glm::max(ndcMax, ndc);
+	}
+
+	// Anything off screen is left to frustum culling
+	if (ndcMin.x > 1.f || ndcMax.x < -1.f || ndcMin.y > 1.f || ndcMax.y < -1.f) {
+		return true;
+	}
+
+	int x0 = (int)std::clamp((ndcMin.x * 0.5f + 0.5f) * _width, 0.f, (float)(_width - 1));
+	int x1 = (int)std::clamp((ndcMax.x * 0.5f + 0.5f) * _width, 0.f, (float)(_width - 1));
+	int y0 = (int)std::clamp((ndcMin.y * 0.5f + 0.5f) * _height, 0.f, (float)(_height - 1));
+	int y1 = (int)std::clamp((ndcMax.y * 0.5f + 0.5f) * _height, 0.f, (float)(_height - 1));
+
+	// Largest depth is the nearest point of the box
+	float nearest = ndcMax.z;
+
+	for (int ty = y0 / TILE_SIZE; ty <= y1 / TILE_SIZE; ty++) {
+		for (int tx = x0 / TILE_SIZE; tx <= x1 / TILE_SIZE; tx++) {
+			// Every pixel in the tile is in front of the box
+			if (_tileMinDepth[(size_t)ty * _tilesX + tx] > nearest) {
+				continue;
+			}
+
+			int px0 = std::max(x0, tx * TILE_SIZE);
+			int px1 = std::min(x1, tx * TILE_SIZE + TILE_SIZE - 1);
+			int py0 = std::max(y0, ty * TILE_SIZE);
+			int py1 = std::min(y1, ty * TILE_SIZE + TILE_SIZE - 1);
+
+			for (int y = py0; y <= py1; y++) {
+				const float* row = &_depth[(size_t)y * _width];
+				for (int x = px0; x <= px1; x++) {
+					if (row[x] <= nearest) {
+						return true;
+					}
+				}
+			}
+		}
+	}
+
+	return false;
+}
@@ -0,0 +1,80 @@
+#pragma once
+// occlusion_rasterizer.h
+
+// CPU occlusion culling. Designated occluder meshes are rasterized into a small depth buffer and
+// object bounds are tested against it before any draw commands are recorded.
+// Only depends on glm and the standard library, so it can be exercised without a Vulkan device.
+
+#include <thread_pool.h>
+
+#include <vector>
+#include <span>
+#include <cstdint>
+
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
+
+//> occluder
+// Position-only copy of a mesh kept on the CPU for rasterization
+struct OccluderGeometry {
+	std::vector<glm::vec3> positions;
+	std::vector<uint32_t> indices;
+};
+//< occluder
+
+//> OcclusionRasterizer
+class OcclusionRasterizer {
+public:
+	// Pixels are processed in 8 wide rows and 8x8 tiles, the resolution is rounded up to match
+	static constexpr int TILE_SIZE = 8;
+
+	OcclusionRasterizer(int width = 320, int height = 192, uint32_t threadCount = 0);
+
+	// Clears the depth buffer and occluder list. viewProj uses the engine's reversed depth range (near = 1, far = 0)
+	void begin_frame(const glm::mat4& viewProj);
+
+	// Transforms, clips and queues the triangles of one occluder instance
+	void add_occluder(const OccluderGeometry& geometry, const glm::mat4& transform);
+
+	// Rasterizes all queued triangles, horizontal bands of the buffer are split across the worker threads
+	void rasterize();
+
+	// Tests an object space box against the rasterized occluders. Anything not fully hidden is visible
+	bool is_visible(const glm::vec3& origin, const glm::vec3& extents, const glm::mat4& transform) const;
+
+	int width() const { return _width; }
+	int height() const { return _height; }
+	std::span<const float> depth() const { return _depth; }
+	uint32_t triangle_count() const { return (uint32_t)_triangles.size(); }
+
+private:
+	struct ScreenTriangle {
+		glm::vec2 v[3];
+		float z[3];
+	};
+
+	void clip_and_queue(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c);
+	void queue_triangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c);
+	void rasterize_band(int tileRowBegin, int tileRowEnd);
+
+	int _width;
+	int _height;
+	int _tilesX;
+	int _tilesY;
+	uint32_t _threadCount;
+
+	// Started with the rasterizer, the calling thread of rasterize is the last one
+	ThreadPool _workers;
+
+	glm::mat4 _viewProj{ 1.f };
+
+	// Nearest occluder depth per pixel, 0 where nothing was drawn
+	std::vector<float> _depth;
+	// Farthest depth of every tile, used to skip whole tiles when testing
+	std::vector<float> _tileMinDepth;
+
+	std::vector<ScreenTriangle> _triangles;
+};
+//< OcclusionRasterizer
@@ -0,0 +1,141 @@
+#pragma once
+// scene_package.h
+
+// Layout of the cooked scene packages written by vksr_cook and read by loadPackage. No Vulkan dependency.
+// A package is a header followed by tables of the POD structs below, every table starts 16 byte aligned.
+// The mesh and image payloads sit in the data section exactly as the GPU takes them, so loading a package
+// is mapping it and copying the payloads into staging memory, with no parsing or conversion per element.
+// Packages are tied to the engine version that cooked them, a version mismatch means recooking.
+
+#include <cstdint>
+#include <string_view>
+
+namespace package {
+	constexpr uint32_t MAGIC = 0x4B505356; // "VSPK"
+	constexpr uint32_t VERSION = 4;
+	constexpr std::string_view EXTENSION = ".vkpak";
+
+	constexpr uint32_t NONE = UINT32_MAX; // Index fields without a target
+	constexpr uint64_t ALIGNMENT = 16;
+
+	struct Section {
+		uint64_t offset; // From the start of the file, or of the data section for payloads
+		uint64_t size;   // In bytes
+	};
+
+	// Characters in the strings section, not null terminated
+	struct String {
+		uint32_t offset;
+		uint32_t length;
+	};
+
+	struct Header {
+		uint32_t magic;
+		uint32_t version;
+		Section strings;
+		Section samplers;  // Sampler[]
+		Section images;    // Image[]
+		Section levels;    // Level[]
+		Section textures;  // Texture[]
+		Section materials; // Material[]
+		Section meshes;    // Mesh[]
+		Section surfaces;  // Surface[]
+		Section lods;      // Lod[]
+		Section nodes;     // Node[]
+		Section children;  // uint32_t[], node indices
+		Section instances; // float[16][], EXT_mesh_gpu_instancing matrices
+		Section data;      // Payloads
+	};
+
+	// fastgltf::Filter values, NONE when the glTF did not set one
+	struct Sampler {
+		uint32_t magFilter;
+		uint32_t minFilter;
+	};
+
+	// A full mip chain in a GPU format. Images that failed to decode have no levels
+	struct Image {
+		String name;
+		uint32_t width;
+		uint32_t height;
+		uint32_t format; // VkFormat
+		uint32_t firstLevel;
+		uint32_t levelCount;
+		uint32_t pad;
+		uint64_t hash;   // Resource cache key
+		Section data;
+	};
+
+	// Relative to the data of its image
+	struct Level {
+		uint64_t offset;
+		uint64_t size;
+	};
+
+	// Cooking keeps both sources of a KHR_texture_basisu texture, the loader samples image when the device
+	// supports its format and fallback otherwise
+	struct Texture {
+		uint32_t image; // NONE when no source could be read, it samples the error checkerboard
+		uint32_t fallback; // NONE without a second source
+		uint32_t sampler;
+	};
+
+	struct Material {
+		String name;
+		float colorFactors[4];
+		float metallicFactor;
+		float roughnessFactor;
+		uint32_t alphaMode; // fastgltf::AlphaMode
+		uint32_t colorTexture;
+		uint32_t metalRoughTexture;
+	};
+
+	// data holds the MeshStaging layout of the counts below. Occluders have no GPU data, theirs is the
+	// vec3 positions followed by the uint32_t indices
+	struct Mesh {
+		String name;
+		uint32_t firstSurface;
+		uint32_t surfaceCount;
+		uint32_t vertexCount;
+		uint32_t colorCount;
+		uint32_t meshletCount;
+		uint32_t indexCount;
+		uint32_t indexType; // VkIndexType
+		uint32_t occluderVertexCount;
+		uint32_t occluderIndexCount;
+		uint32_t occluder; // 1 when data holds occluder geometry
+		uint64_t hash; // Resource cache key
+		Section data;
+	};
+
+	struct Surface {
+		uint32_t startIndex;
+		uint32_t count;
+		uint32_t vertexOffset;
+		uint32_t firstMeshlet;
+		uint32_t meshletCount;
+		uint32_t firstLod;
+		uint32_t lodCount;
+		uint32_t material;
+		float origin[3];
+		float sphereRadius;
+		float extents[3];
+		uint32_t pad;
+	};
+
+	struct Lod {
+		uint32_t startIndex;
+		uint32_t count;
+		float error;
+	};
+
+	struct Node {
+		String name;
+		uint32_t mesh;
+		uint32_t firstChild;
+		uint32_t childCount;
+		uint32_t firstInstance;
+		uint32_t instanceCount;
+		float transform[16]; // Local, column major
+	};
+}
@@ -0,0 +1,164 @@
+#include "texture_cache.h"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <thread>
+#include <vector>
+
+namespace {
+	constexpr const char* EXTENSION = ".ktx2";
+
+	// A hit writes the modification time only when the persisted one is older than this
+	constexpr std::chrono::hours PERSIST_INTERVAL{ 1 };
+}
+
+std::filesystem::path TextureCache::entry_path(uint64_t key) const {
+	return directory / (fmt::format("{:016x}", key) + EXTENSION);
+}
+
+void TextureCache::open(const std::filesystem::path& cacheDirectory, uint64_t cacheMaxBytes) {
+	std::lock_guard lock(mutex);
+	maxBytes = cacheMaxBytes;
+	totalBytes = 0;
+	entries.clear();
+	order.clear();
+
+	std::error_code error;
+	directory = std::filesystem::absolute(cacheDirectory, error);
+	if (error) {
+		directory = cacheDirectory;
+	}
+	std::filesystem::create_directories(directory, error);
+	if (error) {
+		fmt::println("Texture cache disabled, can not create {}: {}", directory.string(), error.message());
+		enabled = false;
+		return;
+	}
+
+	struct Found {
+		uint64_t key;
+		uint64_t size;
+		std::filesystem::file_time_type lastUse;
+	};
+	std::vector<Found> found;
+
+	for (const std::filesystem::directory_entry& file : std::filesystem::directory_iterator(directory, error)) {
+		if (!file.is_regular_file() || file.path().extension() != EXTENSION) {
+			continue;
+		}
+
+		// Anything not named like an entry is left alone, e.g. temporary files of a crashed run
+		const std::string stem = file.path().stem().string();
+		char* end = nullptr;
+		const uint64_t key = std::strtoull(stem.c_str(), &end, 16);
+		if (stem.size() != 16 || *end != '\0') {
+			continue;
+		}
+
+		found.push_back({ key, file.file_size(), file.last_write_time() });
+	}
+
+	std::sort(found.begin(), found.end(), [](const Found& a, const Found& b) { return a.lastUse < b.lastUse; });
+	for (const Found& f : found) {
+		insert(f.key, f.size, f.lastUse);
+	}
+
+	enabled = true;
+	evict();
+}
+
+bool TextureCache::load(uint64_t key, MappedFile& file) {
+	std::filesystem::path path;
+	{
+		std::lock_guard lock(mutex);
+		if (!enabled) {
+			return false;
+		}
+
+		auto it = entries.find(key);
+		if (it == entries.end()) {
+			return false;
+		}
+
+		path = entry_path(key);
+		order.splice(order.begin(), order, it->second.order);
+
+		// Persist the use for the next run, a failure only costs LRU accuracy
+		const std::filesystem::file_time_type now = std::filesystem::file_time_type::clock::now();
+		if (now - it->second.persistedUse > PERSIST_INTERVAL) {
+			std::error_code error;
+			std::filesystem::last_write_time(path, now, error);
+			it->second.persistedUse = now;
+		}
+	}
+
+	// Mapped outside of the lock, another thread may evict the entry meanwhile and that is a miss
+	return file.open(path);
+}
+
+void TextureCache::store(uint64_t key, std::span<const std::byte> bytes) {
+	std::filesystem::path path;
+	{
+		std::lock_guard lock(mutex);
+		if (!enabled || entries.contains(key) || bytes.size() > maxBytes) {
+			return;
+		}
+		path = entry_path(key);
+	}
+
+	// Unique per thread, two threads decoding the same image write different files and the rename picks one
+	std::filesystem::path temporary = path;
+	temporary += fmt::format(".{}.tmp", std::hash<std::thread::id>{}(std::this_thread::get_id()));
+	{
+		std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+		out.write((const char*)bytes.data(), (std::streamsize)bytes.size());
+		if (!out) {
+			out.close();
+			std::error_code error;
+			std::filesystem::remove(temporary, error);
+			return;
+		}
+	}
+
+	std::error_code error;
+	std::filesystem::rename(temporary, path, error);
+	if (error) {
+		std::filesystem::remove(temporary, error);
+		return;
+	}
+
+	std::lock_guard lock(mutex);
+	if (!entries.contains(key)) {
+		insert(key, bytes.size(), std::filesystem::file_time_type::clock::now());
+	}
+	evict();
+}
+
+uint64_t TextureCache::size_bytes() {
+	std::lock_guard lock(mutex);
+	return totalBytes;
+}
+
+void TextureCache::insert(uint64_t key, uint64_t size, std::filesystem::file_time_type lastUse) {
+	order.push_front(key);
+	entries[key] = Entry{ size, lastUse, order.begin() };
+	totalBytes += size;
+}
+
+void TextureCache::evict() {
+	while (totalBytes > maxBytes && !order.empty()) {
+		const uint64_t oldest = order.back();
+
+		// A file that is mapped right now can not be deleted on every OS, it is still dropped from the index
+		std::error_code error;
+		std::filesystem::remove(entry_path(oldest), error);
+
+		totalBytes -= entries[oldest].size;
+		entries.erase(oldest);
+		order.pop_back();
+	}
+}
@@ -0,0 +1,54 @@
+#pragma once
+// texture_cache.h
+
+// Directory of decoded textures on disk, one file per texture named after the content hash of its source
+// image. No Vulkan dependency and safe to use from several loader threads at once.
+// The total size is bounded, the least recently used files are deleted first. The order is kept in memory and
+// persisted coarsely through the file modification time, a hit only touches the file once per PERSIST_INTERVAL,
+// so the order survives restarts without a filesystem write per load.
+
+#include <mapped_file.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <list>
+#include <mutex>
+#include <span>
+#include <unordered_map>
+
+class TextureCache {
+public:
+	// Creates the directory when it does not exist and indexes the files already in it, oldest modification
+	// first. A relative directory is made absolute against the current directory once, here. Without a call to
+	// open the cache stays disabled, load always misses and store does nothing
+	void open(const std::filesystem::path& directory, uint64_t maxBytes);
+
+	// Maps the file of key and marks it most recently used. False on a miss
+	bool load(uint64_t key, MappedFile& file);
+
+	// Writes the file of key, then evicts least recently used files until the cache fits its size again.
+	// Writes go to a temporary file first, a crash never leaves a partial entry behind
+	void store(uint64_t key, std::span<const std::byte> bytes);
+
+	uint64_t size_bytes();
+
+private:
+	struct Entry {
+		uint64_t size;
+		std::filesystem::file_time_type persistedUse; // Last use written to the file
+		std::list<uint64_t>::iterator order;
+	};
+
+	std::filesystem::path directory;
+	uint64_t maxBytes{ 0 };
+	uint64_t totalBytes{ 0 };
+	bool enabled{ false };
+
+	std::mutex mutex;
+	std::unordered_map<uint64_t, Entry> entries;
+	std::list<uint64_t> order; // Keys, most recently used first
+
+	std::filesystem::path entry_path(uint64_t key) const;
+	void insert(uint64_t key, uint64_t size, std::filesystem::file_time_type lastUse);
+	void evict();
+};
@@ -0,0 +1,104 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(uint32_t workerCount) {
+	for (uint32_t i = 0; i < workerCount; i++) {
+		_workers.emplace_back(&ThreadPool::worker, this);
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard lock(_mutex);
+		_stopping = true;
+	}
+	_wake.notify_all();
+
+	for (std::thread& worker : _workers) {
+		worker.join();
+	}
+}
+
+void ThreadPool::parallel_for(size_t count, const std::function<void(size_t)>& task) {
+	if (count == 0) {
+		return;
+	}
+
+	std::shared_ptr<Loop> loop = std::make_shared<Loop>();
+	loop->task = &task;
+	loop->count = count;
+
+	if (count > 1 && !_workers.empty()) {
+		{
+			std::lock_guard lock(_mutex);
+			_loops.push_back(loop);
+		}
+		_wake.notify_all();
+	}
+
+	run(*loop);
+
+	// Workers may still be inside the last indices
+	{
+		std::unique_lock lock(loop->mutex);
+		loop->finished.wait(lock, [&]() { return loop->done == loop->count; });
+	}
+
+	{
+		std::lock_guard lock(_mutex);
+		auto it = std::find(_loops.begin(), _loops.end(), loop);
+		if (it != _loops.end()) {
+			_loops.erase(it);
+		}
+	}
+
+	if (loop->error) {
+		std::rethrow_exception(loop->error);
+	}
+}
+
+void ThreadPool::run(Loop& loop) {
+	for (size_t i = loop.next++; i < loop.count; i = loop.next++) {
+		try {
+			(*loop.task)(i);
+		}
+		catch (...) {
+			std::lock_guard lock(loop.mutex);
+			if (!loop.error) {
+				loop.error = std::current_exception();
+			}
+
+			// Nobody starts the indices past next anymore, they count as done right away
+			const size_t skipped = loop.count - std::min(loop.next.exchange(loop.count), loop.count);
+			loop.done += skipped;
+		}
+
+		if (++loop.done == loop.count) {
+			std::lock_guard lock(loop.mutex);
+			loop.finished.notify_all();
+		}
+	}
+}
+
+void ThreadPool::worker() {
+	while (true) {
+		std::shared_ptr<Loop> loop;
+		{
+			std::unique_lock lock(_mutex);
+			_wake.wait(lock, [&]() { return _stopping || !_loops.empty(); });
+			if (_stopping) {
+				return;
+			}
+
+			// Loops without indices left only wait for the ones in flight, nothing to take
+			loop = _loops.front();
+			if (loop->next >= loop->count) {
+				_loops.pop_front();
+				continue;
+			}
+		}
+
+		run(*loop);
+	}
+}
@@ -0,0 +1,56 @@
+#pragma once
+// thread_pool.h
+
+// Persistent worker threads for data parallel loops. The threads are started once and sleep between loops,
+// so a loop costs a wake-up instead of creating and joining threads. No Vulkan dependency.
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+public:
+	// Starts workerCount threads, the caller of parallel_for is one more. 0 runs every loop on the caller
+	explicit ThreadPool(uint32_t workerCount);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	uint32_t worker_count() const { return (uint32_t)_workers.size(); }
+
+	// Runs task(i) for every i in [0, count) and returns when all are done. The calling thread takes part, so
+	// a task may start a loop of its own. Several threads may run loops at once, the workers share them.
+	// When a task throws, the indices nobody started yet are skipped and the first exception is rethrown here
+	void parallel_for(size_t count, const std::function<void(size_t)>& task);
+
+private:
+	struct Loop {
+		const std::function<void(size_t)>* task;
+		size_t count;
+		std::atomic<size_t> next{ 0 };
+		std::atomic<size_t> done{ 0 };
+
+		std::mutex mutex;
+		std::condition_variable finished;
+		std::exception_ptr error;
+	};
+
+	// Takes indices of the loop until none are left
+	static void run(Loop& loop);
+	void worker();
+
+	std::mutex _mutex;
+	std::condition_variable _wake;
+	std::deque<std::shared_ptr<Loop>> _loops; // Loops with indices left to take, oldest first
+	bool _stopping{ false };
+
+	std::vector<std::thread> _workers;
+};
@@ -0,0 +1,69 @@
+#include "transform_hierarchy.h"
+
+#include <algorithm>
+#include <cassert>
+
+uint32_t TransformHierarchy::add(uint32_t parent, const glm::mat4& localTransform) {
+	const uint32_t index = (uint32_t)_parents.size();
+
+	// Anything else would split the parent's subtree range
+	assert(parent == NO_PARENT || _subtreeEnds[parent] == index);
+
+	_parents.push_back(parent);
+	_subtreeEnds.push_back(index + 1);
+	_locals.push_back(localTransform);
+	_worlds.push_back(parent == NO_PARENT ? localTransform : _worlds[parent] * localTransform);
+	_dirty.push_back(0);
+
+	for (uint32_t p = parent; p != NO_PARENT; p = _parents[p]) {
+		_subtreeEnds[p] = index + 1;
+	}
+
+	return index;
+}
+
+void TransformHierarchy::set_local(uint32_t index, const glm::mat4& localTransform) {
+	_locals[index] = localTransform;
+
+	if (!_dirty[index]) {
+		_dirty[index] = 1;
+		_dirtyRoots.push_back(index);
+	}
+}
+
+void TransformHierarchy::update(std::vector<uint32_t>& changed) {
+	if (_dirtyRoots.empty()) {
+		return;
+	}
+
+	// In index order a dirty node below an earlier dirty node is covered by that node's range
+	std::sort(_dirtyRoots.begin(), _dirtyRoots.end());
+
+	uint32_t covered = 0;
+	for (uint32_t root : _dirtyRoots) {
+		_dirty[root] = 0;
+		if (root < covered) {
+			continue;
+		}
+
+		covered = _subtreeEnds[root];
+		update_range(root, covered);
+
+		for (uint32_t i = root; i < covered; i++) {
+			changed.push_back(i);
+		}
+	}
+
+	_dirtyRoots.clear();
+}
+
+void TransformHierarchy::update_range(uint32_t begin, uint32_t end) {
+	const uint32_t* parents = _parents.data();
+	const glm::mat4* locals = _locals.data();
+	glm::mat4* worlds = _worlds.data();
+
+	for (uint32_t i = begin; i < end; i++) {
+		const uint32_t p = parents[i];
+		worlds[i] = (p == NO_PARENT) ? locals[i] : worlds[p] * locals[i];
+	}
+}
@@ -0,0 +1,49 @@
+#pragma once
+// transform_hierarchy.h
+
+// Flat storage of a node hierarchy's transforms. No Vulkan dependency.
+//
+// Nodes are added in depth first order, parent before child, so every subtree is one contiguous
+// index range. Local and world matrices sit in their own arrays and a dirty node only recomputes
+// its own range, in a single linear pass where each parent is already done when its children read it.
+// Ranges of different dirty subtrees never overlap and can be processed independently.
+
+#include <vector>
+#include <cstdint>
+
+#include <glm/mat4x4.hpp>
+
+class TransformHierarchy {
+public:
+	static constexpr uint32_t NO_PARENT = UINT32_MAX;
+
+	// parent has to be NO_PARENT or the last node whose subtree is still open, as in a depth first walk
+	uint32_t add(uint32_t parent, const glm::mat4& localTransform);
+
+	void set_local(uint32_t index, const glm::mat4& localTransform);
+
+	const glm::mat4& local(uint32_t index) const { return _locals[index]; }
+	const glm::mat4& world(uint32_t index) const { return _worlds[index]; }
+	uint32_t parent(uint32_t index) const { return _parents[index]; }
+	// One past the last descendant of index
+	uint32_t subtree_end(uint32_t index) const { return _subtreeEnds[index]; }
+	size_t size() const { return _parents.size(); }
+
+	bool is_dirty() const { return !_dirtyRoots.empty(); }
+
+	// Recomputes the world matrices below every dirty node. Every node that got a new world matrix
+	// is appended to changed, in increasing order
+	void update(std::vector<uint32_t>& changed);
+
+	// Recomputes [begin, end), the parent of begin has to be up to date
+	void update_range(uint32_t begin, uint32_t end);
+
+private:
+	std::vector<uint32_t> _parents;
+	std::vector<uint32_t> _subtreeEnds;
+	std::vector<glm::mat4> _locals;
+	std::vector<glm::mat4> _worlds;
+
+	std::vector<uint8_t> _dirty;
+	std::vector<uint32_t> _dirtyRoots;
+};
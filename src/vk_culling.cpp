@@ -0,0 +1,308 @@
+#include <vk_culling.h>
+
+#include <vk_engine.h>
+#include <vk_images.h>
+#include <vk_initializers.h>
+#include <vk_pipelines.h>
+
+//> OcclusionCuller
+void OcclusionCuller::init(VkSREngine* engine) {
+	vk::Device device = engine->_device;
+
+	// Sampler used for texelFetch on the depth image and the pyramid, filtering is never used
+	vk::SamplerCreateInfo samplerInfo = {};
+	samplerInfo.magFilter = vk::Filter::eNearest;
+	samplerInfo.minFilter = vk::Filter::eNearest;
+	samplerInfo.mipmapMode = vk::SamplerMipmapMode::eNearest;
+	samplerInfo.addressModeU = vk::SamplerAddressMode::eClampToEdge;
+	samplerInfo.addressModeV = vk::SamplerAddressMode::eClampToEdge;
+	samplerInfo.maxLod = vk::LodClampNone;
+
+	VK_CHECK(device.createSampler(&samplerInfo, nullptr, &pyramidSampler));
+
+	//> depth_pyramid
+	// The pyramid is sized after the depth image so it never has to be recreated on resize. Levels halve
+	// rounding down like every mip chain, build_pyramid uses the same rule for the part it fills
+	vk::Extent3D pyramidExtent = {
+		std::max(engine->_depthImage.imageExtent.width / 2, 1u),
+		std::max(engine->_depthImage.imageExtent.height / 2, 1u),
+		1
+	};
+
+	// Transfer source so the levels can be read back by the tests
+	depthPyramid = engine->create_image(pyramidExtent, vk::Format::eR32G32Sfloat, vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferSrc, true);
+	pyramidLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(pyramidExtent.width, pyramidExtent.height)))) + 1;
+
+	// One view per level for the reduction writes, the full chain view from create_image is used for sampling
+	for (uint32_t i = 0; i < pyramidLevels; i++) {
+		vk::ImageViewCreateInfo viewInfo = vkinit::imageview_create_info(depthPyramid.imageFormat, depthPyramid.image, vk::ImageAspectFlagBits::eColor);
+		viewInfo.subresourceRange.baseMipLevel = i;
+
+		vk::ImageView mipView;
+		VK_CHECK(device.createImageView(&viewInfo, nullptr, &mipView));
+		pyramidMips.push_back(mipView);
+	}
+
+	// The pyramid lives in the general layout, it is both written as a storage image and sampled
+	engine->immediate_submit([&](vk::CommandBuffer cmd) {
+		vkutil::transition_image(cmd, depthPyramid.image, vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral);
+		});
+	//< depth_pyramid
+
+	//> reduce_pipeline
+	{
+		DescriptorLayoutBuilder builder;
+		builder.add_binding(0, vk::DescriptorType::eCombinedImageSampler);
+		builder.add_binding(1, vk::DescriptorType::eStorageImage);
+		builder.add_binding(2, vk::DescriptorType::eStorageImage);
+		reduceLayout = builder.build(device, vk::ShaderStageFlagBits::eCompute);
+	}
+
+	vk::PushConstantRange reducePushConstant = {};
+	reducePushConstant.offset = 0;
+	reducePushConstant.size = sizeof(HiZReducePushConstants);
+	reducePushConstant.stageFlags = vk::ShaderStageFlagBits::eCompute;
+
+	vk::PipelineLayoutCreateInfo reduceLayoutInfo = vkinit::pipeline_layout_create_info();
+	reduceLayoutInfo.setLayoutCount = 1;
+	reduceLayoutInfo.pSetLayouts = &reduceLayout;
+	reduceLayoutInfo.pushConstantRangeCount = 1;
+	reduceLayoutInfo.pPushConstantRanges = &reducePushConstant;
+
+	VK_CHECK(device.createPipelineLayout(&reduceLayoutInfo, nullptr, &reducePipelineLayout));
+
+	vk::ShaderModule reduceShader;
+	const char* reducePath = "../../shaders/hiz_reduce.comp.spv";
+	if (!vkutil::load_shader_module(reducePath, device, &reduceShader)) {
+		fmt::println("Error when building the shader module at path: {}", reducePath);
+	}
+
+	vk::ComputePipelineCreateInfo reducePipelineInfo = {};
+	reducePipelineInfo.layout = reducePipelineLayout;
+	reducePipelineInfo.stage = vkinit::pipeline_shader_stage_create_info(vk::ShaderStageFlagBits::eCompute, reduceShader);
+
+	VK_CHECK(device.createComputePipelines(VK_NULL_HANDLE, 1, &reducePipelineInfo, nullptr, &reducePipeline));
+
+	device.destroyShaderModule(reduceShader, nullptr);
+	//< reduce_pipeline
+
+	//> cull_pipeline
+	{
+		DescriptorLayoutBuilder builder;
+		builder.add_binding(0, vk::DescriptorType::eStorageBuffer);
+		builder.add_binding(1, vk::DescriptorType::eStorageBuffer);
+		builder.add_binding(2, vk::DescriptorType::eStorageBuffer);
+		builder.add_binding(3, vk::DescriptorType::eStorageBuffer);
+		builder.add_binding(4, vk::DescriptorType::eCombinedImageSampler);
+		cullLayout = builder.build(device, vk::ShaderStageFlagBits::eCompute);
+	}
+
+	vk::PushConstantRange cullPushConstant = {};
+	cullPushConstant.offset = 0;
+	cullPushConstant.size = sizeof(CullPushConstants);
+	cullPushConstant.stageFlags = vk::ShaderStageFlagBits::eCompute;
+
+	vk::PipelineLayoutCreateInfo cullLayoutInfo = vkinit::pipeline_layout_create_info();
+	cullLayoutInfo.setLayoutCount = 1;
+	cullLayoutInfo.pSetLayouts = &cullLayout;
+	cullLayoutInfo.pushConstantRangeCount = 1;
+	cullLayoutInfo.pPushConstantRanges = &cullPushConstant;
+
+	VK_CHECK(device.createPipelineLayout(&cullLayoutInfo, nullptr, &cullPipelineLayout));
+
+	vk::ShaderModule cullShader;
+	const char* cullPath = "../../shaders/occlusion_cull.comp.spv";
+	if (!vkutil::load_shader_module(cullPath, device, &cullShader)) {
+		fmt::println("Error when building the shader module at path: {}", cullPath);
+	}
+
+	vk::ComputePipelineCreateInfo cullPipelineInfo = {};
+	cullPipelineInfo.layout = cullPipelineLayout;
+	cullPipelineInfo.stage = vkinit::pipeline_shader_stage_create_info(vk::ShaderStageFlagBits::eCompute, cullShader);
+
+	VK_CHECK(device.createComputePipelines(VK_NULL_HANDLE, 1, &cullPipelineInfo, nullptr, &cullPipeline));
+
+	device.destroyShaderModule(cullShader, nullptr);
+	//< cull_pipeline
+
+	//> reduce_descriptors
+	// The depth image and the pyramid never change, so the per-level sets are written once
+	std::vector<DescriptorAllocatorGrowable::PoolSizeRatio> sizes = {
+		{vk::DescriptorType::eCombinedImageSampler, 1},
+		{vk::DescriptorType::eStorageImage, 2}
+	};
+
+	descriptorPool.init(device, pyramidLevels, sizes);
+
+	DescriptorWriter writer;
+	for (uint32_t i = 0; i < pyramidLevels; i++) {
+		vk::DescriptorSet set = descriptorPool.allocate(device, reduceLayout);
+
+		// Level 0 reads from the depth image, the source binding just has to be valid
+		vk::ImageView srcView = (i == 0) ? pyramidMips[0] : pyramidMips[i - 1];
+
+		writer.clear();
+		writer.write_image(0, engine->_depthImage.imageView, pyramidSampler, vk::ImageLayout::eDepthReadOnlyOptimal, vk::DescriptorType::eCombinedImageSampler);
+		writer.write_image(1, srcView, VK_NULL_HANDLE, vk::ImageLayout::eGeneral, vk::DescriptorType::eStorageImage);
+		writer.write_image(2, pyramidMips[i], VK_NULL_HANDLE, vk::ImageLayout::eGeneral, vk::DescriptorType::eStorageImage);
+		writer.update_set(device, set);
+
+		reduceSets.push_back(set);
+	}
+	//< reduce_descriptors
+
+	// Host visible counters so the results can be shown in the stats window
+	for (int i = 0; i < FRAME_OVERLAP; i++) {
+		engine->_frames[i]._cullStatsBuffer = engine->create_buffer(sizeof(GPUCullStats), vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst, vma::MemoryUsage::eGpuToCpu);
+		memset(engine->_frames[i]._cullStatsBuffer.info.pMappedData, 0, sizeof(GPUCullStats));
+	}
+}
+
+void OcclusionCuller::clear_resources(VkSREngine* engine) {
+	vk::Device device = engine->_device;
+
+	for (int i = 0; i < FRAME_OVERLAP; i++) {
+		FrameData& frame = engine->_frames[i];
+		engine->destroy_buffer(frame._cullStatsBuffer);
+		if (frame._cullObjectCapacity > 0) {
+			engine->destroy_buffer(frame._cullObjectBuffer);
+			frame._cullObjectCapacity = 0;
+		}
+		frame._changedCullObjects.clear();
+		frame._cullObjectsStale = true;
+	}
+
+	if (visibilityCapacity > 0) {
+		engine->destroy_buffer(visibilityBuffer);
+		visibilityCapacity = 0;
+	}
+
+	descriptorPool.destroy_pools(device);
+
+	device.destroyPipeline(cullPipeline, nullptr);
+	device.destroyPipelineLayout(cullPipelineLayout, nullptr);
+	device.destroyDescriptorSetLayout(cullLayout, nullptr);
+
+	device.destroyPipeline(reducePipeline, nullptr);
+	device.destroyPipelineLayout(reducePipelineLayout, nullptr);
+	device.destroyDescriptorSetLayout(reduceLayout, nullptr);
+
+	for (vk::ImageView view : pyramidMips) {
+		device.destroyImageView(view, nullptr);
+	}
+	pyramidMips.clear();
+
+	engine->destroy_image(depthPyramid);
+	device.destroySampler(pyramidSampler, nullptr);
+}
+
+void OcclusionCuller::prepare_visibility(vk::CommandBuffer cmd, VkSREngine* engine, uint32_t proxyCount) {
+	if (proxyCount <= visibilityCapacity) {
+		return;
+	}
+
+	// The old buffer may still be read by the frame in flight, so retire it with this frame
+	if (visibilityCapacity > 0) {
+		AllocatedBuffer oldBuffer = visibilityBuffer;
+		engine->get_current_frame()._deletionQueue.push_function([=]() {
+			engine->destroy_buffer(oldBuffer);
+			});
+	}
+
+	visibilityCapacity = std::max(proxyCount, visibilityCapacity * 2);
+	visibilityBuffer = engine->create_buffer(visibilityCapacity * sizeof(uint32_t), vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst, vma::MemoryUsage::eGpuOnly);
+
+	cmd.fillBuffer(visibilityBuffer.buffer, 0, vk::WholeSize, 0);
+
+	vkutil::memory_barrier(cmd,
+		vk::PipelineStageFlagBits2::eTransfer, vk::AccessFlagBits2::eTransferWrite,
+		vk::PipelineStageFlagBits2::eComputeShader, vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite);
+}
+
+const AllocatedBuffer& OcclusionCuller::upload_objects(VkSREngine* engine, std::span<const GPUCullObject> objects, std::span<const uint32_t> changed) {
+	for (FrameData& frame : engine->_frames) {
+		if (frame._cullObjectsStale) {
+			continue;
+		}
+
+		// Past the object count a whole copy is cheaper than the scattered writes
+		if (frame._changedCullObjects.size() + changed.size() > objects.size()) {
+			frame._changedCullObjects.clear();
+			frame._cullObjectsStale = true;
+			continue;
+		}
+		frame._changedCullObjects.insert(frame._changedCullObjects.end(), changed.begin(), changed.end());
+	}
+
+	FrameData& frame = engine->get_current_frame();
+	if (objects.size() > frame._cullObjectCapacity) {
+		// Only this frame reads the old buffer, retire it with the frame like the visibility buffer
+		if (frame._cullObjectCapacity > 0) {
+			AllocatedBuffer oldBuffer = frame._cullObjectBuffer;
+			frame._deletionQueue.push_function([=]() {
+				engine->destroy_buffer(oldBuffer);
+				});
+		}
+
+		frame._cullObjectCapacity = std::max((uint32_t)objects.size(), frame._cullObjectCapacity * 2);
+		frame._cullObjectBuffer = engine->create_buffer(frame._cullObjectCapacity * sizeof(GPUCullObject), vk::BufferUsageFlagBits::eStorageBuffer, vma::MemoryUsage::eCpuToGpu);
+		frame._cullObjectsStale = true;
+	}
+
+	GPUCullObject* mapped = (GPUCullObject*)frame._cullObjectBuffer.info.pMappedData;
+	if (frame._cullObjectsStale) {
+		memcpy(mapped, objects.data(), objects.size_bytes());
+	}
+	else {
+		// Indices of objects removed since are past the end now
+		for (uint32_t i : frame._changedCullObjects) {
+			if (i < objects.size()) {
+				mapped[i] = objects[i];
+			}
+		}
+	}
+	frame._changedCullObjects.clear();
+	frame._cullObjectsStale = false;
+
+	return frame._cullObjectBuffer;
+}
+
+void OcclusionCuller::invalidate_objects(VkSREngine* engine) {
+	for (FrameData& frame : engine->_frames) {
+		frame._changedCullObjects.clear();
+		frame._cullObjectsStale = true;
+	}
+}
+
+void OcclusionCuller::build_pyramid(vk::CommandBuffer cmd, vk::Extent2D depthExtent) {
+	cmd.bindPipeline(vk::PipelineBindPoint::eCompute, reducePipeline);
+
+	HiZReducePushConstants pushConstants = {};
+	pushConstants.srcSize = glm::ivec2{ (int)depthExtent.width, (int)depthExtent.height };
+
+	for (uint32_t i = 0; i < pyramidLevels; i++) {
+		// Round down like the image levels, the last texel of a row or column also covers an odd source's remainder
+		pushConstants.dstSize.x = std::max(pushConstants.srcSize.x / 2, 1);
+		pushConstants.dstSize.y = std::max(pushConstants.srcSize.y / 2, 1);
+		pushConstants.fromDepth = (i == 0) ? 1 : 0;
+
+		cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, reducePipelineLayout, 0, 1, &reduceSets[i], 0, nullptr);
+		cmd.pushConstants(reducePipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(HiZReducePushConstants), &pushConstants);
+		cmd.dispatch((pushConstants.dstSize.x + 7) / 8, (pushConstants.dstSize.y + 7) / 8, 1);
+
+		// Next level reads what this one wrote
+		vkutil::memory_barrier(cmd,
+			vk::PipelineStageFlagBits2::eComputeShader, vk::AccessFlagBits2::eShaderStorageWrite,
+			vk::PipelineStageFlagBits2::eComputeShader, vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderSampledRead);
+
+		pushConstants.srcSize = pushConstants.dstSize;
+	}
+}
+
+void OcclusionCuller::cull(vk::CommandBuffer cmd, const CullPushConstants& pushConstants, vk::DescriptorSet cullSet) {
+	cmd.bindPipeline(vk::PipelineBindPoint::eCompute, cullPipeline);
+	cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, cullPipelineLayout, 0, 1, &cullSet, 0, nullptr);
+	cmd.pushConstants(cullPipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(CullPushConstants), &pushConstants);
+	cmd.dispatch((pushConstants.objectCount + 63) / 64, 1, 1);
+}
+//< OcclusionCuller
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <vk_types.h>
+#include <vk_descriptors.h>
+
+#include <glm/vec2.hpp>
+
+// Forward declaration of the engine
+class VkSREngine;
+
+//> gpu_structs
+// Layout of one opaque draw as seen by occlusion_cull.comp
+struct GPUCullObject {
+	glm::mat4 transform;
+	glm::vec4 origin; // w is the bounding sphere radius
+	glm::vec4 extents;
+	uint32_t indexCount;
+	uint32_t firstIndex;
+	int32_t vertexOffset;
+	uint32_t instanceCount;
+	uint32_t firstInstance;
+	uint32_t visibilityIndex; // Id of the proxy, stays with the object when the draw list is repacked
+	uint32_t pad1;
+	uint32_t pad2;
+};
+
+// Counters written by the cull shader, read back once the frame's fence has signaled
+struct GPUCullStats {
+	uint32_t tested;
+	uint32_t visibleEarly;
+	uint32_t visibleLate;
+	uint32_t triangles;
+};
+
+struct HiZReducePushConstants {
+	glm::ivec2 srcSize;
+	glm::ivec2 dstSize;
+	int fromDepth;
+};
+
+struct CullPushConstants {
+	glm::mat4 viewProj;
+	glm::ivec2 viewportSize;
+	uint32_t objectCount;
+	uint32_t latePhase;
+	uint32_t pyramidLevels;
+	uint32_t occlusionEnabled;
+};
+//< gpu_structs
+
+//> OcclusionCuller
+// Hi-Z occlusion culling. The depth of the early pass is reduced into a min/max pyramid which the
+// late pass tests every opaque draw against. Visibility is kept per render proxy between frames.
+struct OcclusionCuller {
+	bool enabled{ true };
+
+	// Depth pyramid, level 0 is half the size of the depth image
+	AllocatedImage depthPyramid;
+	uint32_t pyramidLevels{ 0 };
+	std::vector<vk::ImageView> pyramidMips;
+	vk::Sampler pyramidSampler;
+
+	vk::DescriptorSetLayout reduceLayout;
+	vk::PipelineLayout reducePipelineLayout;
+	vk::Pipeline reducePipeline;
+	std::vector<vk::DescriptorSet> reduceSets;
+
+	vk::DescriptorSetLayout cullLayout;
+	vk::PipelineLayout cullPipelineLayout;
+	vk::Pipeline cullPipeline;
+
+	DescriptorAllocatorGrowable descriptorPool;
+
+	// Persistent per-proxy visibility written by the late phase and read by the next early phase
+	AllocatedBuffer visibilityBuffer;
+	uint32_t visibilityCapacity{ 0 };
+
+	void init(VkSREngine* engine);
+	void clear_resources(VkSREngine* engine);
+
+	// Grows the visibility buffer if needed. A new buffer starts out all hidden so everything goes through the late phase once
+	void prepare_visibility(vk::CommandBuffer cmd, VkSREngine* engine, uint32_t proxyCount);
+
+	// Brings the current frame's copy of the cull objects up to date and returns it. changed are the indices
+	// rewritten since the last call, the other frames in flight write them when they come around
+	const AllocatedBuffer& upload_objects(VkSREngine* engine, std::span<const GPUCullObject> objects, std::span<const uint32_t> changed);
+	// For frames that skip the culling, every copy is written whole the next time
+	void invalidate_objects(VkSREngine* engine);
+
+	void build_pyramid(vk::CommandBuffer cmd, vk::Extent2D depthExtent);
+	void cull(vk::CommandBuffer cmd, const CullPushConstants& pushConstants, vk::DescriptorSet cullSet);
+};
+//< OcclusionCuller
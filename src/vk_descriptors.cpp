@@ -1,10 +1,10 @@
 #include "vk_descriptors.h"
 
 //> DescriptorLayoutBuilder
-void DescriptorLayoutBuilder::add_binding(uint32_t binding, vk::DescriptorType type) {
+void DescriptorLayoutBuilder::add_binding(uint32_t binding, vk::DescriptorType type, uint32_t count) {
 	vk::DescriptorSetLayoutBinding newbind = {};
 	newbind.binding = binding;
-	newbind.descriptorCount = 1;
+	newbind.descriptorCount = count;
 	newbind.descriptorType = type;
 
 	bindings.push_back(newbind);
@@ -175,7 +175,7 @@ vk::DescriptorPool DescriptorAllocatorGrowable::create_pool(vk::Device device, u
 //< DescriptorAllocatorGrowable
 
 //> DescriptorWriter
-void DescriptorWriter::write_image(int binding, vk::ImageView image, vk::Sampler sampler, vk::ImageLayout layout, vk::DescriptorType type) {
+void DescriptorWriter::write_image(int binding, vk::ImageView image, vk::Sampler sampler, vk::ImageLayout layout, vk::DescriptorType type, uint32_t arrayElement) {
 	vk::DescriptorImageInfo& info = imageInfos.emplace_back(vk::DescriptorImageInfo{
 		sampler,
 		image,
@@ -185,6 +185,7 @@ void DescriptorWriter::write_image(int binding, vk::ImageView image, vk::Sampler
 	vk::WriteDescriptorSet write = {};
 	write.dstBinding = binding;
 	write.dstSet = VK_NULL_HANDLE; // Left empty for now until we need to write it
+	write.dstArrayElement = arrayElement;
 	write.descriptorCount = 1;
 	write.descriptorType = type;
 	write.pImageInfo = &info;
@@ -6,7 +6,8 @@
 struct DescriptorLayoutBuilder {
 	std::vector<vk::DescriptorSetLayoutBinding> bindings;
 
-	void add_binding(uint32_t binding, vk::DescriptorType type);
+	// count above 1 declares an array, written element by element
+	void add_binding(uint32_t binding, vk::DescriptorType type, uint32_t count = 1);
 	void clear();
 	vk::DescriptorSetLayout build(vk::Device device, vk::ShaderStageFlags shaderStages, void* pNext = nullptr, vk::DescriptorSetLayoutCreateFlags flags = {});
 };
@@ -59,7 +60,7 @@ struct DescriptorWriter {
 	std::deque<vk::DescriptorBufferInfo> bufferInfos;
 	std::vector<vk::WriteDescriptorSet> writes;
 
-	void write_image(int binding, vk::ImageView image, vk::Sampler sampler, vk::ImageLayout layout, vk::DescriptorType type);
+	void write_image(int binding, vk::ImageView image, vk::Sampler sampler, vk::ImageLayout layout, vk::DescriptorType type, uint32_t arrayElement = 0);
 	void write_buffer(int binding, vk::Buffer buffer, size_t size, size_t offset, vk::DescriptorType type);
 
 	void clear();
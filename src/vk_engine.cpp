@@ -18,9 +18,15 @@
 
 #include <vk_images.h>
 #include <vk_pipelines.h>
+#include <scene_package.h>
 
+#include <algorithm>
 #include <chrono>
+#include <cstdlib>
+#include <filesystem>
 #include <thread>
+#include <limits>
+#include <utility>
 
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/transform.hpp>
@@ -34,6 +40,25 @@
 // and false on release build
 constexpr bool bUseValidationLayers = true;
 
+// Size limit of the decoded texture cache on disk, least recently used textures are deleted past it
+constexpr uint64_t TEXTURE_CACHE_MAX_BYTES = 4ull << 30;
+
+// VKSR_TEXTURE_CACHE when set, otherwise the per-user data directory SDL picks for the app. The working
+// directory is only the last resort, it depends on where the engine was started from
+static std::filesystem::path texture_cache_directory()
+{
+	if (const char* overridden = std::getenv("VKSR_TEXTURE_CACHE"); overridden && *overridden) {
+		return overridden;
+	}
+
+	if (char* pref = SDL_GetPrefPath("VkSR", "VkSREngine")) {
+		std::filesystem::path directory = std::filesystem::path(pref) / "texture_cache";
+		SDL_free(pref);
+		return directory;
+	}
+	return "texture_cache";
+}
+
 VkSREngine* loadedEngine = nullptr;
 
 VkSREngine& VkSREngine::Get() { return *loadedEngine; }
@@ -74,6 +99,9 @@ void VkSREngine::init()
 	init_pipelines();
 	
 	init_default_data();
+
+	// Before the first scene starts loading, its images are looked up there
+	_textureCache.open(texture_cache_directory(), TEXTURE_CACHE_MAX_BYTES);
 	
 	init_renderables();
 	
@@ -121,6 +149,7 @@ void VkSREngine::init_vulkan()
 	vk::PhysicalDeviceVulkan12Features features12{};
 	features12.bufferDeviceAddress = true;
 	features12.descriptorIndexing = true;
+	features12.drawIndirectCount = true;
 
 	// Use VkBootstrap to select a GPU
 	vkb::PhysicalDeviceSelector selector{ vkb_inst };
@@ -132,6 +161,11 @@ void VkSREngine::init_vulkan()
 		.select()
 		.value();
 
+	// Block compressed textures are optional, without them KTX2 textures fall back to their uncompressed source
+	vk::PhysicalDeviceFeatures optionalFeatures{};
+	optionalFeatures.textureCompressionBC = true;
+	_textureCompressionBC = physicalDevice.enable_features_if_present(optionalFeatures);
+
 	// Create the final vulkan device
 	vkb::DeviceBuilder deviceBuilder{ physicalDevice };
 
@@ -166,6 +200,7 @@ void VkSREngine::init_swapchain() {
 		1
 	};
 
+	// Holds display encoded color, mesh.frag encodes its linear shading before writing
 	_drawImage.imageFormat = vk::Format::eR16G16B16A16Sfloat;
 	_drawImage.imageExtent = drawImageExtent;
 
@@ -194,8 +229,12 @@ void VkSREngine::init_swapchain() {
 	_depthImage.imageFormat = vk::Format::eD32Sfloat;
 	_depthImage.imageExtent = drawImageExtent;
 
+	// Sampled so the depth pyramid for occlusion culling can be built from it, a transfer destination so the
+	// tests can fill it
 	vk::ImageUsageFlags depthImageUsages{
-		vk::ImageUsageFlagBits::eDepthStencilAttachment
+		  vk::ImageUsageFlagBits::eDepthStencilAttachment
+		| vk::ImageUsageFlagBits::eSampled
+		| vk::ImageUsageFlagBits::eTransferDst
 	};
 
 	vk::ImageCreateInfo dimg_info = vkinit::image_create_info(_depthImage.imageFormat, depthImageUsages, drawImageExtent);
@@ -420,6 +459,10 @@ void VkSREngine::init_pipelines() {
 	init_compute_pipelines();
 
 	_metalRoughMaterial.build_pipelines(this);
+
+	_occlusionCuller.init(this);
+	_meshletCuller.init(this);
+	_mipGenerator.init(this);
 }
 
 void VkSREngine::init_compute_pipelines() {
@@ -522,11 +565,40 @@ void VkSREngine::init_default_data() {
 
 void VkSREngine::init_renderables() {
 	std::string duckPath = { "..\\..\\assets\\duck\\duck.gltf" };
-	auto duckFile = loadGltf(this, duckPath);
 
-	assert(duckFile.has_value());
+	// Streamed so startup does not wait for it, the duck appears once its meshes are uploaded
+	load_scene_async("duck", duckPath);
+	create_instance("duck", glm::mat4{ 1.f });
+}
+
+void VkSREngine::load_scene_async(const std::string& name, std::string_view filePath) {
+	if (filePath.ends_with(package::EXTENSION)) {
+		_loadedScenes[name] = loadPackageAsync(this, filePath);
+	}
+	else {
+		_loadedScenes[name] = loadGltfAsync(this, filePath);
+	}
+}
+
+void VkSREngine::unload_scene(const std::string& name) {
+	auto it = _loadedScenes.find(name);
+	if (it == _loadedScenes.end()) {
+		return;
+	}
+
+	// Gone from the draw lists from the next recorded frame on, frames already in flight may still use the resources
+	it->second->UnregisterProxies(_mainDrawContext);
+	_retiredScenes.push_back(RetiredScene{ it->second, _frameNumber });
+	_loadedScenes.erase(it);
+}
+
+bool VkSREngine::save_scene_snapshot(const std::string& name, std::string_view filePath) {
+	auto it = _loadedScenes.find(name);
+	if (it == _loadedScenes.end()) {
+		return false;
+	}
 
-	_loadedScenes["duck"] = *duckFile;
+	return saveSnapshot(this, *it->second, filePath);
 }
 //< init_default_data
 
@@ -640,14 +712,25 @@ void VkSREngine::cleanup()
 		// Ensure that GPU has stopped all work
 		_device.waitIdle();
 
+		_mainDrawContext.clear();
 		_loadedScenes.clear();
+		_retiredScenes.clear();
+		_resourceCache.clear_resources(this);
 
 		for (auto& frame : _frames) {
 			frame._deletionQueue.flush();
+			if (frame._instanceCapacity > 0) {
+				destroy_buffer(frame._instanceBuffer);
+				frame._instanceCapacity = 0;
+			}
 		}
 
 		_metalRoughMaterial.clear_resources(_device);
 
+		_occlusionCuller.clear_resources(this);
+		_meshletCuller.clear_resources(this);
+		_mipGenerator.clear_resources(this);
+
 		_mainDeletionQueue.flush();
 
 		destroy_swapchain();
@@ -720,6 +803,28 @@ void VkSREngine::draw() {
 	get_current_frame()._deletionQueue.flush();
 	get_current_frame()._frameDescriptors.clear_pools(_device);
 
+	// Every frame up to _frameNumber - FRAME_OVERLAP has finished now, destroy the scenes unloaded in them.
+	// Scenes still importing in the background wait, destroying them would block on the import
+	std::erase_if(_retiredScenes, [&](const RetiredScene& retired) {
+		return retired.frameNumber <= _frameNumber - (int)FRAME_OVERLAP && !retired.scene->is_importing();
+		});
+
+	// The fence has signaled, so the culling counters of the last time this frame was rendered can be read
+	if (_occlusionCuller.enabled) {
+		GPUCullStats* cullStats = (GPUCullStats*)get_current_frame()._cullStatsBuffer.info.pMappedData;
+		_stats.occlusion_tested = cullStats->tested;
+		_stats.occlusion_visible_early = cullStats->visibleEarly;
+		_stats.occlusion_visible_late = cullStats->visibleLate;
+		_stats.occlusion_triangle_count = cullStats->triangles;
+	}
+
+	if (_meshletCuller.enabled && !_occlusionCuller.enabled) {
+		GPUMeshletStats* meshletStats = (GPUMeshletStats*)get_current_frame()._meshletStatsBuffer.info.pMappedData;
+		_stats.meshlets_tested = meshletStats->tested;
+		_stats.meshlets_visible = meshletStats->visible;
+		_stats.meshlet_triangle_count = meshletStats->triangles;
+	}
+
 	// Request an image from the swapchain
 	uint32_t swapchainImageIndex;
 
@@ -747,6 +852,8 @@ void VkSREngine::draw() {
 	vk::CommandBufferBeginInfo cmdBeginInfo = vkinit::command_buffer_begin_info(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
 	VK_CHECK(cmd.begin(&cmdBeginInfo));
 
+	// Background loaded scenes upload their share for this frame before anything reads them
+	update_streaming(cmd);
 
 	// Transition draw image and depth image into general layout so that we can write into it.
 	// It will all be overwritten so don't care about the older layout.
@@ -836,13 +943,7 @@ void VkSREngine::draw_main(vk::CommandBuffer cmd) {
 	//< Compute draws
 
 	//> geometry draws
-	vk::RenderingAttachmentInfo colorAttachment = vkinit::attachment_info(_drawImage.imageView, nullptr, vk::ImageLayout::eGeneral);
-	vk::RenderingAttachmentInfo depthAttachment = vkinit::depth_attachment_info(_depthImage.imageView, vk::ImageLayout::eDepthAttachmentOptimal);
-
-	vk::RenderingInfo renderInfo = vkinit::rendering_info(_windowExtent, &colorAttachment, &depthAttachment);
-
-	cmd.beginRendering(&renderInfo);
-
+	// draw_geometry begins and ends the rendering itself, since occlusion culling splits it in two passes
 	auto start = std::chrono::system_clock::now();
 	
 	draw_geometry(cmd);
@@ -850,35 +951,150 @@ void VkSREngine::draw_main(vk::CommandBuffer cmd) {
 	auto end = std::chrono::system_clock::now();
 	auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
 	_stats.mesh_draw_time = elapsed.count() / 1000.f;
-
-	cmd.endRendering();
 	//< geometry draws
 }
 
+vk::DeviceAddress VkSREngine::upload_instances(uint32_t instanceTotal) {
+	DrawContext& ctx = _mainDrawContext;
+
+	// Every frame in flight has its own buffer, each picks up the changes it missed when it comes around
+	for (FrameData& frame : _frames) {
+		if (ctx.instanceLayoutChanged || frame._changedInstances.size() + ctx.changedInstances.size() > ctx.proxies.size()) {
+			frame._changedInstances.clear();
+			frame._instancesStale = true;
+		}
+		else if (!frame._instancesStale) {
+			frame._changedInstances.insert(frame._changedInstances.end(), ctx.changedInstances.begin(), ctx.changedInstances.end());
+		}
+	}
+	ctx.changedInstances.clear();
+	ctx.instanceLayoutChanged = false;
+
+	if (instanceTotal == 0) {
+		return 0;
+	}
+
+	FrameData& frame = get_current_frame();
+	if (instanceTotal > frame._instanceCapacity) {
+		if (frame._instanceCapacity > 0) {
+			AllocatedBuffer oldBuffer = frame._instanceBuffer;
+			frame._deletionQueue.push_function([=, this]() {
+				destroy_buffer(oldBuffer);
+				});
+		}
+
+		frame._instanceCapacity = std::max(instanceTotal, frame._instanceCapacity * 2);
+		frame._instanceBuffer = create_buffer(frame._instanceCapacity * sizeof(glm::mat4), vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress, vma::MemoryUsage::eCpuToGpu);
+		frame._instancesStale = true;
+
+		vk::BufferDeviceAddressInfo instanceAddressInfo = {};
+		instanceAddressInfo.buffer = frame._instanceBuffer.buffer;
+		frame._instanceBufferAddress = _device.getBufferAddress(&instanceAddressInfo);
+	}
+
+	// Proxies removed or no longer instanced since they changed are skipped
+	glm::mat4* instanceData = (glm::mat4*)frame._instanceBuffer.info.pMappedData;
+	auto write_instances = [&](const InstanceRange& range) {
+		const RenderProxy& proxy = ctx.proxies[range.proxy];
+		if (proxy.objectIndex == UINT32_MAX) {
+			return;
+		}
+
+		const RenderObject& r = (proxy.transparent ? ctx.TransparentSurfaces : ctx.OpaqueSurfaces)[proxy.objectIndex];
+		if (r.instanceCount > 1 && r.instanceCount == proxy.transforms.size() && range.first + range.count <= r.instanceCount) {
+			memcpy(instanceData + r.firstInstance + range.first, proxy.transforms.data() + range.first, range.count * sizeof(glm::mat4));
+		}
+		};
+
+	if (frame._instancesStale) {
+		for (const std::vector<uint32_t>* owners : { &ctx.opaqueProxies, &ctx.transparentProxies }) {
+			for (uint32_t id : *owners) {
+				write_instances(InstanceRange{ id, 0, (uint32_t)ctx.proxies[id].transforms.size() });
+			}
+		}
+	}
+	else {
+		for (const InstanceRange& range : frame._changedInstances) {
+			write_instances(range);
+		}
+	}
+	frame._changedInstances.clear();
+	frame._instancesStale = false;
+
+	return frame._instanceBufferAddress;
+}
+
 void VkSREngine::draw_geometry(vk::CommandBuffer cmd) {
 	std::vector<uint32_t> opaque_draws;
 
 	opaque_draws.reserve(_mainDrawContext.OpaqueSurfaces.size());
 
-	// Perform culling, that is decide which surfaces should be drawn depending on if they are in view
-	for (uint32_t i = 0; i < _mainDrawContext.OpaqueSurfaces.size(); i++) {
-		//if (is_visible(_mainDrawContext.OpaqueSurfaces[i], _sceneData.viewproj)) {
-		//	opaque_draws.push_back(i);
-		//}
-		opaque_draws.push_back(i);
+	// Rasterize the occluders on the CPU so hidden surfaces never get their commands recorded
+	const bool useSoftwareOcclusion = _useSoftwareOcclusion && !_mainDrawContext.Occluders.empty();
+	_stats.sw_occluded_count = 0;
+	_stats.sw_occlusion_time = 0.f;
+
+	if (useSoftwareOcclusion) {
+		auto swStart = std::chrono::system_clock::now();
+
+		_occlusionRasterizer.begin_frame(_sceneData.viewproj);
+		for (const OccluderInstance& occluder : _mainDrawContext.Occluders) {
+			// Slots of unloaded scenes
+			if (!occluder.geometry) {
+				continue;
+			}
+			_occlusionRasterizer.add_occluder(*occluder.geometry, occluder.transform);
+		}
+		_occlusionRasterizer.rasterize();
+
+		auto swEnd = std::chrono::system_clock::now();
+		auto swElapsed = std::chrono::duration_cast<std::chrono::microseconds>(swEnd - swStart);
+		_stats.sw_occlusion_time = swElapsed.count() / 1000.f;
 	}
 
-	// Sort the opaque surfaces by material and mesh
-	std::sort(opaque_draws.begin(), opaque_draws.end(), [&](const auto& iA, const auto& iB) {
-		const RenderObject& A = _mainDrawContext.OpaqueSurfaces[iA];
-		const RenderObject& B = _mainDrawContext.OpaqueSurfaces[iB];
-		if (A.material == B.material) {
-			return A.indexBuffer < B.indexBuffer;
+	auto is_occluded = [&](const RenderObject& r) {
+		if (useSoftwareOcclusion && !_occlusionRasterizer.is_visible(r.bounds.origin, r.bounds.extents, r.transform)) {
+			_stats.sw_occluded_count++;
+			return true;
 		}
-		else {
-			return A.material < B.material;
+		return false;
+		};
+
+	// Sorts a draw list by the keys DrawContext keeps for the current camera. The entries keep last frame's
+	// order while the list size is unchanged, so a static scene is already sorted and the radix sort returns
+	// right away
+	auto sort_draws = [&](std::vector<DrawSortEntry>& entries, const std::vector<RenderObject>& surfaces) {
+		if (entries.size() != surfaces.size()) {
+			entries.resize(surfaces.size());
+			for (uint32_t i = 0; i < entries.size(); i++) {
+				entries[i].index = i;
+			}
 		}
-		});
+
+		for (DrawSortEntry& e : entries) {
+			e.key = surfaces[e.index].sortKey;
+		}
+
+		drawsort::sort(entries, _drawSortScratch);
+		};
+
+	// Opaque surfaces by pipeline, material and mesh, front-to-back inside each group.
+	// opaque_draws keeps indices into OpaqueSurfaces, the GPU culling buffers are laid out by them
+	sort_draws(_opaqueSortEntries, _mainDrawContext.OpaqueSurfaces);
+	for (const DrawSortEntry& e : _opaqueSortEntries) {
+		if (is_occluded(_mainDrawContext.OpaqueSurfaces[e.index])) {
+			continue;
+		}
+		opaque_draws.push_back(e.index);
+	}
+
+	// Transparent surfaces back-to-front
+	sort_draws(_transparentSortEntries, _mainDrawContext.TransparentSurfaces);
+
+	//> instance buffer
+	// World matrices of the instanced objects, only the copies that moved are written
+	const vk::DeviceAddress instanceBufferAddress = upload_instances(_mainDrawContext.assign_instances());
+	//< instance buffer
 
 	// Allocate a new uniform buffer for the scene data
 	AllocatedBuffer gpuSceneDataBuffer = create_buffer(sizeof(GPUSceneData), vk::BufferUsageFlagBits::eUniformBuffer, vma::MemoryUsage::eCpuToGpu);
@@ -899,20 +1115,186 @@ void VkSREngine::draw_geometry(vk::CommandBuffer cmd) {
 	writer.write_buffer(0, gpuSceneDataBuffer.buffer, sizeof(GPUSceneData), 0, vk::DescriptorType::eUniformBuffer);
 	writer.update_set(_device, globalDescriptor);
 
+	//> occlusion culling setup
+	// The culling works on draw indices into OpaqueSurfaces, which stay the same between frames for an unchanged scene
+	const bool useOcclusion = _occlusionCuller.enabled && !_mainDrawContext.OpaqueSurfaces.empty();
+	const uint32_t objectCount = (uint32_t)_mainDrawContext.OpaqueSurfaces.size();
+
+	// The viewport covers the window, clamped to the area of the depth image
+	vk::Extent2D depthExtent = {
+		std::min(_windowExtent.width, _depthImage.imageExtent.width),
+		std::min(_windowExtent.height, _depthImage.imageExtent.height)
+	};
+
+	AllocatedBuffer earlyDrawBuffer = {};
+	AllocatedBuffer lateDrawBuffer = {};
+	vk::DescriptorSet earlyCullSet;
+	vk::DescriptorSet lateCullSet;
+
+	CullPushConstants cullConstants = {};
+	cullConstants.viewProj = _sceneData.viewproj;
+	cullConstants.viewportSize = glm::ivec2{ (int)depthExtent.width, (int)depthExtent.height };
+	cullConstants.objectCount = objectCount;
+	cullConstants.pyramidLevels = _occlusionCuller.pyramidLevels;
+	cullConstants.occlusionEnabled = 1;
+
+	if (useOcclusion) {
+		// Indexed by proxy id, so removing an object does not hand its visibility to the one swapped into its place
+		_occlusionCuller.prepare_visibility(cmd, this, (uint32_t)_mainDrawContext.proxies.size());
+
+		const AllocatedBuffer& objectBuffer = _occlusionCuller.upload_objects(this, _mainDrawContext.opaqueCullObjects, _mainDrawContext.changedCullObjects);
+		earlyDrawBuffer = create_buffer(objectCount * sizeof(vk::DrawIndexedIndirectCommand), vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer, vma::MemoryUsage::eGpuOnly);
+		lateDrawBuffer = create_buffer(objectCount * sizeof(vk::DrawIndexedIndirectCommand), vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer, vma::MemoryUsage::eGpuOnly);
+
+		get_current_frame()._deletionQueue.push_function([=, this]() {
+			destroy_buffer(earlyDrawBuffer);
+			destroy_buffer(lateDrawBuffer);
+			});
+
+		// Both phases share everything but the buffer they write draw commands into
+		auto write_cull_set = [&](vk::DescriptorSet set, const AllocatedBuffer& drawBuffer) {
+			DescriptorWriter cullWriter;
+			cullWriter.write_buffer(0, objectBuffer.buffer, objectCount * sizeof(GPUCullObject), 0, vk::DescriptorType::eStorageBuffer);
+			cullWriter.write_buffer(1, _occlusionCuller.visibilityBuffer.buffer, _occlusionCuller.visibilityCapacity * sizeof(uint32_t), 0, vk::DescriptorType::eStorageBuffer);
+			cullWriter.write_buffer(2, drawBuffer.buffer, objectCount * sizeof(vk::DrawIndexedIndirectCommand), 0, vk::DescriptorType::eStorageBuffer);
+			cullWriter.write_buffer(3, get_current_frame()._cullStatsBuffer.buffer, sizeof(GPUCullStats), 0, vk::DescriptorType::eStorageBuffer);
+			cullWriter.write_image(4, _occlusionCuller.depthPyramid.imageView, _occlusionCuller.pyramidSampler, vk::ImageLayout::eGeneral, vk::DescriptorType::eCombinedImageSampler);
+			cullWriter.update_set(_device, set);
+			};
+
+		earlyCullSet = get_current_frame()._frameDescriptors.allocate(_device, _occlusionCuller.cullLayout);
+		lateCullSet = get_current_frame()._frameDescriptors.allocate(_device, _occlusionCuller.cullLayout);
+		write_cull_set(earlyCullSet, earlyDrawBuffer);
+		write_cull_set(lateCullSet, lateDrawBuffer);
+
+		// Reset the counters, then run the early phase
+		cmd.fillBuffer(get_current_frame()._cullStatsBuffer.buffer, 0, vk::WholeSize, 0);
+		vkutil::memory_barrier(cmd,
+			vk::PipelineStageFlagBits2::eTransfer, vk::AccessFlagBits2::eTransferWrite,
+			vk::PipelineStageFlagBits2::eComputeShader, vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite);
+
+		cullConstants.latePhase = 0;
+		_occlusionCuller.cull(cmd, cullConstants, earlyCullSet);
+
+		vkutil::memory_barrier(cmd,
+			vk::PipelineStageFlagBits2::eComputeShader, vk::AccessFlagBits2::eShaderStorageWrite,
+			vk::PipelineStageFlagBits2::eDrawIndirect, vk::AccessFlagBits2::eIndirectCommandRead);
+	}
+	else {
+		_occlusionCuller.invalidate_objects(this);
+	}
+	_mainDrawContext.changedCullObjects.clear();
+	//< occlusion culling setup
+
+	//> meshlet culling setup
+	// Full detail opaque draws with meshlets get them culled on the GPU. Only on the direct path, the Hi-Z path culls whole draws
+	const bool useMeshlets = _meshletCuller.enabled && !useOcclusion;
+
+	AllocatedBuffer meshletCommandBuffer = {};
+	AllocatedBuffer meshletCountBuffer = {};
+	std::vector<GPUMeshletDraw> meshletDraws;
+	// Slot in meshletDraws for every OpaqueSurfaces index, UINT32_MAX for surfaces drawn whole
+	std::vector<uint32_t> meshletDrawSlots;
+
+	if (useMeshlets) {
+		meshletDrawSlots.assign(_mainDrawContext.OpaqueSurfaces.size(), UINT32_MAX);
+
+		uint32_t commandCount = 0;
+		for (uint32_t i : opaque_draws) {
+			const RenderObject& r = _mainDrawContext.OpaqueSurfaces[i];
+			if (r.meshletCount == 0) {
+				continue;
+			}
+
+			meshletDrawSlots[i] = (uint32_t)meshletDraws.size();
+			meshletDraws.push_back(GPUMeshletDraw{ r.transform, r.meshletBufferAddress, r.firstMeshlet, r.meshletCount, r.vertexOffset, commandCount, 0, 0 });
+			commandCount += r.meshletCount;
+		}
+
+		if (!meshletDraws.empty()) {
+			const uint32_t drawCount = (uint32_t)meshletDraws.size();
+
+			AllocatedBuffer meshletDrawBuffer = create_buffer(drawCount * sizeof(GPUMeshletDraw), vk::BufferUsageFlagBits::eStorageBuffer, vma::MemoryUsage::eCpuToGpu);
+			meshletCommandBuffer = create_buffer(commandCount * sizeof(vk::DrawIndexedIndirectCommand), vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer, vma::MemoryUsage::eGpuOnly);
+			meshletCountBuffer = create_buffer(drawCount * sizeof(uint32_t), vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eTransferDst, vma::MemoryUsage::eGpuOnly);
+
+			get_current_frame()._deletionQueue.push_function([=, this]() {
+				destroy_buffer(meshletDrawBuffer);
+				destroy_buffer(meshletCommandBuffer);
+				destroy_buffer(meshletCountBuffer);
+				});
+
+			memcpy(meshletDrawBuffer.info.pMappedData, meshletDraws.data(), drawCount * sizeof(GPUMeshletDraw));
+
+			vk::DescriptorSet meshletSet = get_current_frame()._frameDescriptors.allocate(_device, _meshletCuller.cullLayout);
+			DescriptorWriter meshletWriter;
+			meshletWriter.write_buffer(0, meshletDrawBuffer.buffer, drawCount * sizeof(GPUMeshletDraw), 0, vk::DescriptorType::eStorageBuffer);
+			meshletWriter.write_buffer(1, meshletCommandBuffer.buffer, commandCount * sizeof(vk::DrawIndexedIndirectCommand), 0, vk::DescriptorType::eStorageBuffer);
+			meshletWriter.write_buffer(2, meshletCountBuffer.buffer, drawCount * sizeof(uint32_t), 0, vk::DescriptorType::eStorageBuffer);
+			meshletWriter.write_buffer(3, get_current_frame()._meshletStatsBuffer.buffer, sizeof(GPUMeshletStats), 0, vk::DescriptorType::eStorageBuffer);
+			meshletWriter.update_set(_device, meshletSet);
+
+			cmd.fillBuffer(meshletCountBuffer.buffer, 0, vk::WholeSize, 0);
+			cmd.fillBuffer(get_current_frame()._meshletStatsBuffer.buffer, 0, vk::WholeSize, 0);
+			vkutil::memory_barrier(cmd,
+				vk::PipelineStageFlagBits2::eTransfer, vk::AccessFlagBits2::eTransferWrite,
+				vk::PipelineStageFlagBits2::eComputeShader, vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite);
+
+			_meshletCuller.cull(cmd, _sceneData.viewproj, _mainCamera.position, drawCount, meshletSet);
+
+			vkutil::memory_barrier(cmd,
+				vk::PipelineStageFlagBits2::eComputeShader, vk::AccessFlagBits2::eShaderStorageWrite,
+				vk::PipelineStageFlagBits2::eDrawIndirect | vk::PipelineStageFlagBits2::eHost, vk::AccessFlagBits2::eIndirectCommandRead | vk::AccessFlagBits2::eHostRead);
+		}
+	}
+	//< meshlet culling setup
+
 	MaterialPipeline* lastPipeline = nullptr;
 	MaterialInstance* lastMaterial = nullptr;
 	vk::Buffer lastIndexBuffer = VK_NULL_HANDLE;
 
+	auto begin_geometry_pass = [&](bool clearDepth) {
+		vk::RenderingAttachmentInfo colorAttachment = vkinit::attachment_info(_drawImage.imageView, nullptr, vk::ImageLayout::eGeneral);
+		vk::RenderingAttachmentInfo depthAttachment = vkinit::depth_attachment_info(_depthImage.imageView, vk::ImageLayout::eDepthAttachmentOptimal);
+		if (!clearDepth) {
+			depthAttachment.loadOp = vk::AttachmentLoadOp::eLoad;
+		}
+
+		vk::RenderingInfo renderInfo = vkinit::rendering_info(_windowExtent, &colorAttachment, &depthAttachment);
+
+		cmd.beginRendering(&renderInfo);
+
+		// Compute work in between passes doesn't touch graphics state, but start from a clean slate anyway
+		lastPipeline = nullptr;
+		lastMaterial = nullptr;
+		lastIndexBuffer = VK_NULL_HANDLE;
+		};
+
+	enum class DepthPassMode { None, Prepass, Shade };
+	DepthPassMode depthPassMode = DepthPassMode::None;
+
 	//> Draw lambda
-	auto draw = [&](const RenderObject& r) {
+	// Binds whatever changed since the previous draw and pushes the per-object constants
+	auto bind_draw_state = [&](const RenderObject& r) {
+		// The depth prepass swaps the opaque pipeline for its depth-only or depth-equal variant
+		MaterialPipeline* pipeline = r.material->pipeline;
+		if (pipeline == &_metalRoughMaterial.opaquePipeline) {
+			if (depthPassMode == DepthPassMode::Prepass) {
+				pipeline = &_metalRoughMaterial.depthPrepassPipeline;
+			}
+			else if (depthPassMode == DepthPassMode::Shade) {
+				pipeline = &_metalRoughMaterial.opaqueDepthEqualPipeline;
+			}
+		}
+
 		if (r.material != lastMaterial) {
 			lastMaterial = r.material;
 			// Rebind pipeline and descriptors if the material changed
-			if (r.material->pipeline != lastPipeline) {
-				lastPipeline = r.material->pipeline;
+			if (pipeline != lastPipeline) {
+				lastPipeline = pipeline;
 
-				cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, r.material->pipeline->pipeline);
-				cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, r.material->pipeline->layout, 0, 1, &globalDescriptor, 0, nullptr);
+				cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline->pipeline);
+				cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipeline->layout, 0, 1, &globalDescriptor, 0, nullptr);
 
 				// Setup viewport
 				vk::Viewport viewport = {};
@@ -935,27 +1317,77 @@ void VkSREngine::draw_geometry(vk::CommandBuffer cmd) {
 				cmd.setScissor(0, 1, &scissor);
 			}
 			// Bind material descriptor sets
-			cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, r.material->pipeline->layout, 1, 1, &r.material->materialSet, 0, nullptr);
+			cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipeline->layout, 1, 1, &r.material->materialSet, 0, nullptr);
 		}
 		// Rebind index buffer if needed
 
 		if (r.indexBuffer != lastIndexBuffer) {
 			lastIndexBuffer = r.indexBuffer;
-			cmd.bindIndexBuffer(r.indexBuffer, 0, vk::IndexType::eUint32);
+			cmd.bindIndexBuffer(r.indexBuffer, 0, r.indexType);
 		}
 
 		// Calculate final mesh matrix
 		GPUDrawPushConstants push_constants;
 		push_constants.worldMatrix = r.transform;
-		push_constants.vertexBuffer = r.vertexBufferAddress;
-		cmd.pushConstants(r.material->pipeline->layout, vk::ShaderStageFlagBits::eVertex, 0, sizeof(GPUDrawPushConstants), &push_constants);
-	
+		push_constants.positionOffset = glm::vec4(r.surfaceBounds.origin - r.surfaceBounds.extents, r.colorBufferAddress ? 1.f : 0.f);
+		push_constants.positionScale = glm::vec4(r.surfaceBounds.extents * 2.f, r.instanceCount > 1 ? 1.f : 0.f);
+		push_constants.vertexBuffer = (depthPassMode == DepthPassMode::Prepass) ? r.positionBufferAddress : r.vertexBufferAddress;
+		push_constants.colorBuffer = r.colorBufferAddress;
+		push_constants.instanceBuffer = r.instanceCount > 1 ? instanceBufferAddress : 0;
+		cmd.pushConstants(pipeline->layout, vk::ShaderStageFlagBits::eVertex, 0, sizeof(GPUDrawPushConstants), &push_constants);
+		};
+
+	// When an indirect buffer is given, the draw command at drawIndex decides if the object is drawn at all
+	auto draw = [&](const RenderObject& r, vk::Buffer indirectBuffer, uint32_t drawIndex) {
+		bind_draw_state(r);
+
 		// Perform the actual draw call
-		cmd.drawIndexed(r.indexCount, 1, r.firstIndex, 0, 0);
+		if (indirectBuffer) {
+			cmd.drawIndexedIndirect(indirectBuffer, drawIndex * sizeof(vk::DrawIndexedIndirectCommand), 1, sizeof(vk::DrawIndexedIndirectCommand));
+
+			// Triangles are counted by the cull shader
+			_stats.drawcall_count++;
+		}
+		else {
+			cmd.drawIndexed(r.indexCount, r.instanceCount, r.firstIndex, r.vertexOffset, r.firstInstance);
+
+			// Update stats counters
+			_stats.drawcall_count++;
+			_stats.triangle_count += r.indexCount / 3 * r.instanceCount;
+		}
+		};
+
+	// Draws the meshlets that survived culling, their count is read from the count buffer
+	auto draw_meshlets = [&](const RenderObject& r, uint32_t slot) {
+		bind_draw_state(r);
+
+		const GPUMeshletDraw& meshletDraw = meshletDraws[slot];
+		cmd.drawIndexedIndirectCount(meshletCommandBuffer.buffer, meshletDraw.firstCommand * sizeof(vk::DrawIndexedIndirectCommand),
+			meshletCountBuffer.buffer, slot * sizeof(uint32_t), meshletDraw.meshletCount, sizeof(vk::DrawIndexedIndirectCommand));
 
-		// Update stats counters
+		// Triangles are counted by the cull shader
 		_stats.drawcall_count++;
-		_stats.triangle_count += r.indexCount / 3;	
+		};
+
+	// With the depth prepass the opaque list is drawn twice inside the same rendering, which keeps the
+	// depth results in submission order: depth only first, then shaded against the finished depth
+	auto draw_opaque = [&](auto&& drawOne) {
+		if (_useDepthPrepass) {
+			depthPassMode = DepthPassMode::Prepass;
+			for (uint32_t r : opaque_draws) {
+				drawOne(r);
+			}
+
+			depthPassMode = DepthPassMode::Shade;
+			lastPipeline = nullptr;
+			lastMaterial = nullptr;
+		}
+
+		for (uint32_t r : opaque_draws) {
+			drawOne(r);
+		}
+
+		depthPassMode = DepthPassMode::None;
 		};
 	//< draw_lambda
 
@@ -963,18 +1395,80 @@ void VkSREngine::draw_geometry(vk::CommandBuffer cmd) {
 	_stats.drawcall_count = 0;
 	_stats.triangle_count = 0;
 
-	// Use the draw lambda to first draw opaque surfaces then transparent surfaces
-	for (auto& r : opaque_draws) {
-		draw(_mainDrawContext.OpaqueSurfaces[r]);
+	if (useOcclusion) {
+		// Early pass: whatever was visible last frame
+		begin_geometry_pass(true);
+		draw_opaque([&](uint32_t r) {
+			draw(_mainDrawContext.OpaqueSurfaces[r], earlyDrawBuffer.buffer, r);
+			});
+		cmd.endRendering();
+
+		// Reduce the early depth into the pyramid
+		vkutil::transition_image(cmd, _depthImage.image, vk::ImageLayout::eDepthAttachmentOptimal, vk::ImageLayout::eDepthReadOnlyOptimal);
+		_occlusionCuller.build_pyramid(cmd, depthExtent);
+		vkutil::transition_image(cmd, _depthImage.image, vk::ImageLayout::eDepthReadOnlyOptimal, vk::ImageLayout::eDepthAttachmentOptimal);
+
+		// Late phase: test everything against the pyramid and draw what the early pass missed
+		cullConstants.latePhase = 1;
+		_occlusionCuller.cull(cmd, cullConstants, lateCullSet);
+
+		vkutil::memory_barrier(cmd,
+			vk::PipelineStageFlagBits2::eComputeShader, vk::AccessFlagBits2::eShaderStorageWrite,
+			vk::PipelineStageFlagBits2::eDrawIndirect | vk::PipelineStageFlagBits2::eHost, vk::AccessFlagBits2::eIndirectCommandRead | vk::AccessFlagBits2::eHostRead);
+
+		begin_geometry_pass(false);
+		draw_opaque([&](uint32_t r) {
+			draw(_mainDrawContext.OpaqueSurfaces[r], lateDrawBuffer.buffer, r);
+			});
+
+		// The GPU counted the triangles, the result lags behind by FRAME_OVERLAP frames
+		_stats.triangle_count += _stats.occlusion_triangle_count;
 	}
-	
-	for (auto& r : _mainDrawContext.TransparentSurfaces) {
-		draw(r);
+	else {
+		begin_geometry_pass(true);
+		draw_opaque([&](uint32_t r) {
+			if (useMeshlets && meshletDrawSlots[r] != UINT32_MAX) {
+				draw_meshlets(_mainDrawContext.OpaqueSurfaces[r], meshletDrawSlots[r]);
+			}
+			else {
+				draw(_mainDrawContext.OpaqueSurfaces[r], VK_NULL_HANDLE, r);
+			}
+			});
+
+		// Like the occlusion counters, the GPU result lags behind by FRAME_OVERLAP frames
+		if (!meshletDraws.empty()) {
+			_stats.triangle_count += _stats.meshlet_triangle_count;
+		}
 	}
-	
-	// Delete draw commands now that we processed them
-	_mainDrawContext.OpaqueSurfaces.clear();
-	_mainDrawContext.TransparentSurfaces.clear();
+
+	for (const DrawSortEntry& e : _transparentSortEntries) {
+		const RenderObject& r = _mainDrawContext.TransparentSurfaces[e.index];
+		if (is_occluded(r)) {
+			continue;
+		}
+		draw(r, VK_NULL_HANDLE, 0);
+	}
+
+	cmd.endRendering();
+}
+
+void VkSREngine::update_streaming(vk::CommandBuffer cmd) {
+	size_t budget = _streamingBudget;
+	for (auto& [name, scene] : _loadedScenes) {
+		if (scene->is_streaming()) {
+			scene->update_streaming(cmd, budget, _mainDrawContext);
+		}
+	}
+
+	// All the textures uploaded this frame get their mips in one batch
+	_mipGenerator.flush(cmd, this);
+
+	if (budget == _streamingBudget) {
+		return;
+	}
+
+	// Images transition themselves, the buffer copies need to finish before vertex pulling and culling read them
+	vkutil::memory_barrier(cmd, vk::PipelineStageFlagBits2::eTransfer, vk::AccessFlagBits2::eTransferWrite, vk::PipelineStageFlagBits2::eAllCommands, vk::AccessFlagBits2::eMemoryRead);
 }
 
 void VkSREngine::draw_imgui(vk::CommandBuffer cmd, vk::ImageView targetImageView) {
@@ -1010,13 +1504,28 @@ AllocatedBuffer VkSREngine::create_buffer(size_t allocSize, vk::BufferUsageFlags
 }
 
 AllocatedImage VkSREngine::create_image(vk::Extent3D size, vk::Format format, vk::ImageUsageFlags usage, bool mipmapped) {
+	uint32_t mipLevels = 1;
+	if (mipmapped) {
+		mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(size.width, size.height)))) + 1;
+	}
+
+	return allocate_image(size, format, usage, mipLevels);
+}
+
+AllocatedImage VkSREngine::allocate_image(vk::Extent3D size, vk::Format format, vk::ImageUsageFlags usage, uint32_t mipLevels) {
 	AllocatedImage newImage;
 	newImage.imageFormat = format;
 	newImage.imageExtent = size;
+	newImage.mipLevels = mipLevels;
 
 	vk::ImageCreateInfo img_info = vkinit::image_create_info(format, usage, size);
-	if (mipmapped) {
-		img_info.mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(size.width, size.height)))) + 1;
+	img_info.mipLevels = mipLevels;
+
+	// sRGB images are written as storage images through UNORM views, which needs a mutable format. The storage
+	// usage only has to be supported by the view format then
+	const bool storageView = (usage & vk::ImageUsageFlagBits::eStorage) && vkutil::storage_format(format) != format;
+	if (storageView) {
+		img_info.flags |= vk::ImageCreateFlagBits::eMutableFormat | vk::ImageCreateFlagBits::eExtendedUsage;
 	}
 
 	// Always allocate images on dedicated GPU memory
@@ -1037,26 +1546,48 @@ AllocatedImage VkSREngine::create_image(vk::Extent3D size, vk::Format format, vk
 	vk::ImageViewCreateInfo view_info = vkinit::imageview_create_info(format, newImage.image, aspectFlag);
 	view_info.subresourceRange.levelCount = img_info.mipLevels;
 
+	// The view in the image's own format is only sampled
+	vk::ImageViewUsageCreateInfo viewUsage = {};
+	viewUsage.usage = usage & ~vk::ImageUsageFlagBits::eStorage;
+	if (storageView) {
+		view_info.pNext = &viewUsage;
+	}
+
 	// Create the image view
 	VK_CHECK(_device.createImageView(&view_info, nullptr, &newImage.imageView));
 
 	return newImage;
 }
 
-AllocatedImage VkSREngine::create_image(void* data, vk::Extent3D size, vk::Format format, vk::ImageUsageFlags usage, bool mipmapped) {
-	// As we're using a void pointer, calculate the size of the data from the vk::Extent3D and the number of channels (4, rgba) 
-	size_t data_size = size.depth * size.width * size.height * 4;
-	
-	// Use a staging buffer for copying the image into gpu memory using immediate submit
-	AllocatedBuffer uploadBuffer = create_buffer(data_size, vk::BufferUsageFlagBits::eTransferSrc, vma::MemoryUsage::eCpuToGpu);
+AllocatedImage VkSREngine::create_image(void* data, vk::Extent3D size, vk::Format format, vk::ImageUsageFlags usage, bool mipmapped, vk::CommandBuffer uploadCmd, uint32_t dataChannels) {
+	// As we're using a void pointer, calculate the size of the data from the vk::Extent3D and the texel size of the format,
+	// or the channels of the data when it is expanded
+	size_t data_size = dataChannels != 0 ? (size_t)size.width * size.height * dataChannels : vkutil::image_level_size(format, vk::Extent2D{ size.width, size.height });
+
+	// Use a staging buffer for copying the image into gpu memory using immediate submit. Expanded texels are read
+	// as 32-bit words straight from it
+	vk::BufferUsageFlags stagingUsage = vk::BufferUsageFlagBits::eTransferSrc;
+	if (dataChannels != 0) {
+		stagingUsage |= vk::BufferUsageFlagBits::eStorageBuffer;
+	}
+	AllocatedBuffer uploadBuffer = create_buffer((data_size + 3) & ~size_t(3), stagingUsage, vma::MemoryUsage::eCpuToGpu);
 
 	memcpy(uploadBuffer.info.pMappedData, data, data_size);
 
-	// Use the other overload of create_image
-	AllocatedImage new_image = create_image(size, format, usage | vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eTransferSrc, mipmapped);
+	// Use the other overload of create_image, the mips and expanded texels are written by the mip generator as storage images
+	vk::ImageUsageFlags imageUsage = usage | vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eTransferSrc;
+	if (mipmapped || dataChannels != 0) {
+		imageUsage |= vk::ImageUsageFlagBits::eStorage;
+	}
+	AllocatedImage new_image = create_image(size, format, imageUsage, mipmapped);
 	
-	// Use immediate_submit to submit the image to GPU memory
-	immediate_submit([&](vk::CommandBuffer cmd) {
+	auto record_upload = [&](vk::CommandBuffer cmd) {
+		if (dataChannels != 0) {
+			// Level 0 is written by the mip generator, which also takes the image out of the undefined layout
+			_mipGenerator.queue_expansion(new_image, uploadBuffer.buffer, dataChannels);
+			return;
+		}
+
 		vkutil::transition_image(cmd, new_image.image, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal);
 
 		vk::BufferImageCopy copyRegion = {};
@@ -1074,19 +1605,112 @@ AllocatedImage VkSREngine::create_image(void* data, vk::Extent3D size, vk::Forma
 		cmd.copyBufferToImage(uploadBuffer.buffer, new_image.image, vk::ImageLayout::eTransferDstOptimal, 1, &copyRegion);
 
 		if (mipmapped) {
-			// generate_mipmaps transitions the from eTransfferDstOptimal to eShaderReadOnlyOptimal
-			vkutil::generate_mipmaps(cmd, new_image.image, vk::Extent2D{ new_image.imageExtent.width, new_image.imageExtent.height });
+			// The mip generator transitions it from eTransferDstOptimal to eShaderReadOnlyOptimal
+			_mipGenerator.queue(new_image);
 		}
 		else {
 			vkutil::transition_image(cmd, new_image.image, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal);
 		}
-		});
-	
-	// Free the staging buffer
-	destroy_buffer(uploadBuffer);
+		};
+
+	if (uploadCmd) {
+		// Recorded into a frame, the staging buffer lives until that frame is done on the GPU
+		record_upload(uploadCmd);
+		get_current_frame()._deletionQueue.push_function([=, this]() {
+			destroy_buffer(uploadBuffer);
+			});
+	}
+	else {
+		// Use immediate_submit to submit the image to GPU memory
+		immediate_submit([&](vk::CommandBuffer cmd) {
+			record_upload(cmd);
+			_mipGenerator.flush(cmd, this);
+			});
+
+		// Free the staging buffer
+		destroy_buffer(uploadBuffer);
+	}
+	return new_image;
+}
+
+AllocatedImage VkSREngine::create_image(std::span<const std::byte> data, std::span<const ImageLevel> levels, vk::Extent3D size, vk::Format format, vk::ImageUsageFlags usage, vk::CommandBuffer uploadCmd) {
+	AllocatedBuffer uploadBuffer = create_buffer(data.size(), vk::BufferUsageFlagBits::eTransferSrc, vma::MemoryUsage::eCpuToGpu);
+
+	memcpy(uploadBuffer.info.pMappedData, data.data(), data.size());
+
+	// Transfer source as well for download_image
+	AllocatedImage new_image = allocate_image(size, format, usage | vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eTransferSrc, (uint32_t)levels.size());
+
+	auto record_upload = [&](vk::CommandBuffer cmd) {
+		vkutil::transition_image(cmd, new_image.image, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal);
+
+		// One region per level, all copied in one call
+		std::vector<vk::BufferImageCopy> copyRegions(levels.size());
+		for (size_t i = 0; i < levels.size(); i++) {
+			vk::BufferImageCopy& copyRegion = copyRegions[i];
+			copyRegion.bufferOffset = levels[i].offset;
+			copyRegion.bufferRowLength = 0;
+			copyRegion.bufferImageHeight = 0;
+
+			copyRegion.imageSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
+			copyRegion.imageSubresource.mipLevel = (uint32_t)i;
+			copyRegion.imageSubresource.baseArrayLayer = 0;
+			copyRegion.imageSubresource.layerCount = 1;
+			copyRegion.imageExtent = vk::Extent3D{ std::max(size.width >> i, 1u), std::max(size.height >> i, 1u), 1 };
+		}
+
+		cmd.copyBufferToImage(uploadBuffer.buffer, new_image.image, vk::ImageLayout::eTransferDstOptimal, (uint32_t)copyRegions.size(), copyRegions.data());
+
+		vkutil::transition_image(cmd, new_image.image, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal);
+		};
+
+	if (uploadCmd) {
+		// Recorded into a frame, the staging buffer lives until that frame is done on the GPU
+		record_upload(uploadCmd);
+		get_current_frame()._deletionQueue.push_function([=, this]() {
+			destroy_buffer(uploadBuffer);
+			});
+	}
+	else {
+		immediate_submit(record_upload);
+		destroy_buffer(uploadBuffer);
+	}
 	return new_image;
 }
 
+bool VkSREngine::supports_texture_format(vk::Format format) const {
+	switch (format) {
+	case vk::Format::eBc1RgbUnormBlock:
+	case vk::Format::eBc1RgbSrgbBlock:
+	case vk::Format::eBc1RgbaUnormBlock:
+	case vk::Format::eBc1RgbaSrgbBlock:
+	case vk::Format::eBc3UnormBlock:
+	case vk::Format::eBc3SrgbBlock:
+	case vk::Format::eBc4UnormBlock:
+	case vk::Format::eBc5UnormBlock:
+	case vk::Format::eBc7UnormBlock:
+	case vk::Format::eBc7SrgbBlock:
+		if (!_textureCompressionBC) {
+			return false;
+		}
+		break;
+	case vk::Format::eR8G8B8A8Unorm:
+	case vk::Format::eR8G8B8A8Srgb:
+	case vk::Format::eR8G8Unorm:
+	case vk::Format::eR8Unorm:
+		// Their mips come from the mip generator, which writes them as storage images
+		if (!(_chosenGPU.getFormatProperties(vkutil::storage_format(format)).optimalTilingFeatures & vk::FormatFeatureFlagBits::eStorageImage)) {
+			return false;
+		}
+		break;
+	default:
+		return false;
+	}
+
+	const vk::FormatFeatureFlags required = vk::FormatFeatureFlagBits::eSampledImage | vk::FormatFeatureFlagBits::eSampledImageFilterLinear;
+	return (_chosenGPU.getFormatProperties(format).optimalTilingFeatures & required) == required;
+}
+
 void VkSREngine::destroy_buffer(const AllocatedBuffer& buffer) {
 	_allocator.destroyBuffer(buffer.buffer, buffer.allocation);
 }
@@ -1096,14 +1720,66 @@ void VkSREngine::destroy_image(const AllocatedImage& img) {
 	_allocator.destroyImage(img.image, img.allocation);
 }
 
-GPUMeshBuffers VkSREngine::upload_mesh(std::span<uint32_t> indices, std::span<Vertex> vertices) {
-	const size_t vertexBufferSize = vertices.size() * sizeof(Vertex);
-	const size_t indexBufferSize = indices.size() * sizeof(uint32_t);
+GPUMeshBuffers VkSREngine::upload_mesh(std::span<uint32_t> indices, std::span<PackedVertex> vertices, std::span<uint32_t> colors, std::span<GPUMeshlet> meshlets, vk::CommandBuffer cmd) {
+	return upload_mesh(indices.data(), indices.size(), vk::IndexType::eUint32, vertices, colors, meshlets, cmd);
+}
+
+GPUMeshBuffers VkSREngine::upload_mesh(std::span<uint16_t> indices, std::span<PackedVertex> vertices, std::span<uint32_t> colors, std::span<GPUMeshlet> meshlets, vk::CommandBuffer cmd) {
+	return upload_mesh(indices.data(), indices.size(), vk::IndexType::eUint16, vertices, colors, meshlets, cmd);
+}
+
+GPUMeshBuffers VkSREngine::upload_mesh(const void* indexData, size_t indexCount, vk::IndexType indexType, std::span<PackedVertex> vertices, std::span<uint32_t> colors, std::span<GPUMeshlet> meshlets, vk::CommandBuffer cmd) {
+	MeshStaging staging = create_mesh_staging(vertices.size(), colors.size(), meshlets.size(), indexCount, indexType);
+
+	// Copy vertex buffer
+	memcpy(staging.vertices(), vertices.data(), staging.vertex_bytes());
+	// Copy position buffer, the first 8 bytes of every packed vertex
+	uint16_t* positions = staging.positions();
+	for (size_t i = 0; i < vertices.size(); i++) {
+		memcpy(positions + i * 4, vertices[i].position, sizeof(uint16_t) * 3);
+		positions[i * 4 + 3] = 0;
+	}
+	// Copy color, meshlet and index buffer
+	memcpy(staging.colors(), colors.data(), staging.color_bytes());
+	memcpy(staging.meshlets(), meshlets.data(), staging.meshlet_bytes());
+	memcpy(staging.indices(), indexData, staging.index_bytes());
+
+	return upload_mesh(staging, cmd);
+}
+
+MeshStaging VkSREngine::create_mesh_staging(size_t vertexCount, size_t colorCount, size_t meshletCount, size_t indexCount, vk::IndexType indexType) {
+	MeshStaging staging;
+	staging.vertexCount = vertexCount;
+	staging.colorCount = colorCount;
+	staging.meshletCount = meshletCount;
+	staging.indexCount = indexCount;
+	staging.indexType = indexType;
+
+	// Use a CPU-local staging buffer which will get copied into GPU memory. VMA synchronizes allocations internally
+	staging.buffer = create_buffer(staging.size(), vk::BufferUsageFlagBits::eTransferSrc, vma::MemoryUsage::eCpuOnly);
+
+	return staging;
+}
+
+GPUMeshBuffers VkSREngine::upload_mesh(MeshStaging& staging, vk::CommandBuffer uploadCmd) {
+	const size_t vertexBufferSize = staging.vertex_bytes();
+	const size_t positionBufferSize = staging.position_bytes();
+	const size_t colorBufferSize = staging.color_bytes();
+	const size_t meshletBufferSize = staging.meshlet_bytes();
+	const size_t indexBufferSize = staging.index_bytes();
 
 	GPUMeshBuffers newSurface;
+	newSurface.indexType = staging.indexType;
+	newSurface.sortId = _meshIds.acquire();
+	newSurface.vertexCount = (uint32_t)staging.vertexCount;
+	newSurface.colorCount = (uint32_t)staging.colorCount;
+	newSurface.meshletCount = (uint32_t)staging.meshletCount;
+	newSurface.indexCount = (uint32_t)staging.indexCount;
+
+	// Every buffer is a transfer source too, for download_mesh
 
 	// Create vertex buffer
-	newSurface.vertexBuffer = create_buffer(vertexBufferSize, vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eShaderDeviceAddress, vma::MemoryUsage::eGpuOnly);
+	newSurface.vertexBuffer = create_buffer(vertexBufferSize, vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eShaderDeviceAddress, vma::MemoryUsage::eGpuOnly);
 
 	// Find the adress of the vertex buffer
 	vk::BufferDeviceAddressInfo deviceAddressInfo = {};
@@ -1111,41 +1787,160 @@ GPUMeshBuffers VkSREngine::upload_mesh(std::span<uint32_t> indices, std::span<Ve
 	
 	newSurface.vertexBufferAddress = _device.getBufferAddress(&deviceAddressInfo);
 
-	// Create index buffer
-	newSurface.indexBuffer = create_buffer(indexBufferSize, vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eTransferDst, vma::MemoryUsage::eGpuOnly);
+	// Create the position stream, a copy of the first 8 bytes of every packed vertex
+	newSurface.positionBuffer = create_buffer(positionBufferSize, vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eShaderDeviceAddress, vma::MemoryUsage::eGpuOnly);
 
-	// Use a CPU-local staging buffer which will get copied into GPU memory
-	AllocatedBuffer staging = create_buffer(vertexBufferSize + indexBufferSize, vk::BufferUsageFlagBits::eTransferSrc, vma::MemoryUsage::eCpuOnly);
+	deviceAddressInfo.buffer = newSurface.positionBuffer.buffer;
+	newSurface.positionBufferAddress = _device.getBufferAddress(&deviceAddressInfo);
 
-	void* data = staging.info.pMappedData; // In VMA, the VmaAllocation would have a pointer ->GetMappedData(), but in VMA-HPP, that is not present. vma::AllocationInfo.pMappedData has the same effect in VMA-HPP it seems
+	// Create the color buffer, only if the mesh has vertex colors
+	if (colorBufferSize > 0) {
+		newSurface.colorBuffer = create_buffer(colorBufferSize, vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eShaderDeviceAddress, vma::MemoryUsage::eGpuOnly);
 
-	// Copy vertex buffer
-	memcpy(data, vertices.data(), vertexBufferSize);
-	// Copy index buffer
-	memcpy((char*)data + vertexBufferSize, indices.data(), indexBufferSize);
+		deviceAddressInfo.buffer = newSurface.colorBuffer.buffer;
+		newSurface.colorBufferAddress = _device.getBufferAddress(&deviceAddressInfo);
+	}
 
-	// Use immediatesubmit to copy buffers to GPU
-	immediate_submit([&](vk::CommandBuffer cmd) {
+	// Create the meshlet buffer, read by the meshlet cull shader through its address
+	if (meshletBufferSize > 0) {
+		newSurface.meshletBuffer = create_buffer(meshletBufferSize, vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eShaderDeviceAddress, vma::MemoryUsage::eGpuOnly);
+
+		deviceAddressInfo.buffer = newSurface.meshletBuffer.buffer;
+		newSurface.meshletBufferAddress = _device.getBufferAddress(&deviceAddressInfo);
+	}
+
+	// Create index buffer
+	newSurface.indexBuffer = create_buffer(indexBufferSize, vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eTransferSrc, vma::MemoryUsage::eGpuOnly);
+
+	// The staging buffer is ours now, the caller's copy no longer owns anything
+	AllocatedBuffer stagingBuffer = std::exchange(staging.buffer, AllocatedBuffer{});
+
+	const size_t colorOffset = vertexBufferSize + positionBufferSize;
+	auto record_copies = [&](vk::CommandBuffer cmd) {
 		vk::BufferCopy vertexCopy{ 0 };
 		vertexCopy.dstOffset = 0;
 		vertexCopy.srcOffset = 0;
 		vertexCopy.size = vertexBufferSize;
 
-		cmd.copyBuffer(staging.buffer, newSurface.vertexBuffer.buffer, 1, &vertexCopy);
+		cmd.copyBuffer(stagingBuffer.buffer, newSurface.vertexBuffer.buffer, 1, &vertexCopy);
+
+		vk::BufferCopy positionCopy{ 0 };
+		positionCopy.dstOffset = 0;
+		positionCopy.srcOffset = vertexBufferSize;
+		positionCopy.size = positionBufferSize;
+
+		cmd.copyBuffer(stagingBuffer.buffer, newSurface.positionBuffer.buffer, 1, &positionCopy);
+
+		if (colorBufferSize > 0) {
+			vk::BufferCopy colorCopy{ 0 };
+			colorCopy.dstOffset = 0;
+			colorCopy.srcOffset = colorOffset;
+			colorCopy.size = colorBufferSize;
+
+			cmd.copyBuffer(stagingBuffer.buffer, newSurface.colorBuffer.buffer, 1, &colorCopy);
+		}
+
+		if (meshletBufferSize > 0) {
+			vk::BufferCopy meshletCopy{ 0 };
+			meshletCopy.dstOffset = 0;
+			meshletCopy.srcOffset = colorOffset + colorBufferSize;
+			meshletCopy.size = meshletBufferSize;
+
+			cmd.copyBuffer(stagingBuffer.buffer, newSurface.meshletBuffer.buffer, 1, &meshletCopy);
+		}
 
 		vk::BufferCopy indexCopy{ 0 };
 		indexCopy.dstOffset = 0;
-		indexCopy.srcOffset = vertexBufferSize;
+		indexCopy.srcOffset = colorOffset + colorBufferSize + meshletBufferSize;
 		indexCopy.size = indexBufferSize;
 
-		cmd.copyBuffer(staging.buffer, newSurface.indexBuffer.buffer, 1, &indexCopy);
+		cmd.copyBuffer(stagingBuffer.buffer, newSurface.indexBuffer.buffer, 1, &indexCopy);
 
-		});
+		};
 
-	destroy_buffer(staging);
+	if (uploadCmd) {
+		// Recorded into a frame, the staging buffer lives until that frame is done on the GPU
+		record_copies(uploadCmd);
+		get_current_frame()._deletionQueue.push_function([=, this]() {
+			destroy_buffer(stagingBuffer);
+			});
+	}
+	else {
+		// Use immediatesubmit to copy buffers to GPU
+		immediate_submit(record_copies);
+		destroy_buffer(stagingBuffer);
+	}
 
 	return newSurface;
 }
+
+MeshStaging VkSREngine::download_mesh(const GPUMeshBuffers& mesh) {
+	MeshStaging staging;
+	staging.vertexCount = mesh.vertexCount;
+	staging.colorCount = mesh.colorCount;
+	staging.meshletCount = mesh.meshletCount;
+	staging.indexCount = mesh.indexCount;
+	staging.indexType = mesh.indexType;
+
+	// Host cached memory, it is read on the CPU
+	staging.buffer = create_buffer(staging.size(), vk::BufferUsageFlagBits::eTransferDst, vma::MemoryUsage::eGpuToCpu);
+
+	immediate_submit([&](vk::CommandBuffer cmd) {
+		// Same layout upload_mesh reads from, one copy per stream
+		size_t offset = 0;
+		auto copy = [&](const AllocatedBuffer& source, size_t size) {
+			if (size > 0) {
+				vk::BufferCopy region{ 0, offset, size };
+				cmd.copyBuffer(source.buffer, staging.buffer.buffer, 1, &region);
+			}
+			offset += size;
+			};
+
+		copy(mesh.vertexBuffer, staging.vertex_bytes());
+		copy(mesh.positionBuffer, staging.position_bytes());
+		copy(mesh.colorBuffer, staging.color_bytes());
+		copy(mesh.meshletBuffer, staging.meshlet_bytes());
+		copy(mesh.indexBuffer, staging.index_bytes());
+		});
+
+	_allocator.invalidateAllocation(staging.buffer.allocation, 0, vk::WholeSize);
+	return staging;
+}
+
+AllocatedBuffer VkSREngine::download_image(const AllocatedImage& image, std::vector<ImageLevel>& levels) {
+	// Every level 16 byte aligned, as create_image takes them back
+	levels.clear();
+	size_t size = 0;
+	for (uint32_t i = 0; i < image.mipLevels; i++) {
+		vk::Extent2D levelSize{ std::max(image.imageExtent.width >> i, 1u), std::max(image.imageExtent.height >> i, 1u) };
+		levels.push_back(ImageLevel{ size, vkutil::image_level_size(image.imageFormat, levelSize) });
+		size += (levels.back().size + 15) & ~size_t(15);
+	}
+
+	AllocatedBuffer readback = create_buffer(size, vk::BufferUsageFlagBits::eTransferDst, vma::MemoryUsage::eGpuToCpu);
+
+	immediate_submit([&](vk::CommandBuffer cmd) {
+		vkutil::transition_image(cmd, image.image, vk::ImageLayout::eShaderReadOnlyOptimal, vk::ImageLayout::eTransferSrcOptimal);
+
+		std::vector<vk::BufferImageCopy> copyRegions(levels.size());
+		for (size_t i = 0; i < levels.size(); i++) {
+			vk::BufferImageCopy& copyRegion = copyRegions[i];
+			copyRegion.bufferOffset = levels[i].offset;
+			copyRegion.imageSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
+			copyRegion.imageSubresource.mipLevel = (uint32_t)i;
+			copyRegion.imageSubresource.baseArrayLayer = 0;
+			copyRegion.imageSubresource.layerCount = 1;
+			copyRegion.imageExtent = vk::Extent3D{ std::max(image.imageExtent.width >> i, 1u), std::max(image.imageExtent.height >> i, 1u), 1 };
+		}
+
+		cmd.copyImageToBuffer(image.image, vk::ImageLayout::eTransferSrcOptimal, readback.buffer, (uint32_t)copyRegions.size(), copyRegions.data());
+
+		vkutil::transition_image(cmd, image.image, vk::ImageLayout::eTransferSrcOptimal, vk::ImageLayout::eShaderReadOnlyOptimal);
+		});
+
+	_allocator.invalidateAllocation(readback.allocation, 0, vk::WholeSize);
+	return readback;
+}
 //< buffer/image/mesh allocation
 
 
@@ -1172,6 +1967,18 @@ void VkSREngine::update_imgui() {
 	ImGui::Text("scene update time %f ms", _stats.scene_update_time);
 	ImGui::Text("triangle count %i", _stats.triangle_count);
 	ImGui::Text("draw calls %i", _stats.drawcall_count);
+	if (_useSoftwareOcclusion) {
+		ImGui::Text("cpu occluded %i (%f ms)", _stats.sw_occluded_count, _stats.sw_occlusion_time);
+	}
+	if (_occlusionCuller.enabled) {
+		ImGui::Text("occlusion visible %i / %i (early %i, late %i)", _stats.occlusion_visible_early + _stats.occlusion_visible_late, _stats.occlusion_tested, _stats.occlusion_visible_early, _stats.occlusion_visible_late);
+		if (_meshletCuller.enabled) {
+			ImGui::Text("meshlet culling inactive while occlusion culling is on");
+		}
+	}
+	else if (_meshletCuller.enabled) {
+		ImGui::Text("meshlets visible %i / %i", _stats.meshlets_visible, _stats.meshlets_tested);
+	}
 	ImGui::End();
 
 	// Controls
@@ -1189,6 +1996,24 @@ void VkSREngine::update_imgui() {
 	ImGui::Text("Press LSHIFT for finder adjustment");
 	ImGui::PushItemFlag(ImGuiItemFlags_NoTabStop, true); // This will stop focusing on the input field when pressing tab 
 	ImGui::SliderFloat("Speed", &_mainCamera.speed, 0.01, 1.0);
+	ImGui::Checkbox("Occlusion culling", &_occlusionCuller.enabled);
+	ImGui::Checkbox("CPU occlusion culling", &_useSoftwareOcclusion);
+	// The two GPU culling paths exclude each other, meshlets are only culled with occlusion culling off
+	ImGui::BeginDisabled(_occlusionCuller.enabled);
+	ImGui::Checkbox("Meshlet culling", &_meshletCuller.enabled);
+	ImGui::EndDisabled();
+	ImGui::Checkbox("Depth prepass", &_useDepthPrepass);
+	ImGui::SliderFloat("LOD pixel error", &_lodPixelError, 0.f, 16.f);
+
+	std::string unloadName;
+	for (auto& [name, scene] : _loadedScenes) {
+		if (ImGui::Button(fmt::format("Unload {}", name).c_str())) {
+			unloadName = name;
+		}
+	}
+	if (!unloadName.empty()) {
+		unload_scene(unloadName);
+	}
 	ImGui::PopItemFlag(); 
 
 	ImGui::End();
@@ -1211,12 +2036,15 @@ void VkSREngine::update_scene() {
 
 	// Camera projection 
 	// The "near" and "far" parameters are flipped to get a reversed depth range, see https://developer.nvidia.com/blog/visualizing-depth-precision/
-	glm::mat4 projection = glm::perspective(glm::radians(70.f), (float)_windowExtent.width / (float)_windowExtent.height, 10000.f, 0.1f); 
+	const float fov = glm::radians(70.f);
+	glm::mat4 projection = glm::perspective(fov, (float)_windowExtent.width / (float)_windowExtent.height, 10000.f, 0.1f); 
 
 	// Invert the Y direction on the projection matrix to conform to OpenGL and glTF axis conventions
 	projection[1][1] *= -1;
 
-	_mainDrawContext.OpaqueSurfaces.clear();
+	_mainDrawContext.cameraPosition = _mainCamera.position;
+	_mainDrawContext.lodPixelsPerUnit = (float)_windowExtent.height / (2.f * std::tan(fov / 2.f));
+	_mainDrawContext.lodPixelError = _lodPixelError;
 
 	update_renderables();
 
@@ -1235,7 +2063,40 @@ void VkSREngine::update_scene() {
 }
 
 void VkSREngine::update_renderables() {
-	_loadedScenes["duck"]->Draw(glm::mat4{ 1.f }, _mainDrawContext);
+	// Propagate moved nodes to their proxies, then rewrite only the draw list entries that changed
+	for (auto& [name, scene] : _loadedScenes) {
+		scene->UpdateProxies(scene->instance_transforms(), _mainDrawContext);
+	}
+	_mainDrawContext.update_proxies();
+}
+
+void VkSREngine::set_node_transform(Node& node, const glm::mat4& localTransform) {
+	// Only marks the node dirty, the world matrices are updated once per frame in update_renderables
+	node.transforms->set_local(node.transformIndex, localTransform);
+}
+
+SceneInstance VkSREngine::create_instance(const std::string& sceneName, const glm::mat4& transform) {
+	auto it = _loadedScenes.find(sceneName);
+	if (it == _loadedScenes.end()) {
+		fmt::println("No scene named {} to instance", sceneName);
+		return {};
+	}
+
+	return SceneInstance{ sceneName, it->second->add_instance(transform) };
+}
+
+void VkSREngine::set_instance_transform(const SceneInstance& instance, const glm::mat4& transform) {
+	auto it = _loadedScenes.find(instance.scene);
+	if (it != _loadedScenes.end()) {
+		it->second->set_instance_transform(instance.id, transform);
+	}
+}
+
+void VkSREngine::destroy_instance(const SceneInstance& instance) {
+	auto it = _loadedScenes.find(instance.scene);
+	if (it != _loadedScenes.end()) {
+		it->second->remove_instance(instance.id);
+	}
 }
 //< update
 
@@ -1401,6 +2262,8 @@ void GLTFMetallic_Roughness::build_pipelines(VkSREngine* engine) {
 
 	opaquePipeline.layout = newLayout;
 	transparentPipeline.layout = newLayout;
+	opaquePipeline.sortId = 0;
+	transparentPipeline.sortId = 1;
 
 	// Build the stage create info for both vertex and fragment stages, which tells the pipeline which shader modules to uge per stage
 	PipelineBuilder pipelineBuilder;
@@ -1429,6 +2292,27 @@ void GLTFMetallic_Roughness::build_pipelines(VkSREngine* engine) {
 
 	transparentPipeline.pipeline = pipelineBuilder.build_pipeline(engine->_device);
 
+	// Opaque shading after a depth prepass, the depth is already final
+	pipelineBuilder.disable_blending();
+	pipelineBuilder.enable_depthtest(false, vk::CompareOp::eEqual);
+
+	opaqueDepthEqualPipeline.layout = newLayout;
+	opaqueDepthEqualPipeline.pipeline = pipelineBuilder.build_pipeline(engine->_device);
+
+	// Depth-only prepass, same layout so the draws can share the push constants
+	vk::ShaderModule depthPrepassShader;
+	if (!vkutil::load_shader_module("../../shaders/depth_prepass.vert.spv", engine->_device, &depthPrepassShader)) {
+		fmt::println("Error when building the depth prepass shader module!");
+	}
+
+	pipelineBuilder.set_shaders(depthPrepassShader, VK_NULL_HANDLE);
+	pipelineBuilder.disable_color_writes();
+	pipelineBuilder.enable_depthtest(true, vk::CompareOp::eGreaterOrEqual);
+
+	depthPrepassPipeline.layout = newLayout;
+	depthPrepassPipeline.pipeline = pipelineBuilder.build_pipeline(engine->_device);
+
+	engine->_device.destroyShaderModule(depthPrepassShader, nullptr);
 	engine->_device.destroyShaderModule(meshFragmentShader, nullptr);
 	engine->_device.destroyShaderModule(meshVertexShader, nullptr);
 
@@ -1440,11 +2324,14 @@ void GLTFMetallic_Roughness::clear_resources(vk::Device device) {
 	
 	device.destroyPipeline(transparentPipeline.pipeline, nullptr);
 	device.destroyPipeline(opaquePipeline.pipeline, nullptr);
+	device.destroyPipeline(opaqueDepthEqualPipeline.pipeline, nullptr);
+	device.destroyPipeline(depthPrepassPipeline.pipeline, nullptr);
 }
 
 MaterialInstance GLTFMetallic_Roughness::write_material(vk::Device device, MaterialPass pass, const MaterialResources& resources, DescriptorAllocatorGrowable& descriptorAllocator) {
 	MaterialInstance matData;
 	matData.passType = pass;
+	matData.sortId = materialIds.acquire();
 	if (pass == MaterialPass::Transparent) {
 		matData.pipeline = &transparentPipeline;
 	}
@@ -1453,40 +2340,459 @@ MaterialInstance GLTFMetallic_Roughness::write_material(vk::Device device, Mater
 	}
 
 	matData.materialSet = descriptorAllocator.allocate(device, materialLayout);
+	write_resources(device, resources, matData.materialSet);
+
+	return matData;
+}
 
+void GLTFMetallic_Roughness::release_material(uint32_t sortId) {
+	materialIds.release(sortId);
+}
+
+void GLTFMetallic_Roughness::update_material(vk::Device device, MaterialInstance& material, const MaterialResources& resources, vk::DescriptorSet set) {
+	material.materialSet = set;
+	write_resources(device, resources, set);
+}
+
+void GLTFMetallic_Roughness::write_resources(vk::Device device, const MaterialResources& resources, vk::DescriptorSet set) {
 	writer.clear();
 	writer.write_buffer(0, resources.dataBuffer, sizeof(MaterialConstants), resources.dataBufferOffset, vk::DescriptorType::eUniformBuffer);
 	writer.write_image(1, resources.colorImage.imageView, resources.colorSampler, vk::ImageLayout::eShaderReadOnlyOptimal, vk::DescriptorType::eCombinedImageSampler);
 	writer.write_image(2, resources.metalRoughImage.imageView, resources.metalRoughSampler, vk::ImageLayout::eShaderReadOnlyOptimal, vk::DescriptorType::eCombinedImageSampler);
 
-	writer.update_set(device, matData.materialSet);
+	writer.update_set(device, set);
+}
 
-	return matData;
+
+// ############## Render proxies ###############
+uint32_t DrawContext::add_proxy(const MeshAsset* mesh, const GeoSurface* surface, std::span<const glm::mat4> transforms) {
+	RenderProxy proxy;
+	proxy.mesh = mesh;
+	proxy.surface = surface;
+	proxy.objectIndex = UINT32_MAX;
+	proxy.transparent = false;
+	proxy.dirty = false;
+
+	uint32_t id;
+	if (!freeProxies.empty()) {
+		id = freeProxies.back();
+		freeProxies.pop_back();
+		proxies[id] = proxy;
+	}
+	else {
+		id = (uint32_t)proxies.size();
+		proxies.push_back(proxy);
+	}
+
+	set_proxy_transforms(id, transforms);
+	return id;
 }
 
+void DrawContext::remove_proxy(uint32_t id) {
+	RenderProxy& proxy = proxies[id];
+	if (proxy.objectIndex != UINT32_MAX) {
+		remove_object(proxy);
+	}
 
-// ############## MeshNode ###############
-void MeshNode::Draw(const glm::mat4& topMatrix, DrawContext& ctx) {
-	glm::mat4 nodeMatrix = topMatrix * worldTransform;
+	// A pending dirty entry is skipped by update_proxies
+	proxy.mesh = nullptr;
+	proxy.surface = nullptr;
+	proxy.transforms.clear();
+	freeProxies.push_back(id);
+}
 
-	for (auto& s : mesh->surfaces) {
-		RenderObject def;
-		def.indexCount = s.count;
-		def.firstIndex = s.startIndex;
-		def.indexBuffer = mesh->meshBuffers.indexBuffer.buffer;
-		def.material = &s.material->data;
+// Grows a world space box by the surface bounds under every transform, and scale by their largest axis scale
+static void add_copy_bounds(const Bounds& bounds, std::span<const glm::mat4> transforms, glm::vec3& boundsMin, glm::vec3& boundsMax, float& scale) {
+	for (const glm::mat4& t : transforms) {
+		glm::vec3 center = glm::vec3(t * glm::vec4(bounds.origin, 1.f));
+		glm::vec3 extents = glm::abs(glm::vec3(t[0])) * bounds.extents.x + glm::abs(glm::vec3(t[1])) * bounds.extents.y + glm::abs(glm::vec3(t[2])) * bounds.extents.z;
+		boundsMin = glm::min(boundsMin, center - extents);
+		boundsMax = glm::max(boundsMax, center + extents);
+		scale = std::max({ scale, glm::length(glm::vec3(t[0])), glm::length(glm::vec3(t[1])), glm::length(glm::vec3(t[2])) });
+	}
+}
+
+static void set_box(Bounds& bounds, const glm::vec3& boundsMin, const glm::vec3& boundsMax) {
+	bounds.origin = (boundsMax + boundsMin) / 2.f;
+	bounds.extents = (boundsMax - boundsMin) / 2.f;
+	bounds.sphereRadius = glm::length(bounds.extents);
+}
+
+void DrawContext::set_proxy_transforms(uint32_t id, std::span<const glm::mat4> transforms) {
+	RenderProxy& proxy = proxies[id];
+	proxy.transforms.assign(transforms.begin(), transforms.end());
+	proxy.worldCenter = transforms.empty() ? glm::vec3{ 0.f } : glm::vec3(transforms[0] * glm::vec4(proxy.surface->bounds.origin, 1.f));
+
+	glm::vec3 boundsMin{ std::numeric_limits<float>::max() };
+	glm::vec3 boundsMax{ -std::numeric_limits<float>::max() };
+	proxy.nodeScale = 0.f;
+	add_copy_bounds(proxy.surface->bounds, transforms, boundsMin, boundsMax, proxy.nodeScale);
+	set_box(proxy.copyBounds, boundsMin, boundsMax);
+
+	if (transforms.size() > 1) {
+		changedInstances.push_back(InstanceRange{ id, 0, (uint32_t)transforms.size() });
+	}
+	mark_proxy_dirty(id);
+}
+
+void DrawContext::set_proxy_copies(uint32_t id, uint32_t first, std::span<const glm::mat4> transforms) {
+	RenderProxy& proxy = proxies[id];
+	std::copy(transforms.begin(), transforms.end(), proxy.transforms.begin() + first);
+	if (first == 0 && !transforms.empty()) {
+		proxy.worldCenter = glm::vec3(transforms[0] * glm::vec4(proxy.surface->bounds.origin, 1.f));
+	}
+
+	// Conservative for culling and the LOD selection, a rebuild would touch every copy
+	glm::vec3 boundsMin = proxy.copyBounds.origin - proxy.copyBounds.extents;
+	glm::vec3 boundsMax = proxy.copyBounds.origin + proxy.copyBounds.extents;
+	add_copy_bounds(proxy.surface->bounds, transforms, boundsMin, boundsMax, proxy.nodeScale);
+	set_box(proxy.copyBounds, boundsMin, boundsMax);
+
+	if (proxy.transforms.size() > 1) {
+		changedInstances.push_back(InstanceRange{ id, first, (uint32_t)transforms.size() });
+	}
+	mark_proxy_dirty(id);
+}
+
+void DrawContext::mark_proxy_dirty(uint32_t id) {
+	if (!proxies[id].dirty) {
+		proxies[id].dirty = true;
+		dirtyProxies.push_back(id);
+	}
+}
+
+void DrawContext::update_proxies() {
+	for (uint32_t id : dirtyProxies) {
+		RenderProxy& proxy = proxies[id];
+		if (proxy.surface && !proxy.transforms.empty()) {
+			write_object(proxy);
+		}
+		else if (proxy.surface && proxy.objectIndex != UINT32_MAX) {
+			// No copies left to draw
+			remove_object(proxy);
+		}
+		proxy.dirty = false;
+	}
+	dirtyProxies.clear();
+
+	// The keys of the rewritten objects are already for this camera. A moved camera only costs a distance per
+	// object, the world origins are cached
+	if (cameraPosition != sortCameraPosition) {
+		sortCameraPosition = cameraPosition;
+		for (std::vector<RenderObject>* objects : { &OpaqueSurfaces, &TransparentSurfaces }) {
+			for (RenderObject& r : *objects) {
+				write_sort_key(r);
+			}
+		}
+	}
+
+	const bool lodChanged = cameraPosition != lodCameraPosition || lodPixelsPerUnit != lodPixelsPerUnitUsed || lodPixelError != lodPixelErrorUsed;
+	if (!lodChanged) {
+		return;
+	}
+
+	lodCameraPosition = cameraPosition;
+	lodPixelsPerUnitUsed = lodPixelsPerUnit;
+	lodPixelErrorUsed = lodPixelError;
+
+	for (uint32_t i = 0; i < OpaqueSurfaces.size(); i++) {
+		if (select_lod(proxies[opaqueProxies[i]], OpaqueSurfaces[i])) {
+			write_cull_object(i);
+		}
+	}
+	for (size_t i = 0; i < TransparentSurfaces.size(); i++) {
+		select_lod(proxies[transparentProxies[i]], TransparentSurfaces[i]);
+	}
+}
+
+uint32_t DrawContext::add_occluder(const OccluderGeometry* geometry, const glm::mat4& transform) {
+	if (!freeOccluders.empty()) {
+		uint32_t index = freeOccluders.back();
+		freeOccluders.pop_back();
+		Occluders[index] = OccluderInstance{ geometry, transform };
+		return index;
+	}
+
+	Occluders.push_back(OccluderInstance{ geometry, transform });
+	return (uint32_t)Occluders.size() - 1;
+}
+
+void DrawContext::remove_occluder(uint32_t index) {
+	Occluders[index].geometry = nullptr;
+	freeOccluders.push_back(index);
+}
+
+void DrawContext::clear() {
+	OpaqueSurfaces.clear();
+	TransparentSurfaces.clear();
+	Occluders.clear();
+	freeOccluders.clear();
+	proxies.clear();
+	freeProxies.clear();
+	opaqueProxies.clear();
+	transparentProxies.clear();
+	dirtyProxies.clear();
+	opaqueCullObjects.clear();
+	changedCullObjects.clear();
+	changedInstances.clear();
+	instanceLayoutChanged = true;
+	lodPixelErrorUsed = -1.f;
+}
+
+void DrawContext::write_object(RenderProxy& proxy) {
+	const GeoSurface& s = *proxy.surface;
+	const GPUMeshBuffers& buffers = proxy.mesh->meshBuffers;
+	const bool transparent = s.material->data.passType == MaterialPass::Transparent;
+
+	// The material changed pass, move the object over to the other list
+	if (proxy.objectIndex != UINT32_MAX && proxy.transparent != transparent) {
+		remove_object(proxy);
+	}
+
+	if (proxy.objectIndex == UINT32_MAX) {
+		std::vector<RenderObject>& objects = transparent ? TransparentSurfaces : OpaqueSurfaces;
+		std::vector<uint32_t>& owners = transparent ? transparentProxies : opaqueProxies;
+
+		proxy.objectIndex = (uint32_t)objects.size();
+		proxy.transparent = transparent;
+		objects.emplace_back();
+		owners.push_back((uint32_t)(&proxy - proxies.data()));
+		if (!transparent) {
+			opaqueCullObjects.emplace_back();
+		}
+	}
+
+	RenderObject& def = (transparent ? TransparentSurfaces : OpaqueSurfaces)[proxy.objectIndex];
+	def.vertexOffset = (int32_t)s.vertexOffset;
+	def.indexBuffer = buffers.indexBuffer.buffer;
+	def.indexType = buffers.indexType;
+	def.geometryId = buffers.sortId;
+	def.material = &s.material->data;
+	def.surfaceBounds = s.bounds;
+	def.instanceCount = (uint32_t)proxy.transforms.size();
+
+	if (def.instanceCount == 1) {
 		def.bounds = s.bounds;
-		def.transform = nodeMatrix;
-		def.vertexBufferAddress = mesh->meshBuffers.vertexBufferAddress;
+		def.transform = proxy.transforms[0];
+	}
+	else {
+		// One world space box around all copies, for the sorting and culling that work per object
+		def.bounds = proxy.copyBounds;
+		def.transform = glm::mat4{ 1.f };
+	}
+	def.vertexBufferAddress = buffers.vertexBufferAddress;
+	def.positionBufferAddress = buffers.positionBufferAddress;
+	def.colorBufferAddress = buffers.colorBufferAddress;
+	def.meshletBufferAddress = buffers.meshletBufferAddress;
+	def.firstMeshlet = s.firstMeshlet;
+	def.worldOrigin = glm::vec3(def.transform * glm::vec4(def.bounds.origin, 1.f));
+
+	select_lod(proxy, def);
+	write_sort_key(def);
+	if (!transparent) {
+		write_cull_object(proxy.objectIndex);
+	}
+}
+
+void DrawContext::remove_object(RenderProxy& proxy) {
+	std::vector<RenderObject>& objects = proxy.transparent ? TransparentSurfaces : OpaqueSurfaces;
+	std::vector<uint32_t>& owners = proxy.transparent ? transparentProxies : opaqueProxies;
+
+	// Swap in the last entry so the lists stay packed
+	uint32_t last = (uint32_t)objects.size() - 1;
+	if (proxy.objectIndex != last) {
+		objects[proxy.objectIndex] = objects[last];
+		owners[proxy.objectIndex] = owners[last];
+		proxies[owners[last]].objectIndex = proxy.objectIndex;
+	}
+	objects.pop_back();
+	owners.pop_back();
 
-		if (s.material->data.passType == MaterialPass::Transparent) {
-			ctx.TransparentSurfaces.push_back(def);
+	if (!proxy.transparent) {
+		if (proxy.objectIndex != last) {
+			opaqueCullObjects[proxy.objectIndex] = opaqueCullObjects[last];
+			changedCullObjects.push_back(proxy.objectIndex);
 		}
-		else {
-			ctx.OpaqueSurfaces.push_back(def);
+		opaqueCullObjects.pop_back();
+	}
+
+	proxy.objectIndex = UINT32_MAX;
+}
+
+bool DrawContext::select_lod(const RenderProxy& proxy, RenderObject& object) const {
+	const GeoSurface& s = *proxy.surface;
+	const uint32_t oldFirstIndex = object.firstIndex;
+	const uint32_t oldIndexCount = object.indexCount;
+	object.indexCount = s.count;
+	object.firstIndex = s.startIndex;
+
+	// Pick the coarsest LOD whose error projects to less than the allowed pixel error
+	if (s.lods.size() > 1 && lodPixelError > 0.f) {
+		// Instanced copies share one LOD, the nearest copy decides it
+		float centerDistance = glm::distance(proxy.worldCenter, cameraPosition);
+		for (size_t i = 1; i < proxy.transforms.size(); i++) {
+			centerDistance = std::min(centerDistance, glm::distance(glm::vec3(proxy.transforms[i] * glm::vec4(s.bounds.origin, 1.f)), cameraPosition));
+		}
+		float distance = std::max(centerDistance - s.bounds.sphereRadius * proxy.nodeScale, 0.01f);
+
+		for (size_t i = s.lods.size() - 1; i > 0; i--) {
+			float pixelError = s.lods[i].error * proxy.nodeScale / distance * lodPixelsPerUnit;
+			if (pixelError <= lodPixelError) {
+				object.indexCount = s.lods[i].count;
+				object.firstIndex = s.lods[i].startIndex;
+				break;
+			}
 		}
 	}
 
+	// Meshlets only cover the full detail indices of a single copy
+	object.meshletCount = (object.firstIndex == s.startIndex && object.instanceCount == 1) ? s.meshletCount : 0;
+	return object.firstIndex != oldFirstIndex || object.indexCount != oldIndexCount;
+}
+
+void DrawContext::write_sort_key(RenderObject& object) const {
+	const float distance = glm::distance(object.worldOrigin, cameraPosition);
+	if (object.material->passType == MaterialPass::Transparent) {
+		object.sortKey = drawsort::transparent_key(object.material->pipeline->sortId, object.material->sortId, object.geometryId, distance);
+	}
+	else {
+		object.sortKey = drawsort::opaque_key(object.material->pipeline->sortId, object.material->sortId, object.geometryId, distance);
+	}
+}
+
+void DrawContext::write_cull_object(uint32_t objectIndex) {
+	const RenderObject& r = OpaqueSurfaces[objectIndex];
+	GPUCullObject& c = opaqueCullObjects[objectIndex];
+	c.transform = r.transform;
+	c.origin = glm::vec4(r.bounds.origin, r.bounds.sphereRadius);
+	c.extents = glm::vec4(r.bounds.extents, 0.f);
+	c.indexCount = r.indexCount;
+	c.firstIndex = r.firstIndex;
+	c.vertexOffset = r.vertexOffset;
+	c.instanceCount = r.instanceCount;
+	c.firstInstance = r.firstInstance;
+	c.visibilityIndex = opaqueProxies[objectIndex];
+	changedCullObjects.push_back(objectIndex);
+}
+
+uint32_t DrawContext::assign_instances() {
+	uint32_t instanceTotal = 0;
+	for (std::vector<RenderObject>* objects : { &OpaqueSurfaces, &TransparentSurfaces }) {
+		for (uint32_t i = 0; i < objects->size(); i++) {
+			RenderObject& r = (*objects)[i];
+			if (r.instanceCount <= 1) {
+				continue;
+			}
+
+			// Offsets only move when an instanced object before this one changed its count
+			if (r.firstInstance != instanceTotal) {
+				r.firstInstance = instanceTotal;
+				instanceLayoutChanged = true;
+				if (objects == &OpaqueSurfaces) {
+					write_cull_object(i);
+				}
+			}
+			instanceTotal += r.instanceCount;
+		}
+	}
+	return instanceTotal;
+}
+
+// ############## MeshNode ###############
+void MeshNode::RegisterProxies(std::span<const glm::mat4> topMatrices, DrawContext& ctx) {
+	update_copies(topMatrices);
+	update_occluder(ctx);
+
+	if (mesh->resident) {
+		register_surfaces(topMatrices, ctx);
+	}
+
 	// Recurse down
-	Node::Draw(topMatrix, ctx);
+	Node::RegisterProxies(topMatrices, ctx);
+}
+
+void MeshNode::UnregisterProxies(DrawContext& ctx) {
+	if (occluderIndex != UINT32_MAX) {
+		ctx.remove_occluder(occluderIndex);
+		occluderIndex = UINT32_MAX;
+	}
+
+	for (uint32_t id : proxies) {
+		ctx.remove_proxy(id);
+	}
+	proxies.clear();
+
+	Node::UnregisterProxies(ctx);
+}
+
+void MeshNode::register_surfaces(std::span<const glm::mat4> topMatrices, DrawContext& ctx) {
+	update_copies(topMatrices);
+
+	proxies.clear();
+	for (auto& s : mesh->surfaces) {
+		proxies.push_back(ctx.add_proxy(mesh.get(), &s, copies));
+	}
+}
+
+void MeshNode::UpdateProxies(std::span<const glm::mat4> topMatrices, DrawContext& ctx) {
+	update_copies(topMatrices);
+	update_occluder(ctx);
+
+	for (uint32_t id : proxies) {
+		ctx.set_proxy_transforms(id, copies);
+	}
+}
+
+void MeshNode::UpdateInstance(std::span<const glm::mat4> topMatrices, uint32_t instance, DrawContext& ctx) {
+	// Copies go instance by instance, each with all GPU instances of the node
+	const size_t perInstance = std::max(gpuInstances.size(), (size_t)1);
+	if (copies.size() != topMatrices.size() * perInstance) {
+		UpdateProxies(topMatrices, ctx);
+		return;
+	}
+
+	const size_t first = instance * perInstance;
+	const glm::mat4 nodeMatrix = topMatrices[instance] * worldTransform();
+	if (gpuInstances.empty()) {
+		copies[first] = nodeMatrix;
+	}
+	for (size_t i = 0; i < gpuInstances.size(); i++) {
+		copies[first + i] = nodeMatrix * gpuInstances[i];
+	}
+	update_occluder(ctx);
+
+	std::span<const glm::mat4> changed(copies.data() + first, perInstance);
+	for (uint32_t id : proxies) {
+		ctx.set_proxy_copies(id, (uint32_t)first, changed);
+	}
+}
+
+void MeshNode::update_copies(std::span<const glm::mat4> topMatrices) {
+	copies.clear();
+	for (const glm::mat4& top : topMatrices) {
+		glm::mat4 nodeMatrix = top * worldTransform();
+
+		if (gpuInstances.empty()) {
+			copies.push_back(nodeMatrix);
+			continue;
+		}
+		for (const glm::mat4& instance : gpuInstances) {
+			copies.push_back(nodeMatrix * instance);
+		}
+	}
+}
+
+void MeshNode::update_occluder(DrawContext& ctx) {
+	if (mesh->occluder && copies.size() == 1) {
+		if (occluderIndex == UINT32_MAX) {
+			occluderIndex = ctx.add_occluder(mesh->occluder.get(), copies[0]);
+		}
+		else {
+			ctx.Occluders[occluderIndex].transform = copies[0];
+		}
+	}
+	else if (occluderIndex != UINT32_MAX) {
+		ctx.remove_occluder(occluderIndex);
+		occluderIndex = UINT32_MAX;
+	}
 }
\ No newline at end of file
@@ -4,6 +4,12 @@
 #include <vk_types.h>
 #include <vk_descriptors.h>
 #include <vk_loader.h>
+#include <vk_culling.h>
+#include <vk_meshlets.h>
+#include <vk_mipgen.h>
+#include <vk_resource_cache.h>
+#include <texture_cache.h>
+#include <draw_sort.h>
 #include <camera.h>
 
 #include "compute_structs.h"
@@ -62,6 +68,22 @@ struct EngineStats {
 	float scene_update_time{ 0.f };
 	float mesh_draw_time{ 0.f };
 	float time_since_start{ 0.f };
+	int sw_occluded_count{ 0 };
+	float sw_occlusion_time{ 0.f };
+	int occlusion_tested{ 0 };
+	int occlusion_visible_early{ 0 };
+	int occlusion_visible_late{ 0 };
+	int occlusion_triangle_count{ 0 };
+	int meshlets_tested{ 0 };
+	int meshlets_visible{ 0 };
+	int meshlet_triangle_count{ 0 };
+};
+
+// Copies [first, first + count) of a render proxy
+struct InstanceRange {
+	uint32_t proxy;
+	uint32_t first;
+	uint32_t count;
 };
 
 struct FrameData 
@@ -74,6 +96,25 @@ struct FrameData
 
 	DeletionQueue _deletionQueue;
 	DescriptorAllocatorGrowable _frameDescriptors;
+
+	// Occlusion culling counters of the last time this frame was rendered
+	AllocatedBuffer _cullStatsBuffer;
+	// Meshlet culling counters, same as above
+	AllocatedBuffer _meshletStatsBuffer;
+
+	// This frame's copy of DrawContext::opaqueCullObjects, only the entries changed since it was last
+	// uploaded are written. Stale copies are written whole
+	AllocatedBuffer _cullObjectBuffer;
+	uint32_t _cullObjectCapacity{ 0 };
+	std::vector<uint32_t> _changedCullObjects;
+	bool _cullObjectsStale{ true };
+
+	// World matrices of the instanced objects, kept up to date the same way by proxy
+	AllocatedBuffer _instanceBuffer;
+	vk::DeviceAddress _instanceBufferAddress{ 0 };
+	uint32_t _instanceCapacity{ 0 };
+	std::vector<InstanceRange> _changedInstances;
+	bool _instancesStale{ true };
 };
 
 struct GPUSceneData {
@@ -89,6 +130,11 @@ struct GLTFMetallic_Roughness {
 	MaterialPipeline opaquePipeline;
 	MaterialPipeline transparentPipeline;
 
+	// Depth prepass variants of the opaque pipeline: depth only from the position stream,
+	// then shading with an equal depth test and no depth writes
+	MaterialPipeline depthPrepassPipeline;
+	MaterialPipeline opaqueDepthEqualPipeline;
+
 	vk::DescriptorSetLayout materialLayout;
 
 	struct MaterialConstants {
@@ -108,33 +154,185 @@ struct GLTFMetallic_Roughness {
 	};
 
 	DescriptorWriter writer;
+	drawsort::IdAllocator materialIds; // sortId of every live material
 
 	void build_pipelines(VkSREngine* engine);
 	void clear_resources(vk::Device device);
 
+	// The instance holds its sortId until release_material, its descriptor set goes with the allocator
 	MaterialInstance write_material(vk::Device device, MaterialPass pass, const MaterialResources& resources, DescriptorAllocatorGrowable& descriptorAllocator);
+	void release_material(uint32_t sortId);
+	// Points material at new resources through set, which replaces its descriptor set. No frame in flight may read set
+	void update_material(vk::Device device, MaterialInstance& material, const MaterialResources& resources, vk::DescriptorSet set);
+	void write_resources(vk::Device device, const MaterialResources& resources, vk::DescriptorSet set);
 };
 
 struct RenderObject {
 	uint32_t indexCount;
 	uint32_t firstIndex;
+	int32_t vertexOffset;
 	vk::Buffer indexBuffer;
+	vk::IndexType indexType;
+	uint32_t geometryId; // sortId of the mesh buffers
 
 	MaterialInstance* material;
-	Bounds bounds;
+	Bounds bounds;        // In world space for instanced objects, their transform is the identity
+	Bounds surfaceBounds; // The vertex positions are quantized against these
 	glm::mat4 transform;
+	glm::vec3 worldOrigin; // Bounds center in world space, the sort distance is measured from it
+	uint64_t sortKey;      // Kept up to date by DrawContext for the current camera position
+	uint32_t instanceCount; // Above 1 the world matrices come from the instance buffer
+	uint32_t firstInstance; // Into this frame's instance buffer, set by draw_geometry
 	vk::DeviceAddress vertexBufferAddress;
+	vk::DeviceAddress positionBufferAddress;
+	vk::DeviceAddress colorBufferAddress;
+
+	// Meshlets of the surface, meshletCount is 0 when it is drawn whole (no meshlets or a reduced LOD)
+	vk::DeviceAddress meshletBufferAddress;
+	uint32_t firstMeshlet;
+	uint32_t meshletCount;
+};
+
+struct OccluderInstance {
+	const OccluderGeometry* geometry;
+	glm::mat4 transform;
+};
+
+// Retained draw data of one mesh surface, registered once when its scene is added.
+// Its RenderObject lives at objectIndex in OpaqueSurfaces or TransparentSurfaces
+struct RenderProxy {
+	const MeshAsset* mesh;
+	const GeoSurface* surface;
+	std::vector<glm::mat4> transforms; // One per copy, several are drawn instanced and none is not drawn
+	glm::vec3 worldCenter; // Bounds center in world space of the first copy, for the LOD selection
+	float nodeScale;       // Largest axis scale of the transforms
+	Bounds copyBounds;     // World space box around all copies, the bounds of instanced objects
+	uint32_t objectIndex;
+	bool transparent;
+	bool dirty;
 };
 
 struct DrawContext {
+	// Kept between frames, only the entries of dirty proxies are rewritten
 	std::vector<RenderObject> OpaqueSurfaces;
 	std::vector<RenderObject> TransparentSurfaces;
+	std::vector<OccluderInstance> Occluders;
+
+	std::vector<RenderProxy> proxies;
+	std::vector<uint32_t> freeProxies;   // Removed proxy slots, reused by add_proxy
+	std::vector<uint32_t> freeOccluders; // Removed Occluders slots, their geometry is null
+	std::vector<uint32_t> opaqueProxies;      // Proxy of every OpaqueSurfaces entry
+	std::vector<uint32_t> transparentProxies; // Proxy of every TransparentSurfaces entry
+	std::vector<uint32_t> dirtyProxies;
+
+	// GPU culling record of every OpaqueSurfaces entry, and the entries rewritten since draw_geometry last
+	// took the list. Indices can repeat
+	std::vector<GPUCullObject> opaqueCullObjects;
+	std::vector<uint32_t> changedCullObjects;
+
+	// Copies of instanced proxies rewritten since draw_geometry last took the list, and whether an object
+	// moved in the instance buffer since
+	std::vector<InstanceRange> changedInstances;
+	bool instanceLayoutChanged{ true };
+
+	// LOD selection, set up by update_scene before the proxies are updated
+	glm::vec3 cameraPosition;
+	float lodPixelsPerUnit; // Screen pixels covered by one world unit at distance 1
+	float lodPixelError;    // Largest allowed LOD error in pixels, 0 always picks full detail
+
+	uint32_t add_proxy(const MeshAsset* mesh, const GeoSurface* surface, std::span<const glm::mat4> transforms);
+	void remove_proxy(uint32_t id);
+	void set_proxy_transforms(uint32_t id, std::span<const glm::mat4> transforms);
+	// Replaces the copies from first on, for when one placed instance of a scene moved. The box around all
+	// copies only grows here, it shrinks again the next time set_proxy_transforms replaces them all
+	void set_proxy_copies(uint32_t id, uint32_t first, std::span<const glm::mat4> transforms);
+	// Re-reads the surface, for when its material was changed
+	void mark_proxy_dirty(uint32_t id);
+
+	uint32_t add_occluder(const OccluderGeometry* geometry, const glm::mat4& transform);
+	void remove_occluder(uint32_t index);
+
+	// Rebuilds the RenderObjects of dirty proxies. The LODs and sort keys of all proxies are only redone
+	// when the camera or the LOD settings changed, so a static view of a static scene costs nothing
+	void update_proxies();
+	void clear();
+
+	// Lays the instanced objects out in the frame's instance buffer and returns the number of matrices
+	uint32_t assign_instances();
+
+private:
+	// Camera and settings the LODs were last picked with
+	glm::vec3 lodCameraPosition{ 0.f };
+	float lodPixelsPerUnitUsed{ 0.f };
+	float lodPixelErrorUsed{ -1.f };
+	// Camera the sort keys hold the distances to
+	glm::vec3 sortCameraPosition{ 0.f };
+
+	void write_object(RenderProxy& proxy);
+	void remove_object(RenderProxy& proxy);
+	// False when the object keeps the LOD it had
+	bool select_lod(const RenderProxy& proxy, RenderObject& object) const;
+	void write_sort_key(RenderObject& object) const;
+	void write_cull_object(uint32_t objectIndex);
 }; 
 
 struct MeshNode : public Node {
 	std::shared_ptr<MeshAsset> mesh;
 
-	virtual void Draw(const glm::mat4& topMatrix, DrawContext& ctx) override;
+	// EXT_mesh_gpu_instancing transforms in node space, the mesh is drawn once per entry when there are any
+	std::vector<glm::mat4> gpuInstances;
+
+	// One proxy per surface, and the occluder entry for occluder meshes. Occluders only
+	// cover a single copy, instanced meshes are too many to rasterize on the CPU
+	std::vector<uint32_t> proxies;
+	uint32_t occluderIndex{ UINT32_MAX };
+
+	virtual void RegisterProxies(std::span<const glm::mat4> topMatrices, DrawContext& ctx) override;
+	virtual void UpdateProxies(std::span<const glm::mat4> topMatrices, DrawContext& ctx) override;
+	virtual void UpdateInstance(std::span<const glm::mat4> topMatrices, uint32_t instance, DrawContext& ctx) override;
+	virtual void UnregisterProxies(DrawContext& ctx) override;
+
+	// Adds the surface proxies alone, for meshes that become resident after the scene was registered
+	void register_surfaces(std::span<const glm::mat4> topMatrices, DrawContext& ctx);
+
+private:
+	// World matrix of every copy of the mesh, kept to reuse the allocation
+	std::vector<glm::mat4> copies;
+
+	void update_copies(std::span<const glm::mat4> topMatrices);
+	void update_occluder(DrawContext& ctx);
+};
+
+// Host visible staging memory of one mesh, every GPU buffer back to back: vertices, positions, colors,
+// meshlets, indices. The loader writes its output straight into it, upload_mesh then only records the copies
+struct MeshStaging {
+	AllocatedBuffer buffer;
+	size_t vertexCount{ 0 };
+	size_t colorCount{ 0 };
+	size_t meshletCount{ 0 };
+	size_t indexCount{ 0 };
+	vk::IndexType indexType{ vk::IndexType::eUint32 };
+
+	size_t vertex_bytes() const { return vertexCount * sizeof(PackedVertex); }
+	size_t position_bytes() const { return vertexCount * sizeof(uint16_t) * 4; }
+	size_t color_bytes() const { return colorCount * sizeof(uint32_t); }
+	size_t meshlet_bytes() const { return meshletCount * sizeof(GPUMeshlet); }
+	size_t index_bytes() const { return indexCount * (indexType == vk::IndexType::eUint16 ? sizeof(uint16_t) : sizeof(uint32_t)); }
+	size_t size() const { return vertex_bytes() + position_bytes() + color_bytes() + meshlet_bytes() + index_bytes(); }
+
+	// The mapping is usually write-combined, write it front to back and never read from it
+	char* data() const { return (char*)buffer.info.pMappedData; }
+	PackedVertex* vertices() const { return (PackedVertex*)data(); }
+	uint16_t* positions() const { return (uint16_t*)(data() + vertex_bytes()); }
+	uint32_t* colors() const { return (uint32_t*)(data() + vertex_bytes() + position_bytes()); }
+	GPUMeshlet* meshlets() const { return (GPUMeshlet*)(data() + vertex_bytes() + position_bytes() + color_bytes()); }
+	void* indices() const { return data() + vertex_bytes() + position_bytes() + color_bytes() + meshlet_bytes(); }
+};
+
+// A placed copy of a loaded scene, see VkSREngine::create_instance
+struct SceneInstance {
+	std::string scene;
+	uint32_t id{ UINT32_MAX };
 };
 
 class VkSREngine {
@@ -160,6 +358,7 @@ public:
 	vk::DebugUtilsMessengerEXT _debug_messenger;
 	vk::Queue _graphicsQueue;
 	uint32_t _graphicsQueueFamily;
+	bool _textureCompressionBC{ false }; // BC formats can only be used when the device feature was enabled
 	
 	// Allocation and deletion
 	DeletionQueue _mainDeletionQueue;
@@ -215,13 +414,53 @@ public:
 	MaterialInstance _defaultData;
 	GLTFMetallic_Roughness _metalRoughMaterial;
 
+	// Hi-Z occlusion culling
+	OcclusionCuller _occlusionCuller;
+
+	// GPU meshlet culling on the direct draw path
+	MeshletCuller _meshletCuller;
+
+	// Compute mip generation, the images streaming uploads in a frame are generated as one batch
+	MipGenerator _mipGenerator;
+
+	// CPU occlusion culling against designated occluder meshes
+	OcclusionRasterizer _occlusionRasterizer;
+	bool _useSoftwareOcclusion{ false };
+
+	// Draw the opaque surfaces depth-only first, then shade them with an equal depth test
+	bool _useDepthPrepass{ false };
+
+	// Allowed screen space error of the mesh LODs, in pixels
+	float _lodPixelError{ 1.f };
+
 	// Draw context 
 	DrawContext _mainDrawContext;
+
+	// Sort keys of the last frame, kept in sorted order so an unchanged scene needs no reordering
+	std::vector<DrawSortEntry> _opaqueSortEntries;
+	std::vector<DrawSortEntry> _transparentSortEntries;
+	std::vector<DrawSortEntry> _drawSortScratch;
+	drawsort::IdAllocator _meshIds; // sortId of every live GPUMeshBuffers, released by the ResourceCache
 	GPUSceneData _sceneData;
 
 	// glTF scenes
 	std::unordered_map<std::string, std::shared_ptr<LoadedGLTF>> _loadedScenes;
 
+	// Images, mesh buffers and samplers shared by the scenes
+	ResourceCache _resourceCache;
+	// Decoded textures on disk, loader threads read and fill it
+	TextureCache _textureCache;
+
+	// Unloaded scenes with the frame they were unloaded in, destroyed once that frame is done on the GPU
+	struct RetiredScene {
+		std::shared_ptr<LoadedGLTF> scene;
+		int frameNumber;
+	};
+	std::vector<RetiredScene> _retiredScenes;
+
+	// Bytes of streamed scene data uploaded per frame at most, an item larger than that still goes in one frame
+	size_t _streamingBudget{ 16 * 1024 * 1024 };
+
 	// Camera
 	Camera _mainCamera;
 
@@ -238,7 +477,10 @@ public:
 	void draw();
 	void draw_main(vk::CommandBuffer cmd);
 	void draw_geometry(vk::CommandBuffer cmd);
+	// Brings this frame's instance buffer up to date with the proxies and returns its address, 0 without instances
+	vk::DeviceAddress upload_instances(uint32_t instanceTotal);
 	void draw_imgui(vk::CommandBuffer cmd, vk::ImageView targetImageView);
+	void update_streaming(vk::CommandBuffer cmd);
 
 	void update();
 	void update_compute();
@@ -246,20 +488,61 @@ public:
 	void update_renderables();
 	void update_imgui();
 
+	// Moves a node, it and everything below it are refreshed by the next update_renderables
+	void set_node_transform(Node& node, const glm::mat4& localTransform);
+
+	// Places a copy of a loaded scene. The copies share its GPU resources and each surface
+	// is drawn once for all of them. A scene without instances is not drawn
+	SceneInstance create_instance(const std::string& sceneName, const glm::mat4& transform);
+	void set_instance_transform(const SceneInstance& instance, const glm::mat4& transform);
+	void destroy_instance(const SceneInstance& instance);
+
+	// Starts loading a glTF file, or a .vkpak package cooked by vksr_cook, in the background. It shows up in the
+	// scene piece by piece
+	void load_scene_async(const std::string& name, std::string_view filePath);
+	// Removes a scene from rendering right away, its GPU resources are freed once no frame in flight can use them
+	void unload_scene(const std::string& name);
+	// Writes a loaded scene with its runtime edits to a .vkpak package, load_scene_async restores it. Stalls
+	// while the GPU data is read back
+	bool save_scene_snapshot(const std::string& name, std::string_view filePath);
+
 	void immediate_submit(std::function<void(vk::CommandBuffer cmd)>&& function);
 
 	AllocatedBuffer create_buffer(size_t allocSize, vk::BufferUsageFlags usage, vma::MemoryUsage memoryUsage);
 	AllocatedImage create_image(vk::Extent3D size, vk::Format format, vk::ImageUsageFlags usage, bool mipmapped = false);
-	AllocatedImage create_image(void* data, vk::Extent3D size, vk::Format format, vk::ImageUsageFlags usage, bool mipmapped = false);
+	// With a command buffer the upload is recorded into it and the staging memory is freed with the current frame,
+	// otherwise it is submitted and waited for. Same for upload_mesh. Mipmapped images are RGBA8, RG8 or R8, with a
+	// command buffer their mips are only queued in _mipGenerator and the caller has to flush it into the same command
+	// buffer. A dataChannels of 1 to 3 has the RGBA8 image expanded from that many packed channels the same way
+	AllocatedImage create_image(void* data, vk::Extent3D size, vk::Format format, vk::ImageUsageFlags usage, bool mipmapped = false, vk::CommandBuffer cmd = {}, uint32_t dataChannels = 0);
+	// Uploads a prebuilt mip chain as is, for block compressed formats the mip generator can not write
+	AllocatedImage create_image(std::span<const std::byte> data, std::span<const ImageLevel> levels, vk::Extent3D size, vk::Format format, vk::ImageUsageFlags usage, vk::CommandBuffer cmd = {});
+	// Whether images of the format can be sampled with linear filtering, and have their mips generated when they
+	// are uncompressed. Only queries, safe on loader threads
+	bool supports_texture_format(vk::Format format) const;
 	void destroy_buffer(const AllocatedBuffer& buffer);
 	void destroy_image(const AllocatedImage& img);
 
-	GPUMeshBuffers upload_mesh(std::span<uint32_t> indices, std::span<Vertex> vertices);
+	// colors is an optional RGBA8 stream with one entry per vertex, meshlets an optional GPUMeshlet array
+	GPUMeshBuffers upload_mesh(std::span<uint32_t> indices, std::span<PackedVertex> vertices, std::span<uint32_t> colors = {}, std::span<GPUMeshlet> meshlets = {}, vk::CommandBuffer cmd = {});
+	GPUMeshBuffers upload_mesh(std::span<uint16_t> indices, std::span<PackedVertex> vertices, std::span<uint32_t> colors = {}, std::span<GPUMeshlet> meshlets = {}, vk::CommandBuffer cmd = {});
+	// Reserves the staging memory of a mesh for the caller to fill. Only allocates, so loader threads can call it
+	MeshStaging create_mesh_staging(size_t vertexCount, size_t colorCount, size_t meshletCount, size_t indexCount, vk::IndexType indexType);
+	// Uploads a filled staging buffer and takes it over, it is destroyed once the copies are done
+	GPUMeshBuffers upload_mesh(MeshStaging& staging, vk::CommandBuffer cmd = {});
+
+	// Copy GPU data back into host memory the caller destroys, in the layouts upload_mesh and create_image take.
+	// Both submit and wait, they are for snapshots and tools and not for every frame
+	MeshStaging download_mesh(const GPUMeshBuffers& mesh);
+	AllocatedBuffer download_image(const AllocatedImage& image, std::vector<ImageLevel>& levels);
 	
 	void handle_controls(SDL_Event& e);
 	void set_relative_mouse_mode(bool enable);
 
 private:
+	AllocatedImage allocate_image(vk::Extent3D size, vk::Format format, vk::ImageUsageFlags usage, uint32_t mipLevels);
+	GPUMeshBuffers upload_mesh(const void* indexData, size_t indexCount, vk::IndexType indexType, std::span<PackedVertex> vertices, std::span<uint32_t> colors, std::span<GPUMeshlet> meshlets, vk::CommandBuffer cmd);
+
 	void init_vulkan();
 	void init_swapchain();
 	void init_commands(); 
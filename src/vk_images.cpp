@@ -1,6 +1,9 @@
 #include <vk_images.h>
 #include <vk_initializers.h>
 
+#include <algorithm>
+#include <cmath>
+
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
@@ -15,7 +18,10 @@ void vkutil::transition_image(vk::CommandBuffer cmd, vk::Image image, vk::ImageL
 	imageBarrier.oldLayout = currentLayout;
 	imageBarrier.newLayout = newLayout;
 
-	vk::ImageAspectFlags aspectMask = (newLayout == vk::ImageLayout::eDepthAttachmentOptimal) ? vk::ImageAspectFlagBits::eDepth : vk::ImageAspectFlagBits::eColor;
+	// Depth images can also be transitioned out of the attachment layout, e.g. to be sampled when building the depth pyramid
+	bool isDepth = newLayout == vk::ImageLayout::eDepthAttachmentOptimal || newLayout == vk::ImageLayout::eDepthReadOnlyOptimal
+		|| currentLayout == vk::ImageLayout::eDepthAttachmentOptimal || currentLayout == vk::ImageLayout::eDepthReadOnlyOptimal;
+	vk::ImageAspectFlags aspectMask = isDepth ? vk::ImageAspectFlagBits::eDepth : vk::ImageAspectFlagBits::eColor;
 	
 	imageBarrier.subresourceRange = vkinit::image_subresource_range(aspectMask);
 	imageBarrier.image = image;
@@ -28,6 +34,23 @@ void vkutil::transition_image(vk::CommandBuffer cmd, vk::Image image, vk::ImageL
 	cmd.pipelineBarrier2(&depInfo);
 }
 
+void vkutil::memory_barrier(vk::CommandBuffer cmd, vk::PipelineStageFlags2 srcStage, vk::AccessFlags2 srcAccess, vk::PipelineStageFlags2 dstStage, vk::AccessFlags2 dstAccess) {
+	// A global memory barrier, used between compute passes that write buffers or general-layout images read by later commands
+	vk::MemoryBarrier2 memoryBarrier = {};
+
+	memoryBarrier.srcStageMask = srcStage;
+	memoryBarrier.srcAccessMask = srcAccess;
+	memoryBarrier.dstStageMask = dstStage;
+	memoryBarrier.dstAccessMask = dstAccess;
+
+	vk::DependencyInfo depInfo = {};
+
+	depInfo.memoryBarrierCount = 1;
+	depInfo.pMemoryBarriers = &memoryBarrier;
+
+	cmd.pipelineBarrier2(&depInfo);
+}
+
 void vkutil::copy_image_to_image(vk::CommandBuffer cmd, vk::Image source, vk::Image destination, vk::Extent2D srcSize, vk::Extent2D dstSize) {
 	vk::ImageBlit2 blitRegion = {};
 
@@ -65,76 +88,74 @@ void vkutil::copy_image_to_image(vk::CommandBuffer cmd, vk::Image source, vk::Im
 	cmd.blitImage2(&blitInfo);
 }
 
-void vkutil::generate_mipmaps(vk::CommandBuffer cmd, vk::Image image, vk::Extent2D imageSize) {
-	int mipLevels = int(std::floor(std::log2(std::max(imageSize.width, imageSize.height)))) + 1;
-	for (int mip = 0; mip < mipLevels; mip++) {
-		// Shrink size in half
-		vk::Extent2D halfSize = imageSize;
-		halfSize.width /= 2;
-		halfSize.height /= 2;
-
-		vk::ImageMemoryBarrier2 imageBarrier = {};
-
-		imageBarrier.srcStageMask = vk::PipelineStageFlagBits2::eAllCommands;
-		imageBarrier.srcAccessMask = vk::AccessFlagBits2::eMemoryWrite;
-		imageBarrier.dstStageMask = vk::PipelineStageFlagBits2::eAllCommands;
-		imageBarrier.dstAccessMask = vk::AccessFlagBits2::eMemoryWrite | vk::AccessFlagBits2::eMemoryRead;
-
-		imageBarrier.oldLayout = vk::ImageLayout::eTransferDstOptimal;
-		imageBarrier.newLayout = vk::ImageLayout::eTransferSrcOptimal;
-
-		vk::ImageAspectFlags aspectMask = vk::ImageAspectFlagBits::eColor;
-		
-		imageBarrier.subresourceRange = vkinit::image_subresource_range(aspectMask);
-		imageBarrier.subresourceRange.levelCount = 1;
-		imageBarrier.subresourceRange.baseMipLevel = mip;
-		imageBarrier.image = image;
-
-		vk::DependencyInfo depInfo = {};
-		depInfo.imageMemoryBarrierCount = 1;
-		depInfo.pImageMemoryBarriers = &imageBarrier;
-
-		cmd.pipelineBarrier2(&depInfo);
-		
-		if (mip < mipLevels - 1) {
-			vk::ImageBlit2 blitRegion = {};
-			
-			blitRegion.srcOffsets[1].x = imageSize.width;
-			blitRegion.srcOffsets[1].y = imageSize.height;
-			blitRegion.srcOffsets[1].z = 1;
-
-			blitRegion.dstOffsets[1].x = halfSize.width;
-			blitRegion.dstOffsets[1].y = halfSize.height;
-			blitRegion.dstOffsets[1].z = 1;
-
-			blitRegion.srcSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
-			blitRegion.srcSubresource.baseArrayLayer = 0;
-			blitRegion.srcSubresource.layerCount = 1;
-			blitRegion.srcSubresource.mipLevel = mip;
-
-			blitRegion.dstSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
-			blitRegion.dstSubresource.baseArrayLayer = 0;
-			blitRegion.dstSubresource.layerCount = 1;
-			blitRegion.dstSubresource.mipLevel = mip + 1;
-
-			vk::BlitImageInfo2 blitInfo = {};
-
-			blitInfo.dstImage = image;
-			blitInfo.dstImageLayout = vk::ImageLayout::eTransferDstOptimal;
-			
-			blitInfo.srcImage = image;
-			blitInfo.srcImageLayout = vk::ImageLayout::eTransferSrcOptimal;
-
-			blitInfo.filter = vk::Filter::eLinear;
-			blitInfo.regionCount = 1;
-			blitInfo.pRegions = &blitRegion;
-
-			cmd.blitImage2(&blitInfo);
-
-			imageSize = halfSize;
+size_t vkutil::image_level_size(vk::Format format, vk::Extent2D levelSize) {
+	// vk::blockExtent is 1x1 for uncompressed formats, so this is width * height * texel size for those
+	std::array<uint8_t, 3> blockExtent = vk::blockExtent(format);
+	size_t blocksX = (levelSize.width + blockExtent[0] - 1) / blockExtent[0];
+	size_t blocksY = (levelSize.height + blockExtent[1] - 1) / blockExtent[1];
+	return blocksX * blocksY * vk::blockSize(format);
+}
+
+namespace {
+	// sRGB encoded byte to linear
+	const std::array<float, 256>& srgb_to_linear_table() {
+		static const std::array<float, 256> table = [] {
+			std::array<float, 256> values;
+			for (int i = 0; i < 256; i++) {
+				const float c = i / 255.0f;
+				values[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+			}
+			return values;
+			}();
+		return table;
+	}
+
+	uint8_t linear_to_srgb(float c) {
+		c = c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+		return (uint8_t)std::lround(std::clamp(c, 0.0f, 1.0f) * 255.0f);
+	}
+}
+
+vk::Format vkutil::storage_format(vk::Format format) {
+	switch (format) {
+	case vk::Format::eR8G8B8A8Srgb:
+		return vk::Format::eR8G8B8A8Unorm;
+	case vk::Format::eR8G8Srgb:
+		return vk::Format::eR8G8Unorm;
+	case vk::Format::eR8Srgb:
+		return vk::Format::eR8Unorm;
+	default:
+		return format;
+	}
+}
+
+void vkutil::downsample_level(vk::Format format, vk::Extent2D srcSize, const uint8_t* src, uint8_t* dst) {
+	const uint32_t texelSize = vk::blockSize(format);
+	const uint32_t srgbChannels = storage_format(format) != format ? std::min(texelSize, 3u) : 0;
+	const std::array<float, 256>& toLinear = srgb_to_linear_table();
+
+	const uint32_t dstWidth = std::max(srcSize.width >> 1, 1u);
+	const uint32_t dstHeight = std::max(srcSize.height >> 1, 1u);
+	for (uint32_t y = 0; y < dstHeight; y++) {
+		// A side that is already 1 texel wide reads the same row or column twice
+		const uint32_t y0 = std::min(y * 2, srcSize.height - 1);
+		const uint32_t y1 = std::min(y * 2 + 1, srcSize.height - 1);
+		for (uint32_t x = 0; x < dstWidth; x++) {
+			const uint32_t x0 = std::min(x * 2, srcSize.width - 1);
+			const uint32_t x1 = std::min(x * 2 + 1, srcSize.width - 1);
+			for (uint32_t c = 0; c < texelSize; c++) {
+				const uint8_t s00 = src[(y0 * srcSize.width + x0) * texelSize + c];
+				const uint8_t s01 = src[(y0 * srcSize.width + x1) * texelSize + c];
+				const uint8_t s10 = src[(y1 * srcSize.width + x0) * texelSize + c];
+				const uint8_t s11 = src[(y1 * srcSize.width + x1) * texelSize + c];
+				uint8_t& texel = dst[(y * dstWidth + x) * texelSize + c];
+				if (c < srgbChannels) {
+					texel = linear_to_srgb((toLinear[s00] + toLinear[s01] + toLinear[s10] + toLinear[s11]) * 0.25f);
+				}
+				else {
+					texel = (uint8_t)((s00 + s01 + s10 + s11 + 2) / 4);
+				}
+			}
 		}
 	}
-	
-	// Transition all mip levels into the final read only layout
-	transition_image(cmd, image, vk::ImageLayout::eTransferSrcOptimal, vk::ImageLayout::eShaderReadOnlyOptimal);
-}
\ No newline at end of file
+}
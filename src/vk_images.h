@@ -3,7 +3,18 @@
 namespace vkutil {
 	void transition_image(vk::CommandBuffer cmd, vk::Image image, vk::ImageLayout currentLayout, vk::ImageLayout newLayout);
 
+	void memory_barrier(vk::CommandBuffer cmd, vk::PipelineStageFlags2 srcStage, vk::AccessFlags2 srcAccess, vk::PipelineStageFlags2 dstStage, vk::AccessFlags2 dstAccess);
+
 	void copy_image_to_image(vk::CommandBuffer cmd, vk::Image source, vk::Image destination, vk::Extent2D srcSize, vk::Extent2D dstSize);
 
-	void generate_mipmaps(vk::CommandBuffer cmd, vk::Image image, vk::Extent2D imageSize);
+	// Tightly packed bytes of one level of the given size, block compressed formats round up to whole blocks
+	size_t image_level_size(vk::Format format, vk::Extent2D levelSize);
+
+	// The format compute shaders write an image of the given format through, sRGB formats are never storage formats
+	vk::Format storage_format(vk::Format format);
+
+	// Box filters one level of 8 bit texels into the next on the CPU, what mip_downsample.comp computes on the GPU.
+	// Sizes halve rounding down and an odd side leaves its last row or column out, sRGB color is averaged in
+	// linear space and alpha never is
+	void downsample_level(vk::Format format, vk::Extent2D srcSize, const uint8_t* src, uint8_t* dst);
 }
\ No newline at end of file
@@ -2,12 +2,32 @@
 #include "stb_image.h"
 #include "vk_loader.h"
 #include <iostream>
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <limits>
+#include <type_traits>
+#include <bit>
+#include <cstring>
+#include <atomic>
+#include <thread>
+#include <future>
+#include <chrono>
+#include <fstream>
 
 #include <vk_engine.h>
 #include <vk_initializers.h>
+#include <vk_images.h>
 #include <vk_types.h>
+#include <mesh_utils.h>
+#include <mapped_file.h>
+#include <meshopt_decode.h>
+#include <ktx2.h>
+#include <scene_package.h>
+#include <thread_pool.h>
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/quaternion.hpp>
+#include <glm/gtc/packing.hpp>
 
 #include <fastgltf/glm_element_traits.hpp>
 #include <fastgltf/core.hpp>
@@ -15,326 +35,618 @@
 #include <fastgltf/util.hpp>
 
 //> global_funcs
-std::optional<AllocatedImage> load_image(VkSREngine* engine, fastgltf::Asset& asset, fastgltf::Image& image) {
-	AllocatedImage newImage = {};
+// Each level aims for half the triangles of the previous one, levels that barely simplify end the chain
+constexpr size_t MAX_MESH_LODS = 4;
+constexpr float LOD_REDUCTION = 0.5f;
+constexpr size_t LOD_MIN_TRIANGLES = 64;
+// Error budget of a whole chain relative to the surface radius, past it a level looks visibly different up close
+constexpr float LOD_MAX_ERROR = 0.05f;
+
+void generate_lods(GeoSurface& surface, std::vector<uint32_t>& indices, std::span<const Vertex> vertices, size_t firstVertex) {
+	std::vector<glm::vec3> positions;
+	positions.reserve(vertices.size() - firstVertex);
+	for (size_t i = firstVertex; i < vertices.size(); i++) {
+		positions.push_back(vertices[i].position);
+	}
 
-	int width, height, nrChannels;
-	std::visit(
-		fastgltf::visitor{
-			[](auto& arg) {},
-			[&](fastgltf::sources::URI& filePath) {
-			assert(filePath.fileByteOffset == 0); // Do not support byte offsets with stb_image
-			assert(filePath.uri.isLocalPath());   // Only handle loading local files 
-			const std::string path(filePath.uri.path().begin(), filePath.uri.path().end()); // Thanks c++
-			unsigned char* data = stbi_load(path.c_str(), &width, &height, &nrChannels, 4);
-			if (data) {
-				vk::Extent3D imagesize;
-				imagesize.width = width;
-				imagesize.height = height;
-				imagesize.depth = 1;
+	std::vector<uint32_t> lodIndices(indices.begin() + surface.startIndex, indices.begin() + surface.startIndex + surface.count);
+	for (uint32_t& index : lodIndices) {
+		index -= (uint32_t)firstVertex;
+	}
 
-				newImage = engine->create_image(data, imagesize, vk::Format::eR8G8B8A8Unorm, vk::ImageUsageFlagBits::eSampled, true); // I have not yet implemented create_image
+	// Levels are simplified from the previous one, so their errors add up and share one budget
+	const float maxError = surface.bounds.sphereRadius * LOD_MAX_ERROR;
+	float error = 0.f;
+	while (surface.lods.size() < MAX_MESH_LODS && lodIndices.size() / 3 > LOD_MIN_TRIANGLES && error < maxError) {
+		size_t target = (size_t)(lodIndices.size() / 3 * LOD_REDUCTION) * 3;
 
-				stbi_image_free(data);
-			}
-		},
-		[&](fastgltf::sources::Array& arr) {
-			unsigned char* data = stbi_load_from_memory(reinterpret_cast<const stbi_uc*>(arr.bytes.data()), static_cast<int>(arr.bytes.size()), &width, &height, &nrChannels, 4);
-			if (data) {
-				vk::Extent3D imagesize;
-				imagesize.width = width;
-				imagesize.height = height;
-				imagesize.depth = 1;
+		float lodError = 0.f;
+		std::vector<uint32_t> simplified = meshutil::simplify(lodIndices, positions, target, maxError - error, &lodError);
+		if (simplified.empty() || simplified.size() > lodIndices.size() * 0.9f) {
+			break;
+		}
 
-				newImage = engine->create_image(data, imagesize, vk::Format::eR8G8B8A8Unorm, vk::ImageUsageFlagBits::eSampled, true);
+		error += lodError;
+		surface.lods.push_back(MeshLod{ (uint32_t)indices.size(), (uint32_t)simplified.size(), error });
+		for (uint32_t index : simplified) {
+			indices.push_back(index + (uint32_t)firstVertex);
+		}
 
-				stbi_image_free(data);
-			}
-		},
-		[&](fastgltf::sources::BufferView& view) {
-			auto& bufferView = asset.bufferViews[view.bufferViewIndex];
-			auto& buffer = asset.buffers[bufferView.bufferIndex];
-			std::visit(fastgltf::visitor { // Only care about VectorWithMime here since LoadExternalBuffers has been specified meaning all buffers are already loaded into a vector
-				[](auto& arg) {},
-				[&](fastgltf::sources::Array& arr) {
-					unsigned char* data = stbi_load_from_memory(reinterpret_cast<const stbi_uc*>(arr.bytes.data()) + bufferView.byteOffset, static_cast<int>(bufferView.byteLength), &width, &height, &nrChannels, 4);
-					if (data) {
-						vk::Extent3D imagesize;
-						imagesize.width = width;
-						imagesize.height = height;
-						imagesize.depth = 1;
+		lodIndices = std::move(simplified);
+	}
+}
 
-						newImage = engine->create_image(data, imagesize, vk::Format::eR8G8B8A8Unorm, vk::ImageUsageFlagBits::eSampled, true);
+// Reorders every LOD of a surface for the vertex cache and overdraw, then sorts the surface's vertices by first use
+void optimize_surface(GeoSurface& surface, std::vector<uint32_t>& indices, std::span<Vertex> vertices, size_t firstVertex) {
+	const size_t vertexCount = vertices.size() - firstVertex;
 
-						stbi_image_free(data);
-					}
-				}
-			}, buffer.data);
-		},
-		 
-		},
-		image.data);
+	std::vector<glm::vec3> positions;
+	positions.reserve(vertexCount);
+	for (size_t i = firstVertex; i < vertices.size(); i++) {
+		positions.push_back(vertices[i].position);
+	}
 
-	// If any o the attempts to load the data failed, we haven't written the image so the return handle is null
-	if (newImage.image == VK_NULL_HANDLE) {
-		return {};
+	// The LODs follow each other in the index buffer, so the whole chain is one range
+	const MeshLod& lastLod = surface.lods.back();
+	std::span<uint32_t> surfaceIndices(indices.data() + surface.startIndex, lastLod.startIndex + lastLod.count - surface.startIndex);
+	for (uint32_t& index : surfaceIndices) {
+		index -= (uint32_t)firstVertex;
 	}
-	else {
-		return newImage;
+
+	for (const MeshLod& lod : surface.lods) {
+		std::span<uint32_t> lodIndices(indices.data() + lod.startIndex, lod.count);
+		meshutil::optimize_vertex_cache(lodIndices, vertexCount);
+		meshutil::optimize_overdraw(lodIndices, positions);
 	}
-}
 
-vk::Filter extract_filter(fastgltf::Filter filter) {
-	switch (filter) {
-		// Nearest sampler
-	case fastgltf::Filter::Nearest:
-	case fastgltf::Filter::NearestMipMapNearest:
-	case fastgltf::Filter::NearestMipMapLinear:
-		return vk::Filter::eNearest;
-		
-		// Linear sampler (default if filter type doesn't match)
-	case fastgltf::Filter::Linear:
-	case fastgltf::Filter::LinearMipMapNearest:
-	case fastgltf::Filter::LinearMipMapLinear:
-	default:
-		return vk::Filter::eLinear;
+	// Full detail comes first, so its order decides the vertex layout
+	std::vector<uint32_t> remap = meshutil::optimize_vertex_fetch(surfaceIndices, vertexCount);
+	std::vector<Vertex> reordered(vertexCount);
+	for (size_t i = 0; i < vertexCount; i++) {
+		reordered[remap[i]] = vertices[firstVertex + i];
+	}
+	std::copy(reordered.begin(), reordered.end(), vertices.begin() + firstVertex);
+
+	for (uint32_t& index : surfaceIndices) {
+		index += (uint32_t)firstVertex;
 	}
 }
 
-vk::SamplerMipmapMode extract_mipmap_mode(fastgltf::Filter filter) {
-	switch (filter) {
-		// Nearest mipmap sampler mode
-	case fastgltf::Filter::NearestMipMapNearest:
-	case fastgltf::Filter::LinearMipMapNearest:
-		return vk::SamplerMipmapMode::eNearest;
+// Quantizes the position against the surface bounds, the shader gets the same bounds to undo it
+PackedVertex pack_vertex(const Vertex& v, const Bounds& bounds) {
+	PackedVertex packed;
 
-		// Linear mipmap sampler mode (default if mipmap filter mode doesn't match)
-	case fastgltf::Filter::NearestMipMapLinear:
-	case fastgltf::Filter::LinearMipMapLinear:
-	default:
-		return vk::SamplerMipmapMode::eLinear;
+	glm::vec3 boundsMin = bounds.origin - bounds.extents;
+	for (int i = 0; i < 3; i++) {
+		float size = bounds.extents[i] * 2.f;
+		float t = size > 0.f ? std::clamp((v.position[i] - boundsMin[i]) / size, 0.f, 1.f) : 0.f;
+		packed.position[i] = (uint16_t)std::round(t * 65535.f);
 	}
-} 
-//< global_funcs
+	packed.pad = 0;
+
+	// Octahedral normal, the lower hemisphere is folded over the diagonals
+	float l1 = std::abs(v.normal.x) + std::abs(v.normal.y) + std::abs(v.normal.z);
+	glm::vec3 n = l1 > 0.f ? v.normal / l1 : glm::vec3{ 0.f, 0.f, 1.f };
+	glm::vec2 oct = { n.x, n.y };
+	if (n.z < 0.f) {
+		oct.x = (1.f - std::abs(n.y)) * (n.x >= 0.f ? 1.f : -1.f);
+		oct.y = (1.f - std::abs(n.x)) * (n.y >= 0.f ? 1.f : -1.f);
+	}
+	packed.normal = glm::packSnorm2x16(oct);
 
-//> loadgltf_func
-std::optional<std::shared_ptr<LoadedGLTF>> loadGltf(VkSREngine* engine, std::string_view filePath) {
-	fmt::println("Loading GLTF: {}", filePath);
+	packed.uv = glm::packHalf2x16(glm::vec2{ v.uv_x, v.uv_y });
 
-	// Prepare the LoadedGLTF structure
-	std::shared_ptr<LoadedGLTF> scene = std::make_shared<LoadedGLTF>();
-	scene->creator = engine;
-	LoadedGLTF& file = *scene.get();
+	return packed;
+}
 
-	// Initialize the fastgltf parser
-	fastgltf::Parser parser{};
-	constexpr auto gltfOptions = fastgltf::Options::DontRequireValidAssetMember | fastgltf::Options::AllowDouble | fastgltf::Options::LoadGLBBuffers | fastgltf::Options::LoadExternalBuffers | fastgltf::Options::LoadExternalImages;
+// Splits the full detail indices of a surface into meshlets. Double sided surfaces get no cone, their back faces are visible
+void build_surface_meshlets(GeoSurface& surface, std::vector<GPUMeshlet>& meshlets, std::span<const uint32_t> indices, std::span<const Vertex> vertices, bool doubleSided) {
+	std::vector<glm::vec3> positions;
+	positions.reserve(vertices.size());
+	for (const Vertex& v : vertices) {
+		positions.push_back(v.position);
+	}
 
-	// Prepare a handle for later use
-	fastgltf::Asset gltf;
-	
-	std::filesystem::path path = filePath;
+	std::vector<meshutil::Meshlet> surfaceMeshlets = meshutil::build_meshlets(indices.subspan(surface.startIndex, surface.count), positions);
 
-	auto gltfFile = fastgltf::GltfDataBuffer::FromPath(path);
+	surface.firstMeshlet = (uint32_t)meshlets.size();
+	surface.meshletCount = (uint32_t)surfaceMeshlets.size();
 
-	if (!bool(gltfFile)) {
-		std::cerr << "Failed to open glTF file: " << fastgltf::getErrorMessage(gltfFile.error()) << std::endl;
-		return {};
+	for (const meshutil::Meshlet& m : surfaceMeshlets) {
+		GPUMeshlet meshlet = {};
+		meshlet.sphere = glm::vec4(m.center, m.radius);
+		meshlet.cone = glm::vec4(m.coneAxis, doubleSided ? 1.f : m.coneCutoff);
+		meshlet.firstIndex = surface.startIndex + m.firstIndex;
+		meshlet.indexCount = m.indexCount;
+		meshlets.push_back(meshlet);
 	}
+}
 
-	auto asset = parser.loadGltf(gltfFile.get(), path.parent_path(), gltfOptions);
-	if (asset.error() != fastgltf::Error::None) {
-		std::cerr << "Failed to load glTF: " << fastgltf::getErrorMessage(asset.error()) << std::endl;
-		return {};
-	}
-	
-	gltf = std::move(asset.get());
-	
+// Runs job(i) for every i in [0, count) spread over all cores, the calling thread takes part. The workers are
+// started on first use and shared by every import, a loop only wakes them. The first exception a job throws
+// is rethrown here
+void parallel_for(size_t count, const std::function<void(size_t)>& job) {
+	static ThreadPool pool(std::max(std::thread::hardware_concurrency(), 1u) - 1);
+	pool.parallel_for(count, job);
+}
 
-	/*if (type == fastgltf::GltfType::glTF) {
-		auto load = parser.loadGltf(fileStream, path.parent_path(), gltfOptions);
-		if (load) {
-			gltf = std::move(load.get());
-		}
-		else {
-			std::cerr << "Failed to load glTF: " << fastgltf::to_underlying(load.error()) << std::endl;
-			return {};
+// Bytes of every glTF buffer. External .bin files are memory-mapped and the binary chunk of a GLB stays
+// in the mapping of the file itself, so accessors are decoded straight from the OS file cache without
+// reading the buffers into memory first. Passed to the fastgltf accessor tools as their buffer data adapter.
+// EXT_meshopt_compression views are the exception, they are decoded into memory once by map
+struct GltfBuffers {
+	std::filesystem::path directory;
+	std::unique_ptr<fastgltf::MappedGltfFile> source; // The .gltf or .glb, backs the GLB binary chunk
+	std::vector<MappedFile> files;
+	std::vector<std::span<const std::byte>> buffers;
+	std::vector<std::vector<std::byte>> decodedViews; // By buffer view index, only filled for compressed views
+
+	// Resolves every buffer of the parsed asset and decodes the compressed views, false when a buffer is
+	// missing or shorter than it claims or a view does not decode
+	bool map(fastgltf::Asset& gltf) {
+		buffers.resize(gltf.buffers.size());
+
+		for (size_t i = 0; i < gltf.buffers.size(); i++) {
+			// The uncompressed stand-in of a meshopt file has no data, every view into it is compressed
+			if (std::holds_alternative<fastgltf::sources::Fallback>(gltf.buffers[i].data)) {
+				continue;
+			}
+
+			bool mapped = std::visit(fastgltf::visitor{
+				[](auto& arg) { return false; },
+				[&](fastgltf::sources::ByteView& view) {
+					buffers[i] = std::span<const std::byte>(view.bytes.data(), view.bytes.size());
+					return true;
+				},
+				[&](fastgltf::sources::Array& arr) {
+					// Embedded base64 data, fastgltf has already decoded it into memory
+					buffers[i] = std::span<const std::byte>(arr.bytes.data(), arr.bytes.size());
+					return true;
+				},
+				[&](fastgltf::sources::URI& filePath) {
+					MappedFile& file = files.emplace_back();
+					if (!filePath.uri.isLocalPath() || !file.open(directory / filePath.uri.fspath()) || file.bytes().size() < filePath.fileByteOffset) {
+						return false;
+					}
+					buffers[i] = file.bytes().subspan(filePath.fileByteOffset);
+					return true;
+				},
+				}, gltf.buffers[i].data);
+
+			if (!mapped || buffers[i].size() < gltf.buffers[i].byteLength) {
+				std::cerr << "Failed to map glTF buffer " << i << std::endl;
+				return false;
+			}
 		}
+
+		return decode_compressed_views(gltf);
 	}
-	else if (type == fastgltf::GltfType::GLB) {
-		auto load = parser.loadGltfBinary(fileStream, path.parent_path(), gltfOptions);
-		if (load) {
-			gltf = std::move(load.get());
+
+	// One job per compressed view, they are independent and the vertex streams of a large mesh dominate
+	bool decode_compressed_views(const fastgltf::Asset& gltf) {
+		std::vector<size_t> compressed;
+		for (size_t i = 0; i < gltf.bufferViews.size(); i++) {
+			if (gltf.bufferViews[i].meshoptCompression) {
+				compressed.push_back(i);
+			}
 		}
-		else {
-			std::cerr << "Failed to load glTF: " << fastgltf::to_underlying(load.error()) << std::endl;
-			return {};
+
+		if (compressed.empty()) {
+			return true;
 		}
-	}
-	else {
-		std::cerr << "Failed to determine glTF container." << std::endl;
-		return {};
-	}*/
 
-	// Time to load the gltf into the structures of LoadedGLTF.
-	// Prepare descriptors
-	std::vector<DescriptorAllocatorGrowable::PoolSizeRatio> sizes = {
-		{vk::DescriptorType::eCombinedImageSampler, 3},
-		{vk::DescriptorType::eUniformBuffer, 3},
-		{vk::DescriptorType::eStorageBuffer, 1}
-	};
+		decodedViews.resize(gltf.bufferViews.size());
 
-	file.descriptorPool.init(engine->_device, gltf.materials.size(), sizes);
+		std::atomic<bool> failed{ false };
+		parallel_for(compressed.size(), [&](size_t j) {
+			const size_t viewIndex = compressed[j];
+			const fastgltf::CompressedBufferView& view = *gltf.bufferViews[viewIndex].meshoptCompression;
 
-	// Load samplers
-	for (fastgltf::Sampler& sampler : gltf.samplers) {
-		vk::SamplerCreateInfo samplerCreateInfo = {};
-		samplerCreateInfo.maxLod = vk::LodClampNone;
-		samplerCreateInfo.minLod = 0;
+			if (view.bufferIndex >= buffers.size() || view.byteOffset + view.byteLength > buffers[view.bufferIndex].size()) {
+				failed = true;
+				return;
+			}
+			std::span<const std::byte> encoded = buffers[view.bufferIndex].subspan(view.byteOffset, view.byteLength);
+
+			std::vector<std::byte>& decoded = decodedViews[viewIndex];
+			decoded.resize(view.count * view.byteStride);
+
+			bool ok = false;
+			switch (view.mode) {
+			case fastgltf::MeshoptCompressionMode::Attributes:
+				ok = meshopt::decode_vertex_buffer(decoded.data(), view.count, view.byteStride, encoded);
+				break;
+			case fastgltf::MeshoptCompressionMode::Triangles:
+				ok = meshopt::decode_index_buffer(decoded.data(), view.count, view.byteStride, encoded);
+				break;
+			case fastgltf::MeshoptCompressionMode::Indices:
+				ok = meshopt::decode_index_sequence(decoded.data(), view.count, view.byteStride, encoded);
+				break;
+			default:
+				break;
+			}
 
-		samplerCreateInfo.magFilter = extract_filter(sampler.magFilter.value_or(fastgltf::Filter::Nearest));
-		samplerCreateInfo.minFilter = extract_filter(sampler.minFilter.value_or(fastgltf::Filter::Nearest));
+			// Filters only exist for attributes and have fixed strides
+			if (ok && view.mode == fastgltf::MeshoptCompressionMode::Attributes) {
+				switch (view.filter) {
+				case fastgltf::MeshoptCompressionFilter::Octahedral:
+					ok = view.byteStride == 4 || view.byteStride == 8;
+					if (ok) {
+						meshopt::decode_filter_oct(decoded.data(), view.count, view.byteStride);
+					}
+					break;
+				case fastgltf::MeshoptCompressionFilter::Quaternion:
+					ok = view.byteStride == 8;
+					if (ok) {
+						meshopt::decode_filter_quat(decoded.data(), view.count);
+					}
+					break;
+				case fastgltf::MeshoptCompressionFilter::Exponential:
+					meshopt::decode_filter_exp(decoded.data(), view.count, view.byteStride);
+					break;
+				default:
+					break;
+				}
+			}
 
-		samplerCreateInfo.mipmapMode = extract_mipmap_mode(sampler.minFilter.value_or(fastgltf::Filter::Nearest));
+			if (!ok) {
+				failed = true;
+			}
+			});
 
-		vk::Sampler newSampler;
-		VK_CHECK(engine->_device.createSampler(&samplerCreateInfo, nullptr, &newSampler));
+		if (failed) {
+			std::cerr << "Failed to decode a meshopt compressed glTF buffer view" << std::endl;
+			return false;
+		}
+		return true;
+	}
 
-		file.samplers.push_back(newSampler);
+	// Empty when the view does not lie inside its buffer, e.g. an uncompressed view into a meshopt fallback
+	// buffer, which has no data. Callers check the size before reading
+	std::span<const std::byte> view_bytes(const fastgltf::Asset& asset, size_t bufferViewIndex) const {
+		const fastgltf::BufferView& view = asset.bufferViews[bufferViewIndex];
+		if (view.meshoptCompression) {
+			return std::span<const std::byte>(decodedViews[bufferViewIndex]).subspan(0, std::min(view.byteLength, decodedViews[bufferViewIndex].size()));
+		}
+		if (view.bufferIndex >= buffers.size() || view.byteOffset > buffers[view.bufferIndex].size() || view.byteLength > buffers[view.bufferIndex].size() - view.byteOffset) {
+			return {};
+		}
+		return buffers[view.bufferIndex].subspan(view.byteOffset, view.byteLength);
 	}
 
-	// Temporary arrays for all the objects to use while creating the glTF data
-	std::vector<std::shared_ptr<MeshAsset>> meshes;
-	std::vector<std::shared_ptr<Node>> nodes;
-	std::vector<AllocatedImage> images;
-	std::vector<std::shared_ptr<GLTFMaterial>> materials;
+	fastgltf::span<const std::byte> operator()(const fastgltf::Asset& asset, std::size_t bufferViewIndex) const {
+		std::span<const std::byte> bytes = view_bytes(asset, bufferViewIndex);
+		return fastgltf::span<const std::byte>(bytes.data(), bytes.size());
+	}
+};
+
+// Everything the import computes for one mesh before anything is created on the GPU
+struct ImportedMesh {
+	std::string name;
+	std::vector<GeoSurface> surfaces;
+	std::vector<size_t> surfaceMaterials; // glTF material of every surface, resolved once the materials exist
+	std::shared_ptr<OccluderGeometry> occluder;
+
+	// The packed GPU data, written in place by import_mesh. Empty for occluders
+	MeshStaging staging;
+	std::vector<std::byte> hostStaging; // Backs staging when cooking, there is no engine to allocate from
+
+	uint64_t hash{ 0 }; // Of the GPU data, the resource cache key of the buffers
+};
+
+//> vertex_decoding
+// Raw view of one vertex attribute for decode_vertices. Float and 8 and 16-bit integer components are
+// read, which covers the quantized attributes KHR_mesh_quantization allows
+struct AttributeStream {
+	const std::byte* data{ nullptr }; // Null when the primitive does not have the attribute
+	size_t stride{ 0 };
+	fastgltf::ComponentType componentType{ fastgltf::ComponentType::Float };
+	size_t components{ 0 };
+	bool normalized{ false };
+
+	const std::byte* element(size_t i) const { return data + i * stride; }
+};
+
+// Component type and normalization of a stream as template arguments, so every layout gets its own loop
+template<typename T, bool Normalized>
+struct AttributeLayout {};
+
+// Runs decode once with the layout of stream, which find_stream limited to the types handled here
+template<typename Decode>
+void with_layout(const AttributeStream& stream, Decode&& decode) {
+	switch (stream.componentType) {
+	case fastgltf::ComponentType::Byte:
+		return stream.normalized ? decode(AttributeLayout<int8_t, true>{}) : decode(AttributeLayout<int8_t, false>{});
+	case fastgltf::ComponentType::UnsignedByte:
+		return stream.normalized ? decode(AttributeLayout<uint8_t, true>{}) : decode(AttributeLayout<uint8_t, false>{});
+	case fastgltf::ComponentType::Short:
+		return stream.normalized ? decode(AttributeLayout<int16_t, true>{}) : decode(AttributeLayout<int16_t, false>{});
+	case fastgltf::ComponentType::UnsignedShort:
+		return stream.normalized ? decode(AttributeLayout<uint16_t, true>{}) : decode(AttributeLayout<uint16_t, false>{});
+	default:
+		return decode(AttributeLayout<float, false>{});
+	}
+}
 
-	// Load all textures
-	for (fastgltf::Image& image : gltf.images) {
-		std::optional<AllocatedImage> img = load_image(engine, gltf, image);
-		
-		if (img.has_value()) {
-			images.push_back(*img);
-			file.images[image.name.c_str()] = *img;
+// N components of one element. Packed floats are copied whole, normalized integers map to [0, 1] or [-1, 1]
+// and the others keep their value
+template<glm::length_t N, typename T, bool Normalized>
+glm::vec<N, float> read_element(const std::byte* element) {
+	glm::vec<N, float> value;
+	if constexpr (std::is_same_v<T, float>) {
+		memcpy(&value, element, sizeof(value));
+	}
+	else {
+		T raw[N];
+		memcpy(raw, element, sizeof(raw));
+		for (glm::length_t c = 0; c < N; c++) {
+			if constexpr (!Normalized) {
+				value[c] = (float)raw[c];
+			}
+			else if constexpr (std::is_signed_v<T>) {
+				value[c] = std::max((float)raw[c] * (1.f / (float)std::numeric_limits<T>::max()), -1.f);
+			}
+			else {
+				value[c] = (float)raw[c] * (1.f / (float)std::numeric_limits<T>::max());
+			}
 		}
-		else {
-			// Failed to load so give assign this slot the error checkerboard texture to not completely break loading
-			images.push_back(engine->_errorCheckerboardImage);
-			std::cout << "glTF failed to load texture" << image.name << std::endl;
+	}
+	return value;
+}
+
+// Whether every element of an accessor, and of its sparse indices and values, lies inside its buffer view.
+// The fastgltf accessor tools read without checking
+bool accessor_fits(const fastgltf::Asset& gltf, const GltfBuffers& buffers, const fastgltf::Accessor& accessor) {
+	auto fits = [&](size_t viewIndex, size_t offset, size_t count, size_t elementSize, size_t stride) {
+		if (viewIndex >= gltf.bufferViews.size()) {
+			return false;
+		}
+		return count == 0 || offset + (count - 1) * stride + elementSize <= buffers.view_bytes(gltf, viewIndex).size();
+		};
+
+	const size_t elementSize = fastgltf::getElementByteSize(accessor.type, accessor.componentType);
+	if (accessor.bufferViewIndex.has_value()) {
+		const size_t view = accessor.bufferViewIndex.value();
+		const size_t stride = view < gltf.bufferViews.size() ? gltf.bufferViews[view].byteStride.value_or(elementSize) : elementSize;
+		if (!fits(view, accessor.byteOffset, accessor.count, elementSize, stride)) {
+			return false;
 		}
 	}
 
-	// Load all materials
-	// Create a buffer to hold the material data
-	file.materialDataBuffer = engine->create_buffer(sizeof(GLTFMetallic_Roughness::MaterialConstants) * gltf.materials.size(), vk::BufferUsageFlagBits::eUniformBuffer, vma::MemoryUsage::eCpuToGpu);
-	int data_index = 0;
+	if (accessor.sparse.has_value()) {
+		const fastgltf::SparseAccessor& sparse = accessor.sparse.value();
+		const size_t indexSize = fastgltf::getElementByteSize(fastgltf::AccessorType::Scalar, sparse.indexComponentType);
+		return fits(sparse.indicesBufferView, sparse.indicesByteOffset, sparse.count, indexSize, indexSize)
+			&& fits(sparse.valuesBufferView, sparse.valuesByteOffset, sparse.count, elementSize, elementSize);
+	}
+	return true;
+}
 
-	GLTFMetallic_Roughness::MaterialConstants* sceneMaterialConstants = (GLTFMetallic_Roughness::MaterialConstants*)file.materialDataBuffer.info.pMappedData;
+// Whether the indices and the attributes import_mesh reads of a primitive fit in their views
+bool primitive_fits(const fastgltf::Asset& gltf, const GltfBuffers& buffers, const fastgltf::Primitive& p) {
+	if (!accessor_fits(gltf, buffers, gltf.accessors[p.indicesAccessor.value()])) {
+		return false;
+	}
+	for (std::string_view name : { "POSITION", "NORMAL", "TEXCOORD_0", "COLOR_0" }) {
+		auto attribute = p.findAttribute(name);
+		if (attribute != p.attributes.end() && !accessor_fits(gltf, buffers, gltf.accessors[attribute->accessorIndex])) {
+			return false;
+		}
+	}
+	return true;
+}
 
-	// Loop to load materials
-	for (fastgltf::Material& mat : gltf.materials) {
-		std::shared_ptr<GLTFMaterial> newMat = std::make_shared<GLTFMaterial>();
-		materials.push_back(newMat);
-		file.materials[mat.name.c_str()] = newMat;
-
-		GLTFMetallic_Roughness::MaterialConstants constants;
-		constants.colorFactors.x = mat.pbrData.baseColorFactor[0];
-		constants.colorFactors.y = mat.pbrData.baseColorFactor[1];
-		constants.colorFactors.z = mat.pbrData.baseColorFactor[2];
-		constants.colorFactors.w = mat.pbrData.baseColorFactor[3];
-
-		constants.metal_rough_factors.x = mat.pbrData.metallicFactor;
-		constants.metal_rough_factors.y = mat.pbrData.roughnessFactor;
-		
-		// Write material parameters to buffer
-		sceneMaterialConstants[data_index] = constants;
+// Sets up the stream of a primitive attribute. False when the attribute exists but has a layout the
+// fast path does not read: sparse, 32-bit integers or doubles, or a view too short for its elements.
+// A missing attribute is fine and leaves the stream empty
+bool find_stream(fastgltf::Asset& gltf, const GltfBuffers& buffers, fastgltf::Primitive& p, std::string_view name, size_t count, AttributeStream& stream) {
+	auto attribute = p.findAttribute(name);
+	if (attribute == p.attributes.end()) {
+		return true;
+	}
 
-		MaterialPass passType = MaterialPass::MainColor;
-		if (mat.alphaMode == fastgltf::AlphaMode::Blend) {
-			passType = MaterialPass::Transparent;
-		}
+	fastgltf::Accessor& accessor = gltf.accessors[attribute->accessorIndex];
+	if (!accessor.bufferViewIndex.has_value() || accessor.sparse.has_value() || accessor.count != count) {
+		return false;
+	}
 
-		GLTFMetallic_Roughness::MaterialResources materialResources;
-		
-		// Default the material textures
-		materialResources.colorImage = engine->_whiteImage;
-		materialResources.colorSampler = engine->_defaultSamplerLinear;
-		materialResources.metalRoughImage = engine->_whiteImage;
-		materialResources.metalRoughSampler = engine->_defaultSamplerLinear;
+	switch (accessor.componentType) {
+	case fastgltf::ComponentType::Float:
+	case fastgltf::ComponentType::Byte:
+	case fastgltf::ComponentType::UnsignedByte:
+	case fastgltf::ComponentType::Short:
+	case fastgltf::ComponentType::UnsignedShort:
+		break;
+	default:
+		return false;
+	}
 
-		// Set the uniform buffer for the material data
-		materialResources.dataBuffer = file.materialDataBuffer.buffer;
-		materialResources.dataBufferOffset = data_index * sizeof(GLTFMetallic_Roughness::MaterialConstants);
+	std::span<const std::byte> bytes = buffers.view_bytes(gltf, accessor.bufferViewIndex.value());
+	const size_t elementSize = fastgltf::getElementByteSize(accessor.type, accessor.componentType);
+	const size_t stride = gltf.bufferViews[accessor.bufferViewIndex.value()].byteStride.value_or(elementSize);
 
-		// Grab textures from glTF file
-		if (mat.pbrData.baseColorTexture.has_value()) {
-			// Holy mother of nesting
-			size_t img = gltf.textures[mat.pbrData.baseColorTexture.value().textureIndex].imageIndex.value();
-			size_t sampler = gltf.textures[mat.pbrData.baseColorTexture.value().textureIndex].samplerIndex.value();
+	// The last element has to end inside the view
+	if (count > 0 && accessor.byteOffset + (count - 1) * stride + elementSize > bytes.size()) {
+		return false;
+	}
+
+	stream.data = bytes.data() + accessor.byteOffset;
+	stream.stride = stride;
+	stream.componentType = accessor.componentType;
+	stream.components = fastgltf::getNumComponents(accessor.type);
+	stream.normalized = accessor.normalized;
+	return true;
+}
+
+// Decodes position, normal, uv and color of a primitive straight into out, one loop per attribute specialized
+// for its layout, and computes the position bounds in the position loop. False when an attribute has a layout
+// the fast path does not cover, the caller then falls back to one fastgltf accessor pass per attribute
+bool decode_vertices(fastgltf::Asset& gltf, const GltfBuffers& buffers, fastgltf::Primitive& p, std::span<Vertex> out, glm::vec3& minpos, glm::vec3& maxpos) {
+	AttributeStream position, normal, uv, color;
+	if (!find_stream(gltf, buffers, p, "POSITION", out.size(), position) ||
+		!find_stream(gltf, buffers, p, "NORMAL", out.size(), normal) ||
+		!find_stream(gltf, buffers, p, "TEXCOORD_0", out.size(), uv) ||
+		!find_stream(gltf, buffers, p, "COLOR_0", out.size(), color)) {
+		return false;
+	}
 
-			// ...but it's neat for indexing
-			materialResources.colorImage = images[img];
-			materialResources.colorSampler = file.samplers[sampler];
+	if (!position.data || position.components != 3 || (normal.data && normal.components != 3) ||
+		(uv.data && uv.components != 2) || (color.data && color.components != 3 && color.components != 4)) {
+		return false;
+	}
+
+	with_layout(position, [&]<typename T, bool Normalized>(AttributeLayout<T, Normalized>) {
+		glm::vec3 lo{ std::numeric_limits<float>::max() };
+		glm::vec3 hi{ -std::numeric_limits<float>::max() };
+		for (size_t i = 0; i < out.size(); i++) {
+			const glm::vec3 value = read_element<3, T, Normalized>(position.element(i));
+			out[i].position = value;
+			lo = glm::min(lo, value);
+			hi = glm::max(hi, value);
+		}
+		minpos = lo;
+		maxpos = hi;
+		});
+
+	if (normal.data) {
+		with_layout(normal, [&]<typename T, bool Normalized>(AttributeLayout<T, Normalized>) {
+			for (size_t i = 0; i < out.size(); i++) {
+				const glm::vec3 n = read_element<3, T, Normalized>(normal.element(i));
+				if constexpr (std::is_same_v<T, float>) {
+					out[i].normal = n;
+				}
+				else {
+					// Quantized normals are only close to unit length, zero ones of broken files keep the default
+					out[i].normal = glm::dot(n, n) > 0.f ? glm::normalize(n) : glm::vec3{ 1.f, 0.f, 0.f };
+				}
+			}
+			});
+	}
+	else {
+		for (Vertex& v : out) {
+			v.normal = glm::vec3{ 1.f, 0.f, 0.f };
 		}
+	}
 
-		// Build material
-		
-		newMat->data = engine->_metalRoughMaterial.write_material(engine->_device, passType, materialResources, file.descriptorPool);
+	if (uv.data) {
+		with_layout(uv, [&]<typename T, bool Normalized>(AttributeLayout<T, Normalized>) {
+			for (size_t i = 0; i < out.size(); i++) {
+				const glm::vec2 value = read_element<2, T, Normalized>(uv.element(i));
+				out[i].uv_x = value.x;
+				out[i].uv_y = value.y;
+			}
+			});
+	}
+	else {
+		for (Vertex& v : out) {
+			v.uv_x = 0.f;
+			v.uv_y = 0.f;
+		}
+	}
 
-		data_index++;	
+	if (color.data) {
+		with_layout(color, [&]<typename T, bool Normalized>(AttributeLayout<T, Normalized>) {
+			if (color.components == 4) {
+				for (size_t i = 0; i < out.size(); i++) {
+					out[i].color = read_element<4, T, Normalized>(color.element(i));
+				}
+			}
+			else {
+				for (size_t i = 0; i < out.size(); i++) {
+					out[i].color = glm::vec4{ read_element<3, T, Normalized>(color.element(i)), 1.f };
+				}
+			}
+			});
 	}
+	else {
+		for (Vertex& v : out) {
+			v.color = glm::vec4{ 1.f };
+		}
+	}
+	return true;
+}
+//< vertex_decoding
 
-	// Loading meshes
+// Converts the accessors of a mesh, computes bounds, LODs and meshlets and packs the vertices.
+// Only reads the asset, so meshes can be imported on worker threads. Without an engine the packed
+// data goes to host memory, for cookGltf
+ImportedMesh import_mesh(VkSREngine* engine, fastgltf::Asset& gltf, const GltfBuffers& buffers, fastgltf::Mesh& mesh) {
+	ImportedMesh result;
+	result.name = mesh.name;
+
+	// Meshes with "occluder" in their name are low poly stand-ins for the CPU occlusion culling
+	std::string lowerName = result.name;
+	std::transform(lowerName.begin(), lowerName.end(), lowerName.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+	const bool isOccluder = lowerName.find("occluder") != std::string::npos;
 
-	// Use the same vectors for all meshes so that the memory doesn't reallocate as often
 	std::vector<uint32_t> indices;
 	std::vector<Vertex> vertices;
+	std::vector<GPUMeshlet> meshlets;
+	bool hasColors = false;
+
+	// Reserve from the accessor counts, the LODs only add a fraction on top
+	size_t vertexCount = 0;
+	size_t indexCount = 0;
+	for (auto&& p : mesh.primitives) {
+		vertexCount += gltf.accessors[p.findAttribute("POSITION")->accessorIndex].count;
+		indexCount += gltf.accessors[p.indicesAccessor.value()].count;
+	}
+	vertices.reserve(vertexCount);
+	indices.reserve(indexCount);
+
+	for (auto&& p : mesh.primitives) {
+		// Nothing is read from a primitive that points outside its buffers, it is left out
+		if (!primitive_fits(gltf, buffers, p)) {
+			std::cerr << "glTF mesh " << mesh.name << " has a primitive outside its buffers" << std::endl;
+			continue;
+		}
 
-	// Iteratively load meshes
-	for (fastgltf::Mesh& mesh : gltf.meshes) {
-		std::shared_ptr<MeshAsset> newMesh = std::make_shared<MeshAsset>();
-		meshes.push_back(newMesh);
-		file.meshes[mesh.name.c_str()] = newMesh;
-		newMesh->name = mesh.name;
-
-		// Clear the mesh arrays to avoid crossing the beams
-		indices.clear();
-		vertices.clear();
-
-		for (auto&& p : mesh.primitives) {
-			GeoSurface newSurface;
-			newSurface.startIndex = (uint32_t)indices.size();
-			newSurface.count = (uint32_t)gltf.accessors[p.indicesAccessor.value()].count;
+		GeoSurface newSurface;
+		newSurface.startIndex = (uint32_t)indices.size();
+		newSurface.vertexOffset = (uint32_t)vertices.size();
+		newSurface.count = (uint32_t)gltf.accessors[p.indicesAccessor.value()].count;
 
-			size_t initial_vtx = vertices.size();
+		size_t initial_vtx = vertices.size();
+		fastgltf::Accessor& posAccessor = gltf.accessors[p.findAttribute("POSITION")->accessorIndex];
 
-			// Load indices
-			{
-				fastgltf::Accessor& indexAccessor = gltf.accessors[p.indicesAccessor.value()];
-				indices.reserve(indices.size() + indexAccessor.count);
+		// Load indices. The LOD and cache passes index the vertex arrays with them, so like the package path
+		// every triangle has to be whole and every index has to name a vertex of the primitive
+		{
+			fastgltf::Accessor& indexAccessor = gltf.accessors[p.indicesAccessor.value()];
 
+			bool validIndices = indexAccessor.count % 3 == 0;
+			if (validIndices) {
 				fastgltf::iterateAccessor<std::uint32_t>(gltf, indexAccessor,
 					[&](std::uint32_t idx) {
+						validIndices &= idx < posAccessor.count;
 						indices.push_back(idx + initial_vtx);
-					});
+					}, buffers);
 			}
 
-			// Load the vertices
-			{
-				fastgltf::Accessor& posAccessor = gltf.accessors[p.findAttribute("POSITION")->accessorIndex];
-				vertices.resize(vertices.size() + posAccessor.count);
-
-				fastgltf::iterateAccessorWithIndex<glm::vec3>(gltf, posAccessor,
-					[&](glm::vec3 v, size_t index) {
-						Vertex newVtx;
-						newVtx.position = v;
-						newVtx.normal = { 1,0,0 }; // Default for now, will load normals next time around if they exist
-						newVtx.color = glm::vec4{ 1.f };
-						newVtx.uv_x = 0;
-						newVtx.uv_y = 0;
-						vertices[initial_vtx + index] = newVtx;
-					});
+			if (!validIndices) {
+				std::cerr << "glTF mesh " << mesh.name << " has a primitive outside its buffers" << std::endl;
+				indices.resize(newSurface.startIndex);
+				continue;
 			}
+		}
+
+		// Load the vertices, in one pass together with the bounds when every attribute has a common layout
+		vertices.resize(vertices.size() + posAccessor.count);
+
+		hasColors |= p.findAttribute("COLOR_0") != p.attributes.end();
+
+		glm::vec3 minpos, maxpos;
+		if (!decode_vertices(gltf, buffers, p, std::span<Vertex>(vertices.data() + initial_vtx, posAccessor.count), minpos, maxpos)) {
+			fastgltf::iterateAccessorWithIndex<glm::vec3>(gltf, posAccessor,
+				[&](glm::vec3 v, size_t index) {
+					Vertex newVtx;
+					newVtx.position = v;
+					newVtx.normal = { 1,0,0 }; // Default for now, will load normals next time around if they exist
+					newVtx.color = glm::vec4{ 1.f };
+					newVtx.uv_x = 0;
+					newVtx.uv_y = 0;
+					vertices[initial_vtx + index] = newVtx;
+				}, buffers);
 
 			// Load vertex normals (if they exist)
 			auto normals = p.findAttribute("NORMAL");
@@ -342,7 +654,7 @@ std::optional<std::shared_ptr<LoadedGLTF>> loadGltf(VkSREngine* engine, std::str
 				fastgltf::iterateAccessorWithIndex<glm::vec3>(gltf, gltf.accessors[(*normals).accessorIndex],
 					[&](glm::vec3 v, size_t index) {
 						vertices[initial_vtx + index].normal = v;
-					});
+					}, buffers);
 			}
 
 			// Load UVs (if they exist)
@@ -352,7 +664,7 @@ std::optional<std::shared_ptr<LoadedGLTF>> loadGltf(VkSREngine* engine, std::str
 					[&](glm::vec2 v, size_t index) {
 						vertices[initial_vtx + index].uv_x = v.x;
 						vertices[initial_vtx + index].uv_y = v.y;
-					});
+					}, buffers);
 			}
 
 			// Load vertex colors (if they exist)
@@ -361,103 +673,2249 @@ std::optional<std::shared_ptr<LoadedGLTF>> loadGltf(VkSREngine* engine, std::str
 				fastgltf::iterateAccessorWithIndex<glm::vec4>(gltf, gltf.accessors[(*colors).accessorIndex],
 					[&](glm::vec4 v, size_t index) {
 						vertices[initial_vtx + index].color = v;
-					});
-			}
-
-			// Add material to the primitive if it exists
-			if (p.materialIndex.has_value()) {
-				newSurface.material = materials[p.materialIndex.value()];
-			}
-			else {
-				newSurface.material = materials[0];
+					}, buffers);
 			}
 
 			// Calculate the bounds of the mesh for culling by comparing all vertices min and max
-			glm::vec3 minpos = vertices[initial_vtx].position;
-			glm::vec3 maxpos = vertices[initial_vtx].position;
-			for (int i = initial_vtx; i < vertices.size(); i++) {
+			minpos = vertices[initial_vtx].position;
+			maxpos = vertices[initial_vtx].position;
+			for (size_t i = initial_vtx; i < vertices.size(); i++) {
 				minpos = glm::min(minpos, vertices[i].position);
 				maxpos = glm::max(maxpos, vertices[i].position);
 			}
-			
-			// Calculate origin and extents from min/max and use the extent length for radius
-			newSurface.bounds.origin = (maxpos + minpos) / 2.f;
-			newSurface.bounds.extents = (maxpos - minpos) / 2.f;
-			newSurface.bounds.sphereRadius = glm::length(newSurface.bounds.extents);
-
-			newMesh->surfaces.push_back(newSurface);
 		}
 
-		newMesh->meshBuffers = engine->upload_mesh(indices, vertices);
-	}
+		// Add material to the primitive if it exists
+		result.surfaceMaterials.push_back(p.materialIndex.value_or(0));
 
-	// Load all nodes and their meshes
-	for (fastgltf::Node& node : gltf.nodes) {
-		std::shared_ptr<Node> newNode;
+		// Calculate origin and extents from min/max and use the extent length for radius
+		newSurface.bounds.origin = (maxpos + minpos) / 2.f;
+		newSurface.bounds.extents = (maxpos - minpos) / 2.f;
+		newSurface.bounds.sphereRadius = glm::length(newSurface.bounds.extents);
 
-		// Find if the node has a mesh, and if it does hook it to the mesh pointer and allocated it with the meshnode class
-		if (node.meshIndex.has_value()) {
-			newNode = std::make_shared<MeshNode>();
-			static_cast<MeshNode*>(newNode.get())->mesh = meshes[*node.meshIndex];
-		}
-		else {
-			newNode = std::make_shared<Node>();
+		// Simplified levels go into the same index buffer, right after the full detail indices
+		newSurface.lods.push_back(MeshLod{ newSurface.startIndex, newSurface.count, 0.f });
+		if (!isOccluder) {
+			generate_lods(newSurface, indices, vertices, initial_vtx);
+			optimize_surface(newSurface, indices, vertices, initial_vtx);
+
+			bool doubleSided = p.materialIndex.has_value() && gltf.materials[p.materialIndex.value()].doubleSided;
+			build_surface_meshlets(newSurface, meshlets, indices, vertices, doubleSided);
 		}
 
-		nodes.push_back(newNode);
-		file.nodes[node.name.c_str()];
+		result.surfaces.push_back(newSurface);
+	}
 
-		
+	if (isOccluder) {
+		// Keep positions only and skip the GPU upload, the surfaces are dropped so nothing gets drawn
+		result.occluder = std::make_shared<OccluderGeometry>();
+		result.occluder->indices = std::move(indices);
+		result.occluder->positions.reserve(vertices.size());
+		for (const Vertex& v : vertices) {
+			result.occluder->positions.push_back(v.position);
+		}
+		result.surfaces.clear();
+		result.surfaceMaterials.clear();
+		return result;
+	}
 
-		// The transform attribute of a node is a std::variant of type either fastgltf::TRS or 
-		// fastgltf::fmat4x4, and an option called "DecomposeNodeMatrices" can make node.transform
-		// return a TRS. Here we handle both cases.
-		std::visit(fastgltf::visitor{
-			[&](fastgltf::math::fmat4x4 matrix) { 
-				memcpy(&newNode->localTransform, matrix.data(), sizeof(matrix));
-			},
-			[&](fastgltf::TRS transform) {
-				glm::vec3 tl(transform.translation[0], transform.translation[1], transform.translation[2]);
-				glm::quat rot(transform.rotation[3], transform.rotation[0], transform.rotation[1], transform.rotation[2]); // w, x, y, z
-				glm::vec3 sc(transform.scale[0], transform.scale[1], transform.scale[2]);
+	// Every primitive was left out, there is nothing to upload
+	if (result.surfaces.empty()) {
+		return result;
+	}
 
-				glm::mat4 tm = glm::translate(glm::mat4(1.f), tl);
-				glm::mat4 rm = glm::toMat4(rot);
-				glm::mat4 sm = glm::scale(glm::mat4(1.f), sc);
+	// Make the indices relative to their surface, most meshes then fit in 16-bit indices
+	bool fitsUint16 = true;
+	for (const GeoSurface& s : result.surfaces) {
+		const MeshLod& lastLod = s.lods.back();
+		std::span<uint32_t> surfaceIndices(indices.data() + s.startIndex, lastLod.startIndex + lastLod.count - s.startIndex);
+		fitsUint16 &= meshutil::rebase_indices(surfaceIndices, s.vertexOffset);
+	}
 
-				newNode->localTransform = tm * rm * sm;
-			}
-			},
-			node.transform);
+	// Hashed here on the worker thread, the same mesh in another file then reuses the uploaded buffers.
+	// The packed data is a function of the vertices and the surface ranges, so those are hashed instead of
+	// reading the staging memory back
+	result.hash = hash_bytes(vertices.data(), vertices.size() * sizeof(Vertex), hasColors);
+	result.hash = hash_bytes(indices.data(), indices.size() * sizeof(uint32_t), result.hash);
+	result.hash = hash_bytes(meshlets.data(), meshlets.size() * sizeof(GPUMeshlet), result.hash);
+	for (const GeoSurface& s : result.surfaces) {
+		result.hash = hash_bytes(&s.vertexOffset, sizeof(s.vertexOffset), result.hash);
 	}
 
-	// Run loop again to setup transform hierarchy
-	for (int i = 0; i < gltf.nodes.size(); i++) {
-		fastgltf::Node& node = gltf.nodes[i];
-		std::shared_ptr<Node>& sceneNode = nodes[i];
+	// Most meshes only have the default white, those skip the color stream entirely
+	MeshStaging& staging = result.staging;
+	const vk::IndexType indexType = fitsUint16 ? vk::IndexType::eUint16 : vk::IndexType::eUint32;
+	if (engine) {
+		staging = engine->create_mesh_staging(vertices.size(), hasColors ? vertices.size() : 0, meshlets.size(), indices.size(), indexType);
+	}
+	else {
+		staging = MeshStaging{ {}, vertices.size(), hasColors ? vertices.size() : 0, meshlets.size(), indices.size(), indexType };
+		result.hostStaging.resize(staging.size());
+		staging.buffer.info.pMappedData = result.hostStaging.data();
+	}
 
-		for (auto& c : node.children) {
-			sceneNode->children.push_back(nodes[c]);
-			nodes[c]->parent = sceneNode;
+	// Pack the vertices surface by surface, positions are quantized against each surface's bounds
+	PackedVertex* packedVertices = staging.vertices();
+	uint16_t* positions = staging.positions();
+	for (size_t i = 0; i < result.surfaces.size(); i++) {
+		const GeoSurface& s = result.surfaces[i];
+		size_t end = (i + 1 < result.surfaces.size()) ? result.surfaces[i + 1].vertexOffset : vertices.size();
+		for (size_t v = s.vertexOffset; v < end; v++) {
+			PackedVertex packed = pack_vertex(vertices[v], s.bounds);
+			packedVertices[v] = packed;
+			positions[v * 4 + 0] = packed.position[0];
+			positions[v * 4 + 1] = packed.position[1];
+			positions[v * 4 + 2] = packed.position[2];
+			positions[v * 4 + 3] = 0;
 		}
 	}
 
-	// Find the top nodes (with no parents :c )
-	for (auto& node : nodes) {
-		if (node->parent.lock() == nullptr) {
-			file.topNodes.push_back(node);
-			node->refreshTransform(glm::mat4{ 1.f });
+	if (hasColors) {
+		uint32_t* colors = staging.colors();
+		for (size_t v = 0; v < vertices.size(); v++) {
+			colors[v] = glm::packUnorm4x8(vertices[v].color);
 		}
 	}
-	return scene;
-}
-//< loadgltf_func
 
-//> LoadedGLTF
-void LoadedGLTF::Draw(const glm::mat4& topMatrix, DrawContext& ctx) {
-	// Create renderables from the scene nodes
-	for (auto& n : topNodes) {
-		n->Draw(topMatrix, ctx);
+	memcpy(staging.meshlets(), meshlets.data(), staging.meshlet_bytes());
+
+	if (fitsUint16) {
+		meshutil::narrow_indices(indices, std::span((uint16_t*)staging.indices(), indices.size()));
+	}
+	else {
+		memcpy(staging.indices(), indices.data(), staging.index_bytes());
+	}
+
+	return result;
+}
+
+// Bumped whenever decoding or mip generation changes, older disk cache entries are then never hit
+constexpr uint64_t TEXTURE_CACHE_VERSION = 4;
+
+// How materials sample a glTF image, which picks the format it is decoded to. The metallic-roughness slot
+// always reads roughness from R and metallic from G, whichever of its kinds the image has
+enum class TextureKind : uint8_t {
+	Data,       // RGBA8 or RGB8, normal maps and images sampled in several roles or in none
+	Color,      // sRGB with the channels of the source, base color and emissive
+	MetalRough, // RG8, roughness in R and metallic in G
+	Occlusion,  // R8
+	OcclusionMetalRough, // RGB8, one image packing roughness in R, metallic in G and occlusion in B
+};
+
+// The kind of every image, from the material slots its textures are bound to. A KHR_texture_basisu texture
+// gives its KTX2 image and its fallback the same kind
+std::vector<TextureKind> image_kinds(const fastgltf::Asset& gltf) {
+	enum : uint8_t { COLOR = 1, METAL_ROUGH = 2, OCCLUSION = 4, DATA = 8 };
+	std::vector<uint8_t> roles(gltf.images.size(), 0);
+
+	auto mark = [&](size_t textureIndex, uint8_t role) {
+		const fastgltf::Texture& texture = gltf.textures[textureIndex];
+		if (texture.imageIndex.has_value()) {
+			roles[texture.imageIndex.value()] |= role;
+		}
+		if (texture.basisuImageIndex.has_value()) {
+			roles[texture.basisuImageIndex.value()] |= role;
+		}
+		};
+
+	for (const fastgltf::Material& mat : gltf.materials) {
+		if (mat.pbrData.baseColorTexture.has_value()) {
+			mark(mat.pbrData.baseColorTexture.value().textureIndex, COLOR);
+		}
+		if (mat.emissiveTexture.has_value()) {
+			mark(mat.emissiveTexture.value().textureIndex, COLOR);
+		}
+		if (mat.pbrData.metallicRoughnessTexture.has_value()) {
+			mark(mat.pbrData.metallicRoughnessTexture.value().textureIndex, METAL_ROUGH);
+		}
+		if (mat.occlusionTexture.has_value()) {
+			mark(mat.occlusionTexture.value().textureIndex, OCCLUSION);
+		}
+		if (mat.normalTexture.has_value()) {
+			mark(mat.normalTexture.value().textureIndex, DATA);
+		}
+	}
+
+	std::vector<TextureKind> kinds(roles.size(), TextureKind::Data);
+	for (size_t i = 0; i < roles.size(); i++) {
+		switch (roles[i]) {
+		case COLOR: kinds[i] = TextureKind::Color; break;
+		case METAL_ROUGH: kinds[i] = TextureKind::MetalRough; break;
+		case OCCLUSION: kinds[i] = TextureKind::Occlusion; break;
+		case OCCLUSION | METAL_ROUGH: kinds[i] = TextureKind::OcclusionMetalRough; break;
+		default: break;
+		}
+	}
+	return kinds;
+}
+
+// Pixels of a glTF image as a full mip chain in a GPU format. The images stb_image decodes only have level 0
+// when loading into an engine, possibly packed in a format upload_format widens on the GPU, and the mip
+// generator builds the rest. The levels are owned, or read straight from the mapped disk cache file or
+// cooked package. No levels when decoding failed
+struct DecodedImage {
+	int width{ 0 };
+	int height{ 0 };
+	uint64_t hash{ 0 }; // Of the source, the resource cache key of the image
+	vk::Format format{ vk::Format::eR8G8B8A8Unorm };
+
+	std::vector<ImageLevel> levels; // Offsets into bytes()
+	std::vector<std::byte> blocks;
+	MappedFile cached;
+	std::span<const std::byte> packaged; // In the package mapping GltfImport keeps alive
+
+	bool unused{ false }; // A KHR_texture_basisu fallback whose KTX2 image is used instead, never uploaded
+	bool generateMips{ false }; // Only level 0 is decoded
+
+	std::span<const std::byte> bytes() const {
+		if (!blocks.empty()) {
+			return blocks;
+		}
+		return cached.bytes().empty() ? packaged : cached.bytes();
+	}
+	bool valid() const { return !levels.empty(); }
+	size_t upload_size() const {
+		size_t size = 0;
+		for (const ImageLevel& level : levels) {
+			size += level.size;
+		}
+		return size;
+	}
+};
+
+// Packed level 0 formats the stb_image path decodes to and create_image expands to RGBA8, with their
+// channel count. 0 for formats that are uploaded as they are
+uint32_t expanded_channels(vk::Format format) {
+	switch (format) {
+	case vk::Format::eR8Srgb:
+		return 1;
+	case vk::Format::eR8G8Srgb:
+		return 2;
+	case vk::Format::eR8G8B8Srgb:
+	case vk::Format::eR8G8B8Unorm:
+		return 3;
+	default:
+		return 0;
+	}
+}
+
+// The format the image of decoded texels is created in
+vk::Format upload_format(vk::Format format) {
+	switch (format) {
+	case vk::Format::eR8Srgb:
+	case vk::Format::eR8G8Srgb:
+	case vk::Format::eR8G8B8Srgb:
+		return vk::Format::eR8G8B8A8Srgb;
+	case vk::Format::eR8G8B8Unorm:
+		return vk::Format::eR8G8B8A8Unorm;
+	default:
+		return format;
+	}
+}
+
+// The GPU format of a KTX2 payload, nothing for formats the loader does not upload. Color images take the
+// sRGB variant so sampling linearizes them, everything else the UNORM one
+std::optional<vk::Format> ktx2_format(uint32_t vkFormat, TextureKind kind) {
+	const bool srgb = kind == TextureKind::Color;
+	switch ((vk::Format)vkFormat) {
+	case vk::Format::eBc1RgbUnormBlock:
+	case vk::Format::eBc1RgbSrgbBlock:
+		return srgb ? vk::Format::eBc1RgbSrgbBlock : vk::Format::eBc1RgbUnormBlock;
+	case vk::Format::eBc1RgbaUnormBlock:
+	case vk::Format::eBc1RgbaSrgbBlock:
+		return srgb ? vk::Format::eBc1RgbaSrgbBlock : vk::Format::eBc1RgbaUnormBlock;
+	case vk::Format::eBc3UnormBlock:
+	case vk::Format::eBc3SrgbBlock:
+		return srgb ? vk::Format::eBc3SrgbBlock : vk::Format::eBc3UnormBlock;
+	case vk::Format::eBc4UnormBlock:
+		return vk::Format::eBc4UnormBlock;
+	case vk::Format::eBc5UnormBlock:
+		return vk::Format::eBc5UnormBlock;
+	case vk::Format::eBc7UnormBlock:
+	case vk::Format::eBc7SrgbBlock:
+		return srgb ? vk::Format::eBc7SrgbBlock : vk::Format::eBc7UnormBlock;
+	case vk::Format::eR8G8B8A8Unorm:
+	case vk::Format::eR8G8B8A8Srgb:
+		return srgb ? vk::Format::eR8G8B8A8Srgb : vk::Format::eR8G8B8A8Unorm;
+	default:
+		return {};
+	}
+}
+
+// Reads the header of a KTX2 file the device can sample. Basis Universal and supercompressed payloads
+// are rejected, those textures use their glTF fallback source. Without an engine (cooking) every format
+// ktx2_format knows is taken, the fallback is cooked next to it and loadPackage picks one for the device
+bool read_ktx2(VkSREngine* engine, std::span<const std::byte> bytes, TextureKind kind, ktx2::Header& header, vk::Format& format) {
+	if (!ktx2::read_header(bytes, header) || header.supercompression != ktx2::NONE) {
+		return false;
+	}
+
+	// Payloads keep glTF's channel order, metallic-roughness textures take their decoded fallback instead
+	if (kind == TextureKind::MetalRough || kind == TextureKind::OcclusionMetalRough) {
+		return false;
+	}
+
+	std::optional<vk::Format> gpuFormat = ktx2_format(header.vkFormat, kind);
+	if (!gpuFormat.has_value() || (engine && !engine->supports_texture_format(*gpuFormat))) {
+		return false;
+	}
+
+	// Uncompressed levels are exactly their texels, a short one would have the upload read past the staging buffer
+	for (size_t i = 0; i < header.levels.size(); i++) {
+		const vk::Extent2D levelSize{ std::max(header.width >> i, 1u), std::max(header.height >> i, 1u) };
+		if (header.levels[i].size != vkutil::image_level_size(*gpuFormat, levelSize)) {
+			return false;
+		}
+	}
+
+	format = *gpuFormat;
+	return true;
+}
+
+void build_mip_chain(const uint8_t* texels, uint32_t width, uint32_t height, vk::Format format, bool fullChain, DecodedImage& decoded);
+
+// Copies the levels of a KTX2 image, the source bytes belong to the glTF file
+void decode_ktx2(VkSREngine* engine, std::span<const std::byte> bytes, TextureKind kind, DecodedImage& decoded) {
+	ktx2::Header header;
+	vk::Format format;
+	if (!read_ktx2(engine, bytes, kind, header, format)) {
+		return;
+	}
+
+	// Files with a level count of 0 have their mips built like decoded images, by the engine's mip generator or
+	// on the CPU when cooking. Nothing generates block compressed mips, those keep their single level
+	const bool generateMips = header.generateMips && !vk::isCompressed(format) && (header.width > 1 || header.height > 1);
+	if (generateMips && !engine) {
+		build_mip_chain((const uint8_t*)bytes.data() + header.levels[0].offset, header.width, header.height, format, true, decoded);
+	}
+	else {
+		// Every level starts 16 byte aligned in the staging buffer, buffer to image copies of block formats need that
+		size_t size = 0;
+		for (const ktx2::Level& level : header.levels) {
+			decoded.levels.push_back(ImageLevel{ size, level.size });
+			size += (level.size + 15) & ~size_t(15);
+		}
+
+		decoded.blocks.resize(size);
+		for (size_t i = 0; i < header.levels.size(); i++) {
+			memcpy(decoded.blocks.data() + decoded.levels[i].offset, bytes.data() + header.levels[i].offset, header.levels[i].size);
+		}
+
+		decoded.width = (int)header.width;
+		decoded.height = (int)header.height;
+		decoded.format = format;
+		decoded.generateMips = generateMips;
+	}
+
+	decoded.hash = hash_bytes(decoded.blocks.data(), decoded.blocks.size(), ((uint64_t)decoded.width << 32) | (uint32_t)decoded.height);
+	decoded.hash = hash_bytes(&decoded.format, sizeof(decoded.format), decoded.hash);
+}
+
+// Maps the disk cache entry of an image and reads its levels in place, false on a miss. Entries hold the
+// level 0 build_mip_chain laid out, in the format it was decoded to. Cooking has no engine and so no cache
+bool load_cached_image(VkSREngine* engine, uint64_t key, DecodedImage& decoded) {
+	if (!engine || !engine->_textureCache.load(key, decoded.cached)) {
+		return false;
+	}
+
+	// Entries only ever hold level 0, which is handed to create_image without its size, so that has to match
+	ktx2::Header header;
+	if (!ktx2::read_header(decoded.cached.bytes(), header) || header.supercompression != ktx2::NONE || header.levels.size() != 1
+		|| vk::isCompressed((vk::Format)header.vkFormat) || !engine->supports_texture_format(upload_format((vk::Format)header.vkFormat))
+		|| header.levels[0].size != vkutil::image_level_size((vk::Format)header.vkFormat, vk::Extent2D{ header.width, header.height })) {
+		decoded.cached.close();
+		return false;
+	}
+
+	for (const ktx2::Level& level : header.levels) {
+		decoded.levels.push_back(ImageLevel{ level.offset, level.size });
+	}
+	decoded.width = (int)header.width;
+	decoded.height = (int)header.height;
+	decoded.format = (vk::Format)header.vkFormat;
+	decoded.generateMips = header.width > 1 || header.height > 1;
+	return true;
+}
+
+// Widens packed grey, grey-alpha or RGB texels to RGBA8 the same way texel_expand.comp does
+std::vector<uint8_t> expand_texels(const uint8_t* texels, size_t count, uint32_t channels) {
+	std::vector<uint8_t> rgba(count * 4);
+	for (size_t i = 0; i < count; i++) {
+		const uint8_t* src = texels + i * channels;
+		uint8_t* dst = rgba.data() + i * 4;
+		if (channels == 3) {
+			dst[0] = src[0];
+			dst[1] = src[1];
+			dst[2] = src[2];
+		}
+		else {
+			dst[0] = dst[1] = dst[2] = src[0];
+		}
+		dst[3] = channels == 2 ? src[1] : 255;
+	}
+	return rgba;
+}
+
+// Box filtered mip chain of 8 bit texels in format, down to 1x1. Laid out as a KTX2 file, so it goes to the
+// disk cache as is. Without fullChain only level 0 is laid out, packed as decoded, and the engine expands it
+// and generates the rest. Cooked packages need the full chain in the upload format, so they are expanded here
+void build_mip_chain(const uint8_t* texels, uint32_t width, uint32_t height, vk::Format format, bool fullChain, DecodedImage& decoded) {
+	const uint32_t chainLength = static_cast<uint32_t>(std::floor(std::log2(std::max(width, height)))) + 1;
+	const uint32_t levelCount = fullChain ? chainLength : 1;
+
+	std::vector<uint8_t> expanded;
+	if (fullChain && expanded_channels(format) != 0) {
+		expanded = expand_texels(texels, (size_t)width * height, expanded_channels(format));
+		texels = expanded.data();
+		format = upload_format(format);
+	}
+
+	const uint32_t texelSize = vk::blockSize(format);
+
+	std::vector<size_t> levelSizes;
+	for (uint32_t i = 0; i < levelCount; i++) {
+		levelSizes.push_back((size_t)std::max(width >> i, 1u) * std::max(height >> i, 1u) * texelSize);
+	}
+
+	ktx2::Header header;
+	decoded.blocks = ktx2::create((uint32_t)format, width, height, levelSizes, header);
+	memcpy(decoded.blocks.data() + header.levels[0].offset, texels, levelSizes[0]);
+
+	for (uint32_t i = 1; i < levelCount; i++) {
+		const vk::Extent2D srcSize{ std::max(width >> (i - 1), 1u), std::max(height >> (i - 1), 1u) };
+		vkutil::downsample_level(format, srcSize, (const uint8_t*)decoded.blocks.data() + header.levels[i - 1].offset,
+			(uint8_t*)decoded.blocks.data() + header.levels[i].offset);
+	}
+
+	for (const ktx2::Level& level : header.levels) {
+		decoded.levels.push_back(ImageLevel{ level.offset, level.size });
+	}
+	decoded.width = (int)width;
+	decoded.height = (int)height;
+	decoded.format = format;
+	decoded.generateMips = levelCount < chainLength;
+}
+
+// Decodes with stb_image into the channels the kind of image is sampled with, instead of always RGBA8.
+// Color keeps the channels of the source and RGB data stays RGB, the GPU widens both. Metallic-roughness
+// moves G and B to R and G, occlusion keeps R and a packed occlusion-metallic-roughness image stores G, B
+// and R in that order. Grey and grey-alpha data still decodes to RGBA8
+bool decode_texels(VkSREngine* engine, std::span<const std::byte> bytes, TextureKind kind, int& width, int& height, vk::Format& format, std::vector<uint8_t>& texels) {
+	const stbi_uc* data = reinterpret_cast<const stbi_uc*>(bytes.data());
+	const int size = static_cast<int>(bytes.size());
+
+	int channels;
+	if (!stbi_info_from_memory(data, size, &width, &height, &channels) || channels < 1 || channels > 4) {
+		return false;
+	}
+
+	// R8 and RG8 take their mips from the mip generator, devices that can not write them get RGBA8. RGB8 keeps
+	// the metallic-roughness channel order there, it is widened on the GPU
+	if (engine && kind == TextureKind::MetalRough && !engine->supports_texture_format(vk::Format::eR8G8Unorm)) {
+		kind = TextureKind::OcclusionMetalRough;
+	}
+	if (engine && kind == TextureKind::Occlusion && !engine->supports_texture_format(vk::Format::eR8Unorm)) {
+		kind = TextureKind::Data;
+	}
+
+	// The channels stb_image decodes to, and the decoded channel each stored one is taken from. Stored as
+	// decoded without picks
+	int requested;
+	std::vector<int> picks;
+	switch (kind) {
+	case TextureKind::Color:
+		requested = channels;
+		format = std::array{ vk::Format::eR8Srgb, vk::Format::eR8G8Srgb, vk::Format::eR8G8B8Srgb, vk::Format::eR8G8B8A8Srgb }[channels - 1];
+		break;
+	case TextureKind::MetalRough:
+		// glTF keeps roughness in G and metallic in B, a grey source has both in its one channel
+		requested = channels >= 3 ? 3 : 1;
+		picks = channels >= 3 ? std::vector<int>{ 1, 2 } : std::vector<int>{ 0, 0 };
+		format = vk::Format::eR8G8Unorm;
+		break;
+	case TextureKind::Occlusion:
+		requested = channels >= 3 ? 3 : 1;
+		if (requested == 3) {
+			picks = { 0 };
+		}
+		format = vk::Format::eR8Unorm;
+		break;
+	case TextureKind::OcclusionMetalRough:
+		// Alpha is never sampled, a grey source has all three in its one channel
+		requested = channels >= 3 ? 3 : 1;
+		picks = channels >= 3 ? std::vector<int>{ 1, 2, 0 } : std::vector<int>{ 0, 0, 0 };
+		format = vk::Format::eR8G8B8Unorm;
+		break;
+	default:
+		requested = channels == 3 ? 3 : 4;
+		format = requested == 3 ? vk::Format::eR8G8B8Unorm : vk::Format::eR8G8B8A8Unorm;
+		break;
+	}
+
+	stbi_uc* pixels = stbi_load_from_memory(data, size, &width, &height, &channels, requested);
+	if (!pixels) {
+		return false;
+	}
+
+	const size_t texelCount = (size_t)width * height;
+	if (picks.empty()) {
+		texels.assign(pixels, pixels + texelCount * requested);
+	}
+	else {
+		texels.resize(texelCount * picks.size());
+		for (size_t i = 0; i < texelCount; i++) {
+			for (size_t c = 0; c < picks.size(); c++) {
+				texels[i * picks.size() + c] = pixels[i * requested + picks[c]];
+			}
+		}
+	}
+	stbi_image_free(pixels);
+	return true;
+}
+
+// Only reads the asset, so images can be decoded on worker threads
+DecodedImage decode_image(VkSREngine* engine, fastgltf::Asset& asset, const GltfBuffers& buffers, fastgltf::Image& image, TextureKind kind) {
+	DecodedImage decoded;
+
+	auto decode = [&](std::span<const std::byte> bytes) {
+		if (ktx2::is_ktx2(bytes)) {
+			decode_ktx2(engine, bytes, kind, decoded);
+			return;
+		}
+
+		// Keyed by the encoded bytes and the kind, which picks the format. A hit skips decoding
+		decoded.hash = hash_bytes(bytes.data(), bytes.size(), TEXTURE_CACHE_VERSION);
+		decoded.hash = hash_bytes(&kind, sizeof(kind), decoded.hash);
+		if (load_cached_image(engine, decoded.hash, decoded)) {
+			return;
+		}
+
+		int width, height;
+		vk::Format format;
+		std::vector<uint8_t> texels;
+		if (!decode_texels(engine, bytes, kind, width, height, format, texels)) {
+			return;
+		}
+
+		build_mip_chain(texels.data(), (uint32_t)width, (uint32_t)height, format, engine == nullptr, decoded);
+
+		if (engine) {
+			engine->_textureCache.store(decoded.hash, decoded.blocks);
+		}
+		};
+
+	std::visit(
+		fastgltf::visitor{
+			[](auto& arg) {},
+			[&](fastgltf::sources::URI& filePath) {
+			// Mapped on this worker thread instead of being read in by the parser
+			MappedFile file;
+			if (filePath.uri.isLocalPath() && file.open(buffers.directory / filePath.uri.fspath()) && file.bytes().size() > filePath.fileByteOffset) {
+				decode(file.bytes().subspan(filePath.fileByteOffset));
+			}
+		},
+		[&](fastgltf::sources::Array& arr) {
+			decode(std::span<const std::byte>(arr.bytes.data(), arr.bytes.size()));
+		},
+		[&](fastgltf::sources::BufferView& view) {
+			decode(buffers.view_bytes(asset, view.bufferViewIndex));
+		},
+		},
+		image.data);
+
+	return decoded;
+}
+
+// Image index of textures with no source the loader reads, e.g. only EXT_texture_webp. They sample the
+// error checkerboard
+constexpr size_t NO_IMAGE = SIZE_MAX;
+
+// The image a texture samples: its KHR_texture_basisu source when that decoded, otherwise the regular one
+size_t texture_image(const fastgltf::Texture& texture, std::span<const DecodedImage> images) {
+	if (texture.basisuImageIndex.has_value() && images[texture.basisuImageIndex.value()].valid()) {
+		return texture.basisuImageIndex.value();
+	}
+	if (texture.imageIndex.has_value()) {
+		return texture.imageIndex.value();
+	}
+	return texture.basisuImageIndex.has_value() ? texture.basisuImageIndex.value() : NO_IMAGE;
+}
+
+// Creates the GPU image, or takes the cached one with the same pixels, and frees the decoded pixels.
+// With a command buffer the upload is recorded into it. The file keeps a reference to the image
+std::optional<AllocatedImage> load_image(VkSREngine* engine, LoadedGLTF& file, DecodedImage& decoded, vk::CommandBuffer cmd = {}) {
+	// If decoding failed there is nothing to upload and the return handle is null
+	if (!decoded.valid()) {
+		return {};
+	}
+
+	auto free_pixels = [&]() {
+		decoded.blocks = {};
+		decoded.cached.close();
+		decoded.packaged = {};
+		};
+
+	vk::Extent3D imagesize;
+	imagesize.width = decoded.width;
+	imagesize.height = decoded.height;
+	imagesize.depth = 1;
+
+	// The source hash, moved on by the cache when another image already has it
+	uint64_t key = decoded.hash;
+	std::optional<AllocatedImage> cached = engine->_resourceCache.acquire_image(key, imagesize, upload_format(decoded.format));
+	file.imageKeys.push_back(key);
+	if (cached.has_value()) {
+		free_pixels();
+		return cached;
+	}
+
+	AllocatedImage newImage;
+	const uint32_t expandChannels = expanded_channels(decoded.format);
+	if (decoded.generateMips || expandChannels != 0) {
+		// Level 0 only, packed texels are expanded on the GPU. With a command buffer the caller flushes the mip
+		// generator into it
+		newImage = engine->create_image((void*)(decoded.bytes().data() + decoded.levels[0].offset), imagesize, upload_format(decoded.format),
+			vk::ImageUsageFlagBits::eSampled, decoded.generateMips, cmd, expandChannels);
+	}
+	else {
+		// The mips are prebuilt, copied from the mapped cache file or package when they come from one
+		newImage = engine->create_image(decoded.bytes(), decoded.levels, imagesize, decoded.format, vk::ImageUsageFlagBits::eSampled, cmd);
+	}
+	engine->_resourceCache.add_image(key, newImage);
+
+	free_pixels();
+
+	return newImage;
+}
+
+vk::Filter extract_filter(fastgltf::Filter filter) {
+	switch (filter) {
+		// Nearest sampler
+	case fastgltf::Filter::Nearest:
+	case fastgltf::Filter::NearestMipMapNearest:
+	case fastgltf::Filter::NearestMipMapLinear:
+		return vk::Filter::eNearest;
+		
+		// Linear sampler (default if filter type doesn't match)
+	case fastgltf::Filter::Linear:
+	case fastgltf::Filter::LinearMipMapNearest:
+	case fastgltf::Filter::LinearMipMapLinear:
+	default:
+		return vk::Filter::eLinear;
+	}
+}
+
+vk::SamplerMipmapMode extract_mipmap_mode(fastgltf::Filter filter) {
+	switch (filter) {
+		// Nearest mipmap sampler mode
+	case fastgltf::Filter::NearestMipMapNearest:
+	case fastgltf::Filter::LinearMipMapNearest:
+		return vk::SamplerMipmapMode::eNearest;
+
+		// Linear mipmap sampler mode (default if mipmap filter mode doesn't match)
+	case fastgltf::Filter::NearestMipMapLinear:
+	case fastgltf::Filter::LinearMipMapLinear:
+	default:
+		return vk::SamplerMipmapMode::eLinear;
+	}
+} 
+
+// EXT_mesh_gpu_instancing: per instance TRS accessors, a missing one is the identity for every instance
+std::vector<glm::mat4> read_gpu_instances(fastgltf::Asset& gltf, const GltfBuffers& buffers, fastgltf::Node& node) {
+	std::vector<glm::vec3> translations;
+	std::vector<glm::quat> rotations;
+	std::vector<glm::vec3> scales;
+	size_t count = 0;
+
+	for (auto& attribute : node.instancingAttributes) {
+		fastgltf::Accessor& accessor = gltf.accessors[attribute.accessorIndex];
+		if (!accessor_fits(gltf, buffers, accessor)) {
+			continue;
+		}
+		count = std::max(count, accessor.count);
+
+		if (attribute.name == "TRANSLATION") {
+			translations.resize(accessor.count);
+			fastgltf::iterateAccessorWithIndex<glm::vec3>(gltf, accessor, [&](glm::vec3 v, size_t index) {
+				translations[index] = v;
+				}, buffers);
+		}
+		else if (attribute.name == "ROTATION") {
+			rotations.resize(accessor.count);
+			fastgltf::iterateAccessorWithIndex<glm::vec4>(gltf, accessor, [&](glm::vec4 v, size_t index) {
+				rotations[index] = glm::quat(v.w, v.x, v.y, v.z);
+				}, buffers);
+		}
+		else if (attribute.name == "SCALE") {
+			scales.resize(accessor.count);
+			fastgltf::iterateAccessorWithIndex<glm::vec3>(gltf, accessor, [&](glm::vec3 v, size_t index) {
+				scales[index] = v;
+				}, buffers);
+		}
+	}
+
+	std::vector<glm::mat4> instances(count);
+	for (size_t i = 0; i < count; i++) {
+		glm::mat4 tm = i < translations.size() ? glm::translate(glm::mat4(1.f), translations[i]) : glm::mat4(1.f);
+		glm::mat4 rm = i < rotations.size() ? glm::toMat4(rotations[i]) : glm::mat4(1.f);
+		glm::mat4 sm = i < scales.size() ? glm::scale(glm::mat4(1.f), scales[i]) : glm::mat4(1.f);
+		instances[i] = tm * rm * sm;
+	}
+	return instances;
+}
+
+// The local matrix of a node. The transform attribute of a node is a std::variant of type either fastgltf::TRS
+// or fastgltf::fmat4x4, and an option called "DecomposeNodeMatrices" can make node.transform return a TRS.
+// Here we handle both cases.
+glm::mat4 node_transform(const fastgltf::Node& node) {
+	glm::mat4 localTransform;
+	std::visit(fastgltf::visitor{
+		[&](fastgltf::math::fmat4x4 matrix) {
+			memcpy(&localTransform, matrix.data(), sizeof(matrix));
+		},
+		[&](fastgltf::TRS transform) {
+			glm::vec3 tl(transform.translation[0], transform.translation[1], transform.translation[2]);
+			glm::quat rot(transform.rotation[3], transform.rotation[0], transform.rotation[1], transform.rotation[2]); // w, x, y, z
+			glm::vec3 sc(transform.scale[0], transform.scale[1], transform.scale[2]);
+
+			glm::mat4 tm = glm::translate(glm::mat4(1.f), tl);
+			glm::mat4 rm = glm::toMat4(rot);
+			glm::mat4 sm = glm::scale(glm::mat4(1.f), sc);
+
+			localTransform = tm * rm * sm;
+		}
+		},
+		node.transform);
+	return localTransform;
+}
+//< global_funcs
+
+//> loadgltf_func
+// CPU side result of reading a glTF file or cooked package, everything short of the GPU resources.
+// A package fills in the asset parts create_scene reads, it has no buffers or accessors
+struct GltfImport {
+	GltfBuffers buffers; // Declared first, the asset may point into its mappings
+	MappedFile packageFile; // Same for the images of a cooked package
+	fastgltf::Asset gltf;
+	std::vector<DecodedImage> images;
+	std::vector<size_t> textureImages; // The image every glTF texture samples, see texture_image
+	std::vector<ImportedMesh> meshes;
+	std::vector<std::vector<glm::mat4>> nodeInstances; // EXT_mesh_gpu_instancing matrices by node
+	VkSREngine* engine{ nullptr }; // Frees the staging memory left behind
+
+	~GltfImport() {
+		// Meshes that were never uploaded still own their staging memory, the GPU has not seen it
+		for (ImportedMesh& mesh : meshes) {
+			if (mesh.staging.buffer.buffer) {
+				engine->destroy_buffer(mesh.staging.buffer);
+			}
+		}
+	}
+};
+
+// The objects create_scene made, by glTF index
+struct SceneObjects {
+	std::vector<std::shared_ptr<MeshAsset>> meshes;
+	std::vector<std::shared_ptr<GLTFMaterial>> materials;
+	std::vector<GLTFMetallic_Roughness::MaterialResources> materialResources;
+	std::vector<MaterialPass> materialPasses;
+	std::vector<std::shared_ptr<Node>> nodes;
+
+	bool started{ false };  // The samplers, descriptor pool and material buffer exist
+	bool complete{ false }; // Every object exists and the node hierarchy is linked
+};
+
+// Background loading state of a LoadedGLTF
+struct SceneStream {
+	std::future<std::unique_ptr<GltfImport>> pending;
+	std::unique_ptr<GltfImport> import;
+	SceneObjects objects;
+	std::vector<AllocatedImage> placeholders; // Sampled by every material until its real texture is uploaded
+	size_t nextMesh{ 0 };
+	size_t nextImage{ 0 };
+
+	// Material sets replaced when their texture arrived, reused once no frame in flight reads them
+	struct RetiredSet {
+		vk::DescriptorSet set;
+		int frameNumber;
+	};
+	std::vector<RetiredSet> retiredSets;
+};
+
+// Parses the file, then decodes its images and imports its meshes. The only Vulkan calls are staging
+// allocations, which VMA synchronizes, so it can run on any thread
+std::unique_ptr<GltfImport> import_gltf(VkSREngine* engine, std::string_view filePath) {
+	// Initialize the fastgltf parser
+	fastgltf::Parser parser{ fastgltf::Extensions::EXT_mesh_gpu_instancing | fastgltf::Extensions::KHR_mesh_quantization | fastgltf::Extensions::EXT_meshopt_compression | fastgltf::Extensions::KHR_texture_basisu };
+	// No Load*Buffers or LoadExternalImages, the buffers and images are mapped instead of read into memory
+	constexpr auto gltfOptions = fastgltf::Options::DontRequireValidAssetMember | fastgltf::Options::AllowDouble;
+
+	std::unique_ptr<GltfImport> result = std::make_unique<GltfImport>();
+	result->engine = engine;
+	fastgltf::Asset& gltf = result->gltf;
+	
+	std::filesystem::path path = filePath;
+
+	auto gltfFile = fastgltf::MappedGltfFile::FromPath(path);
+
+	if (!bool(gltfFile)) {
+		std::cerr << "Failed to open glTF file: " << fastgltf::getErrorMessage(gltfFile.error()) << std::endl;
+		return nullptr;
+	}
+
+	GltfBuffers& buffers = result->buffers;
+	buffers.directory = path.parent_path();
+	buffers.source = std::make_unique<fastgltf::MappedGltfFile>(std::move(gltfFile.get()));
+
+	auto asset = parser.loadGltf(*buffers.source, path.parent_path(), gltfOptions);
+	if (asset.error() != fastgltf::Error::None) {
+		std::cerr << "Failed to load glTF: " << fastgltf::getErrorMessage(asset.error()) << std::endl;
+		return nullptr;
+	}
+	
+	gltf = std::move(asset.get());
+
+	if (!buffers.map(gltf)) {
+		return nullptr;
+	}
+
+	result->nodeInstances.reserve(gltf.nodes.size());
+	for (fastgltf::Node& node : gltf.nodes) {
+		result->nodeInstances.push_back(read_gpu_instances(gltf, buffers, node));
+	}
+	
+
+	/*if (type == fastgltf::GltfType::glTF) {
+		auto load = parser.loadGltf(fileStream, path.parent_path(), gltfOptions);
+		if (load) {
+			gltf = std::move(load.get());
+		}
+		else {
+			std::cerr << "Failed to load glTF: " << fastgltf::to_underlying(load.error()) << std::endl;
+			return nullptr;
+		}
+	}
+	else if (type == fastgltf::GltfType::GLB) {
+		auto load = parser.loadGltfBinary(fileStream, path.parent_path(), gltfOptions);
+		if (load) {
+			gltf = std::move(load.get());
+		}
+		else {
+			std::cerr << "Failed to load glTF: " << fastgltf::to_underlying(load.error()) << std::endl;
+			return nullptr;
+		}
+	}
+	else {
+		std::cerr << "Failed to determine glTF container." << std::endl;
+		return nullptr;
+	}*/
+
+	// Decode the images and import the meshes on all cores. Only CPU work happens here,
+	// the GPU resources are created later by the render thread
+	std::vector<DecodedImage>& decodedImages = result->images;
+	std::vector<ImportedMesh>& importedMeshes = result->meshes;
+	decodedImages.resize(gltf.images.size());
+	importedMeshes.resize(gltf.meshes.size());
+
+	// KTX2 sources first, they are only copied. A texture's fallback image is decoded only when its KTX2
+	// image turned out unusable on this device. Cooking decodes both, the device is only known at load
+	std::vector<size_t> ktx2Images;
+	for (fastgltf::Texture& texture : gltf.textures) {
+		if (texture.basisuImageIndex.has_value()) {
+			ktx2Images.push_back(texture.basisuImageIndex.value());
+		}
+	}
+	std::sort(ktx2Images.begin(), ktx2Images.end());
+	ktx2Images.erase(std::unique(ktx2Images.begin(), ktx2Images.end()), ktx2Images.end());
+
+	const std::vector<TextureKind> imageKinds = image_kinds(gltf);
+	parallel_for(ktx2Images.size(), [&](size_t i) {
+		decodedImages[ktx2Images[i]] = decode_image(engine, gltf, buffers, gltf.images[ktx2Images[i]], imageKinds[ktx2Images[i]]);
+		});
+
+	result->textureImages.reserve(gltf.textures.size());
+	std::vector<bool> fallbackUsed(gltf.images.size(), false);
+	for (fastgltf::Texture& texture : gltf.textures) {
+		result->textureImages.push_back(texture_image(texture, decodedImages));
+		if (result->textureImages.back() != NO_IMAGE) {
+			fallbackUsed[result->textureImages.back()] = true;
+		}
+	}
+
+	// Images no texture points at still get decoded, they are reachable by name
+	std::vector<size_t> otherImages;
+	for (size_t i = 0; i < gltf.images.size(); i++) {
+		if (decodedImages[i].valid() || std::binary_search(ktx2Images.begin(), ktx2Images.end(), i)) {
+			continue;
+		}
+
+		bool isFallback = false;
+		for (fastgltf::Texture& texture : gltf.textures) {
+			isFallback |= texture.basisuImageIndex.has_value() && texture.imageIndex.has_value() && texture.imageIndex.value() == i;
+		}
+
+		if (isFallback && !fallbackUsed[i] && engine) {
+			decodedImages[i].unused = true;
+			continue;
+		}
+		otherImages.push_back(i);
+	}
+
+	parallel_for(otherImages.size() + importedMeshes.size(), [&](size_t i) {
+		if (i < otherImages.size()) {
+			decodedImages[otherImages[i]] = decode_image(engine, gltf, buffers, gltf.images[otherImages[i]], imageKinds[otherImages[i]]);
+		}
+		else {
+			size_t m = i - otherImages.size();
+			importedMeshes[m] = import_mesh(engine, gltf, buffers, gltf.meshes[m]);
+		}
+		});
+
+	return result;
+}
+
+// Rough upload bytes creating a scene object is worth in the streaming budget. Materials write a descriptor
+// set, meshes and nodes are a few allocations
+constexpr size_t MATERIAL_CREATE_COST = 16 * 1024;
+constexpr size_t OBJECT_CREATE_COST = 1024;
+
+// Creates the samplers, the descriptor pool and the material buffer every material needs
+void begin_scene(VkSREngine* engine, LoadedGLTF& file, GltfImport& import) {
+	fastgltf::Asset& gltf = import.gltf;
+
+	// Time to load the gltf into the structures of LoadedGLTF.
+	// Prepare descriptors
+	std::vector<DescriptorAllocatorGrowable::PoolSizeRatio> sizes = {
+		{vk::DescriptorType::eCombinedImageSampler, 3},
+		{vk::DescriptorType::eUniformBuffer, 3},
+		{vk::DescriptorType::eStorageBuffer, 1}
+	};
+
+	file.descriptorPool.init(engine->_device, gltf.materials.size(), sizes);
+
+	// Load samplers
+	for (fastgltf::Sampler& sampler : gltf.samplers) {
+		vk::SamplerCreateInfo samplerCreateInfo = {};
+		samplerCreateInfo.maxLod = vk::LodClampNone;
+		samplerCreateInfo.minLod = 0;
+
+		samplerCreateInfo.magFilter = extract_filter(sampler.magFilter.value_or(fastgltf::Filter::Nearest));
+		samplerCreateInfo.minFilter = extract_filter(sampler.minFilter.value_or(fastgltf::Filter::Nearest));
+
+		samplerCreateInfo.mipmapMode = extract_mipmap_mode(sampler.minFilter.value_or(fastgltf::Filter::Nearest));
+
+		file.samplerFilters.push_back(package::Sampler{
+			sampler.magFilter.has_value() ? (uint32_t)sampler.magFilter.value() : package::NONE,
+			sampler.minFilter.has_value() ? (uint32_t)sampler.minFilter.value() : package::NONE });
+
+		uint64_t samplerKey;
+		file.samplers.push_back(engine->_resourceCache.acquire_sampler(engine->_device, samplerCreateInfo, samplerKey));
+		file.samplerKeys.push_back(samplerKey);
+	}
+
+	// Create a buffer to hold the material data
+	file.materialDataBuffer = engine->create_buffer(sizeof(GLTFMetallic_Roughness::MaterialConstants) * gltf.materials.size(), vk::BufferUsageFlagBits::eUniformBuffer, vma::MemoryUsage::eCpuToGpu);
+}
+
+// Creates the next material of the import
+void create_material(VkSREngine* engine, LoadedGLTF& file, GltfImport& import, std::span<const AllocatedImage> images, SceneObjects& objects) {
+	fastgltf::Asset& gltf = import.gltf;
+	const uint32_t data_index = (uint32_t)objects.materials.size();
+	fastgltf::Material& mat = gltf.materials[data_index];
+
+	GLTFMetallic_Roughness::MaterialConstants* sceneMaterialConstants = (GLTFMetallic_Roughness::MaterialConstants*)file.materialDataBuffer.info.pMappedData;
+
+	std::shared_ptr<GLTFMaterial> newMat = std::make_shared<GLTFMaterial>();
+	objects.materials.push_back(newMat);
+	file.materials[mat.name.c_str()] = newMat;
+	newMat->name = mat.name.c_str();
+	newMat->constantsIndex = data_index;
+
+	GLTFMetallic_Roughness::MaterialConstants constants;
+	constants.colorFactors.x = mat.pbrData.baseColorFactor[0];
+	constants.colorFactors.y = mat.pbrData.baseColorFactor[1];
+	constants.colorFactors.z = mat.pbrData.baseColorFactor[2];
+	constants.colorFactors.w = mat.pbrData.baseColorFactor[3];
+
+	constants.metal_rough_factors.x = mat.pbrData.metallicFactor;
+	constants.metal_rough_factors.y = mat.pbrData.roughnessFactor;
+	
+	// Write material parameters to buffer
+	sceneMaterialConstants[data_index] = constants;
+
+	MaterialPass passType = MaterialPass::MainColor;
+	if (mat.alphaMode == fastgltf::AlphaMode::Blend) {
+		passType = MaterialPass::Transparent;
+	}
+
+	GLTFMetallic_Roughness::MaterialResources materialResources;
+	
+	// Default the material textures
+	materialResources.colorImage = engine->_whiteImage;
+	materialResources.colorSampler = engine->_defaultSamplerLinear;
+	materialResources.metalRoughImage = engine->_whiteImage;
+	materialResources.metalRoughSampler = engine->_defaultSamplerLinear;
+
+	// Set the uniform buffer for the material data
+	materialResources.dataBuffer = file.materialDataBuffer.buffer;
+	materialResources.dataBufferOffset = data_index * sizeof(GLTFMetallic_Roughness::MaterialConstants);
+
+	// Grab textures from glTF file
+	if (mat.pbrData.baseColorTexture.has_value()) {
+		// Holy mother of nesting
+		size_t img = import.textureImages[mat.pbrData.baseColorTexture.value().textureIndex];
+		const auto& sampler = gltf.textures[mat.pbrData.baseColorTexture.value().textureIndex].samplerIndex;
+
+		// ...but it's neat for indexing. Textures without a sampler repeat with linear filtering
+		materialResources.colorImage = img != NO_IMAGE ? images[img] : engine->_errorCheckerboardImage;
+		if (sampler.has_value()) {
+			materialResources.colorSampler = file.samplers[sampler.value()];
+			newMat->colorSampler = (uint32_t)sampler.value();
+		}
+
+		newMat->colorImageKey = img != NO_IMAGE && import.images[img].valid() ? import.images[img].hash : 0;
+	}
+	newMat->colorImage = materialResources.colorImage;
+
+	// Without a texture the factors alone apply, like glTF defines. An unreadable one falls back to that too
+	if (mat.pbrData.metallicRoughnessTexture.has_value()) {
+		size_t img = import.textureImages[mat.pbrData.metallicRoughnessTexture.value().textureIndex];
+		const auto& sampler = gltf.textures[mat.pbrData.metallicRoughnessTexture.value().textureIndex].samplerIndex;
+
+		materialResources.metalRoughImage = img != NO_IMAGE ? images[img] : engine->_whiteImage;
+		if (sampler.has_value()) {
+			materialResources.metalRoughSampler = file.samplers[sampler.value()];
+			newMat->metalRoughSampler = (uint32_t)sampler.value();
+		}
+
+		newMat->metalRoughImageKey = img != NO_IMAGE && import.images[img].valid() ? import.images[img].hash : 0;
+	}
+	newMat->metalRoughImage = materialResources.metalRoughImage;
+
+	// Build material
+	
+	newMat->data = engine->_metalRoughMaterial.write_material(engine->_device, passType, materialResources, file.descriptorPool);
+	file.materialSortIds.push_back(newMat->data.sortId);
+	objects.materialResources.push_back(materialResources);
+	objects.materialPasses.push_back(passType);
+}
+
+// Creates the next mesh of the import, its buffers are uploaded separately
+void create_mesh(LoadedGLTF& file, GltfImport& import, SceneObjects& objects) {
+	ImportedMesh& imported = import.meshes[objects.meshes.size()];
+
+	std::shared_ptr<MeshAsset> newMesh = std::make_shared<MeshAsset>();
+	objects.meshes.push_back(newMesh);
+	file.meshes[imported.name] = newMesh;
+	newMesh->name = imported.name;
+
+	newMesh->surfaces = std::move(imported.surfaces);
+	for (size_t i = 0; i < newMesh->surfaces.size(); i++) {
+		newMesh->surfaces[i].material = objects.materials[imported.surfaceMaterials[i]];
+	}
+
+	// Occluders stay on the CPU, they and meshes without surfaces have nothing to upload
+	newMesh->occluder = std::move(imported.occluder);
+	newMesh->resident = newMesh->surfaces.empty();
+}
+
+// Creates the next node of the import, link_scene puts it into the hierarchy
+void create_node(LoadedGLTF& file, GltfImport& import, SceneObjects& objects) {
+	const size_t i = objects.nodes.size();
+	fastgltf::Node& node = import.gltf.nodes[i];
+	std::shared_ptr<Node> newNode;
+
+	// Find if the node has a mesh, and if it does hook it to the mesh pointer and allocated it with the meshnode class
+	if (node.meshIndex.has_value()) {
+		newNode = std::make_shared<MeshNode>();
+		static_cast<MeshNode*>(newNode.get())->mesh = objects.meshes[*node.meshIndex];
+		static_cast<MeshNode*>(newNode.get())->gpuInstances = std::move(import.nodeInstances[i]);
+	}
+	else {
+		newNode = std::make_shared<Node>();
+	}
+
+	objects.nodes.push_back(newNode);
+	file.nodes[node.name.c_str()] = newNode;
+}
+
+// Sets up the node hierarchy once every node exists
+void link_scene(LoadedGLTF& file, GltfImport& import, SceneObjects& objects) {
+	fastgltf::Asset& gltf = import.gltf;
+	std::vector<std::shared_ptr<Node>>& nodes = objects.nodes;
+
+	// Run loop again to setup transform hierarchy
+	for (int i = 0; i < gltf.nodes.size(); i++) {
+		fastgltf::Node& node = gltf.nodes[i];
+		std::shared_ptr<Node>& sceneNode = nodes[i];
+
+		for (auto& c : node.children) {
+			sceneNode->children.push_back(nodes[c]);
+			nodes[c]->parent = sceneNode;
+		}
+	}
+
+	// Lay the transforms out depth first, parent before child
+	auto add_transforms = [&](auto&& self, size_t nodeIndex, uint32_t parentTransform) -> void {
+		Node* node = nodes[nodeIndex].get();
+		node->transforms = &file.transforms;
+		node->transformIndex = file.transforms.add(parentTransform, node_transform(gltf.nodes[nodeIndex]));
+		file.transformNodes.push_back(node);
+
+		for (size_t c : gltf.nodes[nodeIndex].children) {
+			self(self, c, node->transformIndex);
+		}
+		};
+
+	// Find the top nodes (with no parents :c )
+	for (size_t i = 0; i < nodes.size(); i++) {
+		if (nodes[i]->parent.lock() == nullptr) {
+			file.topNodes.push_back(nodes[i]);
+			add_transforms(add_transforms, i, TransformHierarchy::NO_PARENT);
+		}
+	}
+}
+
+// Creates samplers, materials, meshes and nodes of an imported file into objects, until budget bytes worth of
+// them are created. Called again it continues where it stopped, true once the scene is complete. images holds
+// the image of every glTF image index, the mesh buffers are left to upload_imported_mesh
+bool create_scene(VkSREngine* engine, LoadedGLTF& file, GltfImport& import, std::span<const AllocatedImage> images, SceneObjects& objects, size_t& budget) {
+	fastgltf::Asset& gltf = import.gltf;
+
+	if (!objects.started) {
+		begin_scene(engine, file, import);
+		objects.started = true;
+	}
+
+	while (budget > 0 && objects.materials.size() < gltf.materials.size()) {
+		create_material(engine, file, import, images, objects);
+		budget -= std::min(budget, MATERIAL_CREATE_COST);
+	}
+
+	// Meshes point at their materials, nodes at their meshes
+	while (budget > 0 && objects.materials.size() == gltf.materials.size() && objects.meshes.size() < import.meshes.size()) {
+		create_mesh(file, import, objects);
+		budget -= std::min(budget, OBJECT_CREATE_COST);
+	}
+
+	while (budget > 0 && objects.meshes.size() == import.meshes.size() && objects.nodes.size() < gltf.nodes.size()) {
+		create_node(file, import, objects);
+		budget -= std::min(budget, OBJECT_CREATE_COST);
+	}
+
+	if (!objects.complete && objects.meshes.size() == import.meshes.size() && objects.nodes.size() == gltf.nodes.size()) {
+		link_scene(file, import, objects);
+		objects.complete = true;
+	}
+	return objects.complete;
+}
+
+// Uploads the buffers of an imported mesh and returns the bytes it took, nothing when the same data
+// is already cached. With a command buffer the copies are recorded into it, otherwise they are submitted right away.
+// The file keeps a reference to the buffers
+size_t upload_imported_mesh(VkSREngine* engine, LoadedGLTF& file, MeshAsset& mesh, ImportedMesh& imported, vk::CommandBuffer cmd = {}) {
+	const MeshStaging& staging = imported.staging;
+	const MeshShape shape{ (uint32_t)staging.vertexCount, (uint32_t)staging.colorCount, (uint32_t)staging.meshletCount, (uint32_t)staging.indexCount, staging.indexType };
+
+	mesh.cacheKey = imported.hash;
+	mesh.resident = true;
+
+	std::optional<GPUMeshBuffers> cached = engine->_resourceCache.acquire_mesh(mesh.cacheKey, shape);
+	file.meshKeys.push_back(mesh.cacheKey);
+	if (cached.has_value()) {
+		// The GPU never saw the staging memory, it can go right away
+		engine->destroy_buffer(imported.staging.buffer);
+		imported.staging.buffer = {};
+		mesh.meshBuffers = *cached;
+		return 0;
+	}
+
+	size_t bytes = imported.staging.size();
+	mesh.meshBuffers = engine->upload_mesh(imported.staging, cmd);
+
+	engine->_resourceCache.add_mesh(mesh.cacheKey, mesh.meshBuffers);
+	return bytes;
+}
+
+// Creates the scene of an import with all its GPU resources right away
+std::optional<std::shared_ptr<LoadedGLTF>> load_import(VkSREngine* engine, std::unique_ptr<GltfImport> import) {
+	if (!import) {
+		return {};
+	}
+
+	// Prepare the LoadedGLTF structure
+	std::shared_ptr<LoadedGLTF> scene = std::make_shared<LoadedGLTF>();
+	scene->creator = engine;
+	LoadedGLTF& file = *scene.get();
+
+	// Load all textures, their uploads and mip generation go in one submission. The staging memory is freed
+	// with the current frame
+	std::vector<AllocatedImage> images;
+	engine->immediate_submit([&](vk::CommandBuffer cmd) {
+		for (size_t i = 0; i < import->images.size(); i++) {
+			fastgltf::Image& image = import->gltf.images[i];
+			if (import->images[i].unused) {
+				images.push_back(engine->_errorCheckerboardImage);
+				continue;
+			}
+
+			std::optional<AllocatedImage> img = load_image(engine, file, import->images[i], cmd);
+
+			if (img.has_value()) {
+				images.push_back(*img);
+				file.images[image.name.c_str()] = *img;
+			}
+			else {
+				// Failed to load so give assign this slot the error checkerboard texture to not completely break loading
+				images.push_back(engine->_errorCheckerboardImage);
+				std::cout << "glTF failed to load texture" << image.name << std::endl;
+			}
+		}
+
+		engine->_mipGenerator.flush(cmd, engine);
+		});
+
+	SceneObjects objects;
+	size_t budget = SIZE_MAX;
+	create_scene(engine, file, *import, images, objects, budget);
+
+	for (size_t i = 0; i < objects.meshes.size(); i++) {
+		if (!objects.meshes[i]->resident) {
+			upload_imported_mesh(engine, file, *objects.meshes[i], import->meshes[i]);
+		}
+	}
+
+	return scene;
+}
+
+// Runs import on a background thread, update_streaming creates the scene once it is done
+template<typename F>
+std::shared_ptr<LoadedGLTF> stream_import(VkSREngine* engine, F&& import) {
+	std::shared_ptr<LoadedGLTF> scene = std::make_shared<LoadedGLTF>();
+	scene->creator = engine;
+	scene->stream = std::make_unique<SceneStream>();
+	scene->stream->pending = std::async(std::launch::async, std::forward<F>(import));
+
+	return scene;
+}
+
+std::optional<std::shared_ptr<LoadedGLTF>> loadGltf(VkSREngine* engine, std::string_view filePath) {
+	fmt::println("Loading GLTF: {}", filePath);
+	return load_import(engine, import_gltf(engine, filePath));
+}
+
+std::shared_ptr<LoadedGLTF> loadGltfAsync(VkSREngine* engine, std::string_view filePath) {
+	fmt::println("Streaming GLTF: {}", filePath);
+	return stream_import(engine, [engine, path = std::string(filePath)]() {
+		return import_gltf(engine, path);
+		});
+}
+//< loadgltf_func
+
+//> package
+// The tables of a package as cookGltf and saveSnapshot build them, written out behind the header in one pass
+struct PackageWriter {
+	std::vector<char> strings;
+	std::vector<package::Sampler> samplers;
+	std::vector<package::Image> images;
+	std::vector<package::Level> levels;
+	std::vector<package::Texture> textures;
+	std::vector<package::Material> materials;
+	std::vector<package::Mesh> meshes;
+	std::vector<package::Surface> surfaces;
+	std::vector<package::Lod> lods;
+	std::vector<package::Node> nodes;
+	std::vector<uint32_t> children;
+	std::vector<glm::mat4> instances;
+	std::vector<std::byte> data;
+
+	static uint64_t align(uint64_t offset) {
+		return (offset + package::ALIGNMENT - 1) & ~(package::ALIGNMENT - 1);
+	}
+
+	package::String add_string(std::string_view s) {
+		package::String result{ (uint32_t)strings.size(), (uint32_t)s.size() };
+		strings.insert(strings.end(), s.begin(), s.end());
+		return result;
+	}
+
+	// Payloads start aligned like the tables, buffer to image copies of block formats need that
+	package::Section add_data(std::span<const std::byte> bytes) {
+		data.resize(align(data.size()));
+		package::Section section{ data.size(), bytes.size() };
+		data.insert(data.end(), bytes.begin(), bytes.end());
+		return section;
+	}
+
+	// levels index into bytes. They go back to back, without the KTX2 header of a generated mip chain
+	void add_image(std::string_view name, uint32_t width, uint32_t height, vk::Format format, uint64_t hash,
+		std::span<const std::byte> bytes, std::span<const ImageLevel> imageLevels) {
+		package::Image image = {};
+		image.name = add_string(name);
+		image.width = width;
+		image.height = height;
+		image.format = (uint32_t)format;
+		image.firstLevel = (uint32_t)levels.size();
+		image.levelCount = (uint32_t)imageLevels.size();
+		image.hash = hash;
+
+		image.data.offset = align(data.size());
+		for (const ImageLevel& level : imageLevels) {
+			package::Section section = add_data(bytes.subspan(level.offset, level.size));
+			levels.push_back(package::Level{ section.offset - image.data.offset, section.size });
+			image.data.size = section.offset + section.size - image.data.offset;
+		}
+		images.push_back(image);
+	}
+
+	// staging holds the packed GPU data, it is not read for occluders
+	void add_mesh(std::string_view name, uint64_t hash, std::span<const GeoSurface> meshSurfaces, std::span<const uint32_t> surfaceMaterials,
+		const OccluderGeometry* occluder, const MeshStaging& staging) {
+		package::Mesh mesh = {};
+		mesh.name = add_string(name);
+		mesh.firstSurface = (uint32_t)surfaces.size();
+		mesh.surfaceCount = (uint32_t)meshSurfaces.size();
+		mesh.hash = hash;
+
+		for (size_t i = 0; i < meshSurfaces.size(); i++) {
+			const GeoSurface& s = meshSurfaces[i];
+
+			package::Surface surface = {};
+			surface.startIndex = s.startIndex;
+			surface.count = s.count;
+			surface.vertexOffset = s.vertexOffset;
+			surface.firstMeshlet = s.firstMeshlet;
+			surface.meshletCount = s.meshletCount;
+			surface.firstLod = (uint32_t)lods.size();
+			surface.lodCount = (uint32_t)s.lods.size();
+			surface.material = surfaceMaterials[i];
+			memcpy(surface.origin, &s.bounds.origin, sizeof(surface.origin));
+			surface.sphereRadius = s.bounds.sphereRadius;
+			memcpy(surface.extents, &s.bounds.extents, sizeof(surface.extents));
+			surfaces.push_back(surface);
+
+			for (const MeshLod& lod : s.lods) {
+				lods.push_back(package::Lod{ lod.startIndex, lod.count, lod.error });
+			}
+		}
+
+		if (occluder) {
+			mesh.occluder = 1;
+			mesh.occluderVertexCount = (uint32_t)occluder->positions.size();
+			mesh.occluderIndexCount = (uint32_t)occluder->indices.size();
+
+			const size_t positionBytes = occluder->positions.size() * sizeof(glm::vec3);
+			std::vector<std::byte> occluderData(positionBytes + occluder->indices.size() * sizeof(uint32_t));
+			memcpy(occluderData.data(), occluder->positions.data(), positionBytes);
+			memcpy(occluderData.data() + positionBytes, occluder->indices.data(), occluder->indices.size() * sizeof(uint32_t));
+			mesh.data = add_data(occluderData);
+		}
+		else {
+			mesh.vertexCount = (uint32_t)staging.vertexCount;
+			mesh.colorCount = (uint32_t)staging.colorCount;
+			mesh.meshletCount = (uint32_t)staging.meshletCount;
+			mesh.indexCount = (uint32_t)staging.indexCount;
+			mesh.indexType = (uint32_t)staging.indexType;
+			mesh.data = add_data(std::span<const std::byte>((const std::byte*)staging.data(), staging.size()));
+		}
+		meshes.push_back(mesh);
+	}
+
+	void add_node(std::string_view name, uint32_t mesh, std::span<const uint32_t> nodeChildren, std::span<const glm::mat4> nodeInstances, const glm::mat4& localTransform) {
+		package::Node node = {};
+		node.name = add_string(name);
+		node.mesh = mesh;
+		node.firstChild = (uint32_t)children.size();
+		node.childCount = (uint32_t)nodeChildren.size();
+		children.insert(children.end(), nodeChildren.begin(), nodeChildren.end());
+		node.firstInstance = (uint32_t)instances.size();
+		node.instanceCount = (uint32_t)nodeInstances.size();
+		instances.insert(instances.end(), nodeInstances.begin(), nodeInstances.end());
+		memcpy(node.transform, &localTransform, sizeof(node.transform));
+		nodes.push_back(node);
+	}
+
+	bool write(const std::filesystem::path& path) {
+		package::Header header = {};
+		header.magic = package::MAGIC;
+		header.version = package::VERSION;
+
+		const std::pair<package::Section*, std::span<const std::byte>> sections[] = {
+			{ &header.strings, std::as_bytes(std::span(strings)) },
+			{ &header.samplers, std::as_bytes(std::span(samplers)) },
+			{ &header.images, std::as_bytes(std::span(images)) },
+			{ &header.levels, std::as_bytes(std::span(levels)) },
+			{ &header.textures, std::as_bytes(std::span(textures)) },
+			{ &header.materials, std::as_bytes(std::span(materials)) },
+			{ &header.meshes, std::as_bytes(std::span(meshes)) },
+			{ &header.surfaces, std::as_bytes(std::span(surfaces)) },
+			{ &header.lods, std::as_bytes(std::span(lods)) },
+			{ &header.nodes, std::as_bytes(std::span(nodes)) },
+			{ &header.children, std::as_bytes(std::span(children)) },
+			{ &header.instances, std::as_bytes(std::span(instances)) },
+			{ &header.data, std::as_bytes(std::span(data)) },
+		};
+
+		uint64_t end = sizeof(header);
+		for (auto& [section, bytes] : sections) {
+			section->offset = align(end);
+			section->size = bytes.size();
+			end = section->offset + section->size;
+		}
+
+		std::ofstream out(path, std::ios::binary | std::ios::trunc);
+		out.write((const char*)&header, sizeof(header));
+
+		uint64_t written = sizeof(header);
+		for (auto& [section, bytes] : sections) {
+			constexpr char padding[package::ALIGNMENT] = {};
+			out.write(padding, section->offset - written);
+			out.write((const char*)bytes.data(), bytes.size());
+			written = section->offset + section->size;
+		}
+		return bool(out);
+	}
+};
+
+bool cookGltf(std::string_view gltfPath, std::string_view packagePath) {
+	fmt::println("Cooking GLTF: {} -> {}", gltfPath, packagePath);
+
+	// Without an engine the meshes are packed into host memory and the images skip the texture cache
+	std::unique_ptr<GltfImport> import = import_gltf(nullptr, gltfPath);
+	if (!import) {
+		return false;
+	}
+
+	fastgltf::Asset& gltf = import->gltf;
+	PackageWriter writer;
+
+	for (fastgltf::Sampler& sampler : gltf.samplers) {
+		writer.samplers.push_back(package::Sampler{
+			sampler.magFilter.has_value() ? (uint32_t)sampler.magFilter.value() : package::NONE,
+			sampler.minFilter.has_value() ? (uint32_t)sampler.minFilter.value() : package::NONE });
+	}
+
+	for (size_t i = 0; i < import->images.size(); i++) {
+		const DecodedImage& decoded = import->images[i];
+		writer.add_image(gltf.images[i].name, (uint32_t)decoded.width, (uint32_t)decoded.height, decoded.format, decoded.hash, decoded.bytes(), decoded.levels);
+	}
+
+	// The KTX2 image was taken without knowing the device, its fallback goes along for devices without its format
+	for (size_t i = 0; i < gltf.textures.size(); i++) {
+		const fastgltf::Texture& texture = gltf.textures[i];
+		const size_t image = import->textureImages[i];
+		const bool hasFallback = texture.imageIndex.has_value() && image != NO_IMAGE && image != texture.imageIndex.value();
+		writer.textures.push_back(package::Texture{ image != NO_IMAGE ? (uint32_t)image : package::NONE,
+			hasFallback ? (uint32_t)texture.imageIndex.value() : package::NONE,
+			texture.samplerIndex.has_value() ? (uint32_t)texture.samplerIndex.value() : package::NONE });
+	}
+
+	for (fastgltf::Material& mat : gltf.materials) {
+		package::Material material = {};
+		material.name = writer.add_string(mat.name);
+		for (int c = 0; c < 4; c++) {
+			material.colorFactors[c] = mat.pbrData.baseColorFactor[c];
+		}
+		material.metallicFactor = mat.pbrData.metallicFactor;
+		material.roughnessFactor = mat.pbrData.roughnessFactor;
+		material.alphaMode = (uint32_t)mat.alphaMode;
+		material.colorTexture = mat.pbrData.baseColorTexture.has_value() ? (uint32_t)mat.pbrData.baseColorTexture.value().textureIndex : package::NONE;
+		material.metalRoughTexture = mat.pbrData.metallicRoughnessTexture.has_value() ? (uint32_t)mat.pbrData.metallicRoughnessTexture.value().textureIndex : package::NONE;
+		writer.materials.push_back(material);
+	}
+
+	for (ImportedMesh& imported : import->meshes) {
+		std::vector<uint32_t> surfaceMaterials(imported.surfaceMaterials.begin(), imported.surfaceMaterials.end());
+		writer.add_mesh(imported.name, imported.hash, imported.surfaces, surfaceMaterials, imported.occluder.get(), imported.staging);
+	}
+
+	for (size_t i = 0; i < gltf.nodes.size(); i++) {
+		fastgltf::Node& node = gltf.nodes[i];
+		std::vector<uint32_t> children(node.children.begin(), node.children.end());
+		writer.add_node(node.name, node.meshIndex.has_value() ? (uint32_t)node.meshIndex.value() : package::NONE, children, import->nodeInstances[i], node_transform(node));
+	}
+
+	if (!writer.write(std::filesystem::path(packagePath))) {
+		std::cerr << "Failed to write package: " << packagePath << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool saveSnapshot(VkSREngine* engine, const LoadedGLTF& scene, std::string_view packagePath) {
+	// Streamed meshes and textures may not be on the GPU yet
+	if (scene.is_streaming()) {
+		std::cerr << "Scene is still loading, no snapshot of it saved" << std::endl;
+		return false;
+	}
+
+	fmt::println("Saving snapshot: {}", packagePath);
+
+	PackageWriter writer;
+	writer.samplers = scene.samplerFilters;
+
+	// Only the lookup maps know the names
+	std::unordered_map<const Node*, std::string_view> nodeNames;
+	for (auto& [name, node] : scene.nodes) {
+		nodeNames[node.get()] = name;
+	}
+	std::unordered_map<VkImage, std::string_view> imageNames;
+	for (auto& [name, image] : scene.images) {
+		imageNames[(VkImage)image.image] = name;
+	}
+
+	// Nodes keep the depth first order of the transform hierarchy
+	std::unordered_map<const Node*, uint32_t> nodeIndices;
+	for (size_t i = 0; i < scene.transformNodes.size(); i++) {
+		nodeIndices[scene.transformNodes[i]] = (uint32_t)i;
+	}
+
+	// Every mesh the nodes draw, then the ones no node uses, and the materials of all of them
+	std::vector<const MeshAsset*> meshes;
+	std::unordered_map<const MeshAsset*, uint32_t> meshIndices;
+	std::vector<const GLTFMaterial*> materials;
+	std::unordered_map<const GLTFMaterial*, uint32_t> materialIndices;
+	auto add_mesh = [&](const MeshAsset* mesh) {
+		if (!meshIndices.emplace(mesh, (uint32_t)meshes.size()).second) {
+			return;
+		}
+		meshes.push_back(mesh);
+		for (const GeoSurface& surface : mesh->surfaces) {
+			if (materialIndices.emplace(surface.material.get(), (uint32_t)materials.size()).second) {
+				materials.push_back(surface.material.get());
+			}
+		}
+		};
+	for (const Node* node : scene.transformNodes) {
+		if (const MeshNode* meshNode = dynamic_cast<const MeshNode*>(node)) {
+			add_mesh(meshNode->mesh.get());
+		}
+	}
+	for (auto& [name, mesh] : scene.meshes) {
+		add_mesh(mesh.get());
+	}
+
+	// Constants as they are now, edits included
+	const GLTFMetallic_Roughness::MaterialConstants* constants = (const GLTFMetallic_Roughness::MaterialConstants*)scene.materialDataBuffer.info.pMappedData;
+	std::unordered_map<uint64_t, uint32_t> imageIndices;
+
+	// Materials on the default images keep sampling those after the restore, they get no texture
+	auto add_texture = [&](const AllocatedImage& image, uint64_t key, uint32_t sampler) {
+		if (key == 0) {
+			return package::NONE;
+		}
+
+		auto [it, added] = imageIndices.emplace(key, (uint32_t)writer.images.size());
+		if (added) {
+			std::vector<ImageLevel> levels;
+			AllocatedBuffer readback = engine->download_image(image, levels);
+
+			auto name = imageNames.find((VkImage)image.image);
+			writer.add_image(name != imageNames.end() ? name->second : std::string_view{}, image.imageExtent.width, image.imageExtent.height,
+				image.imageFormat, key, std::span<const std::byte>((const std::byte*)readback.info.pMappedData, readback.info.size), levels);
+			engine->destroy_buffer(readback);
+		}
+
+		writer.textures.push_back(package::Texture{ it->second, package::NONE, sampler });
+		return (uint32_t)writer.textures.size() - 1;
+		};
+
+	for (const GLTFMaterial* material : materials) {
+		package::Material packed = {};
+		packed.name = writer.add_string(material->name);
+		memcpy(packed.colorFactors, &constants[material->constantsIndex].colorFactors, sizeof(packed.colorFactors));
+		packed.metallicFactor = constants[material->constantsIndex].metal_rough_factors.x;
+		packed.roughnessFactor = constants[material->constantsIndex].metal_rough_factors.y;
+		packed.alphaMode = (uint32_t)(material->data.passType == MaterialPass::Transparent ? fastgltf::AlphaMode::Blend : fastgltf::AlphaMode::Opaque);
+		packed.colorTexture = add_texture(material->colorImage, material->colorImageKey, material->colorSampler);
+		packed.metalRoughTexture = add_texture(material->metalRoughImage, material->metalRoughImageKey, material->metalRoughSampler);
+		writer.materials.push_back(packed);
+	}
+
+	for (const MeshAsset* mesh : meshes) {
+		std::vector<uint32_t> surfaceMaterials;
+		for (const GeoSurface& surface : mesh->surfaces) {
+			surfaceMaterials.push_back(materialIndices[surface.material.get()]);
+		}
+
+		// Occluders only have CPU geometry, meshes without surfaces none
+		if (mesh->occluder || mesh->surfaces.empty()) {
+			writer.add_mesh(mesh->name, mesh->cacheKey, mesh->surfaces, surfaceMaterials, mesh->occluder.get(), MeshStaging{});
+			continue;
+		}
+
+		MeshStaging staging = engine->download_mesh(mesh->meshBuffers);
+		writer.add_mesh(mesh->name, mesh->cacheKey, mesh->surfaces, surfaceMaterials, nullptr, staging);
+		engine->destroy_buffer(staging.buffer);
+	}
+
+	for (const Node* node : scene.transformNodes) {
+		std::vector<uint32_t> children;
+		for (const std::shared_ptr<Node>& child : node->children) {
+			children.push_back(nodeIndices[child.get()]);
+		}
+
+		uint32_t mesh = package::NONE;
+		std::span<const glm::mat4> instances;
+		if (const MeshNode* meshNode = dynamic_cast<const MeshNode*>(node)) {
+			mesh = meshIndices[meshNode->mesh.get()];
+			instances = meshNode->gpuInstances;
+		}
+
+		auto name = nodeNames.find(node);
+		writer.add_node(name != nodeNames.end() ? name->second : std::string_view{}, mesh, children, instances, node->localTransform());
+	}
+
+	if (!writer.write(std::filesystem::path(packagePath))) {
+		std::cerr << "Failed to write snapshot: " << packagePath << std::endl;
+		return false;
+	}
+	return true;
+}
+
+// A table of the package, false when it lies outside of the file or does not hold whole elements
+template<typename T>
+bool read_table(std::span<const std::byte> file, const package::Section& section, std::span<const T>& table) {
+	if (section.offset % package::ALIGNMENT != 0 || section.offset > file.size() || section.size > file.size() - section.offset || section.size % sizeof(T) != 0) {
+		return false;
+	}
+	table = std::span<const T>((const T*)(file.data() + section.offset), section.size / sizeof(T));
+	return true;
+}
+
+// count elements from first fit in size
+bool in_range(uint64_t first, uint64_t count, uint64_t size) {
+	return first <= size && count <= size - first;
+}
+
+// Whether every index the surfaces, their LODs and meshlets draw names a vertex of the mesh. payload is the
+// mesh's data in the package, laid out like layout. The ranges themselves are already checked
+bool valid_package_indices(const ImportedMesh& mesh, const MeshStaging& layout, const std::byte* payload) {
+	const std::byte* indices = payload + layout.size() - layout.index_bytes();
+	const std::byte* meshlets = indices - layout.meshlet_bytes();
+	auto valid_range = [&](uint32_t first, uint32_t count, uint32_t vertexOffset) {
+		for (size_t i = first; i < (size_t)first + count; i++) {
+			uint32_t index;
+			if (layout.indexType == vk::IndexType::eUint16) {
+				uint16_t index16;
+				memcpy(&index16, indices + i * sizeof(uint16_t), sizeof(uint16_t));
+				index = index16;
+			}
+			else {
+				memcpy(&index, indices + i * sizeof(uint32_t), sizeof(uint32_t));
+			}
+			if ((uint64_t)index + vertexOffset >= layout.vertexCount) {
+				return false;
+			}
+		}
+		return true;
+		};
+
+	for (const GeoSurface& surface : mesh.surfaces) {
+		for (const MeshLod& lod : surface.lods) {
+			if (!valid_range(lod.startIndex, lod.count, surface.vertexOffset)) {
+				return false;
+			}
+		}
+
+		for (uint32_t m = surface.firstMeshlet; m < surface.firstMeshlet + surface.meshletCount; m++) {
+			GPUMeshlet meshlet;
+			memcpy(&meshlet, meshlets + m * sizeof(GPUMeshlet), sizeof(GPUMeshlet));
+			if (!in_range(meshlet.firstIndex, meshlet.indexCount, layout.indexCount) || !valid_range(meshlet.firstIndex, meshlet.indexCount, surface.vertexOffset)) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+// Maps a package written by cookGltf and fills in what import_gltf produces for a glTF file. Every mesh
+// payload is one copy into staging memory, the images are uploaded later straight from the mapping.
+// Like import_gltf it can run on any thread
+std::unique_ptr<GltfImport> import_package(VkSREngine* engine, std::string_view filePath) {
+	std::unique_ptr<GltfImport> result = std::make_unique<GltfImport>();
+	result->engine = engine;
+
+	if (!result->packageFile.open(std::filesystem::path(filePath))) {
+		std::cerr << "Failed to open package: " << filePath << std::endl;
+		return nullptr;
+	}
+	std::span<const std::byte> file = result->packageFile.bytes();
+
+	package::Header header;
+	if (file.size() < sizeof(header)) {
+		std::cerr << "Not a package: " << filePath << std::endl;
+		return nullptr;
+	}
+	memcpy(&header, file.data(), sizeof(header));
+
+	if (header.magic != package::MAGIC || header.version != package::VERSION) {
+		std::cerr << "Not a package of this engine version, cook it again: " << filePath << std::endl;
+		return nullptr;
+	}
+
+	auto corrupt = [&]() {
+		std::cerr << "Corrupt package: " << filePath << std::endl;
+		return nullptr;
+		};
+
+	std::span<const char> strings;
+	std::span<const package::Sampler> samplers;
+	std::span<const package::Image> images;
+	std::span<const package::Level> levels;
+	std::span<const package::Texture> textures;
+	std::span<const package::Material> materials;
+	std::span<const package::Mesh> meshes;
+	std::span<const package::Surface> surfaces;
+	std::span<const package::Lod> lods;
+	std::span<const package::Node> nodes;
+	std::span<const uint32_t> children;
+	std::span<const glm::mat4> instances;
+	std::span<const std::byte> data;
+	if (!read_table(file, header.strings, strings) || !read_table(file, header.samplers, samplers) ||
+		!read_table(file, header.images, images) || !read_table(file, header.levels, levels) ||
+		!read_table(file, header.textures, textures) || !read_table(file, header.materials, materials) ||
+		!read_table(file, header.meshes, meshes) || !read_table(file, header.surfaces, surfaces) ||
+		!read_table(file, header.lods, lods) || !read_table(file, header.nodes, nodes) ||
+		!read_table(file, header.children, children) || !read_table(file, header.instances, instances) ||
+		!read_table(file, header.data, data)) {
+		return corrupt();
+	}
+
+	bool validStrings = true;
+	auto read_string = [&](const package::String& s) {
+		if (!in_range(s.offset, s.length, strings.size())) {
+			validStrings = false;
+			return std::string_view{};
+		}
+		return std::string_view(strings.data() + s.offset, s.length);
+		};
+
+	fastgltf::Asset& gltf = result->gltf;
+
+	for (const package::Sampler& s : samplers) {
+		fastgltf::Sampler& sampler = gltf.samplers.emplace_back();
+		if (s.magFilter != package::NONE) {
+			sampler.magFilter = (fastgltf::Filter)s.magFilter;
+		}
+		if (s.minFilter != package::NONE) {
+			sampler.minFilter = (fastgltf::Filter)s.minFilter;
+		}
+	}
+
+	result->images.resize(images.size());
+	for (size_t i = 0; i < images.size(); i++) {
+		const package::Image& image = images[i];
+		std::string_view name = read_string(image.name);
+		gltf.images.emplace_back().name.assign(name.data(), name.size());
+
+		if (!in_range(image.firstLevel, image.levelCount, levels.size()) || !in_range(image.data.offset, image.data.size, data.size())) {
+			return corrupt();
+		}
+
+		DecodedImage& decoded = result->images[i];
+		if (image.levelCount == 0) {
+			continue;
+		}
+
+		// The levels are copied straight into the image, each has to be exactly the texels of its size and start
+		// where a buffer to image copy of any format may
+		const vk::Format format = (vk::Format)image.format;
+		const uint32_t chainLength = 32 - std::countl_zero(std::max(image.width, image.height));
+		const bool knownFormat = ktx2_format(image.format, TextureKind::Data).has_value() || format == vk::Format::eR8G8Unorm || format == vk::Format::eR8Unorm;
+		if (image.width == 0 || image.height == 0 || image.levelCount > chainLength || !knownFormat) {
+			return corrupt();
+		}
+
+		std::span<const package::Level> imageLevels = levels.subspan(image.firstLevel, image.levelCount);
+		for (size_t l = 0; l < imageLevels.size(); l++) {
+			const package::Level& level = imageLevels[l];
+			const vk::Extent2D levelSize{ std::max(image.width >> l, 1u), std::max(image.height >> l, 1u) };
+			if (!in_range(level.offset, level.size, image.data.size) || level.offset % package::ALIGNMENT != 0 || level.size != vkutil::image_level_size(format, levelSize)) {
+				return corrupt();
+			}
+		}
+
+		// Anything ktx2_format knows or build_mip_chain expands to was cooked, the device may still lack BC
+		// support or storage writes to R8 and RG8. The image then draws as the error checkerboard like one
+		// that failed to decode
+		if (!engine->supports_texture_format(format)) {
+			continue;
+		}
+
+		decoded.width = (int)image.width;
+		decoded.height = (int)image.height;
+		decoded.format = format;
+		decoded.hash = image.hash;
+		decoded.packaged = data.subspan(image.data.offset, image.data.size);
+		for (const package::Level& level : imageLevels) {
+			decoded.levels.push_back(ImageLevel{ (size_t)level.offset, (size_t)level.size });
+		}
+	}
+
+	// Textures sample the image when this device took it, otherwise the fallback. Fallbacks no texture picks
+	// are never uploaded, like the ones import_gltf leaves undecoded
+	std::vector<bool> fallbackUsed(images.size(), true);
+	for (const package::Texture& t : textures) {
+		if ((t.image != package::NONE && t.image >= images.size()) || (t.fallback != package::NONE && (t.fallback >= images.size() || t.image == package::NONE))
+			|| (t.sampler != package::NONE && t.sampler >= samplers.size())) {
+			return corrupt();
+		}
+		if (t.fallback != package::NONE) {
+			fallbackUsed[t.fallback] = false;
+		}
+	}
+
+	for (const package::Texture& t : textures) {
+		uint32_t image = t.image;
+		if (t.fallback != package::NONE && !result->images[t.image].valid() && result->images[t.fallback].valid()) {
+			image = t.fallback;
+		}
+
+		fastgltf::Texture& texture = gltf.textures.emplace_back();
+		if (image != package::NONE) {
+			texture.imageIndex = image;
+			fallbackUsed[image] = true;
+		}
+		if (t.sampler != package::NONE) {
+			texture.samplerIndex = t.sampler;
+		}
+		result->textureImages.push_back(image != package::NONE ? image : NO_IMAGE);
+	}
+
+	for (size_t i = 0; i < images.size(); i++) {
+		result->images[i].unused = !fallbackUsed[i];
+	}
+
+	for (const package::Material& m : materials) {
+		if ((m.colorTexture != package::NONE && m.colorTexture >= textures.size()) || (m.metalRoughTexture != package::NONE && m.metalRoughTexture >= textures.size())) {
+			return corrupt();
+		}
+
+		fastgltf::Material& mat = gltf.materials.emplace_back();
+		std::string_view name = read_string(m.name);
+		mat.name.assign(name.data(), name.size());
+		for (int c = 0; c < 4; c++) {
+			mat.pbrData.baseColorFactor[c] = m.colorFactors[c];
+		}
+		mat.pbrData.metallicFactor = m.metallicFactor;
+		mat.pbrData.roughnessFactor = m.roughnessFactor;
+		mat.alphaMode = (fastgltf::AlphaMode)m.alphaMode;
+
+		if (m.colorTexture != package::NONE) {
+			fastgltf::TextureInfo colorTexture = {};
+			colorTexture.textureIndex = m.colorTexture;
+			mat.pbrData.baseColorTexture = std::move(colorTexture);
+		}
+		if (m.metalRoughTexture != package::NONE) {
+			fastgltf::TextureInfo metalRoughTexture = {};
+			metalRoughTexture.textureIndex = m.metalRoughTexture;
+			mat.pbrData.metallicRoughnessTexture = std::move(metalRoughTexture);
+		}
+	}
+
+	result->meshes.resize(meshes.size());
+	for (size_t i = 0; i < meshes.size(); i++) {
+		const package::Mesh& mesh = meshes[i];
+		ImportedMesh& imported = result->meshes[i];
+
+		if (!in_range(mesh.firstSurface, mesh.surfaceCount, surfaces.size()) || !in_range(mesh.data.offset, mesh.data.size, data.size())) {
+			return corrupt();
+		}
+
+		imported.name = read_string(mesh.name);
+		imported.hash = mesh.hash;
+
+		if (mesh.occluder) {
+			const size_t positionBytes = (size_t)mesh.occluderVertexCount * sizeof(glm::vec3);
+			const size_t indexBytes = (size_t)mesh.occluderIndexCount * sizeof(uint32_t);
+			if (positionBytes + indexBytes != mesh.data.size) {
+				return corrupt();
+			}
+
+			imported.occluder = std::make_shared<OccluderGeometry>();
+			imported.occluder->positions.resize(mesh.occluderVertexCount);
+			imported.occluder->indices.resize(mesh.occluderIndexCount);
+			memcpy(imported.occluder->positions.data(), data.data() + mesh.data.offset, positionBytes);
+			memcpy(imported.occluder->indices.data(), data.data() + mesh.data.offset + positionBytes, indexBytes);
+
+			// The rasterizer looks the positions up by these
+			for (uint32_t index : imported.occluder->indices) {
+				if (index >= mesh.occluderVertexCount) {
+					return corrupt();
+				}
+			}
+			continue;
+		}
+
+		const vk::IndexType indexType = (vk::IndexType)mesh.indexType;
+		MeshStaging layout{ {}, mesh.vertexCount, mesh.colorCount, mesh.meshletCount, mesh.indexCount, indexType };
+		if ((indexType != vk::IndexType::eUint16 && indexType != vk::IndexType::eUint32) || layout.size() != mesh.data.size) {
+			return corrupt();
+		}
+
+		// The draws and the meshlet culling pass read the mesh buffers through these ranges
+		for (const package::Surface& s : surfaces.subspan(mesh.firstSurface, mesh.surfaceCount)) {
+			if (!in_range(s.firstLod, s.lodCount, lods.size()) || s.lodCount == 0 || s.material >= materials.size() ||
+				!in_range(s.startIndex, s.count, mesh.indexCount) || s.vertexOffset > mesh.vertexCount ||
+				!in_range(s.firstMeshlet, s.meshletCount, mesh.meshletCount)) {
+				return corrupt();
+			}
+			for (const package::Lod& lod : lods.subspan(s.firstLod, s.lodCount)) {
+				if (!in_range(lod.startIndex, lod.count, mesh.indexCount)) {
+					return corrupt();
+				}
+			}
+
+			GeoSurface& surface = imported.surfaces.emplace_back();
+			surface.startIndex = s.startIndex;
+			surface.count = s.count;
+			surface.vertexOffset = s.vertexOffset;
+			surface.firstMeshlet = s.firstMeshlet;
+			surface.meshletCount = s.meshletCount;
+			memcpy(&surface.bounds.origin, s.origin, sizeof(s.origin));
+			surface.bounds.sphereRadius = s.sphereRadius;
+			memcpy(&surface.bounds.extents, s.extents, sizeof(s.extents));
+
+			for (const package::Lod& lod : lods.subspan(s.firstLod, s.lodCount)) {
+				surface.lods.push_back(MeshLod{ lod.startIndex, lod.count, lod.error });
+			}
+			imported.surfaceMaterials.push_back(s.material);
+		}
+	}
+
+	result->nodeInstances.resize(nodes.size());
+	for (size_t i = 0; i < nodes.size(); i++) {
+		const package::Node& n = nodes[i];
+		if ((n.mesh != package::NONE && n.mesh >= meshes.size()) || !in_range(n.firstChild, n.childCount, children.size()) ||
+			!in_range(n.firstInstance, n.instanceCount, instances.size())) {
+			return corrupt();
+		}
+
+		fastgltf::Node& node = gltf.nodes.emplace_back();
+		std::string_view name = read_string(n.name);
+		node.name.assign(name.data(), name.size());
+		if (n.mesh != package::NONE) {
+			node.meshIndex = n.mesh;
+		}
+
+		for (uint32_t c : children.subspan(n.firstChild, n.childCount)) {
+			if (c >= nodes.size()) {
+				return corrupt();
+			}
+			node.children.push_back(c);
+		}
+
+		fastgltf::math::fmat4x4 localTransform;
+		memcpy(localTransform.data(), n.transform, sizeof(n.transform));
+		node.transform = localTransform;
+
+		std::span<const glm::mat4> nodeInstances = instances.subspan(n.firstInstance, n.instanceCount);
+		result->nodeInstances[i].assign(nodeInstances.begin(), nodeInstances.end());
+	}
+
+	// Nodes form a forest, a node with two parents or a cycle would have create_scene recurse forever
+	std::vector<uint32_t> parentCounts(nodes.size(), 0);
+	for (const fastgltf::Node& node : gltf.nodes) {
+		for (size_t c : node.children) {
+			if (++parentCounts[c] > 1) {
+				return corrupt();
+			}
+		}
+	}
+
+	// With at most one parent each, the nodes on a cycle are exactly the ones no root reaches
+	std::vector<size_t> reachable;
+	for (size_t i = 0; i < nodes.size(); i++) {
+		if (parentCounts[i] == 0) {
+			reachable.push_back(i);
+		}
+	}
+	for (size_t i = 0; i < reachable.size(); i++) {
+		const fastgltf::Node& node = gltf.nodes[reachable[i]];
+		reachable.insert(reachable.end(), node.children.begin(), node.children.end());
+	}
+	if (reachable.size() != nodes.size()) {
+		return corrupt();
+	}
+
+	if (!validStrings) {
+		return corrupt();
+	}
+
+	// The tables are validated, the index values and the payload copies are all that is left. Spread over the
+	// cores like the glTF import, the first touch of every mapped page happens here
+	std::atomic<bool> validIndices = true;
+	parallel_for(meshes.size(), [&](size_t i) {
+		const package::Mesh& mesh = meshes[i];
+		if (mesh.occluder || mesh.surfaceCount == 0) {
+			return;
+		}
+
+		const std::byte* payload = data.data() + mesh.data.offset;
+		MeshStaging layout{ {}, mesh.vertexCount, mesh.colorCount, mesh.meshletCount, mesh.indexCount, (vk::IndexType)mesh.indexType };
+		if (!valid_package_indices(result->meshes[i], layout, payload)) {
+			validIndices = false;
+			return;
+		}
+
+		MeshStaging& staging = result->meshes[i].staging;
+		staging = engine->create_mesh_staging(mesh.vertexCount, mesh.colorCount, mesh.meshletCount, mesh.indexCount, (vk::IndexType)mesh.indexType);
+		memcpy(staging.data(), payload, staging.size());
+		});
+
+	// Staging written so far is freed with the import
+	if (!validIndices) {
+		return corrupt();
+	}
+
+	return result;
+}
+
+std::optional<std::shared_ptr<LoadedGLTF>> loadPackage(VkSREngine* engine, std::string_view filePath) {
+	fmt::println("Loading package: {}", filePath);
+	return load_import(engine, import_package(engine, filePath));
+}
+
+std::shared_ptr<LoadedGLTF> loadPackageAsync(VkSREngine* engine, std::string_view filePath) {
+	fmt::println("Streaming package: {}", filePath);
+	return stream_import(engine, [engine, path = std::string(filePath)]() {
+		return import_package(engine, path);
+		});
+}
+//< package
+
+//> LoadedGLTF
+LoadedGLTF::~LoadedGLTF() {
+	clearAll();
+}
+
+bool LoadedGLTF::is_importing() const {
+	return stream && !stream->import && stream->pending.valid() && stream->pending.wait_for(std::chrono::seconds(0)) != std::future_status::ready;
+}
+
+void LoadedGLTF::update_streaming(vk::CommandBuffer cmd, size_t& budget, DrawContext& ctx) {
+	SceneStream& s = *stream;
+
+	if (!s.import) {
+		if (s.pending.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+			return;
+		}
+
+		// import_gltf or import_package has already reported why it failed, the scene stays empty
+		s.import = s.pending.get();
+		if (!s.import) {
+			stream.reset();
+			return;
+		}
+
+		s.placeholders.assign(s.import->images.size(), creator->_whiteImage);
+	}
+
+	// The scene objects come out of the budget too, a scene with many materials or nodes takes several frames
+	if (!s.objects.complete) {
+		if (!create_scene(creator, *this, *s.import, s.placeholders, s.objects, budget)) {
+			return;
+		}
+
+		// Only occluders get proxies yet, the meshes follow as they become resident
+		RegisterProxies(instanceTransforms, ctx);
+		return;
+	}
+
+	fastgltf::Asset& gltf = s.import->gltf;
+
+	// Meshes first, an untextured model reads better than a missing one
+	while (budget > 0 && s.nextMesh < s.objects.meshes.size()) {
+		MeshAsset& mesh = *s.objects.meshes[s.nextMesh];
+		ImportedMesh& imported = s.import->meshes[s.nextMesh];
+		s.nextMesh++;
+
+		if (mesh.resident) {
+			continue;
+		}
+
+		budget -= std::min(budget, upload_imported_mesh(creator, *this, mesh, imported, cmd));
+		imported = {};
+
+		for (Node* node : transformNodes) {
+			MeshNode* meshNode = dynamic_cast<MeshNode*>(node);
+			if (meshNode && meshNode->mesh.get() == &mesh) {
+				meshNode->register_surfaces(instanceTransforms, ctx);
+			}
+		}
+	}
+
+	while (budget > 0 && s.nextMesh == s.objects.meshes.size() && s.nextImage < s.import->images.size()) {
+		const size_t imageIndex = s.nextImage++;
+		DecodedImage& decoded = s.import->images[imageIndex];
+		fastgltf::Image& image = gltf.images[imageIndex];
+
+		if (decoded.unused) {
+			continue;
+		}
+
+		budget -= std::min(budget, decoded.upload_size());
+
+		AllocatedImage residentImage = creator->_errorCheckerboardImage;
+		std::optional<AllocatedImage> img = load_image(creator, *this, decoded, cmd);
+		if (img.has_value()) {
+			residentImage = *img;
+			images[image.name.c_str()] = *img;
+		}
+		else {
+			std::cout << "glTF failed to load texture" << image.name << std::endl;
+		}
+
+		// Frames in flight may still use the material's descriptor set, so it gets another one instead of an
+		// update. The old one is reused for a later texture
+		auto samples = [&](const std::optional<fastgltf::TextureInfo>& texture) {
+			return texture.has_value() && s.import->textureImages[texture.value().textureIndex] == imageIndex;
+			};
+
+		for (size_t m = 0; m < gltf.materials.size(); m++) {
+			fastgltf::Material& mat = gltf.materials[m];
+			const bool color = samples(mat.pbrData.baseColorTexture);
+			const bool metalRough = samples(mat.pbrData.metallicRoughnessTexture);
+			if (!color && !metalRough) {
+				continue;
+			}
+
+			GLTFMetallic_Roughness::MaterialResources& resources = s.objects.materialResources[m];
+			GLTFMaterial& material = *s.objects.materials[m];
+			if (color) {
+				resources.colorImage = residentImage;
+				material.colorImage = residentImage;
+				material.colorImageKey = img.has_value() ? decoded.hash : 0;
+			}
+			if (metalRough) {
+				// Factors alone when the texture failed, like create_material
+				resources.metalRoughImage = img.value_or(creator->_whiteImage);
+				material.metalRoughImage = resources.metalRoughImage;
+				material.metalRoughImageKey = img.has_value() ? decoded.hash : 0;
+			}
+
+			vk::DescriptorSet set;
+			auto reusable = std::find_if(s.retiredSets.begin(), s.retiredSets.end(), [&](const SceneStream::RetiredSet& retired) {
+				return retired.frameNumber <= creator->_frameNumber - (int)FRAME_OVERLAP;
+				});
+			if (reusable != s.retiredSets.end()) {
+				set = reusable->set;
+				s.retiredSets.erase(reusable);
+			}
+			else {
+				set = descriptorPool.allocate(creator->_device, creator->_metalRoughMaterial.materialLayout);
+			}
+
+			s.retiredSets.push_back(SceneStream::RetiredSet{ material.data.materialSet, creator->_frameNumber });
+			creator->_metalRoughMaterial.update_material(creator->_device, material.data, resources, set);
+		}
+	}
+
+	if (s.nextMesh == s.objects.meshes.size() && s.nextImage == s.import->images.size()) {
+		stream.reset();
+	}
+}
+
+uint32_t LoadedGLTF::add_instance(const glm::mat4& transform) {
+	uint32_t id;
+	if (!freeInstanceIds.empty()) {
+		id = freeInstanceIds.back();
+		freeInstanceIds.pop_back();
+	}
+	else {
+		id = (uint32_t)instanceSlots.size();
+		instanceSlots.push_back(UINT32_MAX);
+	}
+
+	instanceSlots[id] = (uint32_t)instanceTransforms.size();
+	instanceTransforms.push_back(transform);
+	instanceIds.push_back(id);
+	instancesChanged = true;
+	return id;
+}
+
+void LoadedGLTF::set_instance_transform(uint32_t id, const glm::mat4& transform) {
+	if (id >= instanceSlots.size() || instanceSlots[id] == UINT32_MAX) {
+		return;
+	}
+
+	instanceTransforms[instanceSlots[id]] = transform;
+	movedInstances.push_back(instanceSlots[id]);
+}
+
+void LoadedGLTF::remove_instance(uint32_t id) {
+	if (id >= instanceSlots.size() || instanceSlots[id] == UINT32_MAX) {
+		return;
+	}
+
+	// Swap in the last instance so the transforms stay packed
+	uint32_t slot = instanceSlots[id];
+	uint32_t last = (uint32_t)instanceTransforms.size() - 1;
+	if (slot != last) {
+		instanceTransforms[slot] = instanceTransforms[last];
+		instanceIds[slot] = instanceIds[last];
+		instanceSlots[instanceIds[slot]] = slot;
+	}
+	instanceTransforms.pop_back();
+	instanceIds.pop_back();
+
+	instanceSlots[id] = UINT32_MAX;
+	freeInstanceIds.push_back(id);
+	instancesChanged = true;
+}
+
+void LoadedGLTF::RegisterProxies(std::span<const glm::mat4> topMatrices, DrawContext& ctx) {
+	// Create render proxies from the scene nodes
+	for (auto& n : topNodes) {
+		n->RegisterProxies(topMatrices, ctx);
+	}
+}
+
+void LoadedGLTF::UpdateProxies(std::span<const glm::mat4> topMatrices, DrawContext& ctx) {
+	// Nothing moved, a static scene ends here
+	if (!transforms.is_dirty() && !instancesChanged && movedInstances.empty()) {
+		return;
+	}
+
+	changedTransforms.clear();
+	transforms.update(changedTransforms);
+
+	// Every proxy draws every instance, so an added or removed instance touches all copies of all nodes
+	if (instancesChanged) {
+		instancesChanged = false;
+		movedInstances.clear();
+		for (Node* node : transformNodes) {
+			node->UpdateProxies(topMatrices, ctx);
+		}
+		return;
+	}
+
+	for (uint32_t i : changedTransforms) {
+		transformNodes[i]->UpdateProxies(topMatrices, ctx);
+	}
+
+	// A moved instance only touches its own copies, of the nodes that did not move themselves
+	if (!movedInstances.empty()) {
+		std::sort(movedInstances.begin(), movedInstances.end());
+		movedInstances.erase(std::unique(movedInstances.begin(), movedInstances.end()), movedInstances.end());
+
+		std::sort(changedTransforms.begin(), changedTransforms.end());
+		for (uint32_t i = 0; i < transformNodes.size(); i++) {
+			if (std::binary_search(changedTransforms.begin(), changedTransforms.end(), i)) {
+				continue;
+			}
+			for (uint32_t slot : movedInstances) {
+				transformNodes[i]->UpdateInstance(topMatrices, slot, ctx);
+			}
+		}
+		movedInstances.clear();
+	}
+}
+
+void LoadedGLTF::UnregisterProxies(DrawContext& ctx) {
+	for (auto& n : topNodes) {
+		n->UnregisterProxies(ctx);
 	}
 }
 
@@ -466,21 +2924,22 @@ void LoadedGLTF::clearAll() {
 
 	descriptorPool.destroy_pools(dv);
 	creator->destroy_buffer(materialDataBuffer);
+
+	for (uint32_t sortId : materialSortIds) {
+		creator->_metalRoughMaterial.release_material(sortId);
+	}
 	
-	for (auto& [k, v] : meshes) {
-		creator->destroy_buffer(v->meshBuffers.indexBuffer);
-		creator->destroy_buffer(v->meshBuffers.vertexBuffer);
+	// Shared resources are destroyed by the cache once no other scene uses them
+	for (uint64_t key : meshKeys) {
+		creator->_resourceCache.release_mesh(creator, key);
 	}
 
-	for (auto& [k, v] : images) {
-		if (v.image == creator->_errorCheckerboardImage.image) {
-			// Don't destroy a default image
-		}
-		creator->destroy_image(v);
+	for (uint64_t key : imageKeys) {
+		creator->_resourceCache.release_image(creator, key);
 	}
 
-	for (auto& sampler : samplers) {
-		dv.destroySampler(sampler, nullptr);
+	for (uint64_t key : samplerKeys) {
+		creator->_resourceCache.release_sampler(dv, key);
 	}
 }
 //< LoadedGLTF
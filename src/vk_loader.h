@@ -2,6 +2,8 @@
 
 #include <vk_types.h>
 #include <vk_descriptors.h>
+#include <occlusion_rasterizer.h>
+#include <scene_package.h>
 #include <unordered_map>
 #include <filesystem>
 
@@ -11,6 +13,16 @@ class VkSREngine;
 //> material
 struct GLTFMaterial {
 	MaterialInstance data;
+
+	// What the material was written from, saveSnapshot reads it back
+	std::string name;
+	uint32_t constantsIndex{ 0 };        // Slot in the scene's materialDataBuffer
+	AllocatedImage colorImage;           // A placeholder until a streamed texture is resident
+	uint64_t colorImageKey{ 0 };         // Of colorImage in the ResourceCache, 0 for the engine's default images
+	uint32_t colorSampler{ UINT32_MAX }; // Into the scene's samplers, UINT32_MAX without a color texture
+	AllocatedImage metalRoughImage;      // Roughness in R and metallic in G
+	uint64_t metalRoughImageKey{ 0 };
+	uint32_t metalRoughSampler{ UINT32_MAX };
 };
 //< material
 
@@ -21,11 +33,28 @@ struct Bounds {
 	glm::vec3 extents;
 };
 
+// One level of detail, a range of the mesh index buffer. error is the simplification error in object space units
+struct MeshLod {
+	uint32_t startIndex;
+	uint32_t count;
+	float error;
+};
+
 struct GeoSurface {
 	uint32_t startIndex;
 	uint32_t count;
 	Bounds bounds;
 	std::shared_ptr<GLTFMaterial> material;
+
+	// First vertex of the surface, the uploaded indices are relative to it
+	uint32_t vertexOffset;
+
+	// Range in the mesh's meshlet buffer, the meshlets cover the full detail indices
+	uint32_t firstMeshlet{ 0 };
+	uint32_t meshletCount{ 0 };
+
+	// lods[0] is the full detail surface, every next level has roughly half the triangles
+	std::vector<MeshLod> lods;
 };
 
 struct MeshAsset {
@@ -33,21 +62,41 @@ struct MeshAsset {
 
 	std::vector<GeoSurface> surfaces;
 	GPUMeshBuffers meshBuffers;
+
+	// Set for meshes named as occluders. Those are only rasterized by the CPU occlusion culling and never drawn
+	std::shared_ptr<OccluderGeometry> occluder;
+
+	// Buffers are uploaded, false while a streamed scene is still loading the mesh
+	bool resident{ false };
+	uint64_t cacheKey{ 0 }; // meshBuffers in the engine's ResourceCache
 };
 //< mesh
 
 //> gltf
+struct SceneStream;
+
 struct LoadedGLTF : public IRenderable {
 	// Storage for all the data on a given gLTF file
 	std::unordered_map<std::string, std::shared_ptr<MeshAsset>> meshes;
 	std::unordered_map<std::string, std::shared_ptr<Node>> nodes;
 	std::unordered_map<std::string, AllocatedImage> images;
 	std::unordered_map<std::string, std::shared_ptr<GLTFMaterial>> materials;
+	std::vector<uint32_t> materialSortIds; // Of every material, given back to the engine with the scene
 
 	// Nodes that do not have a parent, for iterating the file tree in order
 	std::vector<std::shared_ptr<Node>> topNodes;
 
+	// Matrices of all nodes in depth first order, transformNodes maps a slot back to its node
+	TransformHierarchy transforms;
+	std::vector<Node*> transformNodes;
+
 	std::vector<vk::Sampler> samplers;
+	std::vector<package::Sampler> samplerFilters; // The glTF filters of every sampler
+
+	// References this scene holds in the engine's ResourceCache
+	std::vector<uint64_t> imageKeys;
+	std::vector<uint64_t> meshKeys;
+	std::vector<uint64_t> samplerKeys;
 
 	DescriptorAllocatorGrowable descriptorPool;
 
@@ -55,14 +104,61 @@ struct LoadedGLTF : public IRenderable {
 
 	VkSREngine* creator;
 
-	~LoadedGLTF() { clearAll(); };
+	// Set while the scene is loaded in the background, see loadGltfAsync
+	std::unique_ptr<SceneStream> stream;
+
+	~LoadedGLTF();
+
+	bool is_streaming() const { return stream != nullptr; }
+	// The background import is still running, destroying the scene now would wait for it
+	bool is_importing() const;
+
+	// Creates the scene once the background import is done, then records uploads into cmd until budget
+	// bytes are used up. Meshes get their render proxies as they become resident
+	void update_streaming(vk::CommandBuffer cmd, size_t& budget, DrawContext& ctx);
+
+	// Placed copies of the whole scene. Ids stay valid until removed, the transforms are packed
+	// and are what the engine registers and updates the proxies with
+	uint32_t add_instance(const glm::mat4& transform);
+	void set_instance_transform(uint32_t id, const glm::mat4& transform);
+	void remove_instance(uint32_t id);
+	std::span<const glm::mat4> instance_transforms() const { return instanceTransforms; }
 
-	virtual void Draw(const glm::mat4& topMatrix, DrawContext& ctx);
+	virtual void RegisterProxies(std::span<const glm::mat4> topMatrices, DrawContext& ctx);
+	virtual void UpdateProxies(std::span<const glm::mat4> topMatrices, DrawContext& ctx);
+	virtual void UnregisterProxies(DrawContext& ctx);
 
 private:
+	std::vector<uint32_t> changedTransforms;
+
+	std::vector<glm::mat4> instanceTransforms;
+	std::vector<uint32_t> instanceIds;     // Id of every instanceTransforms entry
+	std::vector<uint32_t> instanceSlots;   // instanceTransforms index by id, UINT32_MAX for removed ids
+	std::vector<uint32_t> freeInstanceIds;
+	std::vector<uint32_t> movedInstances; // instanceTransforms slots set since the last update, can repeat
+	bool instancesChanged{ false };       // Instances were added or removed
+
 	void clearAll();
 };
 
 std::optional<std::shared_ptr<LoadedGLTF>> loadGltf(VkSREngine* engine, std::string_view filePath);
+
+// Returns right away, the file is parsed and decoded on background threads and its GPU resources are
+// created over the following frames by update_streaming. Until then it draws with placeholder textures
+std::shared_ptr<LoadedGLTF> loadGltfAsync(VkSREngine* engine, std::string_view filePath);
+
+// Same for a package written by cookGltf, see scene_package.h. The mesh streams and mip chains are uploaded
+// as they were cooked, nothing is parsed or converted per element
+std::optional<std::shared_ptr<LoadedGLTF>> loadPackage(VkSREngine* engine, std::string_view filePath);
+std::shared_ptr<LoadedGLTF> loadPackageAsync(VkSREngine* engine, std::string_view filePath);
+
+// Imports a glTF file without a GPU and writes it as a package: the optimized and packed mesh streams with
+// their bounds and LODs, full mip chains, materials and the node hierarchy. False when either step fails
+bool cookGltf(std::string_view gltfPath, std::string_view packagePath);
+
+// Writes a loaded scene as it is now, with its current node transforms and material constants, to a package
+// that loadPackage restores. The mesh buffers and images are read back from the GPU. False while the scene
+// is still streaming or when the file does not write
+bool saveSnapshot(VkSREngine* engine, const LoadedGLTF& scene, std::string_view packagePath);
 //< gltf
 
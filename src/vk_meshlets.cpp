@@ -0,0 +1,95 @@
+#include <vk_meshlets.h>
+
+#include <vk_engine.h>
+#include <vk_initializers.h>
+#include <vk_pipelines.h>
+
+//> MeshletCuller
+void MeshletCuller::init(VkSREngine* engine) {
+	vk::Device device = engine->_device;
+
+	{
+		DescriptorLayoutBuilder builder;
+		builder.add_binding(0, vk::DescriptorType::eStorageBuffer);
+		builder.add_binding(1, vk::DescriptorType::eStorageBuffer);
+		builder.add_binding(2, vk::DescriptorType::eStorageBuffer);
+		builder.add_binding(3, vk::DescriptorType::eStorageBuffer);
+		cullLayout = builder.build(device, vk::ShaderStageFlagBits::eCompute);
+	}
+
+	vk::PushConstantRange pushConstant = {};
+	pushConstant.offset = 0;
+	pushConstant.size = sizeof(MeshletCullPushConstants);
+	pushConstant.stageFlags = vk::ShaderStageFlagBits::eCompute;
+
+	vk::PipelineLayoutCreateInfo layoutInfo = vkinit::pipeline_layout_create_info();
+	layoutInfo.setLayoutCount = 1;
+	layoutInfo.pSetLayouts = &cullLayout;
+	layoutInfo.pushConstantRangeCount = 1;
+	layoutInfo.pPushConstantRanges = &pushConstant;
+
+	VK_CHECK(device.createPipelineLayout(&layoutInfo, nullptr, &cullPipelineLayout));
+
+	vk::ShaderModule cullShader;
+	const char* cullPath = "../../shaders/meshlet_cull.comp.spv";
+	if (!vkutil::load_shader_module(cullPath, device, &cullShader)) {
+		fmt::println("Error when building the shader module at path: {}", cullPath);
+	}
+
+	vk::ComputePipelineCreateInfo pipelineInfo = {};
+	pipelineInfo.layout = cullPipelineLayout;
+	pipelineInfo.stage = vkinit::pipeline_shader_stage_create_info(vk::ShaderStageFlagBits::eCompute, cullShader);
+
+	VK_CHECK(device.createComputePipelines(VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &cullPipeline));
+
+	device.destroyShaderModule(cullShader, nullptr);
+
+	// Host visible counters so the results can be shown in the stats window
+	for (int i = 0; i < FRAME_OVERLAP; i++) {
+		engine->_frames[i]._meshletStatsBuffer = engine->create_buffer(sizeof(GPUMeshletStats), vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst, vma::MemoryUsage::eGpuToCpu);
+		memset(engine->_frames[i]._meshletStatsBuffer.info.pMappedData, 0, sizeof(GPUMeshletStats));
+	}
+}
+
+void MeshletCuller::clear_resources(VkSREngine* engine) {
+	vk::Device device = engine->_device;
+
+	for (int i = 0; i < FRAME_OVERLAP; i++) {
+		engine->destroy_buffer(engine->_frames[i]._meshletStatsBuffer);
+	}
+
+	device.destroyPipeline(cullPipeline, nullptr);
+	device.destroyPipelineLayout(cullPipelineLayout, nullptr);
+	device.destroyDescriptorSetLayout(cullLayout, nullptr);
+}
+
+void MeshletCuller::cull(vk::CommandBuffer cmd, const glm::mat4& viewProj, const glm::vec3& cameraPosition, uint32_t drawCount, vk::DescriptorSet cullSet) {
+	MeshletCullPushConstants pushConstants = {};
+
+	// Planes from the rows of the matrix, pointing inwards. With the reversed depth range the near plane is z <= w and the far plane z >= 0
+	glm::vec4 rows[4];
+	for (int i = 0; i < 4; i++) {
+		rows[i] = glm::vec4(viewProj[0][i], viewProj[1][i], viewProj[2][i], viewProj[3][i]);
+	}
+
+	pushConstants.frustumPlanes[0] = rows[3] + rows[0];
+	pushConstants.frustumPlanes[1] = rows[3] - rows[0];
+	pushConstants.frustumPlanes[2] = rows[3] + rows[1];
+	pushConstants.frustumPlanes[3] = rows[3] - rows[1];
+	pushConstants.frustumPlanes[4] = rows[3] - rows[2];
+	pushConstants.frustumPlanes[5] = rows[2];
+
+	// Normalized so the sphere radius can be compared against the plane distance
+	for (glm::vec4& plane : pushConstants.frustumPlanes) {
+		plane /= glm::length(glm::vec3(plane));
+	}
+
+	pushConstants.cameraPosition = glm::vec4(cameraPosition, 0.f);
+	pushConstants.drawCount = drawCount;
+
+	cmd.bindPipeline(vk::PipelineBindPoint::eCompute, cullPipeline);
+	cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, cullPipelineLayout, 0, 1, &cullSet, 0, nullptr);
+	cmd.pushConstants(cullPipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(MeshletCullPushConstants), &pushConstants);
+	cmd.dispatch(drawCount, 1, 1);
+}
+//< MeshletCuller
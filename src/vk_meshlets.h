@@ -0,0 +1,65 @@
+#pragma once
+
+#include <vk_types.h>
+#include <vk_descriptors.h>
+
+// Forward declaration of the engine
+class VkSREngine;
+
+//> gpu_structs
+// One meshlet in a mesh's meshlet buffer, a range of the mesh index buffer with its culling data
+struct GPUMeshlet {
+	glm::vec4 sphere; // xyz center, w radius, in object space
+	glm::vec4 cone;   // xyz axis, w cutoff. A cutoff of 1 never culls
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	uint32_t pad0;
+	uint32_t pad1;
+};
+
+// One draw whose meshlets are culled, meshlet_cull.comp runs a workgroup per draw
+struct GPUMeshletDraw {
+	glm::mat4 transform;
+	vk::DeviceAddress meshlets;
+	uint32_t firstMeshlet;
+	uint32_t meshletCount;
+	int32_t vertexOffset;
+	uint32_t firstCommand; // Every draw owns meshletCount command slots starting here
+	uint32_t pad0;
+	uint32_t pad1;
+};
+
+struct GPUMeshletStats {
+	uint32_t tested;
+	uint32_t visible;
+	uint32_t triangles;
+	uint32_t pad0;
+};
+
+struct MeshletCullPushConstants {
+	glm::vec4 frustumPlanes[6];
+	glm::vec4 cameraPosition;
+	uint32_t drawCount;
+	uint32_t pad0;
+	uint32_t pad1;
+	uint32_t pad2;
+};
+//< gpu_structs
+
+//> MeshletCuller
+// Frustum and normal cone culling of meshlets in a compute pass. Surviving meshlets are compacted into
+// per-draw indirect commands, drawn with drawIndexedIndirectCount. No mesh shaders involved.
+// Only runs while Hi-Z occlusion culling is off, the occlusion passes draw whole surfaces from their own commands.
+struct MeshletCuller {
+	bool enabled{ true };
+
+	vk::DescriptorSetLayout cullLayout;
+	vk::PipelineLayout cullPipelineLayout;
+	vk::Pipeline cullPipeline;
+
+	void init(VkSREngine* engine);
+	void clear_resources(VkSREngine* engine);
+
+	void cull(vk::CommandBuffer cmd, const glm::mat4& viewProj, const glm::vec3& cameraPosition, uint32_t drawCount, vk::DescriptorSet cullSet);
+};
+//< MeshletCuller
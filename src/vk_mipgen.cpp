@@ -0,0 +1,323 @@
+#include <vk_mipgen.h>
+
+#include <vk_engine.h>
+#include <vk_images.h>
+#include <vk_initializers.h>
+#include <vk_pipelines.h>
+
+//> MipGenerator
+void MipGenerator::init(VkSREngine* engine) {
+	vk::Device device = engine->_device;
+
+	auto build_pipeline = [&](const char* path, vk::PipelineLayout shaderLayout) {
+		vk::ShaderModule shader;
+		if (!vkutil::load_shader_module(path, device, &shader)) {
+			fmt::println("Error when building the shader module at path: {}", path);
+		}
+
+		vk::ComputePipelineCreateInfo pipelineInfo = {};
+		pipelineInfo.layout = shaderLayout;
+		pipelineInfo.stage = vkinit::pipeline_shader_stage_create_info(vk::ShaderStageFlagBits::eCompute, shader);
+
+		vk::Pipeline pipeline;
+		VK_CHECK(device.createComputePipelines(VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline));
+
+		device.destroyShaderModule(shader, nullptr);
+		return pipeline;
+		};
+
+	//> downsample_pipelines
+	{
+		DescriptorLayoutBuilder builder;
+		builder.add_binding(0, vk::DescriptorType::eStorageImage);
+		builder.add_binding(1, vk::DescriptorType::eStorageImage);
+		builder.add_binding(2, vk::DescriptorType::eStorageImage, MAX_PASS_LEVELS);
+		builder.add_binding(3, vk::DescriptorType::eStorageBuffer);
+		layout = builder.build(device, vk::ShaderStageFlagBits::eCompute);
+	}
+
+	vk::PushConstantRange pushConstant = {};
+	pushConstant.offset = 0;
+	pushConstant.size = sizeof(MipDownsamplePushConstants);
+	pushConstant.stageFlags = vk::ShaderStageFlagBits::eCompute;
+
+	vk::PipelineLayoutCreateInfo layoutInfo = vkinit::pipeline_layout_create_info();
+	layoutInfo.setLayoutCount = 1;
+	layoutInfo.pSetLayouts = &layout;
+	layoutInfo.pushConstantRangeCount = 1;
+	layoutInfo.pPushConstantRanges = &pushConstant;
+
+	VK_CHECK(device.createPipelineLayout(&layoutInfo, nullptr, &pipelineLayout));
+
+	rgbaPipeline = build_pipeline("../../shaders/mip_downsample.comp.spv", pipelineLayout);
+	rgPipeline = build_pipeline("../../shaders/mip_downsample_rg8.comp.spv", pipelineLayout);
+	rPipeline = build_pipeline("../../shaders/mip_downsample_r8.comp.spv", pipelineLayout);
+	//< downsample_pipelines
+
+	//> expand_pipeline
+	{
+		DescriptorLayoutBuilder builder;
+		builder.add_binding(0, vk::DescriptorType::eStorageBuffer);
+		builder.add_binding(1, vk::DescriptorType::eStorageImage);
+		expandLayout = builder.build(device, vk::ShaderStageFlagBits::eCompute);
+	}
+
+	vk::PushConstantRange expandPushConstant = {};
+	expandPushConstant.offset = 0;
+	expandPushConstant.size = sizeof(TexelExpandPushConstants);
+	expandPushConstant.stageFlags = vk::ShaderStageFlagBits::eCompute;
+
+	vk::PipelineLayoutCreateInfo expandLayoutInfo = vkinit::pipeline_layout_create_info();
+	expandLayoutInfo.setLayoutCount = 1;
+	expandLayoutInfo.pSetLayouts = &expandLayout;
+	expandLayoutInfo.pushConstantRangeCount = 1;
+	expandLayoutInfo.pPushConstantRanges = &expandPushConstant;
+
+	VK_CHECK(device.createPipelineLayout(&expandLayoutInfo, nullptr, &expandPipelineLayout));
+
+	expandPipeline = build_pipeline("../../shaders/texel_expand.comp.spv", expandPipelineLayout);
+	//< expand_pipeline
+}
+
+void MipGenerator::clear_resources(VkSREngine* engine) {
+	vk::Device device = engine->_device;
+
+	device.destroyPipeline(expandPipeline, nullptr);
+	device.destroyPipelineLayout(expandPipelineLayout, nullptr);
+	device.destroyDescriptorSetLayout(expandLayout, nullptr);
+
+	device.destroyPipeline(rPipeline, nullptr);
+	device.destroyPipeline(rgPipeline, nullptr);
+	device.destroyPipeline(rgbaPipeline, nullptr);
+	device.destroyPipelineLayout(pipelineLayout, nullptr);
+	device.destroyDescriptorSetLayout(layout, nullptr);
+}
+
+void MipGenerator::queue(const AllocatedImage& image) {
+	pending.push_back(PendingImage{ image, VK_NULL_HANDLE, 0 });
+}
+
+void MipGenerator::queue_expansion(const AllocatedImage& image, vk::Buffer texels, uint32_t channels) {
+	pending.push_back(PendingImage{ image, texels, channels });
+}
+
+vk::Pipeline MipGenerator::format_pipeline(vk::Format format) const {
+	switch (vkutil::storage_format(format)) {
+	case vk::Format::eR8G8Unorm:
+		return rgPipeline;
+	case vk::Format::eR8Unorm:
+		return rPipeline;
+	default:
+		return rgbaPipeline;
+	}
+}
+
+void MipGenerator::flush(vk::CommandBuffer cmd, VkSREngine* engine) {
+	if (pending.empty()) {
+		return;
+	}
+
+	vk::Device device = engine->_device;
+
+	//> passes
+	// A dispatch starts from the last level the one before it wrote. Passes with the same index across
+	// images are independent, so the batch needs one barrier per round of passes, not one per image
+	struct Pass {
+		size_t image;
+		uint32_t baseLevel;
+		uint32_t levelCount;
+	};
+
+	std::vector<std::vector<Pass>> rounds;
+	uint32_t passCount = 0;
+	uint32_t expansionCount = 0;
+	for (size_t i = 0; i < pending.size(); i++) {
+		const AllocatedImage& image = pending[i].image;
+		if (pending[i].texels) {
+			expansionCount++;
+		}
+
+		uint32_t baseLevel = 0;
+		for (size_t round = 0; baseLevel + 1 < image.mipLevels; round++) {
+			const uint32_t baseSize = std::max(image.imageExtent.width >> baseLevel, image.imageExtent.height >> baseLevel);
+			const uint32_t levelCount = std::min(image.mipLevels - 1 - baseLevel, baseSize <= MAX_PASS_SIZE ? MAX_PASS_LEVELS : TILE_LEVELS);
+
+			if (rounds.size() <= round) {
+				rounds.emplace_back();
+			}
+			rounds[round].push_back(Pass{ i, baseLevel, levelCount });
+
+			baseLevel += levelCount;
+			passCount++;
+		}
+	}
+	//< passes
+
+	//> resources
+	// sRGB images are written through UNORM views
+	std::vector<vk::ImageView> views;
+	std::vector<size_t> firstView;
+	for (const PendingImage& entry : pending) {
+		const AllocatedImage& image = entry.image;
+
+		firstView.push_back(views.size());
+		for (uint32_t level = 0; level < image.mipLevels; level++) {
+			vk::ImageViewCreateInfo viewInfo = vkinit::imageview_create_info(vkutil::storage_format(image.imageFormat), image.image, vk::ImageAspectFlagBits::eColor);
+			viewInfo.subresourceRange.baseMipLevel = level;
+
+			vk::ImageView view;
+			VK_CHECK(device.createImageView(&viewInfo, nullptr, &view));
+			views.push_back(view);
+		}
+	}
+
+	// One counter of finished workgroups per pass, cleared before the batch
+	AllocatedBuffer counterBuffer = engine->create_buffer(std::max(passCount, 1u) * sizeof(uint32_t), vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst, vma::MemoryUsage::eGpuOnly);
+
+	// Sized for exactly this batch, every downsample set has the base, level 6 and the level array
+	DescriptorAllocator descriptors;
+	std::vector<DescriptorAllocator::PoolSizeRatio> sizes = {
+		{vk::DescriptorType::eStorageImage, 2 + MAX_PASS_LEVELS},
+		{vk::DescriptorType::eStorageBuffer, 1}
+	};
+	descriptors.init_pool(device, std::max(passCount + expansionCount, 1u), sizes);
+	//< resources
+
+	//> record
+	cmd.fillBuffer(counterBuffer.buffer, 0, vk::WholeSize, 0);
+
+	std::vector<vk::ImageMemoryBarrier2> barriers;
+	for (const PendingImage& entry : pending) {
+		vk::ImageMemoryBarrier2& barrier = barriers.emplace_back();
+		barrier.srcStageMask = vk::PipelineStageFlagBits2::eTransfer;
+		barrier.srcAccessMask = vk::AccessFlagBits2::eTransferWrite;
+		barrier.dstStageMask = vk::PipelineStageFlagBits2::eComputeShader;
+		barrier.dstAccessMask = vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite;
+		barrier.oldLayout = entry.texels ? vk::ImageLayout::eUndefined : vk::ImageLayout::eTransferDstOptimal;
+		barrier.newLayout = vk::ImageLayout::eGeneral;
+		barrier.subresourceRange = vkinit::image_subresource_range(vk::ImageAspectFlagBits::eColor);
+		barrier.image = entry.image.image;
+	}
+
+	// The counter clear is covered by a global barrier next to the image ones
+	vk::MemoryBarrier2 counterBarrier = {};
+	counterBarrier.srcStageMask = vk::PipelineStageFlagBits2::eTransfer;
+	counterBarrier.srcAccessMask = vk::AccessFlagBits2::eTransferWrite;
+	counterBarrier.dstStageMask = vk::PipelineStageFlagBits2::eComputeShader;
+	counterBarrier.dstAccessMask = vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite;
+
+	vk::DependencyInfo depInfo = {};
+	depInfo.memoryBarrierCount = 1;
+	depInfo.pMemoryBarriers = &counterBarrier;
+	depInfo.imageMemoryBarrierCount = (uint32_t)barriers.size();
+	depInfo.pImageMemoryBarriers = barriers.data();
+
+	cmd.pipelineBarrier2(&depInfo);
+
+	DescriptorWriter writer;
+
+	//> expand
+	if (expansionCount > 0) {
+		cmd.bindPipeline(vk::PipelineBindPoint::eCompute, expandPipeline);
+
+		for (size_t i = 0; i < pending.size(); i++) {
+			const PendingImage& entry = pending[i];
+			if (!entry.texels) {
+				continue;
+			}
+
+			vk::DescriptorSet set = descriptors.allocate(device, expandLayout);
+			writer.clear();
+			writer.write_buffer(0, entry.texels, vk::WholeSize, 0, vk::DescriptorType::eStorageBuffer);
+			writer.write_image(1, views[firstView[i]], VK_NULL_HANDLE, vk::ImageLayout::eGeneral, vk::DescriptorType::eStorageImage);
+			writer.update_set(device, set);
+
+			TexelExpandPushConstants pushConstants;
+			pushConstants.size = glm::ivec2(entry.image.imageExtent.width, entry.image.imageExtent.height);
+			pushConstants.channels = entry.channels;
+
+			cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, expandPipelineLayout, 0, 1, &set, 0, nullptr);
+			cmd.pushConstants(expandPipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(TexelExpandPushConstants), &pushConstants);
+
+			cmd.dispatch((entry.image.imageExtent.width + 7) / 8, (entry.image.imageExtent.height + 7) / 8, 1);
+		}
+	}
+	//< expand
+
+	uint32_t counterIndex = 0;
+	vk::Pipeline boundPipeline = VK_NULL_HANDLE;
+	for (size_t round = 0; round < rounds.size(); round++) {
+		// The first round reads the expanded levels 0, every later one the levels of the round before
+		if (round > 0 || expansionCount > 0) {
+			vkutil::memory_barrier(cmd, vk::PipelineStageFlagBits2::eComputeShader, vk::AccessFlagBits2::eShaderStorageWrite, vk::PipelineStageFlagBits2::eComputeShader, vk::AccessFlagBits2::eShaderStorageRead);
+		}
+
+		for (const Pass& pass : rounds[round]) {
+			const AllocatedImage& image = pending[pass.image].image;
+			const uint32_t lastLevel = image.mipLevels - 1;
+			auto level_view = [&](uint32_t level) {
+				return views[firstView[pass.image] + std::min(level, lastLevel)];
+				};
+
+			vk::Pipeline pipeline = format_pipeline(image.imageFormat);
+			if (pipeline != boundPipeline) {
+				cmd.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline);
+				boundPipeline = pipeline;
+			}
+
+			// Levels past the end of the chain are never written, their slots repeat the last level
+			vk::DescriptorSet set = descriptors.allocate(device, layout);
+			writer.clear();
+			writer.write_image(0, level_view(pass.baseLevel), VK_NULL_HANDLE, vk::ImageLayout::eGeneral, vk::DescriptorType::eStorageImage);
+			writer.write_image(1, level_view(pass.baseLevel + TILE_LEVELS), VK_NULL_HANDLE, vk::ImageLayout::eGeneral, vk::DescriptorType::eStorageImage);
+			for (uint32_t i = 0; i < MAX_PASS_LEVELS; i++) {
+				writer.write_image(2, level_view(pass.baseLevel + 1 + i), VK_NULL_HANDLE, vk::ImageLayout::eGeneral, vk::DescriptorType::eStorageImage, i);
+			}
+			writer.write_buffer(3, counterBuffer.buffer, std::max(passCount, 1u) * sizeof(uint32_t), 0, vk::DescriptorType::eStorageBuffer);
+			writer.update_set(device, set);
+
+			MipDownsamplePushConstants pushConstants;
+			pushConstants.baseSize = glm::ivec2(std::max(image.imageExtent.width >> pass.baseLevel, 1u), std::max(image.imageExtent.height >> pass.baseLevel, 1u));
+			pushConstants.levelCount = pass.levelCount;
+			pushConstants.counterIndex = counterIndex++;
+			pushConstants.srgb = vkutil::storage_format(image.imageFormat) != image.imageFormat;
+
+			cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipelineLayout, 0, 1, &set, 0, nullptr);
+			cmd.pushConstants(pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(MipDownsamplePushConstants), &pushConstants);
+
+			// Every workgroup covers a 64x64 tile of the base level
+			cmd.dispatch((uint32_t)(pushConstants.baseSize.x + 63) / 64, (uint32_t)(pushConstants.baseSize.y + 63) / 64, 1);
+		}
+	}
+
+	barriers.clear();
+	for (const PendingImage& entry : pending) {
+		vk::ImageMemoryBarrier2& barrier = barriers.emplace_back();
+		barrier.srcStageMask = vk::PipelineStageFlagBits2::eComputeShader;
+		barrier.srcAccessMask = vk::AccessFlagBits2::eShaderStorageWrite;
+		barrier.dstStageMask = vk::PipelineStageFlagBits2::eFragmentShader;
+		barrier.dstAccessMask = vk::AccessFlagBits2::eShaderSampledRead;
+		barrier.oldLayout = vk::ImageLayout::eGeneral;
+		barrier.newLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+		barrier.subresourceRange = vkinit::image_subresource_range(vk::ImageAspectFlagBits::eColor);
+		barrier.image = entry.image.image;
+	}
+
+	depInfo = vk::DependencyInfo{};
+	depInfo.imageMemoryBarrierCount = (uint32_t)barriers.size();
+	depInfo.pImageMemoryBarriers = barriers.data();
+
+	cmd.pipelineBarrier2(&depInfo);
+	//< record
+
+	pending.clear();
+
+	engine->get_current_frame()._deletionQueue.push_function([=]() mutable {
+		for (vk::ImageView view : views) {
+			device.destroyImageView(view, nullptr);
+		}
+		descriptors.destroy_poool(device);
+		engine->destroy_buffer(counterBuffer);
+		});
+}
+//< MipGenerator
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <vk_types.h>
+#include <vk_descriptors.h>
+
+#include <glm/vec2.hpp>
+
+// Forward declaration of the engine
+class VkSREngine;
+
+//> gpu_structs
+struct MipDownsamplePushConstants {
+	glm::ivec2 baseSize;
+	uint32_t levelCount;
+	uint32_t counterIndex;
+	uint32_t srgb;
+};
+
+struct TexelExpandPushConstants {
+	glm::ivec2 size;
+	uint32_t channels;
+};
+//< gpu_structs
+
+//> MipGenerator
+// Compute mip generation for RGBA8, RG8 and R8 images with mip_downsample.comp, sRGB images are filtered in
+// linear space. One dispatch writes up to 12 levels, so most images take a single one. Images are queued and
+// generated together by flush, with one barrier before and one after the whole batch instead of a barrier per
+// level of every image. RGBA8 images can also have level 0 expanded from packed RGB or grey texels first.
+struct MipGenerator {
+	// Levels one workgroup reduces its 64x64 tile by, and what a dispatch from a base above MAX_PASS_SIZE writes
+	static constexpr uint32_t TILE_LEVELS = 6;
+	static constexpr uint32_t MAX_PASS_LEVELS = 12;
+	static constexpr uint32_t MAX_PASS_SIZE = 4096;
+
+	vk::DescriptorSetLayout layout;
+	vk::PipelineLayout pipelineLayout;
+	// The shader declares the storage format, so there is one pipeline per format
+	vk::Pipeline rgbaPipeline;
+	vk::Pipeline rgPipeline;
+	vk::Pipeline rPipeline;
+
+	vk::DescriptorSetLayout expandLayout;
+	vk::PipelineLayout expandPipelineLayout;
+	vk::Pipeline expandPipeline;
+
+	struct PendingImage {
+		AllocatedImage image;
+		vk::Buffer texels; // Packed level 0 for texel_expand.comp, null when level 0 was copied into the image
+		uint32_t channels;
+	};
+
+	// Waiting for flush, all levels in eTransferDstOptimal after a copy or still undefined for an expansion
+	std::vector<PendingImage> pending;
+
+	void init(VkSREngine* engine);
+	void clear_resources(VkSREngine* engine);
+
+	// The images need storage usage
+	void queue(const AllocatedImage& image);
+	// texels holds width * height * channels bytes and has to live until the flush has executed
+	void queue_expansion(const AllocatedImage& image, vk::Buffer texels, uint32_t channels);
+
+	// Records the mips of every queued image into cmd and leaves them in eShaderReadOnlyOptimal. The per level
+	// views, descriptor sets and counters are freed with the current frame
+	void flush(vk::CommandBuffer cmd, VkSREngine* engine);
+
+	vk::Pipeline format_pipeline(vk::Format format) const;
+};
+//< MipGenerator
@@ -83,7 +83,10 @@ void PipelineBuilder::set_shaders(vk::ShaderModule vertexShader, vk::ShaderModul
 	_shaderStages.clear();
 	
 	_shaderStages.push_back(vkinit::pipeline_shader_stage_create_info(vk::ShaderStageFlagBits::eVertex, vertexShader));
-	_shaderStages.push_back(vkinit::pipeline_shader_stage_create_info(vk::ShaderStageFlagBits::eFragment, fragmentShader));
+	// Depth-only pipelines have no fragment shader
+	if (fragmentShader) {
+		_shaderStages.push_back(vkinit::pipeline_shader_stage_create_info(vk::ShaderStageFlagBits::eFragment, fragmentShader));
+	}
 }
 
 void PipelineBuilder::set_input_topology(vk::PrimitiveTopology topology) {
@@ -120,6 +123,12 @@ void PipelineBuilder::disable_blending() {
 	_colorBlendAttachment.blendEnable = vk::False;
 }
 
+void PipelineBuilder::disable_color_writes() {
+	// The color attachment stays bound but is left untouched
+	_colorBlendAttachment.colorWriteMask = {};
+	_colorBlendAttachment.blendEnable = vk::False;
+}
+
 void PipelineBuilder::enable_blending_additive() {
 	_colorBlendAttachment.colorWriteMask = vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG | vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA;
 	_colorBlendAttachment.blendEnable = vk::True;
@@ -26,6 +26,7 @@ public:
 	void set_cull_mode(vk::CullModeFlags cullMode, vk::FrontFace frontFace);
 	void set_multisampling_none();
 	void disable_blending();
+	void disable_color_writes();
 	void enable_blending_additive();
 	void enable_blending_alphablend();
 	void set_color_attachment_format(vk::Format format);
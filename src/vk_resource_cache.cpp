@@ -0,0 +1,153 @@
+#include <vk_resource_cache.h>
+
+#include <vk_engine.h>
+
+#include <cstring>
+
+uint64_t hash_bytes(const void* data, size_t size, uint64_t seed) {
+	constexpr uint64_t prime = 0x9E3779B97F4A7C15ull;
+	const uint8_t* bytes = (const uint8_t*)data;
+
+	uint64_t h = seed ^ (size * prime);
+	size_t i = 0;
+	for (; i + 8 <= size; i += 8) {
+		uint64_t word;
+		memcpy(&word, bytes + i, 8);
+		h ^= word * prime;
+		h = ((h << 31) | (h >> 33)) * 0xBF58476D1CE4E5B9ull;
+	}
+
+	if (i < size) {
+		uint64_t tail = 0;
+		memcpy(&tail, bytes + i, size - i);
+		h ^= tail * prime;
+	}
+
+	// splitmix64 finalizer, so keys that differ in a few bits spread over the hash map
+	h ^= h >> 30;
+	h *= 0xBF58476D1CE4E5B9ull;
+	h ^= h >> 27;
+	h *= 0x94D049BB133111EBull;
+	h ^= h >> 31;
+	return h;
+}
+
+// Where a key goes when its entry holds other content
+static uint64_t next_probe_key(uint64_t key) {
+	return hash_bytes(&key, sizeof(key), key);
+}
+
+//> ResourceCache
+std::optional<AllocatedImage> ResourceCache::acquire_image(uint64_t& key, vk::Extent3D extent, vk::Format format) {
+	for (auto it = images.find(key); it != images.end(); it = images.find(key)) {
+		if (it->second.resource.imageExtent == extent && it->second.resource.imageFormat == format) {
+			it->second.references++;
+			return it->second.resource;
+		}
+		key = next_probe_key(key);
+	}
+	return {};
+}
+
+void ResourceCache::add_image(uint64_t key, const AllocatedImage& image) {
+	images[key] = Entry<AllocatedImage>{ image, 1 };
+}
+
+void ResourceCache::release_image(VkSREngine* engine, uint64_t key) {
+	auto it = images.find(key);
+	if (it == images.end() || --it->second.references > 0) {
+		return;
+	}
+
+	engine->destroy_image(it->second.resource);
+	images.erase(it);
+}
+
+std::optional<GPUMeshBuffers> ResourceCache::acquire_mesh(uint64_t& key, const MeshShape& shape) {
+	for (auto it = meshes.find(key); it != meshes.end(); it = meshes.find(key)) {
+		const GPUMeshBuffers& buffers = it->second.resource;
+		if (MeshShape{ buffers.vertexCount, buffers.colorCount, buffers.meshletCount, buffers.indexCount, buffers.indexType } == shape) {
+			it->second.references++;
+			return buffers;
+		}
+		key = next_probe_key(key);
+	}
+	return {};
+}
+
+void ResourceCache::add_mesh(uint64_t key, const GPUMeshBuffers& buffers) {
+	meshes[key] = Entry<GPUMeshBuffers>{ buffers, 1 };
+}
+
+void ResourceCache::release_mesh(VkSREngine* engine, uint64_t key) {
+	auto it = meshes.find(key);
+	if (it == meshes.end() || --it->second.references > 0) {
+		return;
+	}
+
+	destroy_mesh(engine, it->second.resource);
+	meshes.erase(it);
+}
+
+vk::Sampler ResourceCache::acquire_sampler(vk::Device device, const vk::SamplerCreateInfo& info, uint64_t& key) {
+	// Only the settings, the create info also holds pNext and padding
+	float settings[] = {
+		(float)info.magFilter, (float)info.minFilter, (float)info.mipmapMode,
+		(float)info.addressModeU, (float)info.addressModeV, (float)info.addressModeW,
+		info.mipLodBias, (float)info.anisotropyEnable, info.maxAnisotropy,
+		(float)info.compareEnable, (float)info.compareOp, info.minLod, info.maxLod,
+		(float)info.borderColor, (float)info.unnormalizedCoordinates
+	};
+	key = hash_bytes(settings, sizeof(settings));
+
+	auto it = samplers.find(key);
+	if (it != samplers.end()) {
+		it->second.references++;
+		return it->second.resource;
+	}
+
+	vk::Sampler sampler;
+	VK_CHECK(device.createSampler(&info, nullptr, &sampler));
+	samplers[key] = Entry<vk::Sampler>{ sampler, 1 };
+	return sampler;
+}
+
+void ResourceCache::release_sampler(vk::Device device, uint64_t key) {
+	auto it = samplers.find(key);
+	if (it == samplers.end() || --it->second.references > 0) {
+		return;
+	}
+
+	device.destroySampler(it->second.resource, nullptr);
+	samplers.erase(it);
+}
+
+void ResourceCache::clear_resources(VkSREngine* engine) {
+	for (auto& [key, entry] : images) {
+		engine->destroy_image(entry.resource);
+	}
+	for (auto& [key, entry] : meshes) {
+		destroy_mesh(engine, entry.resource);
+	}
+	for (auto& [key, entry] : samplers) {
+		engine->_device.destroySampler(entry.resource, nullptr);
+	}
+
+	images.clear();
+	meshes.clear();
+	samplers.clear();
+}
+
+void ResourceCache::destroy_mesh(VkSREngine* engine, const GPUMeshBuffers& buffers) {
+	engine->_meshIds.release(buffers.sortId);
+	engine->destroy_buffer(buffers.indexBuffer);
+	engine->destroy_buffer(buffers.vertexBuffer);
+	engine->destroy_buffer(buffers.positionBuffer);
+	if (buffers.colorBufferAddress) {
+		engine->destroy_buffer(buffers.colorBuffer);
+	}
+	if (buffers.meshletBufferAddress) {
+		engine->destroy_buffer(buffers.meshletBuffer);
+	}
+}
+//< ResourceCache
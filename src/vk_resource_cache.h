@@ -0,0 +1,65 @@
+#pragma once
+
+#include <vk_types.h>
+
+#include <unordered_map>
+
+// Forward declaration of the engine
+class VkSREngine;
+
+// 64-bit content hash for the cache keys, reads 8 bytes at a time. Has no Vulkan calls, so it can run on loader threads
+uint64_t hash_bytes(const void* data, size_t size, uint64_t seed = 0);
+
+// Element counts a cached mesh has to match besides its key
+struct MeshShape {
+	uint32_t vertexCount;
+	uint32_t colorCount;
+	uint32_t meshletCount;
+	uint32_t indexCount;
+	vk::IndexType indexType;
+
+	bool operator==(const MeshShape&) const = default;
+};
+
+//> ResourceCache
+// GPU resources shared between all loaded scenes. Images and mesh buffers are keyed by a hash of their
+// content, samplers by their create info. Every acquire adds a reference and the last release destroys the
+// resource, so a texture or mesh used by several scenes is only in VRAM once.
+// Release only once no frame in flight uses the resource, which is the case in the LoadedGLTF destructor
+struct ResourceCache {
+	// Returns the cached resource with a new reference, nothing when the key is not cached. An entry with the
+	// key but another size is a hash collision, key then moves on to the next probe key until it finds a match
+	// or a free key. add_ and release_ take the key as it is afterwards
+	std::optional<AllocatedImage> acquire_image(uint64_t& key, vk::Extent3D extent, vk::Format format);
+	// Hands a newly created resource to the cache with one reference
+	void add_image(uint64_t key, const AllocatedImage& image);
+	void release_image(VkSREngine* engine, uint64_t key);
+
+	std::optional<GPUMeshBuffers> acquire_mesh(uint64_t& key, const MeshShape& shape);
+	void add_mesh(uint64_t key, const GPUMeshBuffers& buffers);
+	void release_mesh(VkSREngine* engine, uint64_t key);
+
+	// Creates the sampler when none with the same settings exists. key receives what release_sampler takes
+	vk::Sampler acquire_sampler(vk::Device device, const vk::SamplerCreateInfo& info, uint64_t& key);
+	void release_sampler(vk::Device device, uint64_t key);
+
+	size_t image_count() const { return images.size(); }
+	size_t mesh_count() const { return meshes.size(); }
+
+	// Destroys whatever is left, for shutdown after every scene is gone
+	void clear_resources(VkSREngine* engine);
+
+private:
+	template<typename T>
+	struct Entry {
+		T resource;
+		uint32_t references;
+	};
+
+	std::unordered_map<uint64_t, Entry<AllocatedImage>> images;
+	std::unordered_map<uint64_t, Entry<GPUMeshBuffers>> meshes;
+	std::unordered_map<uint64_t, Entry<vk::Sampler>> samplers;
+
+	void destroy_mesh(VkSREngine* engine, const GPUMeshBuffers& buffers);
+};
+//< ResourceCache
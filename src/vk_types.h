@@ -25,6 +25,8 @@
 #include <glm/mat4x4.hpp>
 #include <glm/vec4.hpp>
 
+#include <transform_hierarchy.h>
+
 // Macro to check Vulkan error codes to eas use of most vulkan functions
 #define VK_CHECK(x)															\
 do {																		\
@@ -42,6 +44,13 @@ struct AllocatedImage {
 	vma::Allocation allocation;
 	vk::Extent3D imageExtent;
 	vk::Format imageFormat;
+	uint32_t mipLevels{ 1 };
+};
+
+// One level of a prebuilt mip chain, largest first. The offset is into the data handed to create_image
+struct ImageLevel {
+	size_t offset;
+	size_t size;
 };
 
 struct AllocatedBuffer {
@@ -60,15 +69,44 @@ struct Vertex {
 	glm::vec4 color;
 };
 
+// Layout the meshes are uploaded with, decoded in mesh.vert
+struct PackedVertex {
+	uint16_t position[3]; // unorm, relative to the surface bounds
+	uint16_t pad;
+	uint32_t normal;      // octahedral encoded, snorm 2x16
+	uint32_t uv;          // half 2x16
+};
+
 struct GPUMeshBuffers {
 	AllocatedBuffer indexBuffer;
 	AllocatedBuffer vertexBuffer;
 	vk::DeviceAddress vertexBufferAddress;
+	// Only the quantized positions, 8 bytes per vertex, for the depth prepass
+	AllocatedBuffer positionBuffer;
+	vk::DeviceAddress positionBufferAddress;
+	// Optional unorm RGBA8 stream, only created for meshes with vertex colors
+	AllocatedBuffer colorBuffer;
+	vk::DeviceAddress colorBufferAddress{ 0 };
+	// GPUMeshlet array of all surfaces, only for meshes that were split into meshlets
+	AllocatedBuffer meshletBuffer;
+	vk::DeviceAddress meshletBufferAddress{ 0 };
+	vk::IndexType indexType{ vk::IndexType::eUint32 };
+	uint32_t sortId{ 0 }; // Small id for the draw sort keys
+
+	// Element counts the buffers were created with, see VkSREngine::download_mesh
+	uint32_t vertexCount{ 0 };
+	uint32_t colorCount{ 0 };
+	uint32_t meshletCount{ 0 };
+	uint32_t indexCount{ 0 };
 };
 
 struct GPUDrawPushConstants {
 	glm::mat4 worldMatrix;
+	glm::vec4 positionOffset; // Dequantizes the positions, w is 1 when there is a color stream
+	glm::vec4 positionScale;  // w is 1 for instanced draws
 	vk::DeviceAddress vertexBuffer;
+	vk::DeviceAddress colorBuffer;
+	vk::DeviceAddress instanceBuffer; // World matrix per instance, read instead of worldMatrix when positionScale.w is 1
 };
 //< mesh
 
@@ -82,12 +120,14 @@ enum class MaterialPass : uint8_t {
 struct MaterialPipeline {
 	vk::Pipeline pipeline;
 	vk::PipelineLayout layout;
+	uint32_t sortId{ 0 }; // Small id for the draw sort keys
 };
 
 struct MaterialInstance {
 	MaterialPipeline* pipeline;
 	vk::DescriptorSet materialSet;
 	MaterialPass passType;
+	uint32_t sortId{ 0 };
 };
 //< material
 
@@ -96,8 +136,14 @@ struct DrawContext;
 
 //> renderables
 // Base class for a renderable dynamic object
+// The object is drawn once under each of topMatrices, all copies of a surface share one proxy
 class IRenderable {
-	virtual void Draw(const glm::mat4& topMatrix, DrawContext& ctx) = 0;
+	// Adds render proxies for everything drawable, done once when the object is added to the scene
+	virtual void RegisterProxies(std::span<const glm::mat4> topMatrices, DrawContext& ctx) = 0;
+	// Pushes the current transforms to the already registered proxies
+	virtual void UpdateProxies(std::span<const glm::mat4> topMatrices, DrawContext& ctx) = 0;
+	// Removes every proxy RegisterProxies added
+	virtual void UnregisterProxies(DrawContext& ctx) = 0;
 };
 
 // Implementation of a drawable scene node
@@ -108,20 +154,28 @@ struct Node : public IRenderable {
 	std::weak_ptr<Node> parent;
 	std::vector<std::shared_ptr<Node>> children;
 
-	glm::mat4 localTransform;
-	glm::mat4 worldTransform;
+	// Slot in the scene's TransformHierarchy, which owns the matrices
+	TransformHierarchy* transforms{ nullptr };
+	uint32_t transformIndex{ 0 };
 
-	void refreshTransform(const glm::mat4& parentMatrix) {
-		worldTransform = parentMatrix * localTransform;
-		for (auto c : children) {
-			c->refreshTransform(worldTransform);
+	const glm::mat4& localTransform() const { return transforms->local(transformIndex); }
+	const glm::mat4& worldTransform() const { return transforms->world(transformIndex); }
+
+	virtual void RegisterProxies(std::span<const glm::mat4> topMatrices, DrawContext& ctx) {
+		for (auto& c : children) {
+			c->RegisterProxies(topMatrices, ctx);
 		}
 	}
 
-	virtual void Draw(const glm::mat4& topMatrix, DrawContext& ctx) {
-		// Draw children
+	// Only this node, the scene calls it for every node whose world transform changed
+	virtual void UpdateProxies(std::span<const glm::mat4> topMatrices, DrawContext& ctx) {}
+
+	// Only the copies under topMatrices[instance], for when a single placed instance of the scene moved
+	virtual void UpdateInstance(std::span<const glm::mat4> topMatrices, uint32_t instance, DrawContext& ctx) {}
+
+	virtual void UnregisterProxies(DrawContext& ctx) {
 		for (auto& c : children) {
-			c->Draw(topMatrix, ctx);
+			c->UnregisterProxies(ctx);
 		}
 	}
 };
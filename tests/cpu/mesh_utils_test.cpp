@@ -0,0 +1,156 @@
+// mesh_utils_test.cpp
+
+// Simplifies a flat grid, which has to lose most of its triangles without changing its area or flipping any,
+// and a curved bowl, which has to stay within the error it was given. Cache optimization has to keep the
+// triangles and improve the hit rate of a shuffled grid, and 16-bit packing has to keep every index.
+
+#include <mesh_utils.h>
+#include "test_checks.h"
+
+#include <fmt/core.h>
+#include <glm/geometric.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <deque>
+#include <vector>
+
+namespace {
+	struct Mesh {
+		std::vector<glm::vec3> positions;
+		std::vector<uint32_t> indices;
+	};
+
+	// size x size quads over [0, size]^2 facing +z, lifted by height(x, y)
+	template<typename Height>
+	Mesh grid(uint32_t size, Height height) {
+		Mesh mesh;
+		for (uint32_t y = 0; y <= size; y++) {
+			for (uint32_t x = 0; x <= size; x++) {
+				mesh.positions.push_back({ (float)x, (float)y, height((float)x, (float)y) });
+			}
+		}
+
+		for (uint32_t y = 0; y < size; y++) {
+			for (uint32_t x = 0; x < size; x++) {
+				uint32_t i = y * (size + 1) + x;
+				mesh.indices.insert(mesh.indices.end(), { i, i + 1, i + size + 2, i, i + size + 2, i + size + 1 });
+			}
+		}
+		return mesh;
+	}
+
+	glm::vec3 triangle_normal(const Mesh& mesh, std::span<const uint32_t> indices, size_t t) {
+		const glm::vec3& a = mesh.positions[indices[t * 3]];
+		return glm::cross(mesh.positions[indices[t * 3 + 1]] - a, mesh.positions[indices[t * 3 + 2]] - a);
+	}
+
+	// Vertex shader runs per triangle with a FIFO cache of cacheSize vertices
+	float acmr(std::span<const uint32_t> indices, size_t cacheSize) {
+		std::deque<uint32_t> cache;
+		size_t misses = 0;
+		for (uint32_t index : indices) {
+			if (std::find(cache.begin(), cache.end(), index) == cache.end()) {
+				misses++;
+				cache.push_back(index);
+				if (cache.size() > cacheSize) {
+					cache.pop_front();
+				}
+			}
+		}
+		return (float)misses / (float)(indices.size() / 3);
+	}
+
+	// Triangles rotated to start at their smallest index and sorted, equal when two lists hold the same
+	// triangles with the same winding in any order
+	std::vector<std::array<uint32_t, 3>> triangle_set(std::span<const uint32_t> indices) {
+		std::vector<std::array<uint32_t, 3>> triangles;
+		for (size_t t = 0; t < indices.size() / 3; t++) {
+			std::array<uint32_t, 3> tri = { indices[t * 3], indices[t * 3 + 1], indices[t * 3 + 2] };
+			std::rotate(tri.begin(), std::min_element(tri.begin(), tri.end()), tri.end());
+			triangles.push_back(tri);
+		}
+		std::sort(triangles.begin(), triangles.end());
+		return triangles;
+	}
+}
+
+int main() {
+	TestChecks test;
+
+	// A flat grid collapses for free down to its locked border
+	const Mesh flat = grid(16, [](float, float) { return 0.f; });
+	float flatError = -1.f;
+	std::vector<uint32_t> flatSimplified = meshutil::simplify(flat.indices, flat.positions, 0, 0.01f, &flatError);
+
+	float area = 0.f;
+	bool facesUp = true;
+	for (size_t t = 0; t < flatSimplified.size() / 3; t++) {
+		glm::vec3 normal = triangle_normal(flat, flatSimplified, t);
+		facesUp &= normal.z > 0.f;
+		area += normal.z * 0.5f;
+	}
+	test.check(flatSimplified.size() % 3 == 0 && flatSimplified.size() < flat.indices.size() / 4, "simplifying a flat grid");
+	test.check(facesUp, "no flipped triangles on a flat grid");
+	test.check(std::abs(area - 256.f) < 1e-3f, "the area of a flat grid");
+	test.check(flatError >= 0.f && flatError < 1e-3f, "the error of a flat grid");
+
+	// Every collapse on a curved surface costs something, the error bound decides how far it gets
+	const Mesh bowl = grid(16, [](float x, float y) { return ((x - 8.f) * (x - 8.f) + (y - 8.f) * (y - 8.f)) * 0.05f; });
+	test.check(meshutil::simplify(bowl.indices, bowl.positions, 0, 0.f).size() == bowl.indices.size(), "a bowl without an error budget");
+
+	float tightError = -1.f;
+	float looseError = -1.f;
+	std::vector<uint32_t> tight = meshutil::simplify(bowl.indices, bowl.positions, 0, 0.2f, &tightError);
+	std::vector<uint32_t> loose = meshutil::simplify(bowl.indices, bowl.positions, 0, 1.f, &looseError);
+	test.check(tight.size() < bowl.indices.size() && tightError > 0.f && tightError <= 0.2f, "a bowl within a tight error");
+	test.check(loose.size() < tight.size() && looseError > tightError && looseError <= 1.f, "a bowl within a loose error");
+
+	// The target stops simplification before the error does
+	std::vector<uint32_t> targeted = meshutil::simplify(flat.indices, flat.positions, 300 * 3, 1.f);
+	test.check(targeted.size() <= 300 * 3 && targeted.size() > flatSimplified.size(), "stopping at the target");
+
+	// Triangles in a scrambled order, the same for every run
+	std::vector<uint32_t> shuffled = flat.indices;
+	uint32_t seed = 12345;
+	for (size_t t = shuffled.size() / 3 - 1; t > 0; t--) {
+		seed = seed * 1664525u + 1013904223u;
+		size_t other = (seed >> 8) % (t + 1);
+		std::swap_ranges(shuffled.begin() + t * 3, shuffled.begin() + t * 3 + 3, shuffled.begin() + other * 3);
+	}
+
+	std::vector<uint32_t> optimized = shuffled;
+	meshutil::optimize_vertex_cache(optimized, flat.positions.size());
+	test.check(triangle_set(optimized) == triangle_set(shuffled), "keeping the triangles when optimizing the cache");
+	test.check(acmr(optimized, 16) < 0.8f && acmr(optimized, 16) < acmr(shuffled, 16) * 0.5f, "the cache hit rate after optimizing");
+
+	// Vertices are numbered in the order the indices first use them and keep their positions
+	std::vector<uint32_t> fetched = optimized;
+	std::vector<uint32_t> remap = meshutil::optimize_vertex_fetch(fetched, flat.positions.size());
+	uint32_t nextVertex = 0;
+	bool firstUseOrder = true;
+	bool consistentMapping = true;
+	for (size_t i = 0; i < fetched.size(); i++) {
+		if (fetched[i] == nextVertex) {
+			nextVertex++;
+		}
+		firstUseOrder &= fetched[i] < nextVertex;
+		consistentMapping &= remap[optimized[i]] == fetched[i];
+	}
+	test.check(firstUseOrder && nextVertex == flat.positions.size(), "renumbering vertices by first use");
+	test.check(consistentMapping, "the vertex mapping");
+
+	// A surface far into a shared vertex array still fits in 16 bits once it counts from its first vertex
+	std::vector<uint32_t> farIndices = { 70000, 70000 + 65535, 70001 };
+	test.check(meshutil::rebase_indices(farIndices, 70000) && farIndices == std::vector<uint32_t>{ 0, 65535, 1 }, "rebasing indices");
+
+	std::vector<uint16_t> narrow(farIndices.size());
+	meshutil::narrow_indices(farIndices, narrow);
+	test.check(narrow == std::vector<uint16_t>{ 0, 65535, 1 }, "narrowing indices");
+
+	std::vector<uint32_t> wideIndices = { 70000, 70000 + 65536 };
+	test.check(!meshutil::rebase_indices(wideIndices, 70000), "indices that need 32 bits");
+
+	return test.finish("mesh utility");
+}
@@ -0,0 +1,142 @@
+// meshopt_decode_test.cpp
+
+// Decodes index streams written by the reference meshoptimizer encoder (fixtures of its own test suite) and a
+// vertex stream laid out by hand after the bitstream in the extension spec, then checks the filters. Malformed
+// input has to be rejected or stay finite.
+
+#include <meshopt_decode.h>
+#include "test_checks.h"
+
+#include <fmt/core.h>
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace {
+	// meshopt_encodeIndexBuffer of kIndexBuffer
+	const uint32_t kIndexBuffer[] = { 0, 1, 2, 2, 1, 3, 4, 6, 5, 7, 8, 9 };
+
+	const uint8_t kIndexDataV0[] = {
+		0xe0, 0xf0, 0x10, 0xfe, 0xff, 0xf0, 0x0c, 0xff, 0x02, 0x02, 0x02, 0x00, 0x76, 0x87, 0x56, 0x67,
+		0x78, 0xa9, 0x86, 0x65, 0x89, 0x68, 0x98, 0x01, 0x69, 0x00, 0x00,
+	};
+
+	// meshopt_encodeIndexSequence of kIndexSequence
+	const uint32_t kIndexSequence[] = { 0, 1, 51, 2, 49, 1000 };
+
+	const uint8_t kIndexSequenceV1[] = {
+		0xd1, 0x00, 0x04, 0xcd, 0x01, 0x04, 0x07, 0x98, 0x1f, 0x00, 0x00, 0x00, 0x00,
+	};
+
+	// 12 byte vertices: 3 x u16 position, 2 x u8 normal, 2 x u16 uv
+	struct PV {
+		uint16_t px, py, pz;
+		uint8_t nu, nv;
+		uint16_t tx, ty;
+	};
+	static_assert(sizeof(PV) == 12);
+
+	const PV kVertexBuffer[] = {
+		{ 0, 0, 0, 0, 0, 0, 0 },
+		{ 300, 0, 0, 0, 0, 500, 0 },
+		{ 0, 300, 0, 0, 0, 0, 500 },
+		{ 300, 300, 0, 0, 0, 500, 500 },
+	};
+
+	// kVertexBuffer as the encoder writes it: one block with one group per byte lane. Each lane has a header
+	// byte, then either nothing for all zero deltas or 2-bit zigzag deltas with the larger ones as literals.
+	// The 32 byte tail ends with the first vertex, all zero here
+	const uint8_t kVertexData[] = {
+		0xa0,
+		0x01, 0x3f, 0x00, 0x00, 0x00, 0x58, 0x57, 0x58, // px
+		0x01, 0x26, 0x00, 0x00, 0x00,
+		0x01, 0x0c, 0x00, 0x00, 0x00, 0x58, // py
+		0x01, 0x08, 0x00, 0x00, 0x00,
+		0x00, 0x00, // pz
+		0x00, 0x00, // nu, nv
+		0x01, 0x3f, 0x00, 0x00, 0x00, 0x17, 0x18, 0x17, // tx
+		0x01, 0x26, 0x00, 0x00, 0x00,
+		0x01, 0x0c, 0x00, 0x00, 0x00, 0x17, // ty
+		0x01, 0x08, 0x00, 0x00, 0x00,
+		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	};
+
+	std::span<const std::byte> bytes_of(std::span<const uint8_t> data) {
+		return std::as_bytes(data);
+	}
+
+	// Decodes an index stream at both strides and compares it with expected
+	template<typename Decode>
+	bool decodes_indices(Decode decode, std::span<const uint8_t> encoded, std::span<const uint32_t> expected) {
+		std::vector<uint32_t> wide(expected.size());
+		std::vector<uint16_t> narrow(expected.size());
+		if (!decode(wide.data(), expected.size(), 4, bytes_of(encoded)) || !decode(narrow.data(), expected.size(), 2, bytes_of(encoded))) {
+			return false;
+		}
+
+		for (size_t i = 0; i < expected.size(); i++) {
+			if (wide[i] != expected[i] || narrow[i] != expected[i]) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Every prefix of a stream is missing its tail, none may decode
+	template<typename Decode>
+	bool rejects_truncated(Decode decode, std::span<const uint8_t> encoded, size_t count, size_t stride) {
+		std::vector<uint8_t> out(count * stride);
+		for (size_t size = 0; size < encoded.size(); size++) {
+			if (decode(out.data(), count, stride, bytes_of(encoded.first(size)))) {
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+int main() {
+	TestChecks test;
+
+	test.check(decodes_indices(meshopt::decode_index_buffer, kIndexDataV0, kIndexBuffer), "index buffer");
+	test.check(decodes_indices(meshopt::decode_index_sequence, kIndexSequenceV1, kIndexSequence), "index sequence");
+
+	PV vertices[4];
+	test.check(meshopt::decode_vertex_buffer(vertices, 4, sizeof(PV), bytes_of(kVertexData))
+		&& memcmp(vertices, kVertexBuffer, sizeof(kVertexBuffer)) == 0, "vertex buffer");
+
+	test.check(rejects_truncated(meshopt::decode_index_buffer, kIndexDataV0, std::size(kIndexBuffer), 4), "truncated index buffers");
+	test.check(rejects_truncated(meshopt::decode_index_sequence, kIndexSequenceV1, std::size(kIndexSequence), 4), "truncated index sequences");
+	test.check(rejects_truncated(meshopt::decode_vertex_buffer, kVertexData, 4, sizeof(PV)), "truncated vertex buffers");
+
+	// Decoding fewer triangles than encoded leaves data before the table
+	uint32_t indices[9];
+	test.check(!meshopt::decode_index_buffer(indices, 9, 4, bytes_of(kIndexDataV0)), "an index buffer shorter than encoded");
+
+	// +x stays +x, the corner of the folded lower hemisphere is -z, and a zero vector from a broken stream stays
+	// zero instead of dividing by its length
+	int8_t octs[] = {
+		127, 0, 127, 0,
+		127, 127, 127, 0,
+		0, 0, 0, 0,
+	};
+	meshopt::decode_filter_oct(octs, 3, 4);
+	test.check(octs[0] == 127 && octs[1] == 0 && octs[2] == 0, "octahedral +x");
+	test.check(octs[4] == 0 && octs[5] == 0 && octs[6] == -127, "octahedral -z");
+	test.check(octs[8] == 0 && octs[9] == 0 && octs[10] == 0, "octahedral zero vector");
+
+	int16_t wideOcts[] = { 0, 32767, 32767, 0 };
+	meshopt::decode_filter_oct(wideOcts, 1, 8);
+	test.check(wideOcts[0] == 0 && wideOcts[1] == 32767 && wideOcts[2] == 0, "16-bit octahedral +y");
+
+	// 1.5 as mantissa 3 and exponent -1
+	uint32_t exps[] = { (uint32_t)(-1 << 24) | 3u };
+	meshopt::decode_filter_exp(exps, 1, 4);
+	float value;
+	memcpy(&value, exps, sizeof(value));
+	test.check(value == 1.5f, "exponential filter");
+
+	return test.finish("meshopt decode");
+}
@@ -0,0 +1,83 @@
+// occlusion_rasterizer_test.cpp
+
+// A wall in front of the camera hides boxes fully behind it and nothing else. Rasterized on one thread and
+// on several, over many frames so the workers are reused, and the depth buffers have to match exactly.
+
+#include <occlusion_rasterizer.h>
+#include "test_checks.h"
+
+#include <fmt/core.h>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+
+namespace {
+	// 10x10 square facing the camera at z = -10
+	OccluderGeometry wall() {
+		OccluderGeometry geometry;
+		geometry.positions = { { -5.f, -5.f, -10.f }, { 5.f, -5.f, -10.f }, { 5.f, 5.f, -10.f }, { -5.f, 5.f, -10.f } };
+		geometry.indices = { 0, 1, 2, 0, 2, 3 };
+		return geometry;
+	}
+
+	// Like the engine's camera, near and far swapped for the reversed depth range. Looks down -z from the origin
+	glm::mat4 view_proj() {
+		glm::mat4 projection = glm::perspective(glm::radians(70.f), 1.f, 10000.f, 0.1f);
+		projection[1][1] *= -1;
+		return projection;
+	}
+
+	struct Box {
+		const char* name;
+		glm::vec3 origin;
+		glm::vec3 extents;
+		glm::mat4 transform;
+		bool visible;
+	};
+}
+
+int main() {
+	const OccluderGeometry geometry = wall();
+
+	// The wall reaches 0.71 of the way to the screen edge, at z = -20 a box at x = 10 straddles its edge
+	const Box boxes[] = {
+		{ "behind the wall", { 0.f, 0.f, -20.f }, glm::vec3(1.f), glm::mat4(1.f), false },
+		{ "far behind the wall", { 0.f, 0.f, 0.f }, glm::vec3(10.f), glm::translate(glm::mat4(1.f), { 0.f, 0.f, -500.f }), false },
+		{ "in front of the wall", { 0.f, 0.f, -5.f }, glm::vec3(1.f), glm::mat4(1.f), true },
+		{ "cut by the wall", { 0.f, 0.f, -10.f }, glm::vec3(1.f), glm::mat4(1.f), true },
+		{ "beside the wall", { 12.f, 0.f, -20.f }, glm::vec3(1.f), glm::mat4(1.f), true },
+		{ "over the wall edge", { 10.f, 0.f, -20.f }, glm::vec3(1.f), glm::mat4(1.f), true },
+		{ "around the camera", { 0.f, 0.f, 0.f }, glm::vec3(1.f), glm::mat4(1.f), true },
+	};
+
+	OcclusionRasterizer single(320, 192, 1);
+	OcclusionRasterizer threaded(320, 192, 4);
+
+	TestChecks test;
+	for (int frame = 0; frame < 100; frame++) {
+		for (OcclusionRasterizer* rasterizer : { &single, &threaded }) {
+			rasterizer->begin_frame(view_proj());
+			rasterizer->add_occluder(geometry, glm::mat4(1.f));
+			rasterizer->rasterize();
+		}
+
+		if (!std::equal(single.depth().begin(), single.depth().end(), threaded.depth().begin(), threaded.depth().end())) {
+			test.fail("Frame {}: the threaded depth buffer differs", frame);
+		}
+	}
+
+	for (const Box& box : boxes) {
+		if (threaded.is_visible(box.origin, box.extents, box.transform) != box.visible) {
+			test.fail("The box {} is {}", box.name, box.visible ? "hidden" : "visible");
+		}
+	}
+
+	// Without occluders nothing on screen is hidden
+	threaded.begin_frame(view_proj());
+	threaded.rasterize();
+	if (!threaded.is_visible(boxes[0].origin, boxes[0].extents, boxes[0].transform)) {
+		test.fail("A box is hidden by an empty depth buffer");
+	}
+
+	return test.finish("occlusion");
+}
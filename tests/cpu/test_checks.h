@@ -0,0 +1,37 @@
+#pragma once
+
+#include <fmt/core.h>
+
+#include <cstdlib>
+#include <string_view>
+#include <utility>
+
+// Failed checks of a CPU test. Every failure is printed as it happens and finish turns the count into the
+// exit code of main
+struct TestChecks {
+	int failures{ 0 };
+
+	void check(bool passed, std::string_view what) {
+		if (!passed) {
+			fmt::println("Failed: {}", what);
+			failures++;
+		}
+	}
+
+	// For failures that need more than a fixed description
+	template<typename... Args>
+	void fail(fmt::format_string<Args...> format, Args&&... args) {
+		fmt::println(format, std::forward<Args>(args)...);
+		failures++;
+	}
+
+	// subject names the checks in the summary, "mesh utility" gives "All mesh utility checks passed"
+	int finish(std::string_view subject) const {
+		if (failures > 0) {
+			fmt::println("{} {} checks failed", failures, subject);
+			return EXIT_FAILURE;
+		}
+		fmt::println("All {} checks passed", subject);
+		return EXIT_SUCCESS;
+	}
+};
@@ -0,0 +1,103 @@
+// texture_cache_test.cpp
+
+// Stores entries in a scratch directory, maps them back and evicts the least recently used one once the cache
+// is over its size. Reopening the directory indexes the files again in the order of their modification times
+// and ignores files that are not entries.
+
+#include <texture_cache.h>
+#include "test_checks.h"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <vector>
+
+namespace {
+	std::vector<std::byte> payload(size_t size, uint8_t value) {
+		return std::vector<std::byte>(size, std::byte{ value });
+	}
+
+	// Whether key maps to exactly expected
+	bool holds(TextureCache& cache, uint64_t key, const std::vector<std::byte>& expected) {
+		MappedFile file;
+		if (!cache.load(key, file)) {
+			return false;
+		}
+		std::span<const std::byte> bytes = file.bytes();
+		return std::equal(bytes.begin(), bytes.end(), expected.begin(), expected.end());
+	}
+
+	bool misses(TextureCache& cache, uint64_t key) {
+		MappedFile file;
+		return !cache.load(key, file);
+	}
+
+	std::filesystem::path entry_file(const std::filesystem::path& directory, uint64_t key) {
+		return directory / fmt::format("{:016x}.ktx2", key);
+	}
+}
+
+int main() {
+	TestChecks test;
+
+	const std::filesystem::path directory = std::filesystem::temp_directory_path() / "vksr_texture_cache_test";
+	std::filesystem::remove_all(directory);
+
+	const std::vector<std::byte> a = payload(100, 1);
+	const std::vector<std::byte> b = payload(100, 2);
+	const std::vector<std::byte> c = payload(100, 3);
+
+	{
+		TextureCache closed;
+		closed.store(1, a);
+		test.check(misses(closed, 1) && closed.size_bytes() == 0, "a cache that was never opened");
+	}
+
+	{
+		TextureCache cache;
+		cache.open(directory, 250);
+		test.check(std::filesystem::is_directory(directory), "creating the directory");
+
+		cache.store(1, a);
+		cache.store(2, b);
+		test.check(holds(cache, 1, a) && holds(cache, 2, b), "loading stored entries");
+		test.check(misses(cache, 3), "a missing entry");
+		test.check(cache.size_bytes() == 200, "the size of two entries");
+
+		cache.store(4, payload(300, 4));
+		test.check(misses(cache, 4) && cache.size_bytes() == 200, "an entry larger than the cache");
+
+		// 1 was used after 2, so 2 is the least recently used when 3 no longer fits
+		test.check(holds(cache, 1, a), "using an entry again");
+		cache.store(3, c);
+		test.check(misses(cache, 2) && !std::filesystem::exists(entry_file(directory, 2)), "evicting the least recently used entry");
+		test.check(holds(cache, 1, a) && holds(cache, 3, c), "keeping the recently used entries");
+		test.check(cache.size_bytes() == 200, "the size after an eviction");
+	}
+
+	// Files older than the others are the first to go after a restart, stray files stay where they are
+	const auto now = std::filesystem::file_time_type::clock::now();
+	std::filesystem::last_write_time(entry_file(directory, 3), now - std::chrono::hours(2));
+	std::filesystem::last_write_time(entry_file(directory, 1), now - std::chrono::minutes(30));
+	std::ofstream(directory / "0000000000000005.ktx2.1234.tmp") << "partial";
+	std::ofstream(directory / "notes.ktx2") << "not an entry";
+
+	{
+		TextureCache cache;
+		cache.open(directory, 250);
+		test.check(cache.size_bytes() == 200, "indexing the entries of an earlier run");
+		test.check(holds(cache, 3, c) && holds(cache, 1, a), "loading the entries of an earlier run");
+		test.check(std::filesystem::last_write_time(entry_file(directory, 1)) < now, "not persisting a recent use again");
+
+		// The hit on 3 was persisted since its file was older than the interval, 1 is the oldest file now
+		cache.open(directory, 150);
+		test.check(misses(cache, 1) && holds(cache, 3, c), "evicting by modification time");
+		test.check(std::filesystem::exists(directory / "notes.ktx2"), "leaving stray files alone");
+	}
+
+	std::filesystem::remove_all(directory);
+
+	return test.finish("texture cache");
+}
@@ -0,0 +1,84 @@
+// thread_pool_test.cpp
+
+// Every index of a loop runs exactly once, loops nest and run from several threads at once, and an
+// exception thrown by a task reaches the caller with the pool still usable afterwards.
+
+#include <thread_pool.h>
+#include "test_checks.h"
+
+#include <fmt/core.h>
+
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+	// Whether a loop of count indices on pool runs each exactly once
+	bool covers_every_index(ThreadPool& pool, size_t count) {
+		std::vector<std::atomic<int>> runs(count);
+		pool.parallel_for(count, [&](size_t i) { runs[i]++; });
+
+		for (const std::atomic<int>& r : runs) {
+			if (r != 1) {
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+int main() {
+	TestChecks test;
+
+	ThreadPool pool(3);
+	ThreadPool callerOnly(0);
+
+	test.check(covers_every_index(pool, 0), "an empty loop");
+	test.check(covers_every_index(pool, 1), "a single index");
+	test.check(covers_every_index(pool, 10000), "a long loop");
+	test.check(covers_every_index(callerOnly, 100), "a pool without workers");
+
+	bool repeated = true;
+	for (int i = 0; i < 1000; i++) {
+		repeated &= covers_every_index(pool, 7);
+	}
+	test.check(repeated, "many short loops");
+
+	// Loops inside loops, the callers keep taking their own indices
+	std::atomic<int> nestedRuns = 0;
+	pool.parallel_for(8, [&](size_t) {
+		pool.parallel_for(8, [&](size_t) { nestedRuns++; });
+		});
+	test.check(nestedRuns == 64, "nested loops");
+
+	// Loops started by several threads share the workers
+	std::atomic<int> concurrentRuns = 0;
+	std::vector<std::thread> callers;
+	for (int c = 0; c < 4; c++) {
+		callers.emplace_back([&]() {
+			for (int i = 0; i < 100; i++) {
+				pool.parallel_for(16, [&](size_t) { concurrentRuns++; });
+			}
+			});
+	}
+	for (std::thread& caller : callers) {
+		caller.join();
+	}
+	test.check(concurrentRuns == 4 * 100 * 16, "loops from several threads");
+
+	bool rethrown = false;
+	try {
+		pool.parallel_for(1000, [&](size_t i) {
+			if (i == 500) {
+				throw std::runtime_error("task failed");
+			}
+			});
+	}
+	catch (const std::runtime_error&) {
+		rethrown = true;
+	}
+	test.check(rethrown, "an exception reaching the caller");
+	test.check(covers_every_index(pool, 1000), "a loop after an exception");
+
+	return test.finish("thread pool");
+}
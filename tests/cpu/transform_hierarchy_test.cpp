@@ -0,0 +1,107 @@
+// transform_hierarchy_test.cpp
+
+// Two small trees with scaled and translated nodes, so a child multiplied before its parent gives a different
+// matrix. After every edit the world matrices have to match a walk up the parents, and update has to report
+// exactly the nodes below the edited ones, each once and in increasing order, whatever order set_local ran in.
+
+#include <transform_hierarchy.h>
+#include "test_checks.h"
+
+#include <fmt/core.h>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <vector>
+
+namespace {
+	// Powers of two and whole offsets, every product is exact
+	glm::mat4 transform(glm::vec3 offset, float scale) {
+		glm::mat4 m = glm::translate(glm::mat4(1.f), offset);
+		m[0][0] = m[1][1] = m[2][2] = scale;
+		return m;
+	}
+
+	bool same(const glm::mat4& a, const glm::mat4& b) {
+		for (int c = 0; c < 4; c++) {
+			if (!(a[c] == b[c])) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Whether every world matrix is the product of the local matrices from its root down
+	bool worlds_match(const TransformHierarchy& hierarchy) {
+		for (uint32_t i = 0; i < hierarchy.size(); i++) {
+			glm::mat4 expected = hierarchy.local(i);
+			for (uint32_t p = hierarchy.parent(i); p != TransformHierarchy::NO_PARENT; p = hierarchy.parent(p)) {
+				expected = hierarchy.local(p) * expected;
+			}
+			if (!same(hierarchy.world(i), expected)) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	std::vector<uint32_t> update(TransformHierarchy& hierarchy) {
+		std::vector<uint32_t> changed;
+		hierarchy.update(changed);
+		return changed;
+	}
+}
+
+int main() {
+	TestChecks test;
+
+	// 0
+	// +- 1
+	// |  +- 2
+	// +- 3
+	// 4
+	// +- 5
+	TransformHierarchy hierarchy;
+	const uint32_t root = hierarchy.add(TransformHierarchy::NO_PARENT, transform({ 1.f, 0.f, 0.f }, 2.f));
+	const uint32_t child = hierarchy.add(root, transform({ 0.f, 1.f, 0.f }, 0.5f));
+	const uint32_t grandchild = hierarchy.add(child, transform({ 0.f, 0.f, 1.f }, 4.f));
+	const uint32_t sibling = hierarchy.add(root, transform({ 3.f, 0.f, 0.f }, 1.f));
+	const uint32_t otherRoot = hierarchy.add(TransformHierarchy::NO_PARENT, transform({ 0.f, 5.f, 0.f }, 2.f));
+	const uint32_t otherChild = hierarchy.add(otherRoot, transform({ 1.f, 1.f, 1.f }, 2.f));
+
+	test.check(hierarchy.subtree_end(root) == 4 && hierarchy.subtree_end(child) == 3 && hierarchy.subtree_end(grandchild) == 3
+		&& hierarchy.subtree_end(sibling) == 4 && hierarchy.subtree_end(otherRoot) == 6, "subtree ranges");
+	test.check(worlds_match(hierarchy) && !hierarchy.is_dirty(), "world matrices when adding");
+	test.check(update(hierarchy).empty(), "an update without edits");
+
+	// A leaf only changes itself
+	hierarchy.set_local(grandchild, transform({ 0.f, 0.f, 2.f }, 2.f));
+	test.check(hierarchy.is_dirty(), "an edit marking the hierarchy dirty");
+	test.check(update(hierarchy) == std::vector<uint32_t>{ grandchild }, "the nodes changed by a leaf");
+	test.check(worlds_match(hierarchy) && !hierarchy.is_dirty(), "world matrices after a leaf");
+
+	// A node inside a subtree takes its descendants along and leaves its sibling alone
+	hierarchy.set_local(child, transform({ 0.f, 2.f, 0.f }, 4.f));
+	test.check(update(hierarchy) == std::vector<uint32_t>{ child, grandchild }, "the nodes changed by a subtree");
+	test.check(worlds_match(hierarchy), "world matrices after a subtree");
+
+	// Children edited before their ancestors are covered by the ancestor, and read its new world matrix
+	hierarchy.set_local(grandchild, transform({ 1.f, 0.f, 0.f }, 0.5f));
+	hierarchy.set_local(sibling, transform({ 0.f, 0.f, 3.f }, 2.f));
+	hierarchy.set_local(root, transform({ 0.f, 4.f, 0.f }, 0.25f));
+	hierarchy.set_local(grandchild, transform({ 2.f, 0.f, 0.f }, 0.5f));
+	test.check(update(hierarchy) == std::vector<uint32_t>{ root, child, grandchild, sibling }, "the nodes changed below an ancestor");
+	test.check(worlds_match(hierarchy), "world matrices after children and their ancestor");
+
+	// Separate subtrees come out in index order, whatever order they were edited in
+	hierarchy.set_local(otherChild, transform({ 0.f, 0.f, 0.f }, 8.f));
+	hierarchy.set_local(sibling, transform({ 1.f, 1.f, 0.f }, 1.f));
+	test.check(update(hierarchy) == std::vector<uint32_t>{ sibling, otherChild }, "the nodes changed in separate subtrees");
+	test.check(worlds_match(hierarchy), "world matrices after separate subtrees");
+
+	// update_range alone recomputes a range whose parent is up to date
+	hierarchy.set_local(child, transform({ 5.f, 0.f, 0.f }, 2.f));
+	hierarchy.update_range(child, hierarchy.subtree_end(child));
+	test.check(worlds_match(hierarchy), "world matrices after update_range");
+	update(hierarchy);
+
+	return test.finish("transform hierarchy");
+}
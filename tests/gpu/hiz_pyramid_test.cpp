@@ -0,0 +1,142 @@
+// hiz_pyramid_test.cpp
+
+// Depth pyramids of odd sized viewports against a CPU reduction. Levels halve rounding down like the image's mip
+// chain and the last texel of a row or column also takes the odd source texel left over, so every depth pixel
+// reaches every level and no level is written past its edge.
+
+#include <vk_engine.h>
+#include <vk_images.h>
+
+#include <SDL3/SDL.h>
+
+#include <cstdlib>
+#include <random>
+
+namespace {
+	constexpr int SKIPPED = 77;
+
+	struct Level {
+		vk::Extent2D size;
+		std::vector<glm::vec2> texels; // Farthest and nearest depth
+	};
+
+	// The reduction hiz_reduce.comp runs, R is the minimum and G the maximum of the footprint
+	Level reduce(const Level& source) {
+		Level level;
+		level.size = vk::Extent2D{ std::max(source.size.width / 2, 1u), std::max(source.size.height / 2, 1u) };
+		level.texels.resize((size_t)level.size.width * level.size.height);
+
+		for (uint32_t y = 0; y < level.size.height; y++) {
+			for (uint32_t x = 0; x < level.size.width; x++) {
+				uint32_t endX = (x == level.size.width - 1) ? source.size.width - 1 : std::min(x * 2 + 1, source.size.width - 1);
+				uint32_t endY = (y == level.size.height - 1) ? source.size.height - 1 : std::min(y * 2 + 1, source.size.height - 1);
+
+				glm::vec2 texel{ 1.f, 0.f };
+				for (uint32_t sy = y * 2; sy <= endY; sy++) {
+					for (uint32_t sx = x * 2; sx <= endX; sx++) {
+						const glm::vec2& s = source.texels[(size_t)sy * source.size.width + sx];
+						texel.x = std::min(texel.x, s.x);
+						texel.y = std::max(texel.y, s.y);
+					}
+				}
+				level.texels[(size_t)y * level.size.width + x] = texel;
+			}
+		}
+		return level;
+	}
+}
+
+int main() {
+	if (!SDL_Init(SDL_INIT_VIDEO)) {
+		fmt::println("No video driver, skipped: {}", SDL_GetError());
+		return SKIPPED;
+	}
+
+	VkSREngine engine;
+	engine.init();
+
+	OcclusionCuller& culler = engine._occlusionCuller;
+	const vk::Extent3D depthSize = engine._depthImage.imageExtent;
+
+	// 1700 wide halves to 850, 425 and 212, rounding up gave 213 there. Odd heights and single texel rows too
+	const vk::Extent2D sizes[] = { { 1700, 97 }, { 171, 99 }, { 5, 3 }, { 1, 7 }, { 2, 1 } };
+
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> depth(0.f, 1.f);
+	int failures = 0;
+	for (vk::Extent2D size : sizes) {
+		if (size.width > depthSize.width || size.height > depthSize.height) {
+			fmt::println("{}x{} is larger than the depth image, skipped", size.width, size.height);
+			continue;
+		}
+
+		Level source{ size, {} };
+		std::vector<float> depths((size_t)size.width * size.height);
+		for (float& d : depths) {
+			d = depth(random);
+			source.texels.push_back(glm::vec2(d));
+		}
+
+		// The levels build_pyramid fills, each from the one above
+		std::vector<Level> expected;
+		for (uint32_t i = 0; i < culler.pyramidLevels; i++) {
+			expected.push_back(reduce(i == 0 ? source : expected.back()));
+		}
+
+		AllocatedBuffer upload = engine.create_buffer(depths.size() * sizeof(float), vk::BufferUsageFlagBits::eTransferSrc, vma::MemoryUsage::eCpuToGpu);
+		memcpy(upload.info.pMappedData, depths.data(), depths.size() * sizeof(float));
+
+		std::vector<vk::BufferImageCopy> readRegions(expected.size());
+		size_t readSize = 0;
+		for (size_t i = 0; i < expected.size(); i++) {
+			vk::BufferImageCopy& region = readRegions[i];
+			region.bufferOffset = readSize;
+			region.imageSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
+			region.imageSubresource.mipLevel = (uint32_t)i;
+			region.imageSubresource.layerCount = 1;
+			region.imageExtent = vk::Extent3D{ expected[i].size.width, expected[i].size.height, 1 };
+			readSize += expected[i].texels.size() * sizeof(glm::vec2);
+		}
+		AllocatedBuffer readback = engine.create_buffer(readSize, vk::BufferUsageFlagBits::eTransferDst, vma::MemoryUsage::eGpuToCpu);
+
+		engine.immediate_submit([&](vk::CommandBuffer cmd) {
+			vkutil::transition_image(cmd, engine._depthImage.image, vk::ImageLayout::eUndefined, vk::ImageLayout::eDepthReadOnlyOptimal);
+			vkutil::transition_image(cmd, engine._depthImage.image, vk::ImageLayout::eDepthReadOnlyOptimal, vk::ImageLayout::eTransferDstOptimal);
+
+			vk::BufferImageCopy depthRegion = {};
+			depthRegion.imageSubresource.aspectMask = vk::ImageAspectFlagBits::eDepth;
+			depthRegion.imageSubresource.layerCount = 1;
+			depthRegion.imageExtent = vk::Extent3D{ size.width, size.height, 1 };
+			cmd.copyBufferToImage(upload.buffer, engine._depthImage.image, vk::ImageLayout::eTransferDstOptimal, 1, &depthRegion);
+
+			vkutil::transition_image(cmd, engine._depthImage.image, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eDepthReadOnlyOptimal);
+			culler.build_pyramid(cmd, size);
+
+			vkutil::memory_barrier(cmd,
+				vk::PipelineStageFlagBits2::eComputeShader, vk::AccessFlagBits2::eShaderStorageWrite,
+				vk::PipelineStageFlagBits2::eCopy, vk::AccessFlagBits2::eTransferRead);
+			cmd.copyImageToBuffer(culler.depthPyramid.image, vk::ImageLayout::eGeneral, readback.buffer, (uint32_t)readRegions.size(), readRegions.data());
+			});
+
+		engine._allocator.invalidateAllocation(readback.allocation, 0, vk::WholeSize);
+		const std::byte* gpu = (const std::byte*)readback.info.pMappedData;
+		for (size_t i = 0; i < expected.size(); i++) {
+			if (memcmp(gpu + readRegions[i].bufferOffset, expected[i].texels.data(), expected[i].texels.size() * sizeof(glm::vec2)) != 0) {
+				fmt::println("{}x{}: level {} ({}x{}) differs from the CPU reduction", size.width, size.height, i, expected[i].size.width, expected[i].size.height);
+				failures++;
+			}
+		}
+
+		engine.destroy_buffer(readback);
+		engine.destroy_buffer(upload);
+	}
+
+	engine.cleanup();
+
+	if (failures > 0) {
+		fmt::println("{} pyramid levels differ from the CPU reduction", failures);
+		return EXIT_FAILURE;
+	}
+	fmt::println("All depth pyramids match the CPU reduction");
+	return EXIT_SUCCESS;
+}
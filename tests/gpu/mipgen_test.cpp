@@ -0,0 +1,105 @@
+// mipgen_test.cpp
+
+// Mip chains written by the mip generator against the CPU filter the loader cooks with. The sizes are odd and
+// non-square, so tiles start past the end of the small levels and the last workgroup reads clamped edges.
+// Every GPU level is compared with the CPU filter of the GPU level above it, rounding differences of the
+// float filter then stay within one step instead of adding up down the chain.
+
+#include <vk_engine.h>
+#include <vk_images.h>
+
+#include <SDL3/SDL.h>
+
+#include <cstdlib>
+#include <random>
+
+namespace {
+	constexpr int SKIPPED = 77;
+
+	vk::Extent2D half_size(vk::Extent2D size) {
+		return vk::Extent2D{ std::max(size.width >> 1, 1u), std::max(size.height >> 1, 1u) };
+	}
+
+	// Largest difference of any byte of a level, or -1 when the sizes differ
+	int level_difference(std::span<const uint8_t> gpu, std::span<const uint8_t> expected) {
+		if (gpu.size() != expected.size()) {
+			return -1;
+		}
+
+		int difference = 0;
+		for (size_t i = 0; i < gpu.size(); i++) {
+			difference = std::max(difference, std::abs((int)gpu[i] - (int)expected[i]));
+		}
+		return difference;
+	}
+}
+
+int main() {
+	if (!SDL_Init(SDL_INIT_VIDEO)) {
+		fmt::println("No video driver, skipped: {}", SDL_GetError());
+		return SKIPPED;
+	}
+
+	VkSREngine engine;
+	engine.init();
+
+	// 5000 wide goes over MAX_PASS_SIZE and takes a second dispatch
+	const vk::Extent2D sizes[] = { { 70, 33 }, { 1, 37 }, { 129, 5 }, { 97, 97 }, { 300, 2 }, { 5000, 3 } };
+	const vk::Format formats[] = { vk::Format::eR8G8B8A8Unorm, vk::Format::eR8G8B8A8Srgb, vk::Format::eR8G8Unorm, vk::Format::eR8Unorm };
+
+	std::mt19937 random(1234);
+	int failures = 0;
+	for (vk::Format format : formats) {
+		if (!engine.supports_texture_format(format)) {
+			fmt::println("{} has no mip generation on this device, skipped", vk::to_string(format));
+			continue;
+		}
+
+		for (vk::Extent2D size : sizes) {
+			std::vector<uint8_t> texels(vkutil::image_level_size(format, size));
+			for (uint8_t& texel : texels) {
+				texel = (uint8_t)random();
+			}
+
+			AllocatedImage image = engine.create_image(texels.data(), vk::Extent3D{ size.width, size.height, 1 }, format, vk::ImageUsageFlagBits::eSampled, true);
+
+			std::vector<ImageLevel> levels;
+			AllocatedBuffer readback = engine.download_image(image, levels);
+			const uint8_t* gpu = (const uint8_t*)readback.info.pMappedData;
+			auto gpu_level = [&](size_t level) {
+				return std::span<const uint8_t>(gpu + levels[level].offset, levels[level].size);
+				};
+
+			// Level 0 is copied as is
+			if (level_difference(gpu_level(0), texels) != 0) {
+				fmt::println("{} {}x{}: level 0 differs from the upload", vk::to_string(format), size.width, size.height);
+				failures++;
+			}
+
+			vk::Extent2D levelSize = size;
+			for (size_t level = 1; level < levels.size(); level++) {
+				std::vector<uint8_t> expected(vkutil::image_level_size(format, half_size(levelSize)));
+				vkutil::downsample_level(format, levelSize, gpu_level(level - 1).data(), expected.data());
+				levelSize = half_size(levelSize);
+
+				const int difference = level_difference(gpu_level(level), expected);
+				if (difference < 0 || difference > 1) {
+					fmt::println("{} {}x{}: level {} is off by {}", vk::to_string(format), size.width, size.height, level, difference);
+					failures++;
+				}
+			}
+
+			engine.destroy_buffer(readback);
+			engine.destroy_image(image);
+		}
+	}
+
+	engine.cleanup();
+
+	if (failures > 0) {
+		fmt::println("{} mip levels differ from the CPU filter", failures);
+		return EXIT_FAILURE;
+	}
+	fmt::println("All mip chains match the CPU filter");
+	return EXIT_SUCCESS;
+}